@@ -21,7 +21,14 @@ class AdaptiveDetector : public ContentDetector {
     public:
         explicit AdaptiveDetector(const float adaptive_threshold = 3.0f, const int32_t min_scene_len = 15,
                                   const int32_t window_width = 2, const float min_content_val = 15.0f);
-        std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        std::string serialize_parameters() const override;
+        /* a frame is decided once window_width frames after it are buffered */
+        std::optional<int32_t> get_latency() const override { return window_width_; }
+        /* the window is part of the score, so the latency cannot be bounded below window_width */
+        void set_max_latency(const int32_t max_latency) override {}
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
         static std::shared_ptr<AdaptiveDetector> initialize_detector(float adaptive_threshold = 3.0f,
                                                                      int32_t min_scene_len = 15,
                                                                      int32_t window_width = 2,
@@ -3,12 +3,44 @@
 
 #include <optional>
 #include <cstdint>
+#include <string>
 
 struct VideoFrame;
+class StateWriter;
+class StateReader;
 
+/* What SceneManager has to decode for the detector. */
+enum class FrameSource {
+    PIXELS, /* downscaled BGR frames */
+    MOTION_VECTORS, /* codec side data only, VideoFrame::frame is empty */
+};
+
+/*
+   Detectors score each frame and then decide cuts from the score alone, so that scores saved by one run
+   can be replayed through process_score() with other parameters without decoding the video again.
+*/
 class BaseDetector {
     public:
         virtual std::optional<int32_t> process_frame(const VideoFrame& next_frame) = 0;
+        /* frame_score is std::nullopt for frames which are not scored (e.g., the first frame) */
+        virtual std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) = 0;
+        /* score of the last frame given to process_frame() */
+        virtual std::optional<float> get_frame_score() const = 0;
+        /* scores can be replayed only into a detector with the same score type */
+        virtual std::string get_score_type() const = 0;
+        /* every parameter affecting the cuts, e.g., to tell cached results apart */
+        virtual std::string serialize_parameters() const = 0;
+        /* state carried from one frame to the next, so that a checkpointed detection can be resumed */
+        virtual void save_state(StateWriter& writer) const = 0;
+        virtual void load_state(StateReader& reader) = 0;
+        /* frames between a cut and the frame whose process_frame() returns it, std::nullopt if unbounded */
+        virtual std::optional<int32_t> get_latency() const { return 0; }
+        /* bounds the latency of detectors which delay their decisions (live mode), if they can */
+        virtual void set_max_latency(const int32_t max_latency) {}
+        /* Frames to decode before a range so that the scores from its start are those of a run over the whole
+           video (shard), std::nullopt if they depend on the whole stream. Decisions are replayed from the scores. */
+        virtual std::optional<int32_t> get_warmup_frames() const { return 1; }
+        virtual FrameSource get_frame_source() const { return FrameSource::PIXELS; }
         virtual ~BaseDetector() {}
 
     protected:
@@ -14,7 +14,14 @@ class ContentDetector : public BaseDetector {
     public:
         explicit ContentDetector(const float threshold = 27.0f, const int32_t min_scene_len = 15);
         std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
-        std::optional<float> get_frame_score() const { return frame_score_; }
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        std::optional<float> get_frame_score() const override { return frame_score_; }
+        std::string get_score_type() const override { return "content"; }
+        std::string serialize_parameters() const override;
+        std::optional<int32_t> get_latency() const override { return flash_filter_.get_latency(); }
+        void set_max_latency(const int32_t max_latency) override;
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
         static std::shared_ptr<ContentDetector> initialize_detector(float threshold = 27.0f,
                                                                     int32_t min_scene_len = 15);
         
@@ -25,6 +32,7 @@ class ContentDetector : public BaseDetector {
         const float threshold_;
         const int32_t min_scene_len_;
         const FilterMode filter_mode_ = FilterMode::MERGE;
+        std::optional<int32_t> max_latency_ = std::nullopt;
         std::optional<float> frame_score_ = std::nullopt;
         std::optional<cv::Mat> last_frame_ = std::nullopt;
         FlashFilter flash_filter_ = FlashFilter(filter_mode_, min_scene_len_);
@@ -0,0 +1,139 @@
+#ifndef DETECTOR_STATE_H
+#define DETECTOR_STATE_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <string>
+#include <optional>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+/*
+   Binary encoding of the detectors' state for checkpoints. Values are written in native byte order
+   and read back in the same order, so a checkpoint is only valid for the same build and detector.
+*/
+class StateWriter {
+    public:
+        template <typename T>
+        void write(const T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            data_.insert(data_.end(), bytes, bytes + sizeof(T));
+        }
+
+        template <typename T>
+        void write(const std::optional<T>& value) {
+            write(value.has_value());
+            if (value.has_value())
+                write(value.value());
+        }
+
+        template <typename T>
+        void write(const std::vector<T>& values) {
+            write(static_cast<uint64_t>(values.size()));
+            for (const T& value : values)
+                write(value);
+        }
+
+        void write(const std::string& value) {
+            write(static_cast<uint64_t>(value.size()));
+            data_.insert(data_.end(), value.begin(), value.end());
+        }
+
+        void write(const cv::Mat& mat) {
+            write(mat.rows);
+            write(mat.cols);
+            write(mat.type());
+            const cv::Mat continuous = mat.isContinuous() ? mat : mat.clone();
+            const char* bytes = reinterpret_cast<const char*>(continuous.data);
+            data_.insert(data_.end(), bytes, bytes + continuous.total() * continuous.elemSize());
+        }
+
+        const std::vector<char>& get_data() const { return data_; }
+
+    private:
+        std::vector<char> data_;
+};
+
+class StateReader {
+    public:
+        explicit StateReader(const std::vector<char>& data) : data_{data} {}
+
+        template <typename T>
+        void read(T& value) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (!_consume(sizeof(T)))
+                return;
+            std::memcpy(&value, data_.data() + position_ - sizeof(T), sizeof(T));
+        }
+
+        template <typename T>
+        void read(std::optional<T>& value) {
+            bool has_value = false;
+            read(has_value);
+            value = std::nullopt;
+            if (has_value) {
+                T inner {};
+                read(inner);
+                value = inner;
+            }
+        }
+
+        template <typename T>
+        void read(std::vector<T>& values) {
+            uint64_t size = 0;
+            read(size);
+            values.clear();
+            for (uint64_t i = 0; i < size && !failed_; i++) {
+                T value {};
+                read(value);
+                values.push_back(value);
+            }
+        }
+
+        void read(std::string& value) {
+            uint64_t size = 0;
+            read(size);
+            if (!_consume(size))
+                return;
+            value.assign(data_.data() + position_ - size, size);
+        }
+
+        void read(cv::Mat& mat) {
+            int32_t rows = 0;
+            int32_t cols = 0;
+            int32_t type = 0;
+            read(rows);
+            read(cols);
+            read(type);
+            if (failed_ || rows < 0 || cols < 0) {
+                failed_ = true;
+                return;
+            }
+            mat = cv::Mat(rows, cols, type);
+            const size_t size = mat.total() * mat.elemSize();
+            if (!_consume(size))
+                return;
+            std::memcpy(mat.data, data_.data() + position_ - size, size);
+        }
+
+        /* true if the data ended early, i.e., it was written by another detector or version */
+        bool has_failed() const { return failed_; }
+
+    private:
+        bool _consume(const size_t size) {
+            if (failed_ || size > data_.size() - position_) {
+                failed_ = true;
+                return false;
+            }
+            position_ += size;
+            return true;
+        }
+
+        const std::vector<char>& data_;
+        size_t position_ = 0;
+        bool failed_ = false;
+};
+
+#endif
@@ -4,6 +4,9 @@
 #include <cstdint>
 #include <optional>
 
+class StateWriter;
+class StateReader;
+
 enum class FilterMode {
     MERGE,
     SUPRESS,   
@@ -13,11 +16,18 @@ class FlashFilter {
     public:
         FlashFilter(FilterMode mode, int32_t filter_length);
         std::optional<int32_t> filter(const int32_t frame_num, const bool is_above_threshold);
+        /* merged cuts are decided at most max_latency frames after the flashes started */
+        void set_max_latency(const int32_t max_latency) { max_latency_ = max_latency; }
+        /* frames between a cut and the frame at which it is returned, std::nullopt if unbounded */
+        std::optional<int32_t> get_latency() const;
+        void save_state(StateWriter& writer) const;
+        void load_state(StateReader& reader);
 
     private:
         std::optional<int32_t> _filter_merge(const int32_t frame_num, const bool is_above_threshold);
         FilterMode mode_;
         int32_t filter_length_;
+        std::optional<int32_t> max_latency_ = std::nullopt;
         std::optional<int32_t> last_above_ = std::nullopt;
         std::optional<int32_t> merge_start_ = std::nullopt;
         bool merge_enabled = false;
@@ -14,6 +14,12 @@ class HashDetector : public BaseDetector {
         explicit HashDetector(const float threshold = 0.395f, const int32_t min_scene_len = 15,
                               const int32_t size = 16, const int32_t lowpass = 2);
         std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        std::optional<float> get_frame_score() const override { return frame_score_; }
+        std::string get_score_type() const override;
+        std::string serialize_parameters() const override;
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
         static std::shared_ptr<HashDetector> initialize_detector(float threshold = 0.395f,
                                                                  int32_t min_scene_len = 15,
                                                                  int32_t dct_size = 16,
@@ -28,6 +34,8 @@ class HashDetector : public BaseDetector {
         const int32_t size_;
         const int32_t size_sq_;
         const cv::Size imsize_;
+        const int32_t lowpass_;
+        std::optional<float> frame_score_ = std::nullopt;
         std::optional<int32_t> last_scene_cut_ = std::nullopt;
         std::optional<cv::Mat> last_frame_ = std::nullopt;
         std::optional<cv::Mat> last_hash_ = std::nullopt;
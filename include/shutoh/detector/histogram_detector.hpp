@@ -14,6 +14,12 @@ class HistogramDetector : public BaseDetector {
         explicit HistogramDetector(const float threshold = 0.05f, const int32_t min_scene_len = 15,
                                    const int32_t bins = 256);
         std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        std::optional<float> get_frame_score() const override { return frame_score_; }
+        std::string get_score_type() const override { return "histogram:" + std::to_string(bins_); }
+        std::string serialize_parameters() const override;
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
         static std::shared_ptr<HistogramDetector> initialize_detector(float threshold = 0.05f,
                                                                       int32_t min_scene_len = 15,
                                                                       int32_t bins = 256);
@@ -24,6 +30,7 @@ class HistogramDetector : public BaseDetector {
         const float threshold_;
         const int32_t min_scene_len_;
         const int32_t bins_;
+        std::optional<float> frame_score_ = std::nullopt;
         std::optional<int32_t> last_scene_cut_ = std::nullopt;
         std::optional<cv::Mat> last_hist_ = std::nullopt;
 };
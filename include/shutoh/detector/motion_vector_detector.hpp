@@ -0,0 +1,52 @@
+#ifndef MOTION_VECTOR_DETECTOR_H
+#define MOTION_VECTOR_DETECTOR_H
+
+#include "flash_filter.hpp"
+#include "base_detector.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <memory>
+
+struct VideoFrame;
+struct MotionInfo;
+
+/*
+   Scores frames from the motion vectors exported by the decoder instead of pixels.
+   A P/B-frame whose blocks are mostly intra-coded could not be predicted from its neighbours,
+   which is what happens at a cut. Keyframes are scored as cuts unless they are on the
+   stream's regular keyframe interval. Works with decoders that export motion vectors (e.g., H.264).
+*/
+class MotionVectorDetector : public BaseDetector {
+    public:
+        explicit MotionVectorDetector(const float threshold = 0.5f, const int32_t min_scene_len = 15);
+        std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        FrameSource get_frame_source() const override { return FrameSource::MOTION_VECTORS; }
+        std::optional<float> get_frame_score() const override { return frame_score_; }
+        std::string get_score_type() const override { return "motion"; }
+        std::string serialize_parameters() const override;
+        std::optional<int32_t> get_latency() const override { return flash_filter_.get_latency(); }
+        void set_max_latency(const int32_t max_latency) override;
+        /* keyframes are scored against every keyframe interval since the start of the stream */
+        std::optional<int32_t> get_warmup_frames() const override { return std::nullopt; }
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
+        static std::shared_ptr<MotionVectorDetector> initialize_detector(float threshold = 0.5f,
+                                                                         int32_t min_scene_len = 15);
+
+    private:
+        float _calculate_frame_score(const int32_t frame_num, const MotionInfo& motion_info);
+
+        const float threshold_;
+        const int32_t min_scene_len_;
+        const FilterMode filter_mode_ = FilterMode::MERGE;
+        std::optional<int32_t> max_latency_ = std::nullopt;
+        std::optional<float> frame_score_ = std::nullopt;
+        std::optional<int32_t> last_keyframe_ = std::nullopt;
+        int32_t longest_keyframe_interval_ = 0;
+        int32_t num_frames_without_motion_vectors_ = 0;
+        FlashFilter flash_filter_ = FlashFilter(filter_mode_, min_scene_len_);
+};
+
+#endif
@@ -17,6 +17,17 @@ class ThresholdDetector : public BaseDetector {
         explicit ThresholdDetector(const float threshold = 12.0f, const int32_t min_scene_len = 15, 
                                    const float fade_bias = 0.0f);
         std::optional<int32_t> process_frame(const VideoFrame& next_frame) override;
+        std::optional<int32_t> process_score(const int32_t frame_num, const std::optional<float> frame_score) override;
+        std::optional<float> get_frame_score() const override { return frame_score_; }
+        std::string get_score_type() const override { return "threshold"; }
+        std::string serialize_parameters() const override;
+        /* a fade is split when it ends, which may never happen */
+        std::optional<int32_t> get_latency() const override { return max_latency_; }
+        void set_max_latency(const int32_t max_latency) override { max_latency_ = max_latency; }
+        /* the score is the brightness of the frame alone */
+        std::optional<int32_t> get_warmup_frames() const override { return 0; }
+        void save_state(StateWriter& writer) const override;
+        void load_state(StateReader& reader) override;
         static std::shared_ptr<ThresholdDetector> initialize_detector(float threshold = 12.0f,
                                                                       int32_t min_scene_len = 15,
                                                                       float fade_bias = 0.0f);
@@ -27,6 +38,8 @@ class ThresholdDetector : public BaseDetector {
         const float threshold_;
         const int32_t min_scene_len_;
         const float fade_bias_;
+        std::optional<int32_t> max_latency_ = std::nullopt;
+        std::optional<float> frame_score_ = std::nullopt;
         bool process_frame_ = false;
         int32_t last_frame_ = 0;
         std::optional<int32_t> last_scene_cut_ = std::nullopt;
@@ -0,0 +1,115 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <string>
+#include <optional>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+template <typename T> struct WithError;
+
+/*
+   POSIX shared-memory ring (--event_ring) through which a running detection hands per-frame scores
+   and cuts to other processes on the same host, without a socket or a copy through the kernel.
+   The segment /dev/shm/<name> is an EventRingHeader followed by capacity EventSlots, in native byte order:
+
+     offset 0   EventRingHeader (64 bytes)
+     offset 64  EventSlot[capacity] (24 bytes each), event n is in slot n % capacity
+
+   The single producer writes event n as a seqlock: the slot sequence becomes 2n+1, the payload is written,
+   the sequence becomes 2n+2, then the header's write_count becomes n+1. A consumer never blocks the
+   producer. It reads write_count, copies the payload of its next event and checks that the slot sequence
+   was 2n+2 before and after the copy; otherwise the producer lapped it and the overwritten events are lost.
+*/
+constexpr char EVENT_RING_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'E', 'R' };
+constexpr uint32_t EVENT_RING_VERSION = 1;
+
+enum class EventType : int32_t {
+    SCORE = 0, /* frame_num was processed, score is NaN if the frame has no score */
+    CUT = 1,   /* the cut at frame_num was reported while processing decided_frame_num */
+    END = 2,   /* the detection finished, no event follows */
+};
+
+struct EventRingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity; /* number of slots, a power of two */
+    float framerate;
+    uint32_t slot_size; /* sizeof(EventSlot) */
+    std::atomic<uint64_t> write_count; /* number of events published */
+    char reserved[32];
+};
+static_assert(sizeof(EventRingHeader) == 64);
+static_assert(offsetof(EventRingHeader, write_count) == 24);
+
+struct EventSlot {
+    std::atomic<uint64_t> sequence; /* 2n+1 while event n is written, 2n+2 once it is published, 0 if unused */
+    std::atomic<int32_t> type;
+    std::atomic<int32_t> frame_num;
+    std::atomic<int32_t> decided_frame_num;
+    std::atomic<float> score;
+};
+static_assert(sizeof(EventSlot) == 24);
+/* the counters are shared between processes, which lock-based atomics are not */
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free);
+
+struct RingEvent {
+    EventType type;
+    int32_t frame_num;
+    int32_t decided_frame_num;
+    float score;
+};
+
+class EventRingWriter {
+    public:
+        explicit EventRingWriter(const std::string& name, void* data, const size_t size);
+        EventRingWriter(const EventRingWriter&) = delete;
+        EventRingWriter& operator=(const EventRingWriter&) = delete;
+        ~EventRingWriter();
+
+        void publish_score(const int32_t frame_num, const std::optional<float> score);
+        void publish_cut(const int32_t cut, const int32_t decided_frame_num);
+        /* publishes END and removes the name; consumers already attached keep reading their mapping */
+        void close();
+        /* replaces a segment of the same name left by a run which did not close it */
+        static WithError<std::shared_ptr<EventRingWriter>> initialize_event_ring_writer(const std::string& name,
+                                                                                        const uint32_t capacity,
+                                                                                        const float framerate);
+
+    private:
+        void _publish(const EventType type, const int32_t frame_num, const int32_t decided_frame_num, const float score);
+
+        const std::string name_;
+        void* data_;
+        const size_t size_;
+        EventSlot* slots_;
+        uint64_t write_count_ = 0;
+        bool is_closed_ = false;
+};
+
+class EventRingReader {
+    public:
+        explicit EventRingReader(const void* data, const size_t size);
+        EventRingReader(const EventRingReader&) = delete;
+        EventRingReader& operator=(const EventRingReader&) = delete;
+        ~EventRingReader();
+
+        const EventRingHeader& get_header() const { return *static_cast<const EventRingHeader*>(data_); }
+        /* the next event, or std::nullopt if the producer has not published it yet; never blocks */
+        std::optional<RingEvent> read();
+        /* events overwritten before this reader got to them */
+        uint64_t get_num_lost() const { return num_lost_; }
+        /* starts at the oldest event still in the ring */
+        static WithError<std::shared_ptr<EventRingReader>> initialize_event_ring_reader(const std::string& name);
+
+    private:
+        const void* data_;
+        const size_t size_;
+        const EventSlot* slots_;
+        uint64_t next_ = 0;
+        uint64_t num_lost_ = 0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "error.hpp"
 
 #include <string>
+#include <charconv>
 #include <cstdint>
 
 constexpr int32_t HOUR_MAX = 10;
@@ -74,6 +75,8 @@ class FrameTimeCode {
         int32_t parse_timecode_number(const int32_t seconds) const;
         int32_t parse_timecode_number(const float seconds) const;
         std::string to_string() const;
+        /* writes the same HH:MM:SS.nnn as to_string() without allocating, e.g., into a reused buffer */
+        std::to_chars_result to_chars(char* first, char* last) const;
         std::string to_string_second() const;
 
         bool operator==(const FrameTimeCode& other) const;
@@ -93,6 +96,7 @@ class FrameTimeCode {
 
     private:
         WithError<TimeStamp> _parse_hrs_mins_secs_to_second(const std::string& timecode_str) const;
+        void _split_time(int32_t& hrs, int32_t& mins, float& secs) const;
         float framerate_;
         int32_t frame_num_;
 };
@@ -0,0 +1,83 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <cstddef>
+
+/*
+   Coroutine yielding values one by one, until std::generator (C++23) is available.
+   The coroutine body runs up to its next co_yield each time the iterator is incremented,
+   and destroying the generator destroys the suspended coroutine with its local variables.
+*/
+template <typename T>
+class Generator {
+    public:
+        struct promise_type {
+            std::optional<T> value_ = std::nullopt;
+            std::exception_ptr exception_ = nullptr;
+
+            Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            std::suspend_always yield_value(const T& value) {
+                value_.reset();
+                value_.emplace(value);
+                return {};
+            }
+            void return_void() {}
+            void unhandled_exception() { exception_ = std::current_exception(); }
+        };
+
+        class Iterator {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = T;
+                using difference_type = std::ptrdiff_t;
+
+                explicit Iterator(std::coroutine_handle<promise_type> handle) : handle_{handle} {}
+                const T& operator*() const { return handle_.promise().value_.value(); }
+                Iterator& operator++() {
+                    _resume(handle_);
+                    return *this;
+                }
+                void operator++(int) { ++*this; }
+                bool operator==(std::default_sentinel_t) const { return !handle_ || handle_.done(); }
+
+            private:
+                std::coroutine_handle<promise_type> handle_;
+        };
+
+        Generator(Generator&& other) noexcept : handle_{std::exchange(other.handle_, nullptr)} {}
+        Generator(const Generator&) = delete;
+        Generator& operator=(const Generator&) = delete;
+        ~Generator() {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        Iterator begin() {
+            _resume(handle_);
+            return Iterator(handle_);
+        }
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+        explicit Generator(std::coroutine_handle<promise_type> handle) : handle_{handle} {}
+
+        /* an exception thrown by the coroutine body is rethrown to the caller iterating it */
+        static void _resume(std::coroutine_handle<promise_type> handle) {
+            if (!handle || handle.done())
+                return;
+            handle.resume();
+            if (handle.promise().exception_)
+                std::rethrow_exception(std::exchange(handle.promise().exception_, nullptr));
+        }
+
+        std::coroutine_handle<promise_type> handle_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef HASH_INDEX_H
+#define HASH_INDEX_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <cstdint>
+
+template <typename T> struct WithError;
+
+/*
+   On-disk index of the 64-bit perceptual hash of each scene's keyframe (MotionAggregator), to find
+   near-duplicate shots across many videos (index-hashes, find-duplicates). It is searched by multi-index
+   hashing: a hash is split into HASH_INDEX_NUM_TABLES 16-bit substrings, and since two hashes within
+   Hamming distance r have a substring within r / HASH_INDEX_NUM_TABLES of each other, only the buckets
+   of those substring values are verified instead of every scene. Adding a video appends a record to the
+   sidecar <path>.log, superseding the scenes indexed before under its name, and readers compare the few
+   hashes there one by one. Once it holds more than HASH_INDEX_MAX_APPENDED hashes, it is merged into the
+   tables. Both files are memory-mapped, in native byte order:
+
+     <path>      HashIndexHeader
+                 HashIndexEntry[num_entries]                         sorted by video, then scene
+                 uint32_t bucket_offsets[NUM_TABLES][65536 + 1]      entries of bucket v of table t are
+                 uint32_t bucket_entries[NUM_TABLES][num_entries]    bucket_entries[t][bucket_offsets[t][v]..bucket_offsets[t][v + 1]]
+                 uint64_t name_offsets[num_videos + 1], char names[] name of video i is names[name_offsets[i]..name_offsets[i + 1]]
+     <path>.log  HashLogHeader, then records of
+                 HashLogRecordHeader, SceneHash hashes[num_hashes], char name[name_size], padded to 8 bytes
+*/
+constexpr char HASH_INDEX_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'H', 'I' };
+constexpr char HASH_LOG_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'H', 'L' };
+constexpr uint32_t HASH_INDEX_VERSION = 1;
+constexpr size_t HASH_INDEX_MAX_APPENDED = 65536;
+constexpr int32_t HASH_INDEX_NUM_TABLES = 4;
+constexpr int32_t HASH_INDEX_SUBSTRING_BITS = 64 / HASH_INDEX_NUM_TABLES;
+constexpr size_t HASH_INDEX_NUM_BUCKETS = size_t(1) << HASH_INDEX_SUBSTRING_BITS;
+
+struct HashIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_videos;
+    uint64_t num_entries;
+    uint64_t names_size;
+    char reserved[32];
+};
+static_assert(sizeof(HashIndexHeader) == 64);
+
+struct HashIndexEntry {
+    uint64_t hash;
+    uint32_t video_id;
+    int32_t scene_number;
+    int32_t keyframe; /* frame number of the hashed frame */
+    int32_t reserved;
+};
+static_assert(sizeof(HashIndexEntry) == 24);
+
+struct HashLogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved0;
+    uint64_t data_size; /* bytes of complete records after the header, updated after each append */
+    uint64_t num_hashes; /* in all the records, including superseded ones */
+    char reserved[32];
+};
+static_assert(sizeof(HashLogHeader) == 64);
+
+struct HashLogRecordHeader {
+    uint64_t record_size; /* including this header and the padding */
+    uint32_t num_hashes;
+    uint32_t name_size;
+};
+static_assert(sizeof(HashLogRecordHeader) == 16);
+
+struct SceneHash {
+    int32_t scene_number;
+    int32_t keyframe;
+    uint64_t hash;
+};
+static_assert(sizeof(SceneHash) == 16);
+
+struct HashMatch {
+    uint32_t entry_id;
+    int32_t distance;
+};
+
+class HashIndex {
+    public:
+        explicit HashIndex(const void* data, const size_t size, const void* log, const size_t log_size,
+                           const std::vector<uint64_t>& record_offsets);
+        HashIndex(const HashIndex&) = delete;
+        HashIndex& operator=(const HashIndex&) = delete;
+        ~HashIndex();
+
+        /* entry ids are below get_num_entries(), those of the tables first, then those of the log */
+        size_t get_num_entries() const { return _get_header().num_entries + appended_entries_.size(); }
+        const HashIndexEntry& get_entry(const uint32_t entry_id) const;
+        /* false if the video of the entry was added again after it */
+        bool is_latest(const uint32_t entry_id) const;
+        /* videos with latest entries */
+        size_t get_num_videos() const;
+        std::string get_video_name(const uint32_t video_id) const;
+        /* latest entries within Hamming distance max_distance of hash, closest first */
+        std::vector<HashMatch> query(const uint64_t hash, const int32_t max_distance) const;
+        /* writes the latest entries to index_path as tables only, through a temporary file renamed over it */
+        WithError<void> write_merged(const std::filesystem::path& index_path) const;
+        static WithError<std::shared_ptr<HashIndex>> initialize_hash_index(const std::filesystem::path& index_path);
+
+    private:
+        const HashIndexHeader& _get_header() const { return *static_cast<const HashIndexHeader*>(data_); }
+        std::span<const HashIndexEntry> _get_entries() const;
+        const uint32_t* _get_bucket_offsets(const int32_t table) const;
+        const uint32_t* _get_bucket_entries(const int32_t table) const;
+        const uint64_t* _get_name_offsets() const;
+        std::string_view _get_table_video_name(const uint32_t video_id) const;
+
+        const void* data_;
+        const size_t size_;
+        const void* log_; /* nullptr if nothing was added since the last merge */
+        const size_t log_size_;
+        std::vector<HashIndexEntry> appended_entries_; /* of the latest record of each video in the log */
+        std::vector<std::string_view> appended_names_; /* their video ids follow those of the tables */
+        std::vector<bool> is_superseded_; /* per video of the tables, true if it was added again in the log */
+};
+
+/* Adds the scene hashes of a video to the index, superseding those added before for the same video name.
+   The index is created if it does not exist. Concurrent runs (--batch) add one after the other, and readers
+   keep seeing the entries present when they were opened. */
+WithError<void> add_to_hash_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                  const std::vector<SceneHash>& scene_hashes);
+
+#endif
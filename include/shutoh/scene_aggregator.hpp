@@ -0,0 +1,134 @@
+#ifndef SCENE_AGGREGATOR_H
+#define SCENE_AGGREGATOR_H
+
+#include "video_frame.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <optional>
+#include <utility>
+#include <cstdint>
+
+/*
+   Accumulates statistics of each scene from the frames decoded for the detector, so that describing
+   the scenes does not need a second pass over the video. SceneManager gives each frame to add_frame()
+   before the detector, which may convert it in place, and calls close_scene() when a scene is closed.
+*/
+class SceneAggregator {
+    public:
+        /* names of the values of a scene */
+        virtual std::vector<std::string> get_columns() const = 0;
+        virtual void add_frame(const VideoFrame& frame) = 0;
+        /* closes the scene ending at the frame cut, or the last scene if cut is std::nullopt */
+        virtual void close_scene(const std::optional<int32_t> cut) = 0;
+        /* the values of each closed scene, in the order of get_columns() */
+        const std::vector<std::vector<std::string>>& get_scene_values() const { return scene_values_; }
+        /* frames are added up to latency frames before the cut ending their scene is reported,
+           see BaseDetector::get_latency(); std::nullopt if unbounded */
+        void set_latency(const std::optional<int32_t> latency) { latency_ = latency; }
+        virtual ~SceneAggregator() {}
+
+    protected:
+        SceneAggregator() = default;
+
+        std::vector<std::vector<std::string>> scene_values_;
+        std::optional<int32_t> latency_ = std::nullopt;
+};
+
+/*
+   Aggregator measuring each frame once into a Sample, which is folded into its scene as soon as
+   no cut can be reported before it anymore. Only the samples within the detector's latency are kept,
+   or those of the current scene if the latency is unbounded.
+*/
+template <typename Sample>
+class FrameSampleAggregator : public SceneAggregator {
+    public:
+        void add_frame(const VideoFrame& frame) override {
+            std::optional<Sample> sample = _measure(frame);
+            if (sample.has_value())
+                pending_.emplace_back(frame.frame_num, std::move(sample.value()));
+
+            /* a cut reported from now on is at least at frame_num - latency */
+            while (latency_.has_value() && !pending_.empty() && pending_.front().first <= frame.frame_num - latency_.value()) {
+                _fold(pending_.front().first, pending_.front().second);
+                pending_.pop_front();
+            }
+        }
+
+        void close_scene(const std::optional<int32_t> cut) override {
+            while (!pending_.empty() && (!cut.has_value() || pending_.front().first <= cut.value())) {
+                _fold(pending_.front().first, pending_.front().second);
+                pending_.pop_front();
+            }
+            scene_values_.push_back(_finish_scene());
+        }
+
+    protected:
+        /* std::nullopt if the frame cannot be measured, e.g., empty with the motion vector detector */
+        virtual std::optional<Sample> _measure(const VideoFrame& frame) = 0;
+        virtual void _fold(const int32_t frame_num, const Sample& sample) = 0;
+        /* returns the values of the scene folded so far and starts the next one */
+        virtual std::vector<std::string> _finish_scene() = 0;
+
+    private:
+        std::deque<std::pair<int32_t, Sample>> pending_;
+};
+
+struct ColorSample {
+    cv::Scalar mean_bgr;
+    float brightness;
+    bool is_flash;
+};
+
+/* mean colour and brightness (luma) of a scene, whether it is black, and whether it contains a flash */
+class ColorAggregator : public FrameSampleAggregator<ColorSample> {
+    public:
+        explicit ColorAggregator(const float black_level = 12.0f, const float flash_delta = 64.0f);
+        std::vector<std::string> get_columns() const override;
+
+    protected:
+        std::optional<ColorSample> _measure(const VideoFrame& frame) override;
+        void _fold(const int32_t frame_num, const ColorSample& sample) override;
+        std::vector<std::string> _finish_scene() override;
+
+    private:
+        const float black_level_; /* a scene darker than this on average is black */
+        const float flash_delta_; /* brightness increase from the previous frame making a flash */
+        std::optional<float> last_brightness_ = std::nullopt;
+        cv::Scalar sum_bgr_ = cv::Scalar::all(0.0);
+        double sum_brightness_ = 0.0;
+        int32_t num_frames_ = 0;
+        bool has_flash_ = false;
+};
+
+struct MotionSample {
+    float motion;
+    cv::Mat thumbnail; /* gray, MOTION_IMAGE_WIDTH wide at most */
+};
+
+/* mean motion energy (absolute difference from the previous frame) of a scene, and its most static frame
+   as representative keyframe with the 64-bit perceptual hash of that frame. Frames are measured on a
+   downscaled gray thumbnail, and only the keyframe's is hashed when the scene is closed. */
+class MotionAggregator : public FrameSampleAggregator<MotionSample> {
+    public:
+        std::vector<std::string> get_columns() const override;
+        /* the keyframe of each closed scene with its hash, std::nullopt if no frame of the scene was measured */
+        const std::vector<std::optional<std::pair<int32_t, uint64_t>>>& get_keyframes() const { return keyframes_; }
+        static uint64_t compute_phash(const cv::Mat& gray_frame);
+
+    protected:
+        std::optional<MotionSample> _measure(const VideoFrame& frame) override;
+        void _fold(const int32_t frame_num, const MotionSample& sample) override;
+        std::vector<std::string> _finish_scene() override;
+
+    private:
+        cv::Mat last_gray_;
+        double sum_motion_ = 0.0;
+        int32_t num_frames_ = 0;
+        std::optional<std::pair<int32_t, MotionSample>> keyframe_ = std::nullopt;
+        std::vector<std::optional<std::pair<int32_t, uint64_t>>> keyframes_;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <optional>
+#include <cstdint>
+
+class VideoStream;
+class BaseDetector;
+template <typename T> struct WithError;
+
+/*
+   On-disk cache of detected cuts, so that re-submitted videos are not decoded again.
+   An entry is addressed by the video's fingerprint (file size, a hash of blocks sampled across the file,
+   and stream parameters), the detected range, and the detector's parameters.
+   Entries are written to a temporary file and renamed, so concurrent runs may share a cache directory.
+*/
+class SceneCache {
+    public:
+        explicit SceneCache(const std::filesystem::path& cache_dir);
+        std::optional<std::vector<int32_t>> load(const std::string& key) const;
+        WithError<void> store(const std::string& key, const std::vector<int32_t>& cutting_list) const;
+        static WithError<std::string> create_key(const VideoStream& video, const BaseDetector& detector);
+
+    private:
+        std::filesystem::path _get_entry_path(const std::string& key) const;
+
+        const std::filesystem::path cache_dir_;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef SCENE_INDEX_H
+#define SCENE_INDEX_H
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <span>
+#include <cstdint>
+
+template <typename T> struct WithError;
+
+/*
+   Append-only store of the scene lists of a whole archive (index-scenes), queried without parsing any
+   text (--query). Each record holds the cuts of one detection with the video's fingerprint and detector
+   parameters (SceneCache::create_key). Records are never rewritten: indexing a video again appends a
+   record superseding the previous one. The sidecar directory <path>.dir lists the records sorted by video
+   name with their number of cuts and duration, so that a video is found by binary search and the cut rate
+   of every video is read from one array. It is rebuilt once more than SCENE_INDEX_MAX_UNSORTED records
+   were appended after it, and readers scan those. Both files are memory-mapped, in native byte order:
+
+     <path>      SceneIndexHeader, then records of
+                 SceneListHeader, int32_t cuts[num_cuts], char name[name_size], char key[key_size], padded to 8 bytes
+     <path>.dir  SceneDirectoryHeader, SceneDirectoryEntry[num_entries] sorted by video name, then record offset
+*/
+constexpr char SCENE_INDEX_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'S', 'I' };
+constexpr char SCENE_DIRECTORY_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'S', 'D' };
+constexpr uint32_t SCENE_INDEX_VERSION = 1;
+constexpr size_t SCENE_INDEX_MAX_UNSORTED = 1024;
+
+struct SceneIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved0;
+    uint64_t data_size; /* bytes of complete records after the header, updated after each append */
+    uint64_t num_records;
+    char reserved[32];
+};
+static_assert(sizeof(SceneIndexHeader) == 64);
+
+struct SceneListHeader {
+    uint64_t record_size; /* including this header and the padding */
+    double framerate;
+    int32_t start_frame; /* detected frames are [start_frame, end_frame) */
+    int32_t end_frame;
+    uint32_t num_cuts;
+    uint32_t name_size;
+    uint32_t key_size;
+    uint32_t reserved;
+};
+static_assert(sizeof(SceneListHeader) == 40);
+
+struct SceneDirectoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved0;
+    uint64_t data_size; /* the records in the first data_size bytes of the index are listed */
+    uint64_t num_entries;
+    char reserved[32];
+};
+static_assert(sizeof(SceneDirectoryHeader) == 64);
+
+struct SceneDirectoryEntry {
+    uint64_t record_offset; /* from the start of the index */
+    double duration; /* seconds */
+    uint32_t num_cuts;
+    uint32_t is_latest; /* 0 if a later record of the same video follows */
+};
+static_assert(sizeof(SceneDirectoryEntry) == 24);
+
+/* a record of the index, pointing into its mapping */
+struct SceneListRecord {
+    std::string_view video_name;
+    std::string_view key; /* fingerprint and detector parameters */
+    double framerate;
+    int32_t start_frame;
+    int32_t end_frame;
+    std::span<const int32_t> cuts; /* sorted */
+
+    double get_duration() const { return framerate > 0.0 ? (end_frame - start_frame) / framerate : 0.0; }
+    double get_cuts_per_minute() const;
+    /* the cuts at frames first..last, both included */
+    std::span<const int32_t> get_cuts(const int32_t first, const int32_t last) const;
+};
+
+class SceneIndex {
+    public:
+        explicit SceneIndex(const void* data, const size_t size, const void* directory, const size_t directory_size,
+                            std::vector<uint64_t>&& unsorted_offsets);
+        SceneIndex(const SceneIndex&) = delete;
+        SceneIndex& operator=(const SceneIndex&) = delete;
+        ~SceneIndex();
+
+        size_t get_num_records() const;
+        size_t get_num_unsorted() const { return unsorted_offsets_.size(); }
+        /* the latest record of the video, std::nullopt if it was never indexed */
+        std::optional<SceneListRecord> find(const std::string_view video_name) const;
+        /* the latest record of each video with at least min_cuts_per_minute cuts per minute, sorted by video name */
+        std::vector<SceneListRecord> find_by_cut_rate(const double min_cuts_per_minute) const;
+        /* writes the directory of all the records to directory_path, through a temporary file renamed over it */
+        WithError<void> write_directory(const std::filesystem::path& directory_path) const;
+        static WithError<std::shared_ptr<SceneIndex>> initialize_scene_index(const std::filesystem::path& index_path);
+
+    private:
+        SceneListRecord _get_record(const uint64_t offset) const;
+        std::span<const SceneDirectoryEntry> _get_directory() const;
+
+        const void* data_;
+        const size_t size_;
+        const void* directory_; /* nullptr until the directory is first built */
+        const size_t directory_size_;
+        const std::vector<uint64_t> unsorted_offsets_; /* records appended after the directory was built */
+};
+
+/* Appends the cuts detected in [start_frame, end_frame) of a video, superseding its previous record, unless
+   the latest record of the video has the same key. Returns whether a record was appended. Concurrent runs
+   (--batch) append one after the other, and readers keep seeing the records present when they were opened. */
+WithError<bool> append_to_scene_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                      const std::string& key, const double framerate, const int32_t start_frame,
+                                      const int32_t end_frame, const std::vector<int32_t>& cuts);
+
+#endif
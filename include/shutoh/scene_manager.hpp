@@ -5,33 +5,102 @@
 #include "video_frame.hpp"
 #include "frame_timecode.hpp"
 #include "frame_timecode_pair.hpp"
+#include "scene_observer.hpp"
+#include "scene_aggregator.hpp"
+#include "generator.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <string>
 #include <cstdint>
 #include <optional>
 #include <memory>
+#include <functional>
+#include <filesystem>
+#include <atomic>
 
 class VideoStream;
+class MotionVectorReader;
+class ScoreWriter;
+class ScoreReader;
+class SceneCache;
+class EventRingWriter;
 template <typename T> class BlockingQueue;
 template <typename T> struct WithError;
 
+/* Called for each frame with the full resolution image and the cut reported by the detector at this frame. */
+using FrameCallback = std::function<void(const cv::Mat& frame, const int32_t frame_num, const std::optional<int32_t> cut)>;
+/* Called for each processed frame with its position and the cut reported by the detector at this frame. */
+using ProgressCallback = std::function<void(const FrameTimeCode& position, const std::optional<FrameTimeCode>& cut)>;
+
 class SceneManager {
     public:
         explicit SceneManager(std::shared_ptr<BaseDetector> detector);
         void detect_scenes(VideoStream& video);
+        /* Runs detect_scenes() on another thread and yields each scene as soon as it is closed.
+           Destroying the generator before the last scene stops the detection, which then leaves
+           a partial scene list. The scene manager and the video must outlive the generator. */
+        Generator<FrameTimeCodePair> generate_scenes(VideoStream& video);
+        /* decides cuts from the scores saved by a previous run instead of decoding the video */
+        WithError<void> replay_scores(const ScoreReader& score_reader, const VideoStream& video);
+        /* frames the detector may report a cut after it happened, std::nullopt if unbounded */
+        std::optional<int32_t> get_latency() const { return detector_->get_latency(); }
+        void set_frame_callback(FrameCallback frame_callback) { frame_callback_ = frame_callback; }
+        void set_progress_callback(ProgressCallback progress_callback) { progress_callback_ = progress_callback; }
+        void set_scene_observer(std::shared_ptr<SceneObserver> scene_observer) { scene_observer_ = scene_observer; }
+        void set_score_writer(std::shared_ptr<ScoreWriter> score_writer) { score_writer_ = score_writer; }
+        /* publishes the score of each frame and each cut to other processes (shared memory) */
+        void set_event_ring(std::shared_ptr<EventRingWriter> event_ring) { event_ring_ = event_ring; }
+        /* accumulates statistics of each scene from the frames decoded by detect_scenes(), see SceneAggregator */
+        void add_scene_aggregator(std::shared_ptr<SceneAggregator> aggregator);
+        /* detect_scenes() returns cached cuts without decoding, unless frames are needed by a callback, score writer,
+           event ring or aggregator */
+        void set_scene_cache(std::shared_ptr<SceneCache> scene_cache) { scene_cache_ = scene_cache; }
+        /* saves the detection state every interval frames and when detect_scenes() finishes */
+        void set_checkpoint(const std::filesystem::path& checkpoint_path, const int32_t interval);
+        /* detect_scenes() then continues after the last frame processed by the run which saved the checkpoint */
+        WithError<void> load_checkpoint(const std::filesystem::path& checkpoint_path);
+        /* after the end of the video, detect_scenes() keeps processing frames appended to the file
+           until it has not grown for timeout seconds */
+        void set_follow(const float timeout) { follow_timeout_ = timeout; }
+        /* decodes num_frames before the start of the video stream, so that the scores at its start
+           are the same as in a run starting earlier (shard) */
+        void set_warmup_frames(const int32_t num_frames) { warmup_frames_ = num_frames; }
         WithError<std::vector<FrameTimeCodePair>> get_scene_list() const;
 
     private:
+        WithError<void> _detect_scenes(VideoStream& video);
+        std::optional<std::string> _get_cache_key(const VideoStream& video) const;
+        WithError<void> _follow(const std::string& input_path);
+        WithError<void> _save_checkpoint() const;
         void _process_frame(VideoFrame& next_frame);
+        /* notifies the scene ending at the cut appended last to cutting_list_, or the last scene if cut is std::nullopt */
+        void _close_scene(const std::optional<int32_t> cut) const;
+        void _consume_frames(BlockingQueue<VideoFrame>& frame_queue);
         void _decode_thread(VideoStream& video,
                             const float downscale_factor,
                             BlockingQueue<VideoFrame>& frame_queue);
+        void _motion_vector_thread(MotionVectorReader& reader,
+                                   BlockingQueue<VideoFrame>& frame_queue);
         std::vector<FrameTimeCode> _get_cutting_list() const;
 
         cv::Mat previous_frame_;
         std::vector<int32_t> cutting_list_;
         std::shared_ptr<BaseDetector> detector_;
+        FrameCallback frame_callback_ = nullptr;
+        ProgressCallback progress_callback_ = nullptr;
+        std::shared_ptr<SceneObserver> scene_observer_ = nullptr;
+        std::atomic<bool> stop_requested_ = false; /* set when a generator is destroyed before the last scene */
+        std::shared_ptr<ScoreWriter> score_writer_ = nullptr;
+        std::shared_ptr<EventRingWriter> event_ring_ = nullptr;
+        std::vector<std::shared_ptr<SceneAggregator>> scene_aggregators_;
+        std::shared_ptr<SceneCache> scene_cache_ = nullptr;
+        std::optional<std::filesystem::path> checkpoint_path_ = std::nullopt;
+        int32_t checkpoint_interval_ = 0;
+        int32_t frames_since_checkpoint_ = 0;
+        std::optional<float> follow_timeout_ = std::nullopt;
+        int32_t warmup_frames_ = 0;
+        std::optional<int32_t> next_frame_num_ = std::nullopt; /* first frame which has not been processed */
         float framerate_ = 0.0f;
         std::optional<FrameTimeCode> start_ = std::nullopt;
         std::optional<FrameTimeCode> end_ = std::nullopt;
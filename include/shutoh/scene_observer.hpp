@@ -0,0 +1,21 @@
+#ifndef SCENE_OBSERVER_H
+#define SCENE_OBSERVER_H
+
+#include "frame_timecode_pair.hpp"
+
+/*
+   Receives each scene as soon as it is closed, i.e., when the detector reports the cut ending it,
+   or when the video ends for the last scene. Scenes arrive in order and are those of get_scene_list(),
+   so that splitting or thumbnailing the first scenes can start while the rest of the video is detected.
+   on_scene() is called from the thread running the detection and delays it until it returns.
+*/
+class SceneObserver {
+    public:
+        virtual void on_scene(const FrameTimeCodePair& scene) = 0;
+        virtual ~SceneObserver() {}
+
+    protected:
+        SceneObserver() = default;
+};
+
+#endif
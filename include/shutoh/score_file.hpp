@@ -0,0 +1,79 @@
+#ifndef SCORE_FILE_H
+#define SCORE_FILE_H
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <optional>
+#include <memory>
+#include <span>
+#include <vector>
+#include <cstdint>
+
+template <typename T> struct WithError;
+
+/*
+   Binary sidecar holding the score of every frame given to a detector (--save_scores).
+   A fixed header is followed by one FrameScore per frame in decoding order, in native byte order,
+   so that the file can be memory-mapped and replayed without parsing (--load_scores).
+*/
+constexpr char SCORE_FILE_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'S', 'C' };
+constexpr uint32_t SCORE_FILE_VERSION = 1;
+
+struct ScoreFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_scores; /* written when the file is closed, 0 if the run did not finish */
+    float framerate;
+    int32_t start_frame_num;
+    int32_t end_frame_num;
+    char score_type[36]; /* BaseDetector::get_score_type(), null-terminated */
+};
+static_assert(sizeof(ScoreFileHeader) == 64);
+
+struct FrameScore {
+    int32_t frame_num;
+    float score; /* NaN if the frame has no score */
+};
+static_assert(sizeof(FrameScore) == 8);
+
+class ScoreWriter {
+    public:
+        explicit ScoreWriter(const std::filesystem::path& output_path, const ScoreFileHeader& header);
+        /* frames before the header's start frame only warm up the detector and are not written */
+        void write(const int32_t frame_num, const std::optional<float> score);
+        WithError<void> close();
+        static WithError<std::shared_ptr<ScoreWriter>> initialize_score_writer(const std::filesystem::path& output_path,
+                                                                               const std::string& score_type,
+                                                                               const float framerate,
+                                                                               const int32_t start_frame_num,
+                                                                               const int32_t end_frame_num);
+
+    private:
+        const std::filesystem::path output_path_;
+        ScoreFileHeader header_;
+        std::ofstream file_;
+};
+
+class ScoreReader {
+    public:
+        explicit ScoreReader(const void* data, const size_t size);
+        ScoreReader(const ScoreReader&) = delete;
+        ScoreReader& operator=(const ScoreReader&) = delete;
+        ~ScoreReader();
+
+        const ScoreFileHeader& get_header() const { return *static_cast<const ScoreFileHeader*>(data_); }
+        std::string get_score_type() const;
+        std::span<const FrameScore> get_scores() const;
+        static WithError<std::shared_ptr<ScoreReader>> initialize_score_reader(const std::filesystem::path& input_path);
+
+    private:
+        const void* data_;
+        const size_t size_;
+};
+
+/* Concatenates the scores saved by shards of one video (shard) in frame order. The shards must share
+   the detector and framerate and cover a contiguous range; frames saved by two shards are taken once. */
+WithError<void> merge_score_files(const std::vector<std::filesystem::path>& input_paths, const std::filesystem::path& output_path);
+
+#endif
@@ -3,11 +3,21 @@
 
 #include <opencv2/opencv.hpp>
 #include <cstdint>
+#include <optional>
+
+struct MotionInfo {
+    const char picture_type = '?'; /* I, P, or B, as reported by the decoder */
+    const bool has_motion_vectors = false; /* false if the decoder has not exported AV_FRAME_DATA_MOTION_VECTORS for any frame yet */
+    const float intra_ratio = 0.0f; /* ratio of the picture area which is not covered by motion vectors */
+    const float mean_motion = 0.0f; /* mean length of the motion vectors in pixels */
+};
 
 struct VideoFrame {
     const cv::Mat frame;
     const int32_t frame_num;
     const bool is_end_frame = false;
+    const std::optional<MotionInfo> motion_info = std::nullopt; /* only set for FrameSource::MOTION_VECTORS */
+    const cv::Mat original_frame = cv::Mat(); /* full resolution frame, only set if SceneManager has a frame callback */
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -21,6 +21,7 @@ class VideoStream {
         WithError<void> set_time(const std::optional<std::string>& start, const std::optional<std::string>& end, 
                                  const std::optional<std::string>& duration);
         cv::VideoCapture& get_cap() { return cap_; }
+        const std::string& get_input_path() const { return input_path_; }
         float get_framerate() const { return framerate_; }
         const FrameTimeCode& get_start() const { return start_; }
         const FrameTimeCode& get_end() const { return end_; }
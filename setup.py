@@ -7,11 +7,22 @@ __version__ = "0.0.1"
 
 exclude_files = [
     "src/main.cpp",
+    "src/batch_runner.cpp",
     "src/command_runner.cpp",
     "src/config.cpp",
-    "src/csv_writer.cpp",
     "src/image_extractor.cpp",
+    "src/image_collector.cpp",
+    "src/image_writer.cpp",
+    "src/job_server.cpp",
+    "src/parameter_sweep.cpp",
     "src/parameters.cpp",
+    "src/process_scheduler.cpp",
+    "src/range_detector.cpp",
+    "src/scene_query.cpp",
+    "src/scene_writer.cpp",
+    "src/smart_splitter.cpp",
+    "src/transcode_splitter.cpp",
+    "src/stream_copy_splitter.cpp",
     "src/video_splitter.cpp"
 ]
 
@@ -22,16 +33,19 @@ if system == "Linux":
     library_dirs = ["/usr/local/lib"]
     extra_compile_args=[]
     extra_link_args=[]
+    extra_libraries = ["rt"] # shm_open before glibc 2.34
 elif system == "Darwin":
     # M1 Mac configuration
     include_dirs = ["include", "/opt/homebrew/opt/opencv@4/include/opencv4", "/opt/homebrew/include"]
     library_dirs = ["/opt/homebrew/lib"]
     extra_compile_args=["-mmacosx-version-min=10.15"]
     extra_link_args=["-mmacosx-version-min=10.15"]
+    extra_libraries = []
 else:
     # windows, yet TBD
     include_dirs = []
     library_dirs = []
+    extra_libraries = []
 
 ext_modules = [
     Pybind11Extension(
@@ -39,7 +53,7 @@ ext_modules = [
         sorted([x for x in glob.glob("src/**/*.cpp", recursive=True) if not x in exclude_files]),
         include_dirs=include_dirs,
         library_dirs=library_dirs,
-        libraries=["opencv_core", "opencv_videoio", "fmt"],
+        libraries=["opencv_core", "opencv_videoio", "fmt", "avformat", "avcodec", "avutil"] + extra_libraries,
         language="c++",
         cxx_std=20,
         define_macros=[("SHUTOH_VERSION_INFO", f'"{__version__}"')],
@@ -0,0 +1,401 @@
+#include "shutoh/error.hpp"
+
+#include "batch_runner.hpp"
+#include "config.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <map>
+#include <fmt/core.h>
+
+struct JsonValue {
+    std::string text;
+    bool is_literal; /* true, false, null, or a number */
+};
+
+static const std::map<std::string, std::string> SHORT_OPTION_NAMES = {
+    {"-i", "--input"}, {"-c", "--command"}, {"-o", "--output"}, {"-W", "--width"}, {"-H", "--height"},
+};
+static const std::vector<std::string> PATH_OPTION_NAMES = {
+    "input", "output", "save_scores", "load_scores", "cache_dir", "checkpoint", "range_file", "ground_truth", "shards",
+};
+
+static void _skip_space(const std::string& text, size_t& pos) {
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        pos++;
+}
+
+static void _append_utf8(std::string& text, const uint32_t code_point) {
+    if (code_point < 0x80) {
+        text += static_cast<char>(code_point);
+    } else if (code_point < 0x800) {
+        text += static_cast<char>(0xC0 | (code_point >> 6));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    } else {
+        text += static_cast<char>(0xE0 | (code_point >> 12));
+        text += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+        text += static_cast<char>(0x80 | (code_point & 0x3F));
+    }
+}
+
+static std::optional<JsonValue> _parse_json_scalar(const std::string& text, size_t& pos) {
+    if (pos < text.size() && text[pos] != '"') {
+        const size_t begin = pos;
+        while (pos < text.size() && (std::isalnum(static_cast<unsigned char>(text[pos])) || text[pos] == '.' ||
+                                     text[pos] == '-' || text[pos] == '+'))
+            pos++;
+        if (pos == begin)
+            return std::nullopt;
+        return JsonValue { text.substr(begin, pos - begin), true };
+    }
+
+    /* a string, where \uXXXX escapes outside the basic multilingual plane are not supported */
+    std::string value;
+    for (pos++; pos < text.size() && text[pos] != '"'; pos++) {
+        if (text[pos] != '\\') {
+            value += text[pos];
+            continue;
+        }
+        if (++pos >= text.size())
+            return std::nullopt;
+        switch (text[pos]) {
+            case 'n': value += '\n'; break;
+            case 't': value += '\t'; break;
+            case 'r': value += '\r'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'u': {
+                if (pos + 4 >= text.size())
+                    return std::nullopt;
+                const std::string hex = text.substr(pos + 1, 4);
+                if (hex.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+                    return std::nullopt;
+                _append_utf8(value, static_cast<uint32_t>(std::stoul(hex, nullptr, 16)));
+                pos += 4;
+                break;
+            }
+            default: value += text[pos]; break; /* \" \\ \/ */
+        }
+    }
+    if (pos >= text.size())
+        return std::nullopt;
+    pos++;
+    return JsonValue { value, false };
+}
+
+static WithError<BatchJob> _parse_json_job(const std::string& line) {
+    /* a flat object whose values are strings, numbers, booleans, or arrays of them */
+    const Error parse_error = Error(ErrorCode::InvalidArgument, "Invalid job in the manifest: " + line);
+    std::optional<std::filesystem::path> input_path = std::nullopt;
+    std::vector<std::string> args;
+    size_t pos = 1;
+    while (true) {
+        _skip_space(line, pos);
+        if (pos < line.size() && line[pos] == '}')
+            break;
+        std::optional<JsonValue> key = pos < line.size() && line[pos] == '"' ? _parse_json_scalar(line, pos) : std::nullopt;
+        _skip_space(line, pos);
+        if (!key.has_value() || pos >= line.size() || line[pos] != ':')
+            return WithError<BatchJob> { std::nullopt, parse_error };
+        pos++;
+        _skip_space(line, pos);
+
+        std::vector<JsonValue> values;
+        if (pos < line.size() && line[pos] == '[') {
+            for (pos++, _skip_space(line, pos); pos < line.size() && line[pos] != ']'; _skip_space(line, pos)) {
+                std::optional<JsonValue> value = _parse_json_scalar(line, pos);
+                if (!value.has_value())
+                    return WithError<BatchJob> { std::nullopt, parse_error };
+                values.push_back(value.value());
+                _skip_space(line, pos);
+                if (pos < line.size() && line[pos] == ',')
+                    pos++;
+            }
+            if (pos >= line.size())
+                return WithError<BatchJob> { std::nullopt, parse_error };
+            pos++;
+        } else {
+            std::optional<JsonValue> value = _parse_json_scalar(line, pos);
+            if (!value.has_value())
+                return WithError<BatchJob> { std::nullopt, parse_error };
+            values.push_back(value.value());
+        }
+
+        const std::string& name = key.value().text;
+        if (name == "input") {
+            if (values.size() != 1)
+                return WithError<BatchJob> { std::nullopt, parse_error };
+            input_path = values[0].text;
+        } else if (values.size() == 1 && values[0].is_literal && (values[0].text == "false" || values[0].text == "null")) {
+            /* the option keeps its default */
+        } else {
+            args.push_back("--" + name);
+            for (const JsonValue& value : values) {
+                if (!(value.is_literal && value.text == "true"))
+                    args.push_back(value.text);
+            }
+        }
+
+        _skip_space(line, pos);
+        if (pos < line.size() && line[pos] == ',')
+            pos++;
+        else if (pos >= line.size() || line[pos] != '}')
+            return WithError<BatchJob> { std::nullopt, parse_error };
+    }
+
+    if (!input_path.has_value()) {
+        const std::string error_msg = "A job in the manifest has no input: " + line;
+        return WithError<BatchJob> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    return WithError<BatchJob> { BatchJob { input_path.value(), args }, Error(ErrorCode::Success, "") };
+}
+
+std::string escape_json(const std::string& text) {
+    std::string escaped;
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else if (c == '\t') {
+            escaped += "\\t";
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            escaped += fmt::format("\\u{:04x}", static_cast<int32_t>(c));
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static std::string _escape_csv(const std::string& field) {
+    /* RFC 4180: quoted, with each " doubled */
+    std::string escaped = "\"";
+    for (const char c : field)
+        escaped += c == '"' ? std::string("\"\"") : std::string(1, c);
+    return escaped + "\"";
+}
+
+static bool _is_option(const std::string& token) {
+    /* negative numbers are values, e.g., --fade_bias -0.5 */
+    return token.size() > 1 && token[0] == '-' && !std::isdigit(static_cast<unsigned char>(token[1])) && token[1] != '.';
+}
+
+static std::string _get_long_name(const std::string& token) {
+    const std::string name = token.substr(0, token.find('='));
+    return SHORT_OPTION_NAMES.contains(name) ? SHORT_OPTION_NAMES.at(name) : name;
+}
+
+BatchRunner::BatchRunner(const std::vector<std::string>& shared_args, const size_t num_workers)
+    : shared_args_{shared_args}, num_workers_{num_workers} {}
+
+WithError<void> BatchRunner::run(const std::filesystem::path& manifest_path, const RunFunction& run_job) const {
+    WithError<std::vector<BatchJob>> opt_jobs = load_manifest(manifest_path);
+    if (opt_jobs.has_error())
+        return WithError<void> { opt_jobs.error };
+    const std::vector<BatchJob> jobs = opt_jobs.value();
+
+    /* the largest files start first, so that no long job is left alone at the end */
+    std::vector<uintmax_t> file_sizes;
+    for (const BatchJob& job : jobs) {
+        std::error_code ec;
+        const uintmax_t file_size = std::filesystem::file_size(job.input_path, ec);
+        file_sizes.push_back(ec ? 0 : file_size);
+    }
+    std::vector<size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&file_sizes](const size_t a, const size_t b) {
+        return file_sizes[a] > file_sizes[b];
+    });
+
+    /* each worker takes the next job when it is done, and writes to its own elements of results */
+    std::vector<BatchResult> results(jobs.size());
+    std::atomic<size_t> next_i = 0;
+    std::vector<std::future<void>> futures;
+    for (size_t worker_i = 0; worker_i < std::min(num_workers_, jobs.size()); worker_i++) {
+        futures.push_back(std::async(std::launch::async, [&]() {
+            for (size_t i = next_i++; i < order.size(); i = next_i++)
+                results[order[i]] = _run_job(jobs[order[i]], run_job);
+        }));
+    }
+    for (std::future<void>& future : futures)
+        future.get();
+
+    const std::filesystem::path summary_path = manifest_path.parent_path() / (manifest_path.stem().string() + "-summary.csv");
+    WithError<void> summary_err = _write_summary(summary_path, jobs, results);
+    if (summary_err.has_error())
+        return summary_err;
+
+    const size_t num_failed = std::count_if(results.begin(), results.end(), [](const BatchResult& result) { return !result.success; });
+    std::cout << "Processed " << jobs.size() << " videos, " << num_failed << " failed: " << summary_path.string() << std::endl;
+    if (num_failed > 0) {
+        const std::string error_msg = std::to_string(num_failed) + " of " + std::to_string(jobs.size()) + " jobs failed.";
+        return WithError<void> { Error(ErrorCode::InvalidCommand, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+BatchResult BatchRunner::_run_job(const BatchJob& job, const RunFunction& run_job) const {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const auto elapsed = [&start]() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    const WithError<Config> opt_cfg = parse_args(create_job_args(shared_args_, job), true);
+    if (opt_cfg.has_error())
+        return BatchResult { false, 0, elapsed(), opt_cfg.error.get_error_msg() };
+
+    /* a broken video must not stop the other jobs */
+    try {
+        WithError<std::vector<FrameTimeCodePair>> opt_scene_list = run_job(opt_cfg.value());
+        if (opt_scene_list.has_error())
+            return BatchResult { false, 0, elapsed(), opt_scene_list.error.get_error_msg() };
+        return BatchResult { true, opt_scene_list.value().size(), elapsed(), "" };
+    }
+    catch (const std::exception& err) {
+        return BatchResult { false, 0, elapsed(), err.what() };
+    }
+}
+
+std::vector<std::string> BatchRunner::create_job_args(const std::vector<std::string>& shared_args, const BatchJob& job) {
+    std::vector<std::string> overridden_names = { "--input" };
+    for (const std::string& token : job.args) {
+        if (_is_option(token))
+            overridden_names.push_back(_get_long_name(token));
+    }
+
+    /* options set by the job replace the shared ones, with all their values */
+    std::vector<std::string> args = { shared_args.front() };
+    bool is_skipped = false;
+    for (size_t i = 1; i < shared_args.size(); i++) {
+        const std::string& token = shared_args[i];
+        if (_is_option(token))
+            is_skipped = std::find(overridden_names.begin(), overridden_names.end(), _get_long_name(token)) != overridden_names.end();
+        if (!is_skipped)
+            args.push_back(token);
+    }
+
+    args.push_back("--input");
+    args.push_back(job.input_path.string());
+    args.insert(args.end(), job.args.begin(), job.args.end());
+    return args;
+}
+
+WithError<void> BatchRunner::_write_summary(const std::filesystem::path& summary_path, const std::vector<BatchJob>& jobs,
+                                            const std::vector<BatchResult>& results) const {
+    std::ofstream csv_file(summary_path);
+    if (!csv_file.is_open()) {
+        const std::string error_msg = "Failed to open csv file for writing: " + summary_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    csv_file << "input,status,num_scenes,seconds,error\n";
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchResult& result = results[i];
+        csv_file << _escape_csv(jobs[i].input_path.string()) << "," << (result.success ? "ok" : "failed") << ","
+                 << result.num_scenes << "," << fmt::format("{:.3f}", result.seconds) << "," << _escape_csv(result.error_msg) << "\n";
+    }
+    csv_file.close();
+    if (csv_file.fail()) {
+        const std::string error_msg = "Failed to write the summary: " + summary_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<BatchJob>> BatchRunner::load_manifest(const std::filesystem::path& manifest_path) {
+    std::ifstream file(manifest_path);
+    if (!file.is_open()) {
+        const std::string error_msg = "Failed to open the manifest: " + manifest_path.string();
+        return WithError<std::vector<BatchJob>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::vector<BatchJob> jobs;
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t begin = line.find_first_not_of(" \t");
+        const size_t end = line.find_last_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#')
+            continue;
+        WithError<BatchJob> opt_job = parse_job(line.substr(begin, end + 1 - begin));
+        if (opt_job.has_error())
+            return WithError<std::vector<BatchJob>> { std::nullopt, opt_job.error };
+        jobs.push_back(opt_job.value());
+    }
+
+    if (jobs.empty()) {
+        const std::string error_msg = "No job in the manifest: " + manifest_path.string();
+        return WithError<std::vector<BatchJob>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    return WithError<std::vector<BatchJob>> { jobs, Error(ErrorCode::Success, "") };
+}
+
+WithError<BatchJob> BatchRunner::parse_job(const std::string& line) {
+    if (line.empty() || line[0] != '{')
+        return WithError<BatchJob> { BatchJob { line, {} }, Error(ErrorCode::Success, "") };
+    return _parse_json_job(line);
+}
+
+std::string BatchRunner::format_job(const std::vector<std::string>& args) {
+    std::vector<std::pair<std::string, std::vector<std::string>>> options;
+    for (size_t i = 1; i < args.size(); i++) {
+        if (_is_option(args[i])) {
+            const std::string name = _get_long_name(args[i]).substr(2);
+            const size_t separator = args[i].find('=');
+            options.push_back({ name, {} });
+            if (separator != std::string::npos)
+                options.back().second.push_back(args[i].substr(separator + 1));
+        } else if (!options.empty()) {
+            options.back().second.push_back(args[i]);
+        }
+    }
+
+    const bool has_output = std::any_of(options.begin(), options.end(), [](const auto& option) { return option.first == "output"; });
+    if (!has_output)
+        options.push_back({ "output", { "." } });
+
+    std::string job = "{";
+    for (const auto& [name, values] : options) {
+        job += (job.size() > 1 ? ", \"" : "\"") + name + "\": ";
+        if (values.empty()) {
+            job += "true";
+            continue;
+        }
+
+        std::vector<std::string> json_values;
+        for (const std::string& value : values) {
+            const bool is_path = std::find(PATH_OPTION_NAMES.begin(), PATH_OPTION_NAMES.end(), name) != PATH_OPTION_NAMES.end();
+            json_values.push_back("\"" + escape_json(is_path ? std::filesystem::absolute(value).string() : value) + "\"");
+        }
+        if (json_values.size() == 1) {
+            job += json_values[0];
+            continue;
+        }
+        job += "[";
+        for (size_t i = 0; i < json_values.size(); i++)
+            job += (i > 0 ? ", " : "") + json_values[i];
+        job += "]";
+    }
+    return job + "}";
+}
+
+std::optional<std::string> BatchRunner::extract_option(std::vector<std::string>& args, const std::string& name) {
+    for (size_t i = 1; i < args.size(); i++) {
+        if (args[i].starts_with(name + "=")) {
+            const std::string value = args[i].substr(name.size() + 1);
+            args.erase(args.begin() + i);
+            return value;
+        }
+        if (args[i] == name && i + 1 < args.size()) {
+            const std::string value = args[i + 1];
+            args.erase(args.begin() + i, args.begin() + i + 2);
+            return value;
+        }
+    }
+    return std::nullopt;
+}
@@ -0,0 +1,63 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <cstdint>
+
+template <typename T> struct WithError;
+struct Config;
+
+/* one manifest line: the input and the options overriding the shared command line */
+struct BatchJob {
+    const std::filesystem::path input_path;
+    const std::vector<std::string> args;
+};
+
+struct BatchResult {
+    bool success;
+    size_t num_scenes;
+    double seconds;
+    std::string error_msg;
+};
+
+/*
+   Runs the detection of many videos in one process (--batch). The manifest has one job per line,
+   either a path or an NDJSON object such as {"input": "a.mp4", "detector": "adaptive", "threshold": 3.5},
+   whose keys are the long option names. Each job is the shared command line with its own options,
+   parsed and validated like a single run. Jobs are run by a pool of workers, the largest file first,
+   and the outcome of every job is written to a summary.
+*/
+class BatchRunner {
+    public:
+        using RunFunction = std::function<WithError<std::vector<FrameTimeCodePair>>(const Config& cfg)>;
+
+        explicit BatchRunner(const std::vector<std::string>& shared_args, const size_t num_workers);
+        WithError<void> run(const std::filesystem::path& manifest_path, const RunFunction& run_job) const;
+        static WithError<std::vector<BatchJob>> load_manifest(const std::filesystem::path& manifest_path);
+        /* a manifest line, a path or an NDJSON object */
+        static WithError<BatchJob> parse_job(const std::string& line);
+        /* the NDJSON object of a command line, with paths made absolute for a process in another directory */
+        static std::string format_job(const std::vector<std::string>& args);
+        /* the shared command line with the options of the job replacing the shared ones */
+        static std::vector<std::string> create_job_args(const std::vector<std::string>& shared_args, const BatchJob& job);
+        /* removes --name VALUE (or --name=VALUE) from args and returns VALUE */
+        static std::optional<std::string> extract_option(std::vector<std::string>& args, const std::string& name);
+
+    private:
+        BatchResult _run_job(const BatchJob& job, const RunFunction& run_job) const;
+        WithError<void> _write_summary(const std::filesystem::path& summary_path, const std::vector<BatchJob>& jobs,
+                                       const std::vector<BatchResult>& results) const;
+
+        const std::vector<std::string> shared_args_;
+        const size_t num_workers_;
+};
+
+std::string escape_json(const std::string& text);
+
+#endif
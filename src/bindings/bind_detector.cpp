@@ -3,6 +3,7 @@
 #include <shutoh/detector/hash_detector.hpp>
 #include <shutoh/detector/histogram_detector.hpp>
 #include <shutoh/detector/threshold_detector.hpp>
+#include <shutoh/detector/motion_vector_detector.hpp>
 #include <pybind11/pybind11.h>
 
 void bind_base_detector(pybind11::module_ &m) {
@@ -41,4 +42,10 @@ void bind_threshold_detector(pybind11::module_ &m) {
         .def_static("initialize_detector", &ThresholdDetector::initialize_detector,
             pybind11::arg("threshold") = 12.0f, pybind11::arg("min_scene_len") = 15,
             pybind11::arg("fade_bias") = 0.0f);
+}
+
+void bind_motion_vector_detector(pybind11::module_ &m) {
+    pybind11::class_<MotionVectorDetector, BaseDetector, std::shared_ptr<MotionVectorDetector>>(m, "MotionVectorDetector")
+        .def_static("initialize_detector", &MotionVectorDetector::initialize_detector,
+            pybind11::arg("threshold") = 0.5f, pybind11::arg("min_scene_len") = 15);
 }
\ No newline at end of file
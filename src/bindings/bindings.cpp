@@ -1,5 +1,6 @@
 #include <shutoh/video_stream.hpp>
 #include <shutoh/scene_manager.hpp>
+#include <shutoh/scene_cache.hpp>
 #include <shutoh/detector/base_detector.hpp>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
@@ -10,6 +11,7 @@ void bind_adaptive_detector(pybind11::module_ &m);
 void bind_hash_detector(pybind11::module_ &m);
 void bind_histogram_detector(pybind11::module_ &m);
 void bind_threshold_detector(pybind11::module_ &m);
+void bind_motion_vector_detector(pybind11::module_ &m);
 
 std::vector<std::tuple<pybind11::object, pybind11::object>> create_frame_timecode_list(const std::vector<FrameTimeCodePair>& scene_list) {
     /* Shutoh: FrameTimeCode, PySceneDetect: FrameTimecode */
@@ -33,13 +35,16 @@ std::vector<std::tuple<pybind11::object, pybind11::object>> create_frame_timecod
     return out;
 }
 
-auto _detect(const std::string& input_path, std::shared_ptr<BaseDetector> detector) {
+auto _detect(const std::string& input_path, std::shared_ptr<BaseDetector> detector,
+             const std::optional<std::string>& cache_dir) {
     WithError<VideoStream> opt_video = VideoStream::initialize_video_stream(input_path);
     if (opt_video.has_error())
         throw std::runtime_error(opt_video.error.get_error_msg());
     VideoStream video = opt_video.value();
 
     SceneManager scene_manager = SceneManager(detector);
+    if (cache_dir.has_value())
+        scene_manager.set_scene_cache(std::make_shared<SceneCache>(cache_dir.value()));
     scene_manager.detect_scenes(video);
     std::vector<FrameTimeCodePair> scene_list = scene_manager.get_scene_list().value();
     auto scene_list_py = create_frame_timecode_list(scene_list);
@@ -59,5 +64,7 @@ PYBIND11_MODULE(libshutoh, m) {
     bind_hash_detector(m);
     bind_histogram_detector(m);
     bind_threshold_detector(m);
-    m.def("detect", &_detect, "A function that detects shots from a video");
+    bind_motion_vector_detector(m);
+    m.def("detect", &_detect, "A function that detects shots from a video",
+          pybind11::arg("input_path"), pybind11::arg("detector"), pybind11::arg("cache_dir") = pybind11::none());
 }
@@ -1,40 +1,400 @@
 #include "shutoh/video_stream.hpp"
 #include "shutoh/frame_timecode.hpp"
+#include "shutoh/scene_manager.hpp"
 #include "shutoh/error.hpp"
+#include "shutoh/score_file.hpp"
+#include "shutoh/scene_aggregator.hpp"
+#include "shutoh/hash_index.hpp"
+#include "shutoh/scene_index.hpp"
+#include "shutoh/scene_cache.hpp"
 
 #include "command_runner.hpp"
-#include "csv_writer.hpp"
+#include "scene_writer.hpp"
 #include "video_splitter.hpp"
+#include "stream_copy_splitter.hpp"
+#include "smart_splitter.hpp"
+#include "transcode_splitter.hpp"
 #include "image_extractor.hpp"
+#include "image_collector.hpp"
+#include "parameter_sweep.hpp"
+#include "parameters.hpp"
 
-CommandRunner::CommandRunner(const Config& cfg, const std::vector<FrameTimeCodePair>& scene_list) 
-                            : cfg_{cfg}, scene_list_{scene_list} {}
+#include <limits>
+#include <future>
+#include <fstream>
 
-WithError<void> CommandRunner::execute(VideoStream& video) const {
-    if (cfg_.command == "list-scenes")
-        return _list_scenes();
-    else if (cfg_.command == "split-video")
-        return _split_video();
+CommandRunner::CommandRunner(const Config& cfg) : cfg_{cfg} {}
+
+void CommandRunner::prepare(SceneManager& scene_manager, const VideoStream& video) {
+    /* scenes are listed as soon as they are closed; if the writer fails here, list-scenes reports it */
+    if (_has_command("list-scenes")) {
+        WithError<std::shared_ptr<SceneWriter>> opt_scene_writer = _create_scene_writer();
+        if (!opt_scene_writer.has_error()) {
+            scene_writer_ = opt_scene_writer.value();
+            scene_manager.set_scene_observer(scene_writer_);
+        }
+    }
+    if ((_has_command("list-scenes") && cfg_.scene_stats) || _has_command("index-hashes") || _has_command("find-duplicates"))
+        _prepare_aggregators(scene_manager);
+
+    if (!_has_command("save-images") || !cfg_.single_pass)
+        return;
+
+    if (cfg_.detector_type == DetectorType::MOTION) {
+        std::cout << "Warning: --single_pass needs decoded frames and is ignored with the motion detector." << std::endl;
+        return;
+    }
+
+    if (cfg_.load_scores.has_value()) {
+        std::cout << "Warning: --single_pass needs decoded frames and is ignored with --load_scores." << std::endl;
+        return;
+    }
+
+    /* frames decoded before a checkpoint are not seen again */
+    if (cfg_.checkpoint.has_value()) {
+        std::cout << "Warning: --single_pass needs all decoded frames and is ignored with --checkpoint." << std::endl;
+        return;
+    }
+
+    image_collector_ = std::make_shared<ImageCollector>(_create_image_extractor(), video, cfg_.num_images, cfg_.frame_margin,
+                                                        scene_manager.get_latency());
+    std::shared_ptr<ImageCollector> image_collector = image_collector_;
+    scene_manager.set_frame_callback([image_collector](const cv::Mat& frame, const int32_t frame_num, const std::optional<int32_t> cut) {
+        image_collector->add_frame(frame, frame_num, cut);
+    });
+}
+
+WithError<void> CommandRunner::execute(VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list) {
+    /* list-scenes is cheap and goes first. Splitting runs in ffmpeg processes (or its own decoder),
+       so images are extracted from the detection's video stream at the same time. */
+    if (_has_command("list-scenes")) {
+        WithError<void> err = _list_scenes(scene_list);
+        if (err.has_error())
+            return err;
+        if (cfg_.scene_stats && !scene_aggregators_.empty()) {
+            WithError<void> stats_err = _write_scene_stats(scene_list);
+            if (stats_err.has_error())
+                return stats_err;
+        }
+    }
+
+    if (_has_command("index-hashes") || _has_command("find-duplicates")) {
+        WithError<std::vector<SceneHash>> opt_scene_hashes = _get_scene_hashes(scene_list);
+        if (opt_scene_hashes.has_error())
+            return WithError<void> { opt_scene_hashes.error };
+        /* a video indexed and searched at once is not its own duplicate */
+        if (_has_command("find-duplicates")) {
+            WithError<void> err = _find_duplicates(opt_scene_hashes.value());
+            if (err.has_error())
+                return err;
+        }
+        if (_has_command("index-hashes")) {
+            WithError<void> err = _index_hashes(opt_scene_hashes.value());
+            if (err.has_error())
+                return err;
+        }
+    }
+
+    if (_has_command("index-scenes")) {
+        WithError<void> err = _index_scenes(video, scene_list);
+        if (err.has_error())
+            return err;
+    }
+
+    if (_has_command("sweep")) {
+        WithError<void> err = _sweep(video);
+        if (err.has_error())
+            return err;
+    }
+
+    std::future<WithError<void>> split_future;
+    if (_has_command("split-video"))
+        split_future = std::async(std::launch::async, [this, &scene_list]() { return _split_video(scene_list); });
+
+    std::optional<Error> first_error = std::nullopt;
+    if (_has_command("save-images")) {
+        WithError<void> err = _save_images(video, scene_list);
+        if (err.has_error())
+            first_error.emplace(err.error);
+    }
+
+    if (split_future.valid()) {
+        WithError<void> err = split_future.get();
+        if (err.has_error() && !first_error.has_value())
+            first_error.emplace(err.error);
+    }
+
+    if (first_error.has_value())
+        return WithError<void> { first_error.value() };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+bool CommandRunner::_has_command(const std::string& command) const {
+    return cfg_.has_command(command);
+}
+
+WithError<void> CommandRunner::_list_scenes(const std::vector<FrameTimeCodePair>& scene_list) {
+    if (!scene_writer_) {
+        WithError<std::shared_ptr<SceneWriter>> opt_scene_writer = _create_scene_writer();
+        if (opt_scene_writer.has_error())
+            return WithError<void> { opt_scene_writer.error };
+        scene_writer_ = opt_scene_writer.value();
+    }
+
+    /* the scenes the detection has not closed, e.g., all of them with --range */
+    for (size_t i = scene_writer_->get_num_scenes(); i < scene_list.size(); i++)
+        scene_writer_->on_scene(scene_list[i]);
+    return scene_writer_->close();
+}
+
+WithError<std::shared_ptr<SceneWriter>> CommandRunner::_create_scene_writer() const {
+    if (cfg_.no_output_file)
+        return SceneWriter::initialize_scene_writer(std::nullopt, cfg_.scene_format);
+    const std::filesystem::path output_path = cfg_.output_dir / (cfg_.filenames.at("list-scenes") + "." +
+                                                                  SceneWriter::get_extension(cfg_.scene_format));
+    return SceneWriter::initialize_scene_writer(output_path, cfg_.scene_format);
+}
+
+void CommandRunner::_prepare_aggregators(SceneManager& scene_manager) {
+    if (cfg_.detector_type == DetectorType::MOTION) {
+        std::cout << "Warning: --scene_stats needs decoded frames and is ignored with the motion detector." << std::endl;
+        return;
+    }
+
+    if (cfg_.load_scores.has_value()) {
+        std::cout << "Warning: --scene_stats needs decoded frames and is ignored with --load_scores." << std::endl;
+        return;
+    }
+
+    /* the scenes closed before a checkpoint are not seen again */
+    if (cfg_.checkpoint.has_value()) {
+        std::cout << "Warning: --scene_stats needs all decoded frames and is ignored with --checkpoint." << std::endl;
+        return;
+    }
+
+    motion_aggregator_ = std::make_shared<MotionAggregator>();
+    scene_aggregators_ = { std::make_shared<ColorAggregator>(), motion_aggregator_ };
+    for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_)
+        scene_manager.add_scene_aggregator(aggregator);
+}
+
+WithError<void> CommandRunner::_write_scene_stats(const std::vector<FrameTimeCodePair>& scene_list) const {
+    /* e.g., a cached detection does not decode the frames */
+    for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_) {
+        if (aggregator->get_scene_values().size() != scene_list.size()) {
+            std::cout << "Warning: the scene statistics were not computed for all the scenes and are not written." << std::endl;
+            return WithError<void> { Error(ErrorCode::Success, "") };
+        }
+    }
+
+    const std::filesystem::path output_path = cfg_.output_dir / (cfg_.filenames.at("list-scenes") + "-stats.csv");
+    std::ofstream file;
+    if (!cfg_.no_output_file) {
+        file.open(output_path);
+        if (!file.is_open()) {
+            const std::string error_msg = "Failed to open the scene statistics for writing: " + output_path.string();
+            return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+    }
+    std::ostream& stream = cfg_.no_output_file ? std::cout : file;
+
+    stream << "scene_number,start_frame,end_frame";
+    for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_) {
+        for (const std::string& column : aggregator->get_columns())
+            stream << ',' << column;
+    }
+    stream << '\n';
+
+    for (size_t i = 0; i < scene_list.size(); i++) {
+        const int32_t start_frame_num = std::get<0>(scene_list[i]).get_frame_num();
+        stream << i << ',' << (i == 0 ? start_frame_num : start_frame_num + 1) << ',' << std::get<1>(scene_list[i]).get_frame_num();
+        for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_) {
+            for (const std::string& value : aggregator->get_scene_values()[i])
+                stream << ',' << value;
+        }
+        stream << '\n';
+    }
+
+    stream.flush();
+    if (stream.fail()) {
+        const std::string error_msg = "Failed to write the scene statistics: " + output_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<SceneHash>> CommandRunner::_get_scene_hashes(const std::vector<FrameTimeCodePair>& scene_list) const {
+    if (!motion_aggregator_ || motion_aggregator_->get_keyframes().size() != scene_list.size()) {
+        const std::string error_msg = "The keyframes of the scenes were not hashed while detecting.";
+        return WithError<std::vector<SceneHash>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    std::vector<SceneHash> scene_hashes;
+    const std::vector<std::optional<std::pair<int32_t, uint64_t>>>& keyframes = motion_aggregator_->get_keyframes();
+    for (size_t i = 0; i < keyframes.size(); i++) {
+        if (keyframes[i].has_value())
+            scene_hashes.push_back(SceneHash { static_cast<int32_t>(i), keyframes[i].value().first, keyframes[i].value().second });
+    }
+    return WithError<std::vector<SceneHash>> { scene_hashes, Error(ErrorCode::Success, "") };
+}
+
+WithError<void> CommandRunner::_index_hashes(const std::vector<SceneHash>& scene_hashes) const {
+    /* the same file added from another directory replaces its scenes */
+    const std::string video_name = std::filesystem::absolute(cfg_.input_path).lexically_normal().string();
+    WithError<void> err = add_to_hash_index(cfg_.hash_index.value(), video_name, scene_hashes);
+    if (err.has_error())
+        return err;
+    std::cout << "Indexed " << scene_hashes.size() << " scenes: " << cfg_.hash_index.value().string() << std::endl;
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> CommandRunner::_find_duplicates(const std::vector<SceneHash>& scene_hashes) const {
+    /* find-duplicates alone needs an existing index, but a video indexed first has an empty one */
+    if (!std::filesystem::exists(cfg_.hash_index.value())) {
+        std::cout << "No scene has been indexed yet: " << cfg_.hash_index.value().string() << std::endl;
+        return WithError<void> { Error(ErrorCode::Success, "") };
+    }
+
+    WithError<std::shared_ptr<HashIndex>> opt_hash_index = HashIndex::initialize_hash_index(cfg_.hash_index.value());
+    if (opt_hash_index.has_error())
+        return WithError<void> { opt_hash_index.error };
+    const HashIndex& hash_index = *opt_hash_index.value();
+
+    const std::filesystem::path output_path = cfg_.output_dir / (cfg_.filenames.at("find-duplicates") + ".csv");
+    std::ofstream file(output_path);
+    if (!file.is_open()) {
+        const std::string error_msg = "Failed to open " + output_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const std::string video_name = std::filesystem::absolute(cfg_.input_path).lexically_normal().string();
+    size_t num_duplicates = 0;
+    file << "scene_number,keyframe,duplicate_video,duplicate_scene_number,duplicate_keyframe,distance\n";
+    for (const SceneHash& scene_hash : scene_hashes) {
+        for (const HashMatch& match : hash_index.query(scene_hash.hash, cfg_.max_distance)) {
+            const HashIndexEntry& entry = hash_index.get_entry(match.entry_id);
+            const std::string duplicate_video = hash_index.get_video_name(entry.video_id);
+            if (duplicate_video == video_name)
+                continue;
+            file << scene_hash.scene_number << ',' << scene_hash.keyframe << ",\"" << duplicate_video << "\"," << entry.scene_number
+                 << ',' << entry.keyframe << ',' << match.distance << '\n';
+            num_duplicates++;
+        }
+    }
+
+    file.close();
+    if (file.fail()) {
+        const std::string error_msg = "Failed to write " + output_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    std::cout << "Found " << num_duplicates << " near-duplicate scenes in " << hash_index.get_num_videos()
+              << " indexed videos: " << output_path.string() << std::endl;
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> CommandRunner::_index_scenes(const VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list) const {
+    /* the same key as the scene cache, so that a video detected again with the same parameters is not appended */
+    const std::shared_ptr<BaseDetector> detector = _select_detector(initialize_parameters(cfg_));
+    WithError<std::string> opt_key = SceneCache::create_key(video, *detector);
+    if (opt_key.has_error())
+        return WithError<void> { opt_key.error };
+
+    /* a followed recording ends at its last scene rather than at the length it had when opened */
+    int32_t start_frame = video.get_start().get_frame_num();
+    int32_t end_frame = video.get_end().get_frame_num();
+    std::vector<int32_t> cuts;
+    if (!scene_list.empty()) {
+        start_frame = std::get<0>(scene_list.front()).get_frame_num();
+        end_frame = std::get<1>(scene_list.back()).get_frame_num();
+        for (size_t i = 1; i < scene_list.size(); i++)
+            cuts.push_back(std::get<0>(scene_list[i]).get_frame_num());
+    }
+
+    const std::string video_name = std::filesystem::absolute(cfg_.input_path).lexically_normal().string();
+    WithError<bool> opt_appended = append_to_scene_index(cfg_.scene_index.value(), video_name, opt_key.value(),
+                                                         video.get_framerate(), start_frame, end_frame, cuts);
+    if (opt_appended.has_error())
+        return WithError<void> { opt_appended.error };
+    if (opt_appended.value())
+        std::cout << "Indexed " << cuts.size() << " cuts: " << cfg_.scene_index.value().string() << std::endl;
     else
-        return _save_images(video);
+        std::cout << "Already indexed with the same parameters: " << cfg_.scene_index.value().string() << std::endl;
+    return WithError<void> { Error(ErrorCode::Success, "") };
 }
 
-WithError<void> CommandRunner::_list_scenes() const {
-    const CSVWriter csv_writer = CSVWriter(cfg_.output_dir, cfg_.filename, cfg_.no_output_file);
-    return csv_writer.list_scenes(scene_list_);
+WithError<void> CommandRunner::_split_video(const std::vector<FrameTimeCodePair>& scene_list) const {
+    if (cfg_.copy)
+        return _split_video_copy(scene_list);
+
+    if (cfg_.smart) {
+        const SmartSplitter smart_splitter = SmartSplitter(cfg_.output_dir, cfg_.filenames.at("split-video"), cfg_.crf, cfg_.preset);
+        return smart_splitter.split_video(cfg_.input_path, scene_list);
+    }
+
+    if (cfg_.decode_once) {
+        TranscodeSplitter transcode_splitter = TranscodeSplitter(cfg_.output_dir, cfg_.filenames.at("split-video"), cfg_.crf, cfg_.preset);
+        return transcode_splitter.split_video(cfg_.input_path, scene_list);
+    }
+
+    const VideoSplitter video_splitter = VideoSplitter(cfg_.output_dir, cfg_.filenames.at("split-video"), cfg_.crf, cfg_.preset, cfg_.ffmpeg_args);
+    return video_splitter.split_video(cfg_.input_path, scene_list);
 }
 
-WithError<void> CommandRunner::_split_video() const {
-    const std::string ffmpeg_args = cfg_.copy ? "-map 0:v:0 -map 0:a? -map 0:s? -c:v copy -c:a copy" : cfg_.ffmpeg_args;
-    const VideoSplitter video_splitter = VideoSplitter(cfg_.output_dir, cfg_.filename, cfg_.crf, cfg_.preset, ffmpeg_args);
-    video_splitter.split_video(cfg_.input_path, scene_list_);
+WithError<void> CommandRunner::_split_video_copy(const std::vector<FrameTimeCodePair>& scene_list) const {
+    StreamCopySplitter stream_copy_splitter = StreamCopySplitter(cfg_.output_dir, cfg_.filenames.at("split-video"));
+    WithError<std::vector<FrameTimeCodePair>> opt_split_list = stream_copy_splitter.split_video(cfg_.input_path, scene_list);
+    if (opt_split_list.has_error())
+        return WithError<void> { opt_split_list.error };
+
+    /* cuts can only be made at keyframes, so report where they actually are */
+    const std::vector<FrameTimeCodePair> split_list = opt_split_list.value();
+    size_t split_i = 0;
+    for (size_t scene_i = 0; scene_i < scene_list.size(); scene_i++) {
+        /* a file belongs to the last scene starting at or before its first keyframe */
+        const FrameTimeCode& start = std::get<0>(scene_list[scene_i]);
+        const int32_t next_start = scene_i + 1 < scene_list.size() ? std::get<0>(scene_list[scene_i + 1]).get_frame_num()
+                                                                   : std::numeric_limits<int32_t>::max();
+        const bool has_file = split_i < split_list.size() && std::get<0>(split_list[split_i]).get_frame_num() < next_start;
+        if (!has_file) {
+            std::cout << "Scene " << scene_i << " (" << start.to_string() << ") has no keyframe and is merged into the previous file." << std::endl;
+            continue;
+        }
+        const FrameTimeCode& actual_start = std::get<0>(split_list[split_i++]);
+        if (actual_start != start)
+            std::cout << "Scene " << scene_i << " starts at keyframe " << actual_start.to_string()
+                      << " instead of " << start.to_string() << "." << std::endl;
+    }
     return WithError<void> { Error(ErrorCode::Success, "") };
 }
 
-WithError<void> CommandRunner::_save_images(VideoStream& video) const {
-    const ImageExtractor image_extractor = ImageExtractor(cfg_.output_dir, cfg_.filename,
-                                                          cfg_.num_images, cfg_.frame_margin,
-                                                          cfg_.format, cfg_.quality, cfg_.width,
-                                                          cfg_.height, cfg_.scale);
-    return image_extractor.save_images(video, scene_list_);
-}
\ No newline at end of file
+WithError<void> CommandRunner::_save_images(VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list) {
+    if (image_collector_)
+        return image_collector_->finish(scene_list);
+
+    const ImageExtractor image_extractor = _create_image_extractor();
+    return image_extractor.save_images(video, scene_list);
+}
+
+WithError<void> CommandRunner::_sweep(const VideoStream& video) const {
+    /* the config makes sure that the scores were saved by this run or are loaded */
+    const std::filesystem::path score_path = cfg_.load_scores.has_value() ? cfg_.load_scores.value() : cfg_.save_scores.value();
+    WithError<std::shared_ptr<ScoreReader>> opt_score_reader = ScoreReader::initialize_score_reader(score_path);
+    if (opt_score_reader.has_error())
+        return WithError<void> { opt_score_reader.error };
+
+    std::optional<std::vector<int32_t>> ground_truth = std::nullopt;
+    if (cfg_.ground_truth.has_value()) {
+        WithError<std::vector<int32_t>> opt_ground_truth = ParameterSweep::load_ground_truth(cfg_.ground_truth.value(), video.get_framerate());
+        if (opt_ground_truth.has_error())
+            return WithError<void> { opt_ground_truth.error };
+        ground_truth = opt_ground_truth.value();
+    }
+
+    const ParameterSweep parameter_sweep = ParameterSweep(cfg_.output_dir, cfg_.filenames.at("sweep"), ground_truth, cfg_.tolerance);
+    return parameter_sweep.sweep(*opt_score_reader.value(), video, initialize_sweep_parameters(cfg_));
+}
+
+ImageExtractor CommandRunner::_create_image_extractor() const {
+    return ImageExtractor(cfg_.output_dir, cfg_.filenames.at("save-images"), cfg_.num_images, cfg_.frame_margin,
+                          cfg_.format, cfg_.quality, cfg_.compression, cfg_.width, cfg_.height, cfg_.scale, cfg_.readers);
+}
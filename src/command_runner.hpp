@@ -7,23 +7,46 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <memory>
 
 class VideoStream;
+class SceneManager;
+class ImageExtractor;
+class ImageCollector;
+class SceneWriter;
+class SceneAggregator;
+class MotionAggregator;
+struct SceneHash;
 template <typename T> struct WithError;
 struct Config;
 
 class CommandRunner {
     public:
-        explicit CommandRunner(const Config& cfg, const std::vector<FrameTimeCodePair>& scene_list);
-        WithError<void> execute(VideoStream& video) const;
+        explicit CommandRunner(const Config& cfg);
+        void prepare(SceneManager& scene_manager, const VideoStream& video);
+        WithError<void> execute(VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list);
 
     private:
-        WithError<void> _list_scenes() const;
-        WithError<void> _split_video() const;
-        WithError<void> _save_images(VideoStream& video) const;
+        bool _has_command(const std::string& command) const;
+        WithError<void> _list_scenes(const std::vector<FrameTimeCodePair>& scene_list);
+        WithError<std::shared_ptr<SceneWriter>> _create_scene_writer() const;
+        void _prepare_aggregators(SceneManager& scene_manager);
+        WithError<void> _write_scene_stats(const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<std::vector<SceneHash>> _get_scene_hashes(const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> _index_hashes(const std::vector<SceneHash>& scene_hashes) const;
+        WithError<void> _find_duplicates(const std::vector<SceneHash>& scene_hashes) const;
+        WithError<void> _index_scenes(const VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> _split_video(const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> _split_video_copy(const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> _save_images(VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list);
+        WithError<void> _sweep(const VideoStream& video) const;
+        ImageExtractor _create_image_extractor() const;
 
         const Config cfg_;
-        const std::vector<FrameTimeCodePair> scene_list_;
+        std::shared_ptr<ImageCollector> image_collector_ = nullptr;
+        std::shared_ptr<SceneWriter> scene_writer_ = nullptr;
+        std::vector<std::shared_ptr<SceneAggregator>> scene_aggregators_;
+        std::shared_ptr<MotionAggregator> motion_aggregator_ = nullptr;
 };
 
 #endif
@@ -6,8 +6,13 @@
 #include "parameters.hpp"
 
 #include <regex>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
 
-std::shared_ptr<BaseDetector> _select_detector(const DetectorParameters& params) {
+constexpr size_t MAX_SWEEP_VALUES = 1000;
+
+static std::shared_ptr<BaseDetector> _initialize_detector(const DetectorParameters& params) {
     switch (params.detector_type) {
         case DetectorType::CONTENT:
             return ContentDetector::initialize_detector(params.threshold, params.min_scene_len);
@@ -24,14 +29,22 @@ std::shared_ptr<BaseDetector> _select_detector(const DetectorParameters& params)
             return AdaptiveDetector::initialize_detector(params.threshold, params.min_scene_len,
                                                          params.adaptive_params.window_width,
                                                          params.adaptive_params.min_content_val);
+        case DetectorType::MOTION:
+            return MotionVectorDetector::initialize_detector(params.threshold, params.min_scene_len);
         default:
             return ContentDetector::initialize_detector();
     }
 }
 
-std::string _interpret_filename(const std::filesystem::path& input_path,
+std::shared_ptr<BaseDetector> _select_detector(const DetectorParameters& params) {
+    std::shared_ptr<BaseDetector> detector = _initialize_detector(params);
+    if (params.max_latency.has_value())
+        detector->set_max_latency(params.max_latency.value());
+    return detector;
+}
+
+std::string _interpret_filename(const std::filesystem::path& input_path, const std::string& command,
                                 const argparse::ArgumentParser& program) {
-    const std::string command = program.get<std::string>("--command");
     const std::string input_filename = input_path.stem().string();
     const std::optional<std::string> output_filename = program.present<std::string>("--filename");
 
@@ -44,11 +57,72 @@ std::string _interpret_filename(const std::filesystem::path& input_path,
             return input_filename + "-scenes";
         else if (command == "split-video")
             return input_filename + "-scene-@SCENE_NUMBER";
+        else if (command == "sweep")
+            return input_filename + "-sweep";
+        else if (command == "shard")
+            return input_filename + "-shard-@START";
+        else if (command == "merge")
+            return input_filename + "-merged";
+        else if (command == "index-hashes")
+            return input_filename + "-hashes";
+        else if (command == "find-duplicates")
+            return input_filename + "-duplicates";
+        else if (command == "index-scenes")
+            return input_filename + "-index";
         else
             return input_filename + "-scene-@SCENE_NUMBER-@IMAGE_NUMBER";
     }
 }
 
+template <typename T>
+WithError<std::vector<T>> _parse_sweep_range(const argparse::ArgumentParser& program, const std::string& option, const T value) {
+    /* START:STOP:STEP (STOP included) or comma separated values. Unset ranges are the single value of the detector. */
+    const std::optional<std::string> opt_range = program.present<std::string>(option);
+    if (!opt_range.has_value())
+        return WithError<std::vector<T>> { std::vector<T>{ value }, Error(ErrorCode::Success, "") };
+
+    const std::string range = opt_range.value();
+    const char separator = range.find(':') != std::string::npos ? ':' : ',';
+    std::vector<double> numbers;
+    for (size_t begin = 0; begin <= range.size();) {
+        const size_t end = std::min(range.find(separator, begin), range.size());
+        double number = 0.0;
+        const auto [ptr, ec] = std::from_chars(range.data() + begin, range.data() + end, number);
+        if (ec != std::errc() || ptr != range.data() + end) {
+            const std::string error_msg = option + " should be START:STOP:STEP or comma separated values, but got " + range;
+            return WithError<std::vector<T>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        numbers.push_back(number);
+        begin = end + 1;
+    }
+
+    if (separator == ':') {
+        if (numbers.size() != 3 || numbers[2] <= 0.0 || numbers[1] < numbers[0]) {
+            const std::string error_msg = option + " should be START:STOP:STEP with START <= STOP and STEP > 0.";
+            return WithError<std::vector<T>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        /* computed from the index so that rounding errors do not accumulate or drop STOP */
+        const double start = numbers[0];
+        const double step = numbers[2];
+        const size_t num_steps = static_cast<size_t>(std::floor((numbers[1] - start) / step + 1e-6));
+        numbers.clear();
+        for (size_t i = 0; i <= num_steps && i < MAX_SWEEP_VALUES; i++)
+            numbers.push_back(start + i * step);
+    }
+
+    std::vector<T> values;
+    for (const double number : numbers) {
+        if (number < 0.0) {
+            const std::string error_msg = option + " should not contain negative values.";
+            return WithError<std::vector<T>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        values.push_back(static_cast<T>(std::is_integral_v<T> ? std::round(number) : number));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return WithError<std::vector<T>> { values, Error(ErrorCode::Success, "") };
+}
+
 DetectorType _convert_name_to_type(const std::string& detector_name) {
     const std::unordered_map<std::string, DetectorType> detector_map = {
         {"adaptive", DetectorType::ADAPTIVE},
@@ -56,6 +130,7 @@ DetectorType _convert_name_to_type(const std::string& detector_name) {
         {"content", DetectorType::CONTENT},
         {"histogram", DetectorType::HISTOGRAM},
         {"threshold", DetectorType::THRESHOLD},
+        {"motion", DetectorType::MOTION},
     };
 
     auto it = detector_map.find(detector_name);
@@ -65,6 +140,20 @@ DetectorType _convert_name_to_type(const std::string& detector_name) {
         return DetectorType::OTHER;
 }
 
+std::optional<SceneFormat> _convert_name_to_scene_format(const std::string& format_name) {
+    const std::unordered_map<std::string, SceneFormat> format_map = {
+        {"csv", SceneFormat::CSV},
+        {"ndjson", SceneFormat::NDJSON},
+        {"binary", SceneFormat::BINARY},
+    };
+
+    auto it = format_map.find(format_name);
+    if (it != format_map.end())
+        return it->second;
+    else
+        return std::nullopt;
+}
+
 float _get_default_threshold(const DetectorType& detector_type) {
     switch (detector_type) {
         case DetectorType::CONTENT:
@@ -77,6 +166,8 @@ float _get_default_threshold(const DetectorType& detector_type) {
             return 12.0f;
         case DetectorType::ADAPTIVE:
             return 3.0f;
+        case DetectorType::MOTION:
+            return 0.5f;
         default:
             return 27.0f; /* content detector */
     }
@@ -86,14 +177,23 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
     /* mandatory commands */
     const std::filesystem::path input_path(program.get<std::string>("--input"));
     const std::filesystem::path output_dir(program.get<std::string>("--output"));
-    const std::string command = program.get<std::string>("--command");
-    const std::string filename = _interpret_filename(input_path, program);
+    const std::vector<std::string> commands = program.get<std::vector<std::string>>("--command");
+    std::map<std::string, std::string> filenames;
+    for (const std::string& command : commands)
+        filenames[command] = _interpret_filename(input_path, command, program);
+    auto has_command = [&commands](const std::string& command) {
+        return std::find(commands.begin(), commands.end(), command) != commands.end();
+    };
 
     /* list-scenes */
     const bool no_output_file = program.get<bool>("--no_output_file");
+    const std::string scene_format_name = program.get<std::string>("--scene_format");
+    const bool scene_stats = program.get<bool>("--scene_stats");
     
     /* split-video */
     const bool copy = program.get<bool>("--copy");
+    const bool smart = program.get<bool>("--smart");
+    const bool decode_once = program.get<bool>("--decode_once");
     const int32_t crf = program.get<int32_t>("--crf");
     const std::string preset = program.get<std::string>("--preset");
     const std::string ffmpeg_args = program.get<std::string>("--ffmpeg_args");
@@ -102,21 +202,37 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
     const int32_t num_images = program.get<int32_t>("--num_images");
     const std::string format = program.get<std::string>("--format");
     const int32_t quality = program.get<int32_t>("--quality");
+    const int32_t compression = program.get<int32_t>("--compression");
     const int32_t frame_margin = program.get<int32_t>("--frame_margin");
     
     const std::optional<float> scale = program.present<float>("--scale");
     const std::optional<int32_t> height = program.present<int32_t>("--height");
     const std::optional<int32_t> width = program.present<int32_t>("--width");
+    const bool single_pass = program.get<bool>("--single_pass");
+    const int32_t readers = program.get<int32_t>("--readers");
 
     /* timecode */
     const std::optional<std::string> start = program.present<std::string>("--start");
     const std::optional<std::string> end = program.present<std::string>("--end");
     const std::optional<std::string> duration = program.present<std::string>("--duration");
+    const std::vector<std::string> range_names = program.get<std::vector<std::string>>("--range");
+    const std::optional<std::string> range_file = program.present<std::string>("--range_file");
 
     /* detector common */
     const std::string detector_name = program.get<std::string>("--detector");
     const std::optional<float> opt_threshold = program.present<float>("--threshold");
     const int32_t min_scene_len = program.get<int32_t>("--min_scene_len");
+    std::optional<std::filesystem::path> save_scores = program.present<std::string>("--save_scores");
+    std::optional<std::filesystem::path> load_scores = program.present<std::string>("--load_scores");
+    const std::optional<std::string> cache_dir = program.present<std::string>("--cache_dir");
+    const std::optional<std::string> checkpoint = program.present<std::string>("--checkpoint");
+    const int32_t checkpoint_interval = program.get<int32_t>("--checkpoint_interval");
+    const bool follow = program.get<bool>("--follow");
+    const float follow_timeout = program.get<float>("--follow_timeout");
+    const bool live = program.get<bool>("--live");
+    const std::optional<int32_t> max_latency = program.present<int32_t>("--max_latency");
+    const std::optional<std::string> event_ring = program.present<std::string>("--event_ring");
+    const int32_t event_ring_size = program.get<int32_t>("--event_ring_size");
     
     /* adaptive detector */
     const int32_t window_width = program.get<int32_t>("--window_width");
@@ -132,9 +248,39 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
     /* threshold detector */
     const float fade_bias = program.get<float>("--fade_bias");
 
+    /* sweep */
+    const std::optional<std::string> ground_truth = program.present<std::string>("--ground_truth");
+    const int32_t tolerance = program.get<int32_t>("--tolerance");
+
+    /* merge */
+    const std::vector<std::string> shard_names = program.get<std::vector<std::string>>("--shards");
+    const std::vector<std::filesystem::path> shards(shard_names.begin(), shard_names.end());
+
+    /* index-hashes, find-duplicates */
+    const std::optional<std::string> hash_index = program.present<std::string>("--hash_index");
+    const int32_t max_distance = program.get<int32_t>("--max_distance");
+
+    /* index-scenes */
+    const std::optional<std::string> scene_index = program.present<std::string>("--scene_index");
+
     /* validate arguments */
-    if (!(command == "list-scenes" || command == "split-video" || command == "save-images")) {
-        std::string error_msg = "--command should be list-scenes, split-video, or save-images.";
+    for (const std::string& command : commands) {
+        if (!(command == "list-scenes" || command == "split-video" || command == "save-images" || command == "sweep" ||
+              command == "shard" || command == "merge" || command == "index-hashes" || command == "find-duplicates" ||
+              command == "index-scenes")) {
+            std::string error_msg = "--command should be list-scenes, split-video, save-images, sweep, shard, merge, "
+                                    "index-hashes, find-duplicates, or index-scenes.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    if (filenames.size() != commands.size()) {
+        std::string error_msg = "--command should not contain the same command twice.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (copy + smart + decode_once > 1) {
+        std::string error_msg = "Only one of --copy, --smart, and --decode_once can be set.";
         return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
     }
 
@@ -168,8 +314,8 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
     }
 
     if (format == "png") {
-        if (quality < 0 || quality > 9) {
-            std::string error_msg = "--quality should be 0 < quality < 9 for png.";
+        if (compression < 0 || compression > 9) {
+            std::string error_msg = "--compression should be 0 < compression < 9 for png.";
             return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
         }
     }
@@ -179,14 +325,206 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
         return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
     }
 
+    if (readers < 0) {
+        std::string error_msg = "--readers should be 0 <= readers.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    std::vector<TimeRange> ranges;
+    for (const std::string& range_name : range_names) {
+        WithError<TimeRange> opt_range = RangeDetector::parse_range(range_name);
+        if (opt_range.has_error())
+            return WithError<Config> { std::nullopt, opt_range.error };
+        ranges.push_back(opt_range.value());
+    }
+
+    if (range_file.has_value()) {
+        WithError<std::vector<TimeRange>> opt_ranges = RangeDetector::load_ranges(range_file.value());
+        if (opt_ranges.has_error())
+            return WithError<Config> { std::nullopt, opt_ranges.error };
+        for (const TimeRange& range : opt_ranges.value())
+            ranges.push_back(range);
+        if (ranges.empty()) {
+            const std::string error_msg = "No range in " + range_file.value();
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    /* each range is detected by its own detector, which the options saving or resuming one detection do not support */
+    if (!ranges.empty() && (start.has_value() || end.has_value() || duration.has_value() || save_scores.has_value() ||
+                            load_scores.has_value() || checkpoint.has_value() || follow || live || event_ring.has_value() ||
+                            has_command("sweep") ||
+                            has_command("shard") || has_command("merge"))) {
+        std::string error_msg = "--range cannot be used with --start, --end, --duration, --save_scores, --load_scores, "
+                                "--checkpoint, --follow, --live, --event_ring, sweep, shard, or merge.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (save_scores.has_value() && load_scores.has_value()) {
+        std::string error_msg = "Only one of --save_scores and --load_scores can be set.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (load_scores.has_value() && !std::filesystem::exists(load_scores.value())) {
+        const std::string error_msg = "No such file: " + load_scores.value().string();
+        return WithError<Config> { std::nullopt, Error(ErrorCode::NoSuchFile, error_msg) };
+    }
+
+    /* a shard saves the scores of its range, and merge replays the scores of all shards like --load_scores */
+    if (has_command("shard") || has_command("merge")) {
+        if (has_command("shard") && has_command("merge")) {
+            std::string error_msg = "Only one of shard and merge can be run at once.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        if (save_scores.has_value() || load_scores.has_value()) {
+            std::string error_msg = "shard and merge cannot be used with --save_scores and --load_scores.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    if (has_command("shard")) {
+        std::string start_name = start.value_or("00:00:00");
+        std::replace(start_name.begin(), start_name.end(), ':', '-');
+        const std::string shard_filename = std::regex_replace(filenames.at("shard"), std::regex("@START"), start_name);
+        save_scores = output_dir / (shard_filename + ".bin");
+    }
+
+    if (has_command("merge")) {
+        if (shards.empty()) {
+            std::string error_msg = "merge needs the files saved by shard in --shards.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        for (const std::filesystem::path& shard : shards) {
+            if (!std::filesystem::exists(shard)) {
+                const std::string error_msg = "No such file: " + shard.string();
+                return WithError<Config> { std::nullopt, Error(ErrorCode::NoSuchFile, error_msg) };
+            }
+        }
+        load_scores = output_dir / (filenames.at("merge") + ".bin");
+    }
+
+    /* sweep replays saved scores, which are kept next to the report for later sweeps */
+    if (has_command("sweep") && !save_scores.has_value() && !load_scores.has_value())
+        save_scores = output_dir / (input_path.stem().string() + "-scores.bin");
+
+    if (checkpoint.has_value() && load_scores.has_value()) {
+        std::string error_msg = "--checkpoint cannot be used with --load_scores, which does not decode the video.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (checkpoint_interval <= 0) {
+        std::string error_msg = "--checkpoint_interval should be 0 < checkpoint_interval.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* the end of a growing file is not known in advance */
+    if (follow && (end.has_value() || duration.has_value() || save_scores.has_value() || load_scores.has_value())) {
+        std::string error_msg = "--follow cannot be used with --end, --duration, --save_scores, --load_scores, or sweep.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (follow_timeout <= 0.0f) {
+        std::string error_msg = "--follow_timeout should be 0 < follow_timeout.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* cuts are reported while frames are decoded */
+    if (live && load_scores.has_value()) {
+        std::string error_msg = "--live cannot be used with --load_scores, sweep, or merge, which do not decode the video.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (max_latency.has_value() && max_latency.value() < 0) {
+        std::string error_msg = "--max_latency should be 0 <= max_latency.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* slots are indexed by masking the event number */
+    if (event_ring_size < 2 || (event_ring_size & (event_ring_size - 1)) != 0) {
+        std::string error_msg = "--event_ring_size should be a power of two >= 2.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (ground_truth.has_value() && !std::filesystem::exists(ground_truth.value())) {
+        const std::string error_msg = "No such file: " + ground_truth.value();
+        return WithError<Config> { std::nullopt, Error(ErrorCode::NoSuchFile, error_msg) };
+    }
+
+    if (tolerance < 0) {
+        std::string error_msg = "--tolerance should be 0 <= tolerance.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
     const DetectorType detector_type = _convert_name_to_type(detector_name);
     if (detector_type == DetectorType::OTHER) {
-        std::string error_msg = "Unsupported --detector type. Choose one from [adaptive, content, hash, histogram, threshold].";
+        std::string error_msg = "Unsupported --detector type. Choose one from [adaptive, content, hash, histogram, motion, threshold].";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    const std::optional<SceneFormat> scene_format = _convert_name_to_scene_format(scene_format_name);
+    if (!scene_format.has_value()) {
+        std::string error_msg = "Unsupported --scene_format. Choose one from [csv, ndjson, binary].";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* the keyframes are hashed from the frames decoded for the detector, from the start of the video */
+    const bool has_hash_command = has_command("index-hashes") || has_command("find-duplicates");
+    if (has_hash_command) {
+        if (!hash_index.has_value()) {
+            std::string error_msg = "index-hashes and find-duplicates need --hash_index.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        if (!ranges.empty() || load_scores.has_value() || checkpoint.has_value() || detector_type == DetectorType::MOTION) {
+            std::string error_msg = "index-hashes and find-duplicates cannot be used with --range, --load_scores, --checkpoint, "
+                                    "merge, or the motion detector, which do not decode every frame.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    if (has_command("find-duplicates") && !has_command("index-hashes") &&
+        !std::filesystem::exists(hash_index.value())) {
+        const std::string error_msg = "No such file: " + hash_index.value();
+        return WithError<Config> { std::nullopt, Error(ErrorCode::NoSuchFile, error_msg) };
+    }
+
+    if (max_distance < 0 || max_distance > 32) {
+        std::string error_msg = "--max_distance should be 0 <= max_distance <= 32.";
+        return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* a record covers one range of the video, from its first to its last scene */
+    if (has_command("index-scenes")) {
+        if (!scene_index.has_value()) {
+            std::string error_msg = "index-scenes needs --scene_index.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        if (!ranges.empty()) {
+            std::string error_msg = "index-scenes cannot be used with --range.";
+            return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    /* the scores of the motion detector depend on every keyframe since the start of the stream */
+    if (has_command("shard") && detector_type == DetectorType::MOTION) {
+        std::string error_msg = "shard is not supported by the motion detector.";
         return WithError<Config> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
     }
 
     const float threshold = opt_threshold.has_value() ? opt_threshold.value() : _get_default_threshold(detector_type);
 
+    const WithError<std::vector<float>> sweep_thresholds = _parse_sweep_range(program, "--sweep_threshold", threshold);
+    const WithError<std::vector<int32_t>> sweep_min_scene_lens = _parse_sweep_range(program, "--sweep_min_scene_len", min_scene_len);
+    const WithError<std::vector<int32_t>> sweep_window_widths = _parse_sweep_range(program, "--sweep_window_width", window_width);
+    const WithError<std::vector<float>> sweep_min_content_vals = _parse_sweep_range(program, "--sweep_min_content_val", min_content_val);
+    if (sweep_thresholds.has_error())
+        return WithError<Config> { std::nullopt, sweep_thresholds.error };
+    if (sweep_min_scene_lens.has_error())
+        return WithError<Config> { std::nullopt, sweep_min_scene_lens.error };
+    if (sweep_window_widths.has_error())
+        return WithError<Config> { std::nullopt, sweep_window_widths.error };
+    if (sweep_min_content_vals.has_error())
+        return WithError<Config> { std::nullopt, sweep_min_content_vals.error };
+
     /* If width, height, and scale is set (save-images), resized_size is calculated. */
     if (!std::filesystem::exists(input_path)) {
         const std::string error_msg = "No such file: " + input_path.string();
@@ -194,33 +532,86 @@ WithError<Config> _construct_config(argparse::ArgumentParser& program) {
     }
 
     const Config config = { .input_path = input_path,         .output_dir = output_dir,
-                            .command = command,               .filename = filename,
-                            .no_output_file = no_output_file, .copy = copy,
+                            .commands = commands,             .filenames = filenames,
+                            .no_output_file = no_output_file, .scene_format = scene_format.value(),
+                            .scene_stats = scene_stats,
+                            .copy = copy,
+                            .smart = smart,                   .decode_once = decode_once,
                             .crf = crf,                       .preset = preset,
                             .ffmpeg_args = ffmpeg_args,       .num_images = num_images,
                             .format = format,                 .quality = quality,
+                            .compression = compression,
                             .frame_margin = frame_margin,     .scale = scale,
                             .height = height,                 .width = width,
+                            .single_pass = single_pass,       .readers = readers,
                             .start = start,                   .end = end,
-                            .duration = duration,             .detector_type = detector_type,
+                            .duration = duration,             .ranges = ranges,
+                            .detector_type = detector_type,
                             .threshold = threshold,           .min_scene_len = min_scene_len,
+                            .save_scores = save_scores,       .load_scores = load_scores,
+                            .cache_dir = cache_dir,           .checkpoint = checkpoint,
+                            .checkpoint_interval = checkpoint_interval,
+                            .follow = follow,                 .follow_timeout = follow_timeout,
+                            .live = live,                     .max_latency = max_latency,
+                            .event_ring = event_ring,         .event_ring_size = static_cast<uint32_t>(event_ring_size),
                             .window_width = window_width,     .min_content_val = min_content_val,
                             .dct_size = dct_size,             .lowpass = lowpass,
-                            .bins = bins,                     .fade_bias = fade_bias };
+                            .bins = bins,                     .fade_bias = fade_bias,
+                            .sweep_thresholds = sweep_thresholds.value(),
+                            .sweep_min_scene_lens = sweep_min_scene_lens.value(),
+                            .sweep_window_widths = sweep_window_widths.value(),
+                            .sweep_min_content_vals = sweep_min_content_vals.value(),
+                            .ground_truth = ground_truth,     .tolerance = tolerance,
+                            .shards = shards,
+                            .hash_index = hash_index,         .max_distance = max_distance,
+                            .scene_index = scene_index };
 
     return WithError<Config> { config, Error(ErrorCode::Success, "") };
 }
 
 WithError<Config> parse_args(int argc, char *argv[]) {
-    argparse::ArgumentParser program("shutoh", "0.0.1");
+    return parse_args(std::vector<std::string>(argv, argv + argc));
+}
+
+WithError<Config> parse_args(const std::vector<std::string>& args, const bool is_job) {
+    /* --help and --version of a job must not exit the process running it (--batch, --serve) */
+    const argparse::default_arguments default_arguments = is_job ? argparse::default_arguments::none : argparse::default_arguments::all;
+    argparse::ArgumentParser program("shutoh", "0.0.1", default_arguments);
 
     /* Mandatory */ 
     program.add_argument("-i", "--input")
         .help("Input video file.")
         .required();
     
+    program.add_argument("--batch")
+        .help("Manifest of videos to detect in this process instead of --input: one path or NDJSON job per line, "
+              "e.g., {\"input\": \"a.mp4\", \"detector\": \"adaptive\"}. The other options are shared by all jobs.");
+
+    program.add_argument("--batch_workers")
+        .default_value(0)
+        .scan<'d', int>()
+        .help("Number of videos detected at the same time with --batch. 0 means one per two CPU cores.");
+
+    program.add_argument("--serve")
+        .help("Unix socket to serve detection jobs on instead of detecting --input. Each connection sends one NDJSON job "
+              "and receives its progress, cuts, and scenes as NDJSON events. The other options are shared by all jobs.");
+
+    program.add_argument("--serve_workers")
+        .default_value(0)
+        .scan<'d', int>()
+        .help("Number of jobs detected at the same time with --serve. 0 means one per two CPU cores.");
+
+    program.add_argument("--connect")
+        .help("Unix socket of a running --serve process. The other options are sent as a job and its events are printed.");
+
+    program.add_argument("--query")
+        .help("Scene index written by index-scenes to query instead of detecting --input, see shutoh --query INDEX --help.");
+
     program.add_argument("-c", "--command")
-        .help("Command name. choose one from [list-scenes, split-videos, save-images]")
+        .help("Command name. choose one or more from [list-scenes, split-video, save-images, sweep, shard, merge, "
+              "index-hashes, find-duplicates, index-scenes]. "
+              "Scenes are detected once and shared by all of them.")
+        .nargs(argparse::nargs_pattern::at_least_one)
         .required();
 
     program.add_argument("-o", "--output")
@@ -233,7 +624,9 @@ WithError<Config> parse_args(int argc, char *argv[]) {
               "Default value: "
               "$VIDEO_NAME-scenes.csv (list-scenes), "
               "$VIDEO_NAME-scene-$SCENE_NUMBER (split-video), "
-              "$VIDEO_NAME-scene-$SCENE_NUMBER-$IMAGE_NUMBER (save-images).");
+              "$VIDEO_NAME-scene-$SCENE_NUMBER-$IMAGE_NUMBER (save-images), "
+              "$VIDEO_NAME-sweep.csv (sweep), $VIDEO_NAME-shard-$START.bin (shard), $VIDEO_NAME-merged.bin (merge), "
+              "$VIDEO_NAME-duplicates.csv (find-duplicates).");
 
     /* list-scenes */
     program.add_argument("--no_output_file")
@@ -241,12 +634,33 @@ WithError<Config> parse_args(int argc, char *argv[]) {
         .implicit_value(true)
         .help("[list-scenes] Print scene list only.");
 
+    program.add_argument("--scene_format")
+        .default_value(std::string("csv"))
+        .help("[list-scenes] Format of the scene list. Choose from [csv, ndjson, binary]. "
+              "Scenes are written as soon as they are detected.");
+
+    program.add_argument("--scene_stats")
+        .default_value(false)
+        .implicit_value(true)
+        .help("[list-scenes] Also write the mean colour, brightness, motion energy, a representative keyframe with "
+              "its perceptual hash, and black/flash flags of each scene to $FILENAME-stats.csv, computed while detecting.");
+
     /* split-video */
     program.add_argument("--copy")
         .default_value(false)
         .implicit_value(true)
         .help("[split-video] Copy instead of re-encode. Faster but less precise.");
 
+    program.add_argument("--smart")
+        .default_value(false)
+        .implicit_value(true)
+        .help("[split-video] Frame-accurate split which re-encodes only the partial GOPs at the head and tail of each scene.");
+
+    program.add_argument("--decode_once")
+        .default_value(false)
+        .implicit_value(true)
+        .help("[split-video] Decode the video once in-process and encode the scenes with libx264 on all cores.");
+
     program.add_argument("--crf")
         .default_value(22)
         .scan<'d', int>()
@@ -303,6 +717,18 @@ WithError<Config> parse_args(int argc, char *argv[]) {
         .scan<'d', int>()
         .help("[save-images] Height of images.");
 
+    program.add_argument("--readers")
+        .default_value(0)
+        .help("[save-images] Number of video readers extracting images in parallel, also used to detect --range in parallel. "
+              "0 means one per CPU core.")
+        .scan<'i', int32_t>();
+
+    program.add_argument("--single_pass")
+        .default_value(false)
+        .implicit_value(true)
+        .help("[save-images] Collect images while detecting scenes instead of decoding the video twice. "
+              "Images in the middle of long scenes are the nearest retained frames.");
+
     /* timecode */
     program.add_argument("--start")
         .help("Time in video to start detection. Default value reperesents the first frame of the video.");
@@ -312,11 +738,20 @@ WithError<Config> parse_args(int argc, char *argv[]) {
 
     program.add_argument("--duration")
         .help("Maximum time in video to process. Default value represents the whole video length. Ignored if --end is set.");
+
+    program.add_argument("--range")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("Time range START-END to detect, e.g., 00:01:00-00:02:30. Can be repeated to detect several disjoint ranges "
+              "instead of --start and --end, each by its own detector.");
+
+    program.add_argument("--range_file")
+        .help("File with one range START-END per line, such as chapters or ad-break candidates. Lines starting with # are skipped.");
     
     /* detectors' common parameters */
     program.add_argument("--detector")
         .default_value(std::string("content"))
-        .help("Detector type. Choose from [adaptive, content, hash, histogram, threshold].");
+        .help("Detector type. Choose from [adaptive, content, hash, histogram, motion, threshold].");
 
     program.add_argument("--threshold")
         .scan<'g', float>()
@@ -326,6 +761,59 @@ WithError<Config> parse_args(int argc, char *argv[]) {
         .default_value(15)
         .scan<'d', int>()
         .help("Minimum scene length (=#frames) in cuts. Higher values ignore abrupt cuts.");
+
+    program.add_argument("--save_scores")
+        .help("Save the detector's score of every frame to this file. "
+              "Runs with --load_scores can then try other --threshold and --min_scene_len values without decoding the video.");
+
+    program.add_argument("--cache_dir")
+        .help("Directory caching the detected scenes by video fingerprint and detector parameters. "
+              "A video detected before with the same parameters is not decoded again.");
+
+    program.add_argument("--checkpoint")
+        .help("Save the detection state to this file periodically and at the end. "
+              "If the file exists, the detection resumes from it, e.g., after the process was killed.");
+
+    program.add_argument("--checkpoint_interval")
+        .default_value(1000)
+        .scan<'d', int>()
+        .help("Number of frames between checkpoints.");
+
+    program.add_argument("--follow")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Keep detecting the frames appended to the video while it is being recorded, "
+              "until no frame is added for --follow_timeout seconds.");
+
+    program.add_argument("--follow_timeout")
+        .default_value(30.0f)
+        .scan<'g', float>()
+        .help("Seconds without new frames after which a followed video is considered complete.");
+
+    program.add_argument("--live")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Print each cut as soon as the detector decides it, e.g., for a real-time feed with --follow. "
+              "The detector's decision delay must be bounded, see --max_latency.");
+
+    program.add_argument("--max_latency")
+        .scan<'d', int>()
+        .help("Maximum number of frames between a cut and its decision. Detectors merging flashes (content, motion) "
+              "or splitting fades (threshold) then decide without waiting for them to end. "
+              "The adaptive detector always decides --window_width frames after a cut.");
+
+    program.add_argument("--event_ring")
+        .help("Publish the score of each frame and each cut to a POSIX shared-memory ring of this name, e.g., /shutoh, "
+              "which other processes on the host read with EventRingReader (shutoh/event_ring.hpp) while detecting.");
+
+    program.add_argument("--event_ring_size")
+        .default_value(65536)
+        .scan<'d', int>()
+        .help("Number of events kept in the ring (power of two). Consumers falling further behind lose the oldest events.");
+
+    program.add_argument("--load_scores")
+        .help("Detect scenes from the scores saved by --save_scores instead of decoding the video. "
+              "--detector and its score parameters (--dct_size, --lowpass, --bins) must be the same as when saving.");
     
     /* adaptive detector */
     program.add_argument("--window_width")
@@ -361,8 +849,54 @@ WithError<Config> parse_args(int argc, char *argv[]) {
         .scan<'g', float>()
         .help("[ThresholdDetector]: Float between -1.0 and +1.0 that represents the percentage of timecode skew for the start of a scene");
 
+    /* sweep */
+    program.add_argument("--sweep_threshold")
+        .help("[sweep] Values of --threshold to evaluate, as START:STOP:STEP or comma separated values.");
+
+    program.add_argument("--sweep_min_scene_len")
+        .help("[sweep] Values of --min_scene_len to evaluate, as START:STOP:STEP or comma separated values.");
+
+    program.add_argument("--sweep_window_width")
+        .help("[sweep] Values of --window_width to evaluate with the adaptive detector.");
+
+    program.add_argument("--sweep_min_content_val")
+        .help("[sweep] Values of --min_content_val to evaluate with the adaptive detector.");
+
+    program.add_argument("--ground_truth")
+        .help("[sweep] File with one true cut per line, as a frame number or a timecode. "
+              "Adds precision and recall of each combination to the report.");
+
+    program.add_argument("--tolerance")
+        .default_value(1)
+        .scan<'d', int>()
+        .help("[sweep] Maximum distance (#frames) between a detected cut and a true cut to count it as correct.");
+
+    /* merge */
+    program.add_argument("--shards")
+        .default_value(std::vector<std::string>{})
+        .nargs(argparse::nargs_pattern::at_least_one)
+        .help("[merge] Files saved by shard runs on the ranges of the video, in any order. "
+              "The scenes are detected from all of them as in a single run on the whole video.");
+
+    /* index-hashes, find-duplicates */
+    program.add_argument("--hash_index")
+        .help("[index-hashes, find-duplicates] Index of the perceptual hashes of the scenes' keyframes. index-hashes adds "
+              "the scenes of the video to it (replacing those of a previous run on the same file), and find-duplicates "
+              "searches it for scenes of other videos close to the scenes of the video.");
+
+    program.add_argument("--max_distance")
+        .default_value(8)
+        .scan<'d', int>()
+        .help("[find-duplicates] Maximum Hamming distance (bits out of 64) between the hashes of near-duplicate scenes.");
+
+    /* index-scenes */
+    program.add_argument("--scene_index")
+        .help("[index-scenes] Scene index of an archive, created if it does not exist. The cuts of the video are appended "
+              "with its fingerprint and the detector parameters, superseding those of a previous run on the same file, "
+              "and are queried with --query.");
+
     try {
-        program.parse_args(argc, argv);
+        program.parse_args(args);
     }
     catch (const std::exception& err) {
         std::string error_msg = err.what();
@@ -371,3 +905,53 @@ WithError<Config> parse_args(int argc, char *argv[]) {
 
     return _construct_config(program);
 }
+
+WithError<QueryConfig> parse_query_args(const std::filesystem::path& scene_index, const std::vector<std::string>& args) {
+    argparse::ArgumentParser program("shutoh --query", "0.0.1");
+
+    program.add_argument("--video")
+        .help("Video to list the cuts of, as given to index-scenes. Without it, the indexed videos are listed with "
+              "their number of cuts and cuts per minute.");
+
+    program.add_argument("--start")
+        .help("[--video] Time of the first cut to list, as HH:MM:SS[.nnn] or a frame number.");
+
+    program.add_argument("--end")
+        .help("[--video] Time of the last cut to list, as HH:MM:SS[.nnn] or a frame number.");
+
+    program.add_argument("--min_cuts_per_minute")
+        .scan<'g', float>()
+        .help("Lists only the videos with at least this many cuts per minute.");
+
+    try {
+        program.parse_args(args);
+    }
+    catch (const std::exception& err) {
+        std::string error_msg = err.what();
+        return WithError<QueryConfig> { std::nullopt, Error(ErrorCode::FailedToParseArgs, error_msg) };
+    }
+
+    const std::optional<std::string> video = program.present<std::string>("--video");
+    const std::optional<std::string> start = program.present<std::string>("--start");
+    const std::optional<std::string> end = program.present<std::string>("--end");
+    const std::optional<float> min_cuts_per_minute = program.present<float>("--min_cuts_per_minute");
+
+    if (!video.has_value() && (start.has_value() || end.has_value())) {
+        std::string error_msg = "--start and --end select the cuts of --video.";
+        return WithError<QueryConfig> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (video.has_value() && min_cuts_per_minute.has_value()) {
+        std::string error_msg = "--min_cuts_per_minute selects videos and cannot be used with --video.";
+        return WithError<QueryConfig> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (!std::filesystem::exists(scene_index)) {
+        const std::string error_msg = "No such file: " + scene_index.string();
+        return WithError<QueryConfig> { std::nullopt, Error(ErrorCode::NoSuchFile, error_msg) };
+    }
+
+    const QueryConfig config = { .scene_index = scene_index, .video = video, .start = start, .end = end,
+                                 .min_cuts_per_minute = min_cuts_per_minute.value_or(0.0f) };
+    return WithError<QueryConfig> { config, Error(ErrorCode::Success, "") };
+}
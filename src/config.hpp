@@ -8,12 +8,18 @@
 #include "shutoh/detector/histogram_detector.hpp"
 #include "shutoh/detector/threshold_detector.hpp"
 #include "shutoh/detector/adaptive_detector.hpp"
+#include "shutoh/detector/motion_vector_detector.hpp"
+#include "range_detector.hpp"
+#include "scene_writer.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <filesystem>
 #include <optional>
 #include <argparse/argparse.hpp>
 #include <memory>
+#include <vector>
+#include <map>
+#include <algorithm>
 
 class VideoStream;
 template <typename T> struct WithError;
@@ -25,6 +31,7 @@ enum class DetectorType {
     HISTOGRAM,
     ADAPTIVE,
     THRESHOLD,
+    MOTION,
     OTHER,
 };
 
@@ -32,14 +39,22 @@ struct Config {
     /* common */
     const std::filesystem::path input_path;
     const std::filesystem::path output_dir;
-    const std::string command;
-    const std::string filename;
+    const std::vector<std::string> commands; /* run in one invocation, sharing the detection */
+    const std::map<std::string, std::string> filenames; /* output filename format of each command */
+
+    bool has_command(const std::string& command) const {
+        return std::find(commands.begin(), commands.end(), command) != commands.end();
+    }
 
     /* list-scene */
     const bool no_output_file;
+    const SceneFormat scene_format;
+    const bool scene_stats; /* per-scene statistics aggregated while detecting */
 
     /* split-video */
     const bool copy;
+    const bool smart;
+    const bool decode_once;
     const int32_t crf;
     const std::string preset;
     const std::string ffmpeg_args;
@@ -48,10 +63,13 @@ struct Config {
     const int32_t num_images;
     const std::string format;
     const int32_t quality;
+    const int32_t compression;
     const int32_t frame_margin;
     const std::optional<float> scale; /* scale is ignored if width and height are set. */
     const std::optional<int32_t> height;
     const std::optional<int32_t> width;
+    const bool single_pass;
+    const int32_t readers;
 
     /* time information
        Time expression is represented as string format,
@@ -62,11 +80,23 @@ struct Config {
     const std::optional<std::string> start;
     const std::optional<std::string> end;
     const std::optional<std::string> duration;
+    const std::vector<TimeRange> ranges; /* disjoint ranges detected instead of start and end */
 
     /* detectors' common parameters */
     const DetectorType detector_type;
     const float threshold;
     const int32_t min_scene_len = 15;
+    const std::optional<std::filesystem::path> save_scores; /* per-frame score sidecar written while detecting */
+    const std::optional<std::filesystem::path> load_scores; /* replayed instead of decoding the video */
+    const std::optional<std::filesystem::path> cache_dir; /* detected cuts of previous runs */
+    const std::optional<std::filesystem::path> checkpoint; /* detection state, resumed if the file exists */
+    const int32_t checkpoint_interval; /* #frames between checkpoints */
+    const bool follow; /* keep detecting frames appended to a growing file */
+    const float follow_timeout; /* seconds without new frames before the file is considered complete */
+    const bool live; /* report cuts as soon as they are decided */
+    const std::optional<int32_t> max_latency; /* #frames between a cut and its decision */
+    const std::optional<std::string> event_ring; /* shared memory name the scores and cuts are published to */
+    const uint32_t event_ring_size; /* #events kept in the ring */
 
     /* adaptive detector */
     const int32_t window_width;
@@ -79,14 +109,46 @@ struct Config {
     /* histogram detector */
     const int32_t bins;
     const float fade_bias;
+
+    /* sweep: every combination is evaluated on the saved scores */
+    const std::vector<float> sweep_thresholds;
+    const std::vector<int32_t> sweep_min_scene_lens;
+    const std::vector<int32_t> sweep_window_widths;
+    const std::vector<float> sweep_min_content_vals;
+    const std::optional<std::filesystem::path> ground_truth;
+    const int32_t tolerance;
+
+    /* merge: scores saved by the shard command on each range of the video */
+    const std::vector<std::filesystem::path> shards;
+
+    /* index-hashes, find-duplicates */
+    const std::optional<std::filesystem::path> hash_index;
+    const int32_t max_distance; /* Hamming distance between near-duplicate keyframe hashes */
+
+    /* index-scenes */
+    const std::optional<std::filesystem::path> scene_index;
+};
+
+/* shutoh --query: reads a scene index instead of detecting a video */
+struct QueryConfig {
+    const std::filesystem::path scene_index;
+    const std::optional<std::string> video; /* whose cuts are listed, or std::nullopt to list the videos */
+    const std::optional<std::string> start; /* cuts of the video from start to end */
+    const std::optional<std::string> end;
+    const float min_cuts_per_minute; /* videos with fewer cuts are not listed */
 };
 
 std::shared_ptr<BaseDetector> _select_detector(const DetectorParameters& params);
-std::string _interpret_filename(const std::filesystem::path& input_path,
+std::string _interpret_filename(const std::filesystem::path& input_path, const std::string& command,
                                 const argparse::ArgumentParser& program);
+template <typename T>
+WithError<std::vector<T>> _parse_sweep_range(const argparse::ArgumentParser& program, const std::string& option, const T value);
 DetectorType _convert_name_to_type(const std::string& detector_name);
 float _get_default_threshold(const DetectorType& detector_type);
 WithError<Config> _construct_config(argparse::ArgumentParser& program);
 WithError<Config> parse_args(int argc, char *argv[]);
+/* is_job: the args of a job run by --batch or --serve, which has no --help or --version */
+WithError<Config> parse_args(const std::vector<std::string>& args, const bool is_job = false);
+WithError<QueryConfig> parse_query_args(const std::filesystem::path& scene_index, const std::vector<std::string>& args);
 
 #endif
\ No newline at end of file
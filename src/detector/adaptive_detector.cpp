@@ -1,4 +1,5 @@
 #include "shutoh/detector/adaptive_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "shutoh/video_frame.hpp"
 
 #include <algorithm>
@@ -10,16 +11,12 @@ AdaptiveDetector::AdaptiveDetector(const float adaptive_threshold, const int32_t
       window_width_{window_width}, min_content_val_{min_content_val}, required_frames_{1 + (2 * static_cast<size_t>(window_width_))},
       buffer_{required_frames_} {}
 
-std::optional<int32_t> AdaptiveDetector::process_frame(const VideoFrame& next_frame) {
-    ContentDetector::process_frame(next_frame);
-    
-    const int32_t frame_num = next_frame.frame_num;
+/* ContentDetector::process_frame() scores the frame and calls this function */
+std::optional<int32_t> AdaptiveDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
     if (!last_cut_.has_value())
         last_cut_ = frame_num;
-    
-    const float frame_score = ContentDetector::get_frame_score().value();
 
-    buffer_.push(FrameNumScore { frame_num, frame_score });
+    buffer_.push(FrameNumScore { frame_num, frame_score.value_or(0.0f) });
     if (buffer_.size() < required_frames_)
         return std::nullopt;
 
@@ -55,6 +52,37 @@ float AdaptiveDetector::_calculate_average_window_score() const {
     return average_window_score / (2.0f * window_width_);
 }
 
+std::string AdaptiveDetector::serialize_parameters() const {
+    return "adaptive:threshold=" + std::to_string(adaptive_threshold_) + ":min_scene_len=" + std::to_string(min_scene_len_) +
+           ":window_width=" + std::to_string(window_width_) + ":min_content_val=" + std::to_string(min_content_val_);
+}
+
+void AdaptiveDetector::save_state(StateWriter& writer) const {
+    ContentDetector::save_state(writer);
+    writer.write(static_cast<uint64_t>(buffer_.size()));
+    for (size_t i = 0; i < buffer_.size(); i++) {
+        writer.write(buffer_[i].frame_num);
+        writer.write(buffer_[i].frame_score);
+    }
+    writer.write(last_cut_);
+    writer.write(first_frame_num_);
+}
+
+void AdaptiveDetector::load_state(StateReader& reader) {
+    ContentDetector::load_state(reader);
+    uint64_t buffer_size = 0;
+    reader.read(buffer_size);
+    for (uint64_t i = 0; i < buffer_size && !reader.has_failed(); i++) {
+        int32_t frame_num = 0;
+        float frame_score = 0.0f;
+        reader.read(frame_num);
+        reader.read(frame_score);
+        buffer_.push(FrameNumScore { frame_num, frame_score });
+    }
+    reader.read(last_cut_);
+    reader.read(first_frame_num_);
+}
+
 std::shared_ptr<AdaptiveDetector> AdaptiveDetector::initialize_detector(float adaptive_threshold, int32_t min_scene_len,
                                                                         int32_t window_width, float min_content_val) {
     if (adaptive_threshold < 0.0) {
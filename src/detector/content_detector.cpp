@@ -1,4 +1,5 @@
 #include "shutoh/detector/content_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "shutoh/video_frame.hpp"
 
 ContentDetector::ContentDetector(const float threshold, const int32_t min_scene_len)
@@ -7,8 +8,11 @@ ContentDetector::ContentDetector(const float threshold, const int32_t min_scene_
 std::optional<int32_t> ContentDetector::process_frame(const VideoFrame& next_frame) {
     const float frame_score = _calculate_frame_score(next_frame);
     frame_score_ = frame_score; /* for adaptive detector */
-    const bool is_above_threshold = (frame_score > threshold_);
-    const int32_t frame_num = next_frame.frame_num;
+    return process_score(next_frame.frame_num, frame_score);
+}
+
+std::optional<int32_t> ContentDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
+    const bool is_above_threshold = (frame_score.value_or(0.0f) > threshold_);
     std::optional<int32_t> cut = flash_filter_.filter(frame_num, is_above_threshold);
     return cut;
 }
@@ -33,6 +37,30 @@ float ContentDetector::_mean_pixel_distance(const VideoFrame& next_frame) const
     return pixel_diff_sum;
 }
 
+std::string ContentDetector::serialize_parameters() const {
+    const std::string parameters = "content:threshold=" + std::to_string(threshold_) + ":min_scene_len=" + std::to_string(min_scene_len_);
+    if (max_latency_.has_value())
+        return parameters + ":max_latency=" + std::to_string(max_latency_.value());
+    return parameters;
+}
+
+void ContentDetector::set_max_latency(const int32_t max_latency) {
+    max_latency_ = max_latency;
+    flash_filter_.set_max_latency(max_latency);
+}
+
+void ContentDetector::save_state(StateWriter& writer) const {
+    writer.write(frame_score_);
+    writer.write(last_frame_);
+    flash_filter_.save_state(writer);
+}
+
+void ContentDetector::load_state(StateReader& reader) {
+    reader.read(frame_score_);
+    reader.read(last_frame_);
+    flash_filter_.load_state(reader);
+}
+
 std::shared_ptr<ContentDetector> ContentDetector::initialize_detector(float threshold, int32_t min_scene_len) {
     if (threshold < 0.0) {
         std::cout << "Warning: threshold should be positive and is reset to be 27.0f" << std::endl;
@@ -1,4 +1,5 @@
 #include "shutoh/detector/flash_filter.hpp"
+#include "shutoh/detector/detector_state.hpp"
 
 FlashFilter::FlashFilter(const FilterMode mode, const int32_t length) : mode_{mode}, filter_length_{length} {}
 
@@ -13,6 +14,13 @@ std::optional<int32_t> FlashFilter::filter(const int32_t frame_num, const bool i
     }
 }
 
+std::optional<int32_t> FlashFilter::get_latency() const {
+    /* a merged cut is returned filter_length_ frames after the last flash, or sooner with max_latency_ */
+    if (mode_ == FilterMode::MERGE)
+        return max_latency_.value_or(filter_length_);
+    return 0;
+}
+
 std::optional<int32_t> FlashFilter::_filter_merge(const int32_t frame_num, const bool is_above_threshold) {
     const bool min_length_met = (frame_num - last_above_.value()) >= filter_length_;
     if (is_above_threshold) {
@@ -24,6 +32,13 @@ std::optional<int32_t> FlashFilter::_filter_merge(const int32_t frame_num, const
             merge_triggered = false;
             return last_above_.value();
         }
+        /* Decide now instead of waiting for the flashes to end. last_above_ is not before merge_start_,
+           so the cut is returned at most max_latency_ frames after it, or dropped as a flash if too short. */
+        if (max_latency_.has_value() && frame_num - merge_start_.value() >= max_latency_.value()) {
+            merge_triggered = false;
+            if (num_merged_frames >= filter_length_)
+                return last_above_.value();
+        }
         return std::nullopt;
     }
 
@@ -42,4 +57,18 @@ std::optional<int32_t> FlashFilter::_filter_merge(const int32_t frame_num, const
     }
 
     return std::nullopt;
-}
\ No newline at end of file
+}
+
+void FlashFilter::save_state(StateWriter& writer) const {
+    writer.write(last_above_);
+    writer.write(merge_start_);
+    writer.write(merge_enabled);
+    writer.write(merge_triggered);
+}
+
+void FlashFilter::load_state(StateReader& reader) {
+    reader.read(last_above_);
+    reader.read(merge_start_);
+    reader.read(merge_enabled);
+    reader.read(merge_triggered);
+}
@@ -1,17 +1,14 @@
 #include "shutoh/detector/hash_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "shutoh/video_frame.hpp"
 
 HashDetector::HashDetector(const float threshold, const int32_t min_scene_len,
                            const int32_t size, const int32_t lowpass) : threshold_{threshold}, min_scene_len_{min_scene_len}, 
-                           size_{size}, size_sq_{size * size}, imsize_{cv::Size(size * lowpass, size * lowpass)} {}
+                           size_{size}, size_sq_{size * size}, imsize_{cv::Size(size * lowpass, size * lowpass)}, lowpass_{lowpass} {}
 
 std::optional<int32_t> HashDetector::process_frame(const VideoFrame& next_frame) {
-    std::optional<int32_t> cut = std::nullopt;
-    const int32_t frame_num = next_frame.frame_num;
+    frame_score_ = std::nullopt;
 
-    if (!last_scene_cut_.has_value())
-        last_scene_cut_ = frame_num;
-    
     if (last_frame_.has_value()) {
         cv::Mat curr_hash;
         _hash_frame(next_frame.frame, curr_hash);
@@ -23,20 +20,35 @@ std::optional<int32_t> HashDetector::process_frame(const VideoFrame& next_frame)
         }
         
         const int32_t hash_dist = _calculate_hamming_distance(curr_hash, last_hash_.value());
-        const float hash_dist_norm = static_cast<float>(hash_dist) / size_sq_;
-
+        frame_score_ = static_cast<float>(hash_dist) / size_sq_;
         last_hash_ = curr_hash;
+    }
+
+    last_frame_ = next_frame.frame;
+    return process_score(next_frame.frame_num, frame_score_);
+}
+
+std::optional<int32_t> HashDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
+    std::optional<int32_t> cut = std::nullopt;
+
+    if (!last_scene_cut_.has_value())
+        last_scene_cut_ = frame_num;
 
+    if (frame_score.has_value()) {
+        const float hash_dist_norm = frame_score.value();
         if (hash_dist_norm >= threshold_ && (frame_num - last_scene_cut_.value() >= min_scene_len_)) {
             cut = frame_num;
             last_scene_cut_ = frame_num;
         }
     }
-
-    last_frame_ = next_frame.frame;
     return cut;
 }
 
+std::string HashDetector::get_score_type() const {
+    /* the hash depends on its size */
+    return "hash:" + std::to_string(size_) + ":" + std::to_string(lowpass_);
+}
+
 void HashDetector::_hash_frame(const cv::Mat& frame, cv::Mat& hash) const {
     /* Convert frames to grayscale */
     cv::Mat gray_img;
@@ -90,6 +102,25 @@ float HashDetector::_calculate_median_in_DCT(const cv::Mat& dct) const {
     return median;
 }
 
+std::string HashDetector::serialize_parameters() const {
+    return "hash:threshold=" + std::to_string(threshold_) + ":min_scene_len=" + std::to_string(min_scene_len_) +
+           ":size=" + std::to_string(size_) + ":lowpass=" + std::to_string(lowpass_);
+}
+
+void HashDetector::save_state(StateWriter& writer) const {
+    writer.write(frame_score_);
+    writer.write(last_scene_cut_);
+    writer.write(last_frame_);
+    writer.write(last_hash_);
+}
+
+void HashDetector::load_state(StateReader& reader) {
+    reader.read(frame_score_);
+    reader.read(last_scene_cut_);
+    reader.read(last_frame_);
+    reader.read(last_hash_);
+}
+
 std::shared_ptr<HashDetector> HashDetector::initialize_detector(float threshold, int32_t min_scene_len,
                                                                 int32_t dct_size, int32_t lowpass) {
     if (threshold < 0.0f) {
@@ -1,29 +1,35 @@
 #include "shutoh/detector/histogram_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "shutoh/video_frame.hpp"
 
 HistogramDetector::HistogramDetector(const float threshold, const int32_t min_scene_len, const int32_t bins) 
     : threshold_{std::max(0.0f, std::min(1.0f, 1.0f - threshold))}, min_scene_len_{min_scene_len}, bins_{bins} {}
 
 std::optional<int32_t> HistogramDetector::process_frame(const VideoFrame& next_frame) {
+    cv::Mat hist;
+    _calculate_histogram(next_frame.frame, hist);
+
+    frame_score_ = std::nullopt;
+    if (last_hist_.has_value())
+        frame_score_ = static_cast<float>(cv::compareHist(last_hist_.value(), hist, cv::HISTCMP_CORREL));
+
+    last_hist_ = hist;
+    return process_score(next_frame.frame_num, frame_score_);
+}
+
+std::optional<int32_t> HistogramDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
     std::optional<int32_t> cut = std::nullopt;
-    const int32_t frame_num = next_frame.frame_num;
 
     if (!last_scene_cut_.has_value())
         last_scene_cut_ = frame_num;
-    
-    cv::Mat hist;
-    _calculate_histogram(next_frame.frame, hist);
 
-    if (last_hist_.has_value()) {
-        const double hist_diff = cv::compareHist(last_hist_.value(), hist, cv::HISTCMP_CORREL);
-        
+    if (frame_score.has_value()) {
+        const float hist_diff = frame_score.value();
         if (hist_diff <= threshold_ && (frame_num - last_scene_cut_.value()) >= min_scene_len_) {
             cut = frame_num;
             last_scene_cut_ = frame_num;
         }
     }
-
-    last_hist_ = hist;
     return cut;
 }
 
@@ -43,6 +49,23 @@ void HistogramDetector::_calculate_histogram(const cv::Mat& frame, cv::Mat& hist
     cv::normalize(hist, hist);
 }
 
+std::string HistogramDetector::serialize_parameters() const {
+    return "histogram:threshold=" + std::to_string(threshold_) + ":min_scene_len=" + std::to_string(min_scene_len_) +
+           ":bins=" + std::to_string(bins_);
+}
+
+void HistogramDetector::save_state(StateWriter& writer) const {
+    writer.write(frame_score_);
+    writer.write(last_scene_cut_);
+    writer.write(last_hist_);
+}
+
+void HistogramDetector::load_state(StateReader& reader) {
+    reader.read(frame_score_);
+    reader.read(last_scene_cut_);
+    reader.read(last_hist_);
+}
+
 std::shared_ptr<HistogramDetector> HistogramDetector::initialize_detector(float threshold, int32_t min_scene_len, int32_t bins) {
     if (threshold < 0) {
         std::cout << "Warning: threshold should be positive and is reset to 0.05f." << std::endl;
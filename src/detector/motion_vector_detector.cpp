@@ -0,0 +1,89 @@
+#include "shutoh/detector/motion_vector_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
+#include "shutoh/video_frame.hpp"
+
+#include <iostream>
+
+constexpr int32_t MISSING_MOTION_VECTORS_WARNING_FRAMES = 30; /* P/B-frames without any motion vector before warning */
+
+MotionVectorDetector::MotionVectorDetector(const float threshold, const int32_t min_scene_len)
+    : threshold_{threshold}, min_scene_len_{min_scene_len} {}
+
+std::optional<int32_t> MotionVectorDetector::process_frame(const VideoFrame& next_frame) {
+    const int32_t frame_num = next_frame.frame_num;
+    const float frame_score = _calculate_frame_score(frame_num, next_frame.motion_info.value_or(MotionInfo{}));
+    frame_score_ = frame_score;
+    return process_score(frame_num, frame_score);
+}
+
+std::optional<int32_t> MotionVectorDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
+    const bool is_above_threshold = (frame_score.value_or(0.0f) >= threshold_);
+    std::optional<int32_t> cut = flash_filter_.filter(frame_num, is_above_threshold);
+    return cut;
+}
+
+float MotionVectorDetector::_calculate_frame_score(const int32_t frame_num, const MotionInfo& motion_info) {
+    if (motion_info.picture_type != 'I') {
+        /* a few P/B-frames may be fully intra-coded before the first motion vector is exported */
+        if (!motion_info.has_motion_vectors && ++num_frames_without_motion_vectors_ == MISSING_MOTION_VECTORS_WARNING_FRAMES) {
+            std::cout << "Warning: the decoder does not export motion vectors for this video. "
+                         "MotionVectorDetector can only use keyframes." << std::endl;
+        }
+        return motion_info.intra_ratio;
+    }
+
+    /* The first keyframe is the start of the stream. Afterwards, encoders insert a keyframe every
+       keyint frames and additionally at cuts, so keyframes which come earlier than the longest
+       interval seen so far are the ones placed by scene-cut decisions. */
+    if (!last_keyframe_.has_value()) {
+        last_keyframe_ = frame_num;
+        return 0.0f;
+    }
+
+    const int32_t interval = frame_num - last_keyframe_.value();
+    const bool is_periodic = interval >= longest_keyframe_interval_;
+    longest_keyframe_interval_ = std::max(longest_keyframe_interval_, interval);
+    last_keyframe_ = frame_num;
+    return is_periodic ? 0.0f : 1.0f;
+}
+
+std::string MotionVectorDetector::serialize_parameters() const {
+    const std::string parameters = "motion:threshold=" + std::to_string(threshold_) + ":min_scene_len=" + std::to_string(min_scene_len_);
+    if (max_latency_.has_value())
+        return parameters + ":max_latency=" + std::to_string(max_latency_.value());
+    return parameters;
+}
+
+void MotionVectorDetector::set_max_latency(const int32_t max_latency) {
+    max_latency_ = max_latency;
+    flash_filter_.set_max_latency(max_latency);
+}
+
+void MotionVectorDetector::save_state(StateWriter& writer) const {
+    writer.write(frame_score_);
+    writer.write(last_keyframe_);
+    writer.write(longest_keyframe_interval_);
+    writer.write(num_frames_without_motion_vectors_);
+    flash_filter_.save_state(writer);
+}
+
+void MotionVectorDetector::load_state(StateReader& reader) {
+    reader.read(frame_score_);
+    reader.read(last_keyframe_);
+    reader.read(longest_keyframe_interval_);
+    reader.read(num_frames_without_motion_vectors_);
+    flash_filter_.load_state(reader);
+}
+
+std::shared_ptr<MotionVectorDetector> MotionVectorDetector::initialize_detector(float threshold, int32_t min_scene_len) {
+    if (threshold < 0.0f || threshold > 1.0f) {
+        std::cout << "Warning: threshold should be between 0.0 and 1.0 and is reset to be 0.5f" << std::endl;
+        threshold = 0.5f;
+    }
+
+    if (min_scene_len < 0) {
+        std::cout << "Warning: min_scene_len should be positive and is reset to be 15" << std::endl;
+        min_scene_len = 15;
+    }
+    return std::make_shared<MotionVectorDetector>(threshold, min_scene_len);
+}
@@ -1,17 +1,24 @@
 #include "shutoh/detector/threshold_detector.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "shutoh/video_frame.hpp"
 
+#include <algorithm>
+
 ThresholdDetector::ThresholdDetector(const float threshold, const int32_t min_scene_len, const float fade_bias)
     : threshold_{threshold}, min_scene_len_{min_scene_len}, fade_bias_{fade_bias} {}
 
 std::optional<int32_t> ThresholdDetector::process_frame(const VideoFrame& next_frame) {
+    frame_score_ = _compute_frame_average(next_frame.frame);
+    return process_score(next_frame.frame_num, frame_score_);
+}
+
+std::optional<int32_t> ThresholdDetector::process_score(const int32_t frame_num, const std::optional<float> frame_score) {
     std::optional<int32_t> cut = std::nullopt;
-    const int32_t frame_num = next_frame.frame_num;
 
     if (!last_scene_cut_.has_value())
         last_scene_cut_ = frame_num;
     
-    const float frame_avg = _compute_frame_average(next_frame.frame);
+    const float frame_avg = frame_score.value_or(0.0f);
 
     if (process_frame_) {
         if (last_fade_.value() == Fade::FADE_IN && frame_avg < threshold_) {
@@ -20,7 +27,10 @@ std::optional<int32_t> ThresholdDetector::process_frame(const VideoFrame& next_f
         } else if (last_fade_.value() == Fade::FADE_OUT && frame_avg >= threshold_) {
             if ((frame_num - last_scene_cut_.value()) >= min_scene_len_) {
                 const int32_t f_out = last_frame_;
-                const int32_t f_split = (frame_num + f_out + static_cast<int32_t>(fade_bias_ * (frame_num - f_out))) / 2;
+                int32_t f_split = (frame_num + f_out + static_cast<int32_t>(fade_bias_ * (frame_num - f_out))) / 2;
+                /* a fade longer than the latency is split nearer its end, so that the cut is not reported too late */
+                if (max_latency_.has_value())
+                    f_split = std::max(f_split, frame_num - max_latency_.value());
                 cut = f_split;
                 last_scene_cut_ = frame_num;
             }
@@ -45,6 +55,30 @@ float ThresholdDetector::_compute_frame_average(const cv::Mat& frame) const {
     return static_cast<float>(sum_value[0] + sum_value[1] + sum_value[2]) / total_pixels;
 }
 
+std::string ThresholdDetector::serialize_parameters() const {
+    const std::string parameters = "threshold:threshold=" + std::to_string(threshold_) + ":min_scene_len=" +
+                                   std::to_string(min_scene_len_) + ":fade_bias=" + std::to_string(fade_bias_);
+    if (max_latency_.has_value())
+        return parameters + ":max_latency=" + std::to_string(max_latency_.value());
+    return parameters;
+}
+
+void ThresholdDetector::save_state(StateWriter& writer) const {
+    writer.write(frame_score_);
+    writer.write(process_frame_);
+    writer.write(last_frame_);
+    writer.write(last_scene_cut_);
+    writer.write(last_fade_);
+}
+
+void ThresholdDetector::load_state(StateReader& reader) {
+    reader.read(frame_score_);
+    reader.read(process_frame_);
+    reader.read(last_frame_);
+    reader.read(last_scene_cut_);
+    reader.read(last_fade_);
+}
+
 std::shared_ptr<ThresholdDetector> ThresholdDetector::initialize_detector(float threshold, int32_t min_scene_len, float fade_bias) {
     if (threshold < 0) {
         std::cout << "Warning: threshold should be positive and is reset to 12.0f." << std::endl;
@@ -0,0 +1,162 @@
+#include "shutoh/event_ring.hpp"
+#include "shutoh/error.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <new>
+
+EventRingWriter::EventRingWriter(const std::string& name, void* data, const size_t size)
+    : name_{name}, data_{data}, size_{size},
+      slots_{reinterpret_cast<EventSlot*>(static_cast<char*>(data) + sizeof(EventRingHeader))} {}
+
+EventRingWriter::~EventRingWriter() {
+    close();
+    munmap(data_, size_);
+}
+
+void EventRingWriter::publish_score(const int32_t frame_num, const std::optional<float> score) {
+    _publish(EventType::SCORE, frame_num, frame_num, score.value_or(std::numeric_limits<float>::quiet_NaN()));
+}
+
+void EventRingWriter::publish_cut(const int32_t cut, const int32_t decided_frame_num) {
+    _publish(EventType::CUT, cut, decided_frame_num, std::numeric_limits<float>::quiet_NaN());
+}
+
+void EventRingWriter::close() {
+    if (is_closed_)
+        return;
+
+    _publish(EventType::END, -1, -1, std::numeric_limits<float>::quiet_NaN());
+    shm_unlink(name_.c_str());
+    is_closed_ = true;
+}
+
+void EventRingWriter::_publish(const EventType type, const int32_t frame_num, const int32_t decided_frame_num, const float score) {
+    EventRingHeader* header = static_cast<EventRingHeader*>(data_);
+    EventSlot& slot = slots_[write_count_ & (header->capacity - 1)];
+
+    /* a consumer reading the slot meanwhile sees an odd sequence or a changed one after its copy */
+    slot.sequence.store(2 * write_count_ + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.type.store(static_cast<int32_t>(type), std::memory_order_relaxed);
+    slot.frame_num.store(frame_num, std::memory_order_relaxed);
+    slot.decided_frame_num.store(decided_frame_num, std::memory_order_relaxed);
+    slot.score.store(score, std::memory_order_relaxed);
+    slot.sequence.store(2 * write_count_ + 2, std::memory_order_release);
+
+    write_count_++;
+    header->write_count.store(write_count_, std::memory_order_release);
+}
+
+WithError<std::shared_ptr<EventRingWriter>> EventRingWriter::initialize_event_ring_writer(const std::string& name,
+                                                                                          const uint32_t capacity,
+                                                                                          const float framerate) {
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos) {
+        const std::string error_msg = "The event ring name must be a single slash followed by a name, e.g., /shutoh: " + name;
+        return WithError<std::shared_ptr<EventRingWriter>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+        const std::string error_msg = "The event ring size must be a power of two: " + std::to_string(capacity);
+        return WithError<std::shared_ptr<EventRingWriter>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    shm_unlink(name.c_str());
+    const int32_t fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    const size_t size = sizeof(EventRingHeader) + static_cast<size_t>(capacity) * sizeof(EventSlot);
+    const bool is_resized = fd >= 0 && ftruncate(fd, size) == 0;
+    void* data = is_resized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (fd >= 0)
+        ::close(fd); /* the mapping stays valid */
+    if (data == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        const std::string error_msg = "Failed to create the shared memory " + name + ": " + std::strerror(errno);
+        return WithError<std::shared_ptr<EventRingWriter>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    /* the new segment is zero-filled, so every slot sequence is 0 until its first event */
+    EventRingHeader* header = new (data) EventRingHeader {};
+    std::memcpy(header->magic, EVENT_RING_MAGIC, sizeof(header->magic));
+    header->version = EVENT_RING_VERSION;
+    header->capacity = capacity;
+    header->framerate = framerate;
+    header->slot_size = sizeof(EventSlot);
+    EventSlot* slots = reinterpret_cast<EventSlot*>(static_cast<char*>(data) + sizeof(EventRingHeader));
+    for (uint32_t i = 0; i < capacity; i++)
+        new (&slots[i]) EventSlot {};
+
+    std::shared_ptr<EventRingWriter> writer = std::make_shared<EventRingWriter>(name, data, size);
+    return WithError<std::shared_ptr<EventRingWriter>> { writer, Error(ErrorCode::Success, "") };
+}
+
+EventRingReader::EventRingReader(const void* data, const size_t size)
+    : data_{data}, size_{size},
+      slots_{reinterpret_cast<const EventSlot*>(static_cast<const char*>(data) + sizeof(EventRingHeader))} {}
+
+EventRingReader::~EventRingReader() {
+    munmap(const_cast<void*>(data_), size_);
+}
+
+std::optional<RingEvent> EventRingReader::read() {
+    const EventRingHeader& header = get_header();
+    while (true) {
+        const uint64_t write_count = header.write_count.load(std::memory_order_acquire);
+        if (next_ >= write_count)
+            return std::nullopt;
+        if (write_count - next_ > header.capacity) {
+            num_lost_ += write_count - header.capacity - next_;
+            next_ = write_count - header.capacity;
+        }
+
+        const EventSlot& slot = slots_[next_ & (header.capacity - 1)];
+        const uint64_t published = 2 * next_ + 2;
+        const uint64_t sequence_before = slot.sequence.load(std::memory_order_acquire);
+        const RingEvent event { static_cast<EventType>(slot.type.load(std::memory_order_relaxed)),
+                                slot.frame_num.load(std::memory_order_relaxed),
+                                slot.decided_frame_num.load(std::memory_order_relaxed),
+                                slot.score.load(std::memory_order_relaxed) };
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t sequence_after = slot.sequence.load(std::memory_order_relaxed);
+
+        next_++;
+        if (sequence_before == published && sequence_after == published)
+            return event;
+        /* the producer has already reused the slot for a later event */
+        num_lost_++;
+    }
+}
+
+WithError<std::shared_ptr<EventRingReader>> EventRingReader::initialize_event_ring_reader(const std::string& name) {
+    const int32_t fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        const std::string error_msg = "Failed to open the shared memory " + name + ": " + std::strerror(errno);
+        return WithError<std::shared_ptr<EventRingReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    struct stat shm_stat;
+    const bool has_header = fstat(fd, &shm_stat) == 0 && static_cast<size_t>(shm_stat.st_size) >= sizeof(EventRingHeader);
+    void* data = has_header ? mmap(nullptr, shm_stat.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd); /* the mapping stays valid */
+    if (data == MAP_FAILED) {
+        const std::string error_msg = name + " is not an event ring.";
+        return WithError<std::shared_ptr<EventRingReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::shared_ptr<EventRingReader> reader = std::make_shared<EventRingReader>(data, shm_stat.st_size);
+    const EventRingHeader& header = reader->get_header();
+    const size_t expected_size = sizeof(EventRingHeader) + static_cast<size_t>(header.capacity) * sizeof(EventSlot);
+    if (std::memcmp(header.magic, EVENT_RING_MAGIC, sizeof(header.magic)) != 0 || header.version != EVENT_RING_VERSION ||
+        header.slot_size != sizeof(EventSlot) || expected_size != reader->size_) {
+        const std::string error_msg = name + " is not an event ring of this version.";
+        return WithError<std::shared_ptr<EventRingReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const uint64_t write_count = header.write_count.load(std::memory_order_acquire);
+    reader->next_ = write_count > header.capacity ? write_count - header.capacity : 0;
+    return WithError<std::shared_ptr<EventRingReader>> { reader, Error(ErrorCode::Success, "") };
+}
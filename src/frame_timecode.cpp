@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 #include <regex>
 #include <fmt/core.h>
 
@@ -43,11 +44,64 @@ int32_t FrameTimeCode::parse_timecode_number(const float seconds) const {
     return std::round(seconds * framerate_);
 }
 
+static char* _write_padded(char* first, char* last, const int32_t value, const int32_t width) {
+    if (first == nullptr)
+        return nullptr;
+    char digits[16];
+    const char* digits_end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+    const int32_t num_digits = static_cast<int32_t>(digits_end - digits);
+    const int32_t num_zeros = std::max(0, width - num_digits);
+    if (last - first < num_zeros + num_digits)
+        return nullptr;
+    first = std::fill_n(first, num_zeros, '0');
+    return std::copy_n(digits, num_digits, first);
+}
+
+static char* _write_char(char* first, char* last, const char c) {
+    if (first == nullptr || first == last)
+        return nullptr;
+    *first = c;
+    return first + 1;
+}
+
 std::string FrameTimeCode::to_string() const {
-    float secs = static_cast<float>(frame_num_ / framerate_);
-    int32_t hrs = static_cast<int32_t>(secs / frame_timecode::_SECONDS_PER_HOUR);
+    int32_t hrs = 0;
+    int32_t mins = 0;
+    float secs = 0.0f;
+    _split_time(hrs, mins, secs);
+    return convert_timecode_to_datetime(hrs, mins, secs);
+}
+
+std::to_chars_result FrameTimeCode::to_chars(char* first, char* last) const {
+    int32_t hrs = 0;
+    int32_t mins = 0;
+    float secs = 0.0f;
+    _split_time(hrs, mins, secs);
+
+    /* the digits of std::to_string(frac_part).substr(2, 3) in convert_timecode_to_datetime():
+       rounded to 6 decimals, ties to even like printf, and then truncated to 3 */
+    const int32_t int_sec = static_cast<int32_t>(secs);
+    const float frac_part = secs - int_sec;
+    const int64_t micros = static_cast<int64_t>(std::nearbyint(static_cast<double>(frac_part) * 1000000.0));
+    const int32_t millis = static_cast<int32_t>(micros / 1000 % 1000);
+
+    char* ptr = _write_padded(first, last, hrs, 2);
+    ptr = _write_char(ptr, last, ':');
+    ptr = _write_padded(ptr, last, mins, 2);
+    ptr = _write_char(ptr, last, ':');
+    ptr = _write_padded(ptr, last, int_sec, 2);
+    ptr = _write_char(ptr, last, '.');
+    ptr = _write_padded(ptr, last, millis, 3);
+    if (ptr == nullptr)
+        return std::to_chars_result { last, std::errc::value_too_large };
+    return std::to_chars_result { ptr, std::errc() };
+}
+
+void FrameTimeCode::_split_time(int32_t& hrs, int32_t& mins, float& secs) const {
+    secs = static_cast<float>(frame_num_ / framerate_);
+    hrs = static_cast<int32_t>(secs / frame_timecode::_SECONDS_PER_HOUR);
     secs -= (hrs * frame_timecode::_SECONDS_PER_HOUR);
-    int32_t mins = static_cast<int32_t>(secs / frame_timecode::_SECONDS_PER_MINUTE);
+    mins = static_cast<int32_t>(secs / frame_timecode::_SECONDS_PER_MINUTE);
     secs = std::max(0.0f, secs - (mins * frame_timecode::_SECONDS_PER_MINUTE));
     secs = std::round(secs * 1000) / 1000; // equivalent to round(secs, precison=3) in Python
     secs = std::min(frame_timecode::_SECONDS_PER_MINUTE, secs);
@@ -59,7 +113,6 @@ std::string FrameTimeCode::to_string() const {
             hrs += 1;
         }
     }
-    return convert_timecode_to_datetime(hrs, mins, secs);
 }
 
 std::string FrameTimeCode::to_string_second() const {
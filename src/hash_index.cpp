@@ -0,0 +1,397 @@
+#include "shutoh/hash_index.hpp"
+#include "shutoh/error.hpp"
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <cstring>
+#include <optional>
+#include <map>
+
+static uint32_t _get_substring(const uint64_t hash, const int32_t table) {
+    return static_cast<uint32_t>((hash >> (table * HASH_INDEX_SUBSTRING_BITS)) & (HASH_INDEX_NUM_BUCKETS - 1));
+}
+
+/* calls visit with every substring value within distance of value */
+template <typename F>
+static void _visit_neighbors(const uint32_t value, const int32_t distance, const int32_t first_bit, F& visit) {
+    visit(value);
+    if (distance == 0)
+        return;
+    for (int32_t bit = first_bit; bit < HASH_INDEX_SUBSTRING_BITS; bit++)
+        _visit_neighbors(value ^ (uint32_t(1) << bit), distance - 1, bit + 1, visit);
+}
+
+static const SceneHash* _get_record_hashes(const void* log, const uint64_t offset) {
+    return reinterpret_cast<const SceneHash*>(static_cast<const char*>(log) + offset + sizeof(HashLogRecordHeader));
+}
+
+static std::string_view _get_record_name(const void* log, const uint64_t offset) {
+    const HashLogRecordHeader& header = *reinterpret_cast<const HashLogRecordHeader*>(static_cast<const char*>(log) + offset);
+    return std::string_view(reinterpret_cast<const char*>(_get_record_hashes(log, offset) + header.num_hashes), header.name_size);
+}
+
+/* the offsets of the records from begin to the end of the log, std::nullopt if one of them is cut off */
+static std::optional<std::vector<uint64_t>> _find_record_offsets(const void* log, const uint64_t begin, const uint64_t end) {
+    std::vector<uint64_t> offsets;
+    uint64_t offset = begin;
+    while (offset < end) {
+        if (end - offset < sizeof(HashLogRecordHeader))
+            return std::nullopt;
+        const HashLogRecordHeader& header = *reinterpret_cast<const HashLogRecordHeader*>(static_cast<const char*>(log) + offset);
+        const uint64_t payload_size = sizeof(HashLogRecordHeader) + uint64_t(header.num_hashes) * sizeof(SceneHash) + header.name_size;
+        if (header.record_size % 8 != 0 || header.record_size < payload_size || header.record_size > end - offset)
+            return std::nullopt;
+        offsets.push_back(offset);
+        offset += header.record_size;
+    }
+    return offsets;
+}
+
+/* writes the tables of the entries, sorted by video, through a temporary file renamed over index_path */
+static WithError<void> _write_hash_index(const std::filesystem::path& index_path, const std::vector<std::string_view>& video_names,
+                                         const std::vector<HashIndexEntry>& entries) {
+    if (entries.size() > UINT32_MAX) {
+        const std::string error_msg = index_path.string() + " cannot hold more than 2^32 scenes.";
+        return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* counting sort of the entries by each substring */
+    std::vector<uint32_t> bucket_offsets(HASH_INDEX_NUM_TABLES * (HASH_INDEX_NUM_BUCKETS + 1), 0);
+    std::vector<uint32_t> bucket_entries(HASH_INDEX_NUM_TABLES * entries.size());
+    for (int32_t table = 0; table < HASH_INDEX_NUM_TABLES; table++) {
+        uint32_t* offsets = bucket_offsets.data() + table * (HASH_INDEX_NUM_BUCKETS + 1);
+        for (const HashIndexEntry& entry : entries)
+            offsets[_get_substring(entry.hash, table) + 1]++;
+        for (size_t value = 0; value < HASH_INDEX_NUM_BUCKETS; value++)
+            offsets[value + 1] += offsets[value];
+
+        std::vector<uint32_t> next(offsets, offsets + HASH_INDEX_NUM_BUCKETS);
+        for (uint32_t entry_id = 0; entry_id < entries.size(); entry_id++)
+            bucket_entries[table * entries.size() + next[_get_substring(entries[entry_id].hash, table)]++] = entry_id;
+    }
+
+    std::vector<uint64_t> name_offsets { 0 };
+    std::string names;
+    for (const std::string_view name : video_names) {
+        names += name;
+        name_offsets.push_back(names.size());
+    }
+
+    HashIndexHeader header {};
+    std::memcpy(header.magic, HASH_INDEX_MAGIC, sizeof(header.magic));
+    header.version = HASH_INDEX_VERSION;
+    header.num_videos = static_cast<uint32_t>(video_names.size());
+    header.num_entries = entries.size();
+    header.names_size = names.size();
+
+    /* readers of the previous index keep their mapping of the replaced file */
+    const std::filesystem::path temp_path = index_path.string() + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(HashIndexHeader));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(HashIndexEntry));
+    file.write(reinterpret_cast<const char*>(bucket_offsets.data()), bucket_offsets.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(bucket_entries.data()), bucket_entries.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(name_offsets.data()), name_offsets.size() * sizeof(uint64_t));
+    file.write(names.data(), names.size());
+    file.close();
+    if (file.fail()) {
+        std::filesystem::remove(temp_path);
+        const std::string error_msg = "Failed to write " + temp_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::error_code rename_error;
+    std::filesystem::rename(temp_path, index_path, rename_error);
+    if (rename_error) {
+        const std::string error_msg = "Failed to replace " + index_path.string() + ": " + rename_error.message();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+static WithError<std::shared_ptr<HashIndex>> _open_hash_index(const std::filesystem::path& index_path) {
+    /* The log is opened first: a merge replaces the tables before removing the log, and the entries of a
+       log already merged supersede the same entries in the tables. */
+    const std::filesystem::path log_path = index_path.string() + ".log";
+    void* log = nullptr;
+    size_t log_size = 0;
+    std::optional<std::vector<uint64_t>> record_offsets = std::vector<uint64_t>();
+    const int32_t log_fd = ::open(log_path.c_str(), O_RDONLY);
+    if (log_fd >= 0) {
+        HashLogHeader log_header;
+        struct stat log_stat;
+        const bool is_log = ::pread(log_fd, &log_header, sizeof(HashLogHeader), 0) == sizeof(HashLogHeader) &&
+                            std::memcmp(log_header.magic, HASH_LOG_MAGIC, sizeof(log_header.magic)) == 0 &&
+                            log_header.version == HASH_INDEX_VERSION && fstat(log_fd, &log_stat) == 0 &&
+                            static_cast<uint64_t>(log_stat.st_size) >= sizeof(HashLogHeader) + log_header.data_size;
+        /* bytes after data_size are an append in progress */
+        log_size = is_log ? sizeof(HashLogHeader) + log_header.data_size : 0;
+        log = is_log ? mmap(nullptr, log_size, PROT_READ, MAP_PRIVATE, log_fd, 0) : MAP_FAILED;
+        ::close(log_fd); /* the mapping stays valid */
+        record_offsets = log != MAP_FAILED ? _find_record_offsets(log, sizeof(HashLogHeader), log_size) : std::nullopt;
+        if (!record_offsets.has_value()) {
+            if (log != MAP_FAILED)
+                munmap(log, log_size);
+            const std::string error_msg = log_path.string() + " is not a hash log of this version.";
+            return WithError<std::shared_ptr<HashIndex>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+    }
+
+    const int32_t fd = ::open(index_path.c_str(), O_RDONLY);
+    HashIndexHeader header;
+    struct stat file_stat;
+    const bool is_index = fd >= 0 && ::pread(fd, &header, sizeof(HashIndexHeader), 0) == sizeof(HashIndexHeader) &&
+                          std::memcmp(header.magic, HASH_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                          header.version == HASH_INDEX_VERSION && fstat(fd, &file_stat) == 0 &&
+                          static_cast<uint64_t>(file_stat.st_size) ==
+                          sizeof(HashIndexHeader) + header.num_entries * sizeof(HashIndexEntry) +
+                          HASH_INDEX_NUM_TABLES * ((HASH_INDEX_NUM_BUCKETS + 1) + header.num_entries) * sizeof(uint32_t) +
+                          (header.num_videos + 1) * sizeof(uint64_t) + header.names_size;
+    void* data = is_index ? mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (fd >= 0)
+        ::close(fd);
+    if (data == MAP_FAILED) {
+        if (log)
+            munmap(log, log_size);
+        const std::string error_msg = fd < 0 ? "Failed to open " + index_path.string()
+                                             : index_path.string() + " is not a hash index of this version.";
+        return WithError<std::shared_ptr<HashIndex>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::shared_ptr<HashIndex> hash_index = std::make_shared<HashIndex>(data, file_stat.st_size, log, log_size, record_offsets.value());
+    return WithError<std::shared_ptr<HashIndex>> { hash_index, Error(ErrorCode::Success, "") };
+}
+
+HashIndex::HashIndex(const void* data, const size_t size, const void* log, const size_t log_size,
+                     const std::vector<uint64_t>& record_offsets)
+    : data_{data}, size_{size}, log_{log}, log_size_{log_size} {
+    /* a record supersedes the earlier ones of its video, in the tables and in the log */
+    std::map<std::string_view, uint64_t> latest_offsets;
+    for (const uint64_t offset : record_offsets)
+        latest_offsets.insert_or_assign(_get_record_name(log_, offset), offset);
+
+    const uint32_t num_videos = _get_header().num_videos;
+    is_superseded_.resize(num_videos);
+    for (uint32_t video_id = 0; video_id < num_videos; video_id++)
+        is_superseded_[video_id] = latest_offsets.contains(_get_table_video_name(video_id));
+
+    for (const uint64_t offset : record_offsets) {
+        const std::string_view name = _get_record_name(log_, offset);
+        if (latest_offsets.at(name) != offset)
+            continue;
+        const uint32_t video_id = num_videos + static_cast<uint32_t>(appended_names_.size());
+        appended_names_.push_back(name);
+        const HashLogRecordHeader& header = *reinterpret_cast<const HashLogRecordHeader*>(static_cast<const char*>(log_) + offset);
+        const SceneHash* hashes = _get_record_hashes(log_, offset);
+        for (uint32_t i = 0; i < header.num_hashes; i++)
+            appended_entries_.push_back(HashIndexEntry { hashes[i].hash, video_id, hashes[i].scene_number, hashes[i].keyframe, 0 });
+    }
+}
+
+HashIndex::~HashIndex() {
+    munmap(const_cast<void*>(data_), size_);
+    if (log_)
+        munmap(const_cast<void*>(log_), log_size_);
+}
+
+std::span<const HashIndexEntry> HashIndex::_get_entries() const {
+    const HashIndexEntry* entries = reinterpret_cast<const HashIndexEntry*>(static_cast<const char*>(data_) + sizeof(HashIndexHeader));
+    return std::span<const HashIndexEntry>(entries, _get_header().num_entries);
+}
+
+const uint32_t* HashIndex::_get_bucket_offsets(const int32_t table) const {
+    const char* tables = reinterpret_cast<const char*>(_get_entries().data() + _get_header().num_entries);
+    return reinterpret_cast<const uint32_t*>(tables) + table * (HASH_INDEX_NUM_BUCKETS + 1);
+}
+
+const uint32_t* HashIndex::_get_bucket_entries(const int32_t table) const {
+    return _get_bucket_offsets(HASH_INDEX_NUM_TABLES) + table * _get_header().num_entries;
+}
+
+const uint64_t* HashIndex::_get_name_offsets() const {
+    return reinterpret_cast<const uint64_t*>(_get_bucket_entries(HASH_INDEX_NUM_TABLES));
+}
+
+std::string_view HashIndex::_get_table_video_name(const uint32_t video_id) const {
+    const uint64_t* name_offsets = _get_name_offsets();
+    const char* names = reinterpret_cast<const char*>(name_offsets + _get_header().num_videos + 1);
+    return std::string_view(names + name_offsets[video_id], name_offsets[video_id + 1] - name_offsets[video_id]);
+}
+
+const HashIndexEntry& HashIndex::get_entry(const uint32_t entry_id) const {
+    const std::span<const HashIndexEntry> entries = _get_entries();
+    return entry_id < entries.size() ? entries[entry_id] : appended_entries_[entry_id - entries.size()];
+}
+
+bool HashIndex::is_latest(const uint32_t entry_id) const {
+    return entry_id >= _get_header().num_entries || !is_superseded_[_get_entries()[entry_id].video_id];
+}
+
+size_t HashIndex::get_num_videos() const {
+    return std::count(is_superseded_.begin(), is_superseded_.end(), false) + appended_names_.size();
+}
+
+std::string HashIndex::get_video_name(const uint32_t video_id) const {
+    const uint32_t num_videos = _get_header().num_videos;
+    return std::string(video_id < num_videos ? _get_table_video_name(video_id) : appended_names_[video_id - num_videos]);
+}
+
+std::vector<HashMatch> HashIndex::query(const uint64_t hash, const int32_t max_distance) const {
+    std::vector<uint32_t> candidates;
+    for (int32_t table = 0; table < HASH_INDEX_NUM_TABLES; table++) {
+        const uint32_t* bucket_offsets = _get_bucket_offsets(table);
+        const uint32_t* bucket_entries = _get_bucket_entries(table);
+        auto add_bucket = [&](const uint32_t value) {
+            candidates.insert(candidates.end(), bucket_entries + bucket_offsets[value], bucket_entries + bucket_offsets[value + 1]);
+        };
+        _visit_neighbors(_get_substring(hash, table), max_distance / HASH_INDEX_NUM_TABLES, 0, add_bucket);
+    }
+
+    /* an entry close in several substrings is a candidate of each table */
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    /* the entries of the log are few enough to compare one by one */
+    const uint32_t num_entries = static_cast<uint32_t>(_get_header().num_entries);
+    for (uint32_t i = 0; i < appended_entries_.size(); i++)
+        candidates.push_back(num_entries + i);
+
+    std::vector<HashMatch> matches;
+    for (const uint32_t entry_id : candidates) {
+        const int32_t distance = std::popcount(get_entry(entry_id).hash ^ hash);
+        if (distance <= max_distance && is_latest(entry_id))
+            matches.push_back(HashMatch { entry_id, distance });
+    }
+    std::stable_sort(matches.begin(), matches.end(), [](const HashMatch& a, const HashMatch& b) { return a.distance < b.distance; });
+    return matches;
+}
+
+WithError<void> HashIndex::write_merged(const std::filesystem::path& index_path) const {
+    /* the videos of the tables that were not added again keep their order, followed by those of the log */
+    std::vector<std::string_view> video_names;
+    std::vector<uint32_t> new_video_ids(is_superseded_.size());
+    for (uint32_t video_id = 0; video_id < is_superseded_.size(); video_id++) {
+        if (is_superseded_[video_id])
+            continue;
+        new_video_ids[video_id] = static_cast<uint32_t>(video_names.size());
+        video_names.push_back(_get_table_video_name(video_id));
+    }
+
+    std::vector<HashIndexEntry> entries;
+    for (const HashIndexEntry& entry : _get_entries()) {
+        if (!is_superseded_[entry.video_id])
+            entries.push_back(HashIndexEntry { entry.hash, new_video_ids[entry.video_id], entry.scene_number, entry.keyframe, 0 });
+    }
+    const uint32_t first_appended_id = static_cast<uint32_t>(video_names.size());
+    video_names.insert(video_names.end(), appended_names_.begin(), appended_names_.end());
+    for (const HashIndexEntry& entry : appended_entries_) {
+        const uint32_t video_id = first_appended_id + entry.video_id - _get_header().num_videos;
+        entries.push_back(HashIndexEntry { entry.hash, video_id, entry.scene_number, entry.keyframe, 0 });
+    }
+    return _write_hash_index(index_path, video_names, entries);
+}
+
+WithError<std::shared_ptr<HashIndex>> HashIndex::initialize_hash_index(const std::filesystem::path& index_path) {
+    /* waits for an add in progress */
+    const std::filesystem::path lock_path = index_path.string() + ".lock";
+    const int32_t lock_fd = ::open(lock_path.c_str(), O_RDONLY);
+    if (lock_fd >= 0)
+        flock(lock_fd, LOCK_SH);
+    WithError<std::shared_ptr<HashIndex>> opt_hash_index = _open_hash_index(index_path);
+    if (lock_fd >= 0)
+        ::close(lock_fd);
+    return opt_hash_index;
+}
+
+static WithError<void> _add_to_hash_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                          const std::vector<SceneHash>& scene_hashes) {
+    /* the tables start empty, and every video is added to the log */
+    if (!std::filesystem::exists(index_path)) {
+        WithError<void> write_err = _write_hash_index(index_path, {}, {});
+        if (write_err.has_error())
+            return write_err;
+    }
+
+    const std::filesystem::path log_path = index_path.string() + ".log";
+    const int32_t fd = ::open(log_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        const std::string error_msg = "Failed to open " + log_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    HashLogHeader header {};
+    const ssize_t header_size = ::pread(fd, &header, sizeof(HashLogHeader), 0);
+    if (header_size == 0) {
+        std::memcpy(header.magic, HASH_LOG_MAGIC, sizeof(header.magic));
+        header.version = HASH_INDEX_VERSION;
+    } else if (header_size != sizeof(HashLogHeader) || std::memcmp(header.magic, HASH_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+               header.version != HASH_INDEX_VERSION) {
+        ::close(fd);
+        const std::string error_msg = log_path.string() + " is not a hash log of this version.";
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const size_t payload_size = sizeof(HashLogRecordHeader) + scene_hashes.size() * sizeof(SceneHash) + video_name.size();
+    const size_t record_size = (payload_size + 7) / 8 * 8;
+    const HashLogRecordHeader record_header { record_size, static_cast<uint32_t>(scene_hashes.size()),
+                                              static_cast<uint32_t>(video_name.size()) };
+    std::vector<char> record(record_size, 0);
+    std::memcpy(record.data(), &record_header, sizeof(HashLogRecordHeader));
+    std::memcpy(record.data() + sizeof(HashLogRecordHeader), scene_hashes.data(), scene_hashes.size() * sizeof(SceneHash));
+    std::memcpy(record.data() + sizeof(HashLogRecordHeader) + scene_hashes.size() * sizeof(SceneHash), video_name.data(), video_name.size());
+
+    /* The record becomes visible when the header is updated after it. Bytes of an append interrupted
+       before that are overwritten. */
+    const off_t offset = sizeof(HashLogHeader) + header.data_size;
+    header.data_size += record_size;
+    header.num_hashes += scene_hashes.size();
+    const bool is_written = ::ftruncate(fd, offset) == 0 &&
+                            ::pwrite(fd, record.data(), record_size, offset) == static_cast<ssize_t>(record_size) &&
+                            ::pwrite(fd, &header, sizeof(HashLogHeader), 0) == sizeof(HashLogHeader);
+    ::close(fd);
+    if (!is_written) {
+        const std::string error_msg = "Failed to append to " + log_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    if (header.num_hashes <= HASH_INDEX_MAX_APPENDED)
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    /* an interruption before the log is removed leaves entries that supersede the same ones in the tables */
+    WithError<std::shared_ptr<HashIndex>> opt_hash_index = _open_hash_index(index_path);
+    if (opt_hash_index.has_error())
+        return WithError<void> { opt_hash_index.error };
+    WithError<void> merge_err = opt_hash_index.value()->write_merged(index_path);
+    if (merge_err.has_error())
+        return merge_err;
+
+    std::error_code remove_error;
+    std::filesystem::remove(log_path, remove_error);
+    if (remove_error) {
+        const std::string error_msg = "Failed to remove " + log_path.string() + ": " + remove_error.message();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> add_to_hash_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                  const std::vector<SceneHash>& scene_hashes) {
+    /* concurrent runs (--batch) add their videos one after the other; the lock is released when closed */
+    const std::filesystem::path lock_path = index_path.string() + ".lock";
+    const int32_t lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+        if (lock_fd >= 0)
+            ::close(lock_fd);
+        const std::string error_msg = "Failed to lock " + lock_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    WithError<void> add_err = _add_to_hash_index(index_path, video_name, scene_hashes);
+    ::close(lock_fd);
+    return add_err;
+}
@@ -0,0 +1,106 @@
+#include "shutoh/error.hpp"
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/video_stream.hpp"
+
+#include "image_collector.hpp"
+
+#include <cstdlib>
+
+constexpr int32_t SINGLE_PASS_FRAMES_PER_IMAGE = 4;
+
+ImageCollector::ImageCollector(const ImageExtractor& image_extractor, const VideoStream& video,
+                               const int32_t num_images, const int32_t frame_margin,
+                               const std::optional<int32_t> latency)
+    : image_extractor_{image_extractor}, resize_{image_extractor.get_size(video)}, framerate_{video.get_framerate()},
+      frame_margin_{frame_margin},
+      capacity_{static_cast<size_t>(SINGLE_PASS_FRAMES_PER_IMAGE * num_images)},
+      ring_size_{2 * frame_margin + latency.value_or(static_cast<int32_t>(capacity_)) + 1},
+      scene_start_{video.get_start().get_frame_num()} {}
+
+void ImageCollector::add_frame(const cv::Mat& frame, const int32_t frame_num, const std::optional<int32_t> cut) {
+    cv::Mat sample = frame;
+    _resize_frame(sample);
+    samples_.emplace(frame_num, sample);
+
+    if (cut.has_value()) {
+        _close_scene(cut.value());
+        samples_.erase(samples_.begin(), samples_.lower_bound(cut.value()));
+        scene_start_ = cut.value();
+        scene_ind_++;
+        stride_ = 1;
+    }
+    _thin_out(frame_num);
+}
+
+WithError<void> ImageCollector::finish(const std::vector<FrameTimeCodePair>& scene_list) {
+    if (!error_msg_.has_value()) {
+        if (static_cast<size_t>(scene_ind_) + 1 != scene_list.size())
+            error_msg_ = "Scene list does not match the cuts seen while collecting images.";
+        else
+            _close_scene(std::get<1>(scene_list.back()).get_frame_num());
+    }
+    samples_.clear();
+
+    WithError<void> flush_err = image_extractor_.flush();
+    if (flush_err.has_error() && !error_msg_.has_value())
+        error_msg_ = flush_err.error.get_error_msg();
+
+    if (error_msg_.has_value())
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg_.value()) };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void ImageCollector::_resize_frame(cv::Mat& frame) const {
+    if (resize_.resize_mode == ResizeMode::RESIZE_TARGET)
+        cv::resize(frame, frame, cv::Size(resize_.width, resize_.height), 0, 0, cv::INTER_LINEAR);
+    else if (resize_.resize_mode == ResizeMode::RESIZE_SCALE)
+        cv::resize(frame, frame, cv::Size(), resize_.scale, resize_.scale, cv::INTER_LINEAR);
+}
+
+void ImageCollector::_close_scene(const int32_t scene_end) {
+    if (error_msg_.has_value() || samples_.empty())
+        return;
+
+    const FrameTimeCode start(scene_start_, framerate_);
+    const FrameTimeCode end(scene_end, framerate_);
+    const std::vector<int32_t> frame_inds = image_extractor_.get_frame_inds(start, end);
+
+    for (size_t image_ind = 0; image_ind < frame_inds.size(); image_ind++) {
+        /* nearest retained frame, preferring the later one on a tie */
+        const int32_t target = frame_inds[image_ind];
+        auto after = samples_.lower_bound(target);
+        auto nearest = after;
+        if (after == samples_.end() || (after != samples_.begin() && target - std::prev(after)->first < after->first - target))
+            nearest = std::prev(after);
+
+        WithError<void> err = image_extractor_.save_frame(nearest->second, scene_ind_, static_cast<int32_t>(image_ind));
+        if (err.has_error()) {
+            error_msg_ = err.error.get_error_msg();
+            return;
+        }
+    }
+}
+
+bool ImageCollector::_is_protected(const int32_t sample_num, const int32_t frame_num) const {
+    const bool is_head = sample_num <= scene_start_ + frame_margin_;
+    const bool is_recent = sample_num > frame_num - ring_size_;
+    return is_head || is_recent;
+}
+
+void ImageCollector::_thin_out(const int32_t frame_num) {
+    /* the frame which has just left the ring is kept only if it is on the stride */
+    auto leaving = samples_.find(frame_num - ring_size_);
+    if (leaving != samples_.end() && !_is_protected(leaving->first, frame_num)
+        && (leaving->first - scene_start_) % stride_ != 0)
+        samples_.erase(leaving);
+
+    while (samples_.size() > capacity_ + ring_size_ + frame_margin_ + 1) {
+        stride_ *= 2;
+        for (auto it = samples_.begin(); it != samples_.end();) {
+            if (!_is_protected(it->first, frame_num) && (it->first - scene_start_) % stride_ != 0)
+                it = samples_.erase(it);
+            else
+                ++it;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef IMAGE_COLLECTOR_H
+#define IMAGE_COLLECTOR_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+#include "image_extractor.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+
+class VideoStream;
+template <typename T> struct WithError;
+
+/*
+   Collects the images of save-images while SceneManager decodes the video, so that no second pass is needed.
+   Recent frames are kept in a ring sized from the detector's latency so that the end image of a scene is still
+   there when its cut is reported, and the first frames after a cut are kept until the start image is taken.
+   If the latency is unbounded, the ring holds SINGLE_PASS_FRAMES_PER_IMAGE * num_images frames and a cut reported
+   later takes its end image from the nearest older sample. Images in the middle of a scene
+   depend on where the scene ends, so the open scene is sampled with a stride which doubles whenever more than
+   SINGLE_PASS_FRAMES_PER_IMAGE * num_images frames are retained, and the nearest sample is saved.
+*/
+class ImageCollector {
+    public:
+        explicit ImageCollector(const ImageExtractor& image_extractor, const VideoStream& video,
+                                const int32_t num_images, const int32_t frame_margin,
+                                const std::optional<int32_t> latency);
+        void add_frame(const cv::Mat& frame, const int32_t frame_num, const std::optional<int32_t> cut);
+        WithError<void> finish(const std::vector<FrameTimeCodePair>& scene_list);
+
+    private:
+        void _resize_frame(cv::Mat& frame) const;
+        void _close_scene(const int32_t scene_end);
+        void _thin_out(const int32_t frame_num);
+        bool _is_protected(const int32_t sample_num, const int32_t frame_num) const;
+
+        const ImageExtractor image_extractor_;
+        const ResizedSize resize_;
+        const float framerate_;
+        const int32_t frame_margin_;
+        const size_t capacity_;
+        const int32_t ring_size_;
+        std::map<int32_t, cv::Mat> samples_;
+        int32_t scene_start_;
+        int32_t scene_ind_ = 0;
+        int32_t stride_ = 1;
+        std::optional<std::string> error_msg_ = std::nullopt;
+};
+
+#endif
@@ -3,58 +3,119 @@
 #include "shutoh/video_stream.hpp"
 
 #include "image_extractor.hpp"
+#include "image_writer.hpp"
+#include "keyframe_index.hpp"
 #include "config.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <iostream>
 #include <numeric>
 #include <optional>
+#include <algorithm>
+#include <future>
+#include <thread>
 #include <fmt/core.h>
-#include <regex>
+
+constexpr size_t MIN_IMAGES_PER_READER = 32; /* opening another reader costs about as much as a few seeks */
+constexpr size_t KEYFRAMES_TO_ESTIMATE_GOP = 16;
 
 ImageExtractor::ImageExtractor(const std::filesystem::path& output_dir, const std::string output_filename, 
                                const int32_t num_images, const int32_t frame_margin, const std::string& format, 
-                               const int32_t quality, const std::optional<int32_t> width, const std::optional<int32_t> height,
-                               const std::optional<float> scale) : output_dir_{output_dir}, output_filename_{output_filename},
-                               num_images_{num_images}, frame_margin_{frame_margin}, format_{format}, quality_{quality}, width_{width},
-                               height_{height}, scale_{scale} {
-    if (format_ == "jpg")
+                               const int32_t quality, const int32_t compression, const std::optional<int32_t> width,
+                               const std::optional<int32_t> height, const std::optional<float> scale, const int32_t num_readers)
+                               : output_dir_{output_dir}, output_filename_{output_filename}, num_images_{num_images},
+                               frame_margin_{frame_margin}, format_{format}, quality_{quality}, compression_{compression}, width_{width},
+                               height_{height}, scale_{scale}, num_readers_{num_readers},
+                               filename_template_{_compile_filename_template(output_filename)} {
+    if (format_ == "jpg") {
         params_.push_back(cv::IMWRITE_JPEG_QUALITY);
-    else if (format_ == "webp")
+        params_.push_back(quality_);
+    } else if (format_ == "webp") {
         params_.push_back(cv::IMWRITE_WEBP_QUALITY);
-    else
+        params_.push_back(quality_);
+    } else {
         params_.push_back(cv::IMWRITE_PNG_COMPRESSION);
-    params_.push_back(quality_);
+        params_.push_back(compression_);
+    }
+    image_writer_ = std::make_shared<ImageWriter>(format_, params_, std::max(1u, std::thread::hardware_concurrency()));
 }
 
 WithError<void> ImageExtractor::save_images(VideoStream& video,
                                             const std::vector<FrameTimeCodePair>& scene_list) const {
     
-    ResizedSize resize = _get_size(video);
+    ResizedSize resize = get_size(video);
     std::vector<SceneFrameIndex> scene_frame_list = _get_selected_frame_ind_from_scenes(scene_list);
     
     if (resize.resize_mode == ResizeMode::ORIGINAL) {
-        auto resize_frame = [](cv::Mat& frame){}; /* dummy */
-        return _save_scene_frames(video, scene_frame_list, resize_frame);
+        auto resize_frame = [](cv::Mat& frame){ frame = frame.clone(); }; /* the reader reuses its buffer while the image is queued */
+        return _save_scene_frames_parallel(video, scene_frame_list, resize_frame);
     } else if (resize.resize_mode == ResizeMode::RESIZE_TARGET) {
         cv::Size resized_size(resize.width, resize.height);
         auto resize_frame = [resized_size](cv::Mat& frame){ cv::resize(frame, frame, resized_size, 0, 0, cv::INTER_LINEAR); };
-        return _save_scene_frames(video, scene_frame_list, resize_frame);
+        return _save_scene_frames_parallel(video, scene_frame_list, resize_frame);
     } else {
         const float scale = resize.scale;
         auto resize_frame = [scale](cv::Mat& frame) { cv::resize(frame, frame, cv::Size(), scale, scale, cv::INTER_LINEAR); };
-        return _save_scene_frames(video, scene_frame_list, resize_frame);
+        return _save_scene_frames_parallel(video, scene_frame_list, resize_frame);
     }
 }
 
+template <typename ResizeFunc>
+WithError<void> ImageExtractor::_save_scene_frames_parallel(VideoStream& video,
+                                                            const std::vector<SceneFrameIndex>& scene_frame_list,
+                                                            ResizeFunc resize_frame) const {
+    /* Targets are read in frame order and split into contiguous ranges, one reader (VideoStream) per range. */
+    std::vector<size_t> order(scene_frame_list.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&scene_frame_list](const size_t a, const size_t b) {
+        return scene_frame_list[a].frame_ind_in_video < scene_frame_list[b].frame_ind_in_video;
+    });
+
+    const size_t num_readers = _get_num_readers(scene_frame_list.size());
+    const int32_t max_forward_frames = _get_max_forward_frames(video);
+    std::vector<std::future<WithError<void>>> futures;
+
+    for (size_t reader_i = 0; reader_i < num_readers; reader_i++) {
+        std::vector<SceneFrameIndex> targets;
+        for (size_t i = reader_i * order.size() / num_readers; i < (reader_i + 1) * order.size() / num_readers; i++)
+            targets.push_back(scene_frame_list[order[i]]);
+
+        futures.push_back(std::async(std::launch::async, [this, &video, reader_i, targets, max_forward_frames, resize_frame]() {
+            if (reader_i == 0)
+                return _save_scene_frames(video, targets, max_forward_frames, resize_frame);
+
+            WithError<VideoStream> opt_reader = VideoStream::initialize_video_stream(video.get_input_path());
+            if (opt_reader.has_error())
+                return WithError<void> { opt_reader.error };
+            VideoStream reader = opt_reader.value();
+            return _save_scene_frames(reader, targets, max_forward_frames, resize_frame);
+        }));
+    }
+
+    std::optional<Error> first_error = std::nullopt;
+    for (auto& future : futures) {
+        WithError<void> err = future.get();
+        if (err.has_error() && !first_error.has_value())
+            first_error.emplace(err.error);
+    }
+    WithError<void> flush_err = flush();
+    if (flush_err.has_error() && !first_error.has_value())
+        first_error.emplace(flush_err.error);
+    if (first_error.has_value())
+        return WithError<void> { first_error.value() };
+
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
 template <typename ResizeFunc>
 WithError<void> ImageExtractor::_save_scene_frames(VideoStream& video,
                                                    const std::vector<SceneFrameIndex>& scene_frame_list,
+                                                   const int32_t max_forward_frames,
                                                    ResizeFunc resize_frame) const {
-    
-    const std::string output_dir = output_dir_.string();
-    const std::regex scene_pattern("@SCENE_NUMBER");
-    const std::regex frame_pattern("@IMAGE_NUMBER");
+    /* A seek decodes from the previous keyframe anyway, so targets within a GOP ahead are
+       reached by grabbing frames forward instead. */
+    int32_t next_frame_num = -1; /* unknown until the first seek */
+    cv::Mat frame;
 
     for (size_t sf_i = 0; sf_i < scene_frame_list.size(); sf_i++) {
         const SceneFrameIndex scene_frame_index = scene_frame_list[sf_i];
@@ -62,27 +123,98 @@ WithError<void> ImageExtractor::_save_scene_frames(VideoStream& video,
         const int32_t frame_ind_in_scene = scene_frame_index.frame_ind_in_scene;
         const int32_t frame_ind_in_video = scene_frame_index.frame_ind_in_video; 
 
-        WithError<void> err = video.seek(frame_ind_in_video);
-        if (err.has_error())
-            return err;
+        const bool is_last_frame = !frame.empty() && frame_ind_in_video == next_frame_num - 1;
+        if (!is_last_frame) {
+            const bool decode_forward = next_frame_num >= 0 && frame_ind_in_video >= next_frame_num
+                                        && frame_ind_in_video - next_frame_num <= max_forward_frames;
+            if (decode_forward) {
+                while (next_frame_num < frame_ind_in_video && video.get_cap().grab())
+                    next_frame_num++;
+            } else {
+                WithError<void> err = video.seek(frame_ind_in_video);
+                if (err.has_error())
+                    return err;
+                next_frame_num = frame_ind_in_video;
+            }
+
+            if (next_frame_num != frame_ind_in_video || !video.get_cap().read(frame)) {
+                const std::string error_msg = fmt::format("Failed to read frame {} for scene {}.", frame_ind_in_video, scene_ind);
+                return WithError<void> { Error(ErrorCode::FailedToSetFramePosition, error_msg) };
+            }
+            next_frame_num++;
+        }
 
-        cv::Mat frame;
-        if(!video.get_cap().read(frame))
-            break;
+        cv::Mat image = frame;
+        resize_frame(image); /* if resize_ == ResizeMode::ORIGINAL, nothing happens. */
+        if (image.data == frame.data) /* resizing to the same size keeps the reader's buffer, reused by the next read */
+            image = frame.clone();
 
-        resize_frame(frame); /* if resize_ == ResizeMode::ORIGINAL, nothing happens. */
+        WithError<void> save_err = save_frame(image, scene_ind, frame_ind_in_scene);
+        if (save_err.has_error())
+            return save_err;
+    }
 
-        const std::string filename = std::regex_replace(std::regex_replace(output_filename_, scene_pattern, std::to_string(scene_ind)), 
-                                                        frame_pattern, std::to_string(frame_ind_in_scene));
-        const std::string output_path = output_dir + "/" + filename + "." + format_;
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
 
-        if(!cv::imwrite(output_path, frame, params_)) {
-            const std::string error_msg = "Failed to save the frame to " + output_path;
-            return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+size_t ImageExtractor::_get_num_readers(const size_t num_targets) const {
+    const size_t max_readers = num_readers_ > 0 ? num_readers_ : std::max(1u, std::thread::hardware_concurrency());
+    const size_t useful_readers = (num_targets + MIN_IMAGES_PER_READER - 1) / MIN_IMAGES_PER_READER;
+    return std::max<size_t>(1, std::min(max_readers, useful_readers));
+}
+
+int32_t ImageExtractor::_get_max_forward_frames(const VideoStream& video) const {
+    const WithError<KeyframeIndex> keyframe_index = KeyframeIndex::build(video.get_input_path(), video.get_framerate(),
+                                                                         KEYFRAMES_TO_ESTIMATE_GOP);
+    const int32_t interval = keyframe_index.has_error() ? 0 : keyframe_index.value().estimate_interval();
+    if (interval > 0)
+        return interval;
+    return static_cast<int32_t>(2 * video.get_framerate()); /* typical GOP length */
+}
+
+WithError<void> ImageExtractor::save_frame(const cv::Mat& frame, const int32_t scene_ind, const int32_t frame_ind_in_scene) const {
+    /* Encoding and writing happen on the writer pool; their errors are reported by flush(). */
+    image_writer_->write(frame, _get_output_path(scene_ind, frame_ind_in_scene));
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> ImageExtractor::flush() const {
+    return image_writer_->wait();
+}
+
+std::vector<FilenamePart> ImageExtractor::_compile_filename_template(const std::string& output_filename) const {
+    const std::string scene_pattern = "@SCENE_NUMBER";
+    const std::string image_pattern = "@IMAGE_NUMBER";
+    std::vector<FilenamePart> parts;
+    std::string literal;
+    size_t pos = 0;
+    while (pos < output_filename.size()) {
+        if (output_filename.compare(pos, scene_pattern.size(), scene_pattern) == 0) {
+            parts.push_back(FilenamePart { literal, FilenameField::SCENE_NUMBER });
+            literal.clear();
+            pos += scene_pattern.size();
+        } else if (output_filename.compare(pos, image_pattern.size(), image_pattern) == 0) {
+            parts.push_back(FilenamePart { literal, FilenameField::IMAGE_NUMBER });
+            literal.clear();
+            pos += image_pattern.size();
+        } else {
+            literal += output_filename[pos++];
         }
     }
+    parts.push_back(FilenamePart { literal, FilenameField::NONE });
+    return parts;
+}
 
-    return WithError<void> { Error(ErrorCode::Success, "") };
+std::string ImageExtractor::_get_output_path(const int32_t scene_ind, const int32_t frame_ind_in_scene) const {
+    std::string output_path = output_dir_.string() + "/";
+    for (const FilenamePart& part : filename_template_) {
+        output_path += part.literal;
+        if (part.field == FilenameField::SCENE_NUMBER)
+            output_path += std::to_string(scene_ind);
+        else if (part.field == FilenameField::IMAGE_NUMBER)
+            output_path += std::to_string(frame_ind_in_scene);
+    }
+    return output_path + "." + format_;
 }
 
 std::vector<SceneFrameIndex> ImageExtractor::_get_selected_frame_ind_from_scenes(const std::vector<FrameTimeCodePair>& scene_list) const {
@@ -90,7 +222,7 @@ std::vector<SceneFrameIndex> ImageExtractor::_get_selected_frame_ind_from_scenes
     for (size_t scene_i = 0; scene_i < scene_list.size(); scene_i++) {
         const FrameTimeCode start = std::get<0>(scene_list[scene_i]);
         const FrameTimeCode end = std::get<1>(scene_list[scene_i]);
-        const std::vector<int32_t> frame_inds = _get_frame_inds(start, end);
+        const std::vector<int32_t> frame_inds = get_frame_inds(start, end);
         for (size_t frame_j = 0; frame_j < frame_inds.size(); frame_j++) {
             scene_frame_list.push_back(SceneFrameIndex { 
                 static_cast<int32_t>(scene_i),
@@ -102,8 +234,8 @@ std::vector<SceneFrameIndex> ImageExtractor::_get_selected_frame_ind_from_scenes
     return scene_frame_list;
 }
 
-std::vector<int32_t> ImageExtractor::_get_frame_inds(const FrameTimeCode& start, 
-                                                     const FrameTimeCode& end) const {
+std::vector<int32_t> ImageExtractor::get_frame_inds(const FrameTimeCode& start, 
+                                                    const FrameTimeCode& end) const {
     std::vector<StartEndSplitIndex> splits = _construct_splits(start, end);
     std::vector<int32_t> frame_inds;
     const int32_t split_size = splits.size();
@@ -150,7 +282,7 @@ std::vector<StartEndSplitIndex> ImageExtractor::_construct_splits(const FrameTim
     return result;
 }
 
-ResizedSize ImageExtractor::_get_size(const VideoStream& video) const {
+ResizedSize ImageExtractor::get_size(const VideoStream& video) const {
     if (width_.has_value() && height_.has_value())
         return ResizedSize { width_.value(), height_.value(), 1.0, ResizeMode::RESIZE_TARGET };
 
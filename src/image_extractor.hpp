@@ -3,12 +3,15 @@
 
 #include "shutoh/frame_timecode_pair.hpp"
 
+#include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <optional>
+#include <memory>
 
 class VideoStream;
+class ImageWriter;
 template <typename T> struct WithError;
 enum class ResizeMode;
 
@@ -23,6 +26,17 @@ struct SceneFrameIndex {
     const int32_t frame_ind_in_video; /* frame index in the video (absolute) */
 };
 
+enum class FilenameField {
+    NONE,
+    SCENE_NUMBER,
+    IMAGE_NUMBER,
+};
+
+struct FilenamePart {
+    const std::string literal; /* text before the field */
+    const FilenameField field;
+};
+
 enum class ResizeMode {
     ORIGINAL,
     RESIZE_TARGET,
@@ -39,25 +53,34 @@ struct ResizedSize {
 class ImageExtractor {
     public:
         explicit ImageExtractor(const std::filesystem::path& output_dir, const std::string output_filename, const int32_t num_images, 
-                                const int32_t frame_margin, const std::string& format, const int32_t quality, const std::optional<int32_t> width,
-                                const std::optional<int32_t> height, const std::optional<float> scale);
+                                const int32_t frame_margin, const std::string& format, const int32_t quality, const int32_t compression,
+                                const std::optional<int32_t> width,
+                                const std::optional<int32_t> height, const std::optional<float> scale, const int32_t num_readers = 0);
         
         WithError<void> save_images(VideoStream& video, const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> save_frame(const cv::Mat& frame, const int32_t scene_ind, const int32_t frame_ind_in_scene) const;
+        WithError<void> flush() const;
+        std::vector<int32_t> get_frame_inds(const FrameTimeCode& start, const FrameTimeCode& end) const;
+        ResizedSize get_size(const VideoStream& video) const;
 
     private:
         template <typename ResizeFunc>
+        WithError<void> _save_scene_frames_parallel(VideoStream& video, const std::vector<SceneFrameIndex>& scene_frame_list,
+                                                    ResizeFunc resize_frame) const;
+        template <typename ResizeFunc>
         WithError<void> _save_scene_frames(VideoStream& video, const std::vector<SceneFrameIndex>& scene_frame_list,
-                                           ResizeFunc resize_frame) const;
+                                           const int32_t max_forward_frames, ResizeFunc resize_frame) const;
+        size_t _get_num_readers(const size_t num_targets) const;
+        int32_t _get_max_forward_frames(const VideoStream& video) const;
 
         std::vector<SceneFrameIndex> _get_selected_frame_ind_from_scenes(const std::vector<FrameTimeCodePair>& scene_list) const;
 
-        std::vector<int32_t> _get_frame_inds(const FrameTimeCode& start, 
-                                             const FrameTimeCode& end) const;
-        
         std::vector<StartEndSplitIndex> _construct_splits(const FrameTimeCode& start,
                                                           const FrameTimeCode& end) const;
 
-        ResizedSize _get_size(const VideoStream& video) const;
+        std::vector<FilenamePart> _compile_filename_template(const std::string& output_filename) const;
+        std::string _get_output_path(const int32_t scene_ind, const int32_t frame_ind_in_scene) const;
+
         std::pair<int32_t, int32_t> _calculate_resized_size(const int32_t original_width, const int32_t original_height) const;
 
         const std::filesystem::path output_dir_;
@@ -66,10 +89,14 @@ class ImageExtractor {
         const int32_t frame_margin_;
         std::string format_;
         const int32_t quality_;
+        const int32_t compression_;
         std::optional<int32_t> width_;
         std::optional<int32_t> height_;
         std::optional<float> scale_;
+        const int32_t num_readers_; /* 0: one per core */
         std::vector<int32_t> params_;
+        const std::vector<FilenamePart> filename_template_;
+        std::shared_ptr<ImageWriter> image_writer_; /* shared by copies, e.g. ImageCollector, its threads start with the first image */
 };
 
 #endif
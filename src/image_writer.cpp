@@ -0,0 +1,75 @@
+#include "shutoh/error.hpp"
+
+#include "image_writer.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+constexpr size_t IMAGE_QUEUE_LENGTH_PER_WORKER = 2;
+
+ImageWriter::ImageWriter(const std::string& format, const std::vector<int32_t>& params, const size_t num_workers)
+    : extension_{"." + format}, params_{params}, num_workers_{std::max<size_t>(1, num_workers)},
+      queue_{IMAGE_QUEUE_LENGTH_PER_WORKER * num_workers_} {}
+
+ImageWriter::~ImageWriter() {
+    for (size_t i = 0; i < workers_.size(); i++)
+        queue_.push(std::nullopt);
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void ImageWriter::write(const cv::Mat& image, const std::string& output_path) {
+    std::call_once(workers_started_, &ImageWriter::_start_workers, this);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+    queue_.push(ImageWriteTask { image, output_path }); /* blocks while all workers are busy */
+}
+
+WithError<void> ImageWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_done_.wait(lock, [this]() { return pending_ == 0; });
+
+    if (error_msg_.has_value()) {
+        const std::string error_msg = error_msg_.value();
+        error_msg_.reset();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void ImageWriter::_start_workers() {
+    for (size_t i = 0; i < num_workers_; i++)
+        workers_.emplace_back(&ImageWriter::_encode_thread, this);
+}
+
+void ImageWriter::_encode_thread() {
+    std::vector<uint8_t> buffer; /* reused across images to avoid reallocating the encoded output */
+    while (true) {
+        const std::optional<ImageWriteTask> task = queue_.get();
+        if (!task.has_value())
+            break;
+
+        const ImageWriteTask& write_task = task.value();
+        if (!cv::imencode(extension_, write_task.image, buffer, params_)) {
+            _set_error("Failed to encode the frame for " + write_task.output_path);
+        } else {
+            std::ofstream output(write_task.output_path, std::ios::binary);
+            output.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            if (!output)
+                _set_error("Failed to save the frame to " + write_task.output_path);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_--;
+        if (pending_ == 0)
+            cond_done_.notify_all();
+    }
+}
+
+void ImageWriter::_set_error(const std::string& error_msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_msg_.has_value())
+        error_msg_ = error_msg;
+}
@@ -0,0 +1,51 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "blocking_queue.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+
+template <typename T> struct WithError;
+
+struct ImageWriteTask {
+    const cv::Mat image; /* must not be modified after it is submitted */
+    const std::string output_path;
+};
+
+/* Encodes and writes images on a pool of worker threads so that decoding is not blocked by
+   slow encoders (PNG with high compression, WebP). The workers are started by the first write. */
+class ImageWriter {
+    public:
+        explicit ImageWriter(const std::string& format, const std::vector<int32_t>& params, const size_t num_workers);
+        ~ImageWriter();
+        ImageWriter(const ImageWriter&) = delete;
+        ImageWriter& operator=(const ImageWriter&) = delete;
+
+        void write(const cv::Mat& image, const std::string& output_path);
+        WithError<void> wait();
+
+    private:
+        void _start_workers();
+        void _encode_thread();
+        void _set_error(const std::string& error_msg);
+
+        const std::string extension_;
+        const std::vector<int32_t> params_;
+        const size_t num_workers_;
+        std::once_flag workers_started_;
+        BlockingQueue<std::optional<ImageWriteTask>> queue_; /* std::nullopt stops a worker */
+        std::vector<std::thread> workers_;
+
+        std::mutex mutex_;
+        std::condition_variable cond_done_;
+        size_t pending_ = 0;
+        std::optional<std::string> error_msg_ = std::nullopt;
+};
+
+#endif
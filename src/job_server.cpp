@@ -0,0 +1,216 @@
+#include "shutoh/error.hpp"
+
+#include "job_server.hpp"
+#include "batch_runner.hpp"
+#include "blocking_queue.hpp"
+#include "config.hpp"
+
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <fmt/core.h>
+
+constexpr std::chrono::milliseconds PROGRESS_INTERVAL(500);
+constexpr size_t MAX_REQUEST_SIZE = 64 * 1024;
+constexpr int32_t REQUEST_TIMEOUT_SECONDS = 10; /* a client which never sends its line does not hold a worker */
+constexpr int32_t LISTEN_BACKLOG = 64;
+
+static WithError<sockaddr_un> _create_address(const std::filesystem::path& socket_path) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    const std::string path = socket_path.string();
+    if (path.size() >= sizeof(address.sun_path)) {
+        const std::string error_msg = "The socket path is too long: " + path;
+        return WithError<sockaddr_un> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return WithError<sockaddr_un> { address, Error(ErrorCode::Success, "") };
+}
+
+static bool _send_line(const int32_t fd, const std::string& line) {
+    /* MSG_NOSIGNAL: a client which went away must not kill the server with SIGPIPE */
+    const std::string data = line + "\n";
+    for (size_t sent = 0; sent < data.size();) {
+        const ssize_t size = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (size <= 0)
+            return false;
+        sent += static_cast<size_t>(size);
+    }
+    return true;
+}
+
+JobServer::JobServer(const std::filesystem::path& socket_path, const std::vector<std::string>& shared_args,
+                     const size_t num_workers)
+    : socket_path_{socket_path}, shared_args_{shared_args}, num_workers_{num_workers} {}
+
+WithError<void> JobServer::serve(const RunFunction& run_job) {
+    WithError<sockaddr_un> opt_address = _create_address(socket_path_);
+    if (opt_address.has_error())
+        return WithError<void> { opt_address.error };
+    const sockaddr_un address = opt_address.value();
+
+    /* a socket file left by a killed server would make bind() fail */
+    std::error_code ec;
+    std::filesystem::remove(socket_path_, ec);
+    const int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, LISTEN_BACKLOG) != 0) {
+        const std::string error_msg = "Failed to listen on " + socket_path_.string() + ": " + std::strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    listen_fd_ = fd;
+    if (is_stopped_)
+        shutdown(fd, SHUT_RDWR);
+    std::cout << "Listening on " << socket_path_.string() << " with " << num_workers_ << " workers." << std::endl;
+
+    /* -1 stops a worker */
+    BlockingQueue<int32_t> client_queue(LISTEN_BACKLOG);
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < num_workers_; i++) {
+        workers.emplace_back([this, &client_queue, &run_job]() {
+            for (int32_t client_fd = client_queue.get(); client_fd >= 0; client_fd = client_queue.get()) {
+                _handle_client(client_fd, run_job);
+                close(client_fd);
+            }
+        });
+    }
+
+    std::optional<Error> accept_error = std::nullopt;
+    while (!is_stopped_) {
+        const int32_t client_fd = accept(fd, nullptr, nullptr);
+        if (client_fd >= 0) {
+            client_queue.push(client_fd);
+        } else if (errno != EINTR && errno != ECONNABORTED && !is_stopped_) {
+            accept_error.emplace(ErrorCode::FailedToOpenFile, std::string("Failed to accept a client: ") + std::strerror(errno));
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < workers.size(); i++)
+        client_queue.push(-1);
+    for (std::thread& worker : workers)
+        worker.join();
+    listen_fd_ = -1;
+    close(fd);
+    std::filesystem::remove(socket_path_, ec);
+
+    if (accept_error.has_value())
+        return WithError<void> { accept_error.value() };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void JobServer::stop() {
+    is_stopped_ = true;
+    const int32_t fd = listen_fd_;
+    if (fd >= 0)
+        shutdown(fd, SHUT_RDWR); /* wakes up accept() */
+}
+
+void JobServer::_handle_client(const int32_t client_fd, const RunFunction& run_job) const {
+    const timeval timeout { REQUEST_TIMEOUT_SECONDS, 0 };
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[4096];
+    bool is_timed_out = false;
+    while (request.find('\n') == std::string::npos && request.size() < MAX_REQUEST_SIZE) {
+        const ssize_t size = recv(client_fd, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0) {
+            is_timed_out = size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(size));
+    }
+    request = request.substr(0, request.find('\n'));
+    const auto send_error = [client_fd](const std::string& error_msg) {
+        _send_line(client_fd, "{\"event\": \"error\", \"message\": \"" + escape_json(error_msg) + "\"}");
+    };
+    if (is_timed_out)
+        return send_error(fmt::format("No job was received within {} seconds.", REQUEST_TIMEOUT_SECONDS));
+
+    WithError<BatchJob> opt_job = BatchRunner::parse_job(request);
+    if (opt_job.has_error())
+        return send_error(opt_job.error.get_error_msg());
+    const WithError<Config> opt_cfg = parse_args(BatchRunner::create_job_args(shared_args_, opt_job.value()), true);
+    if (opt_cfg.has_error())
+        return send_error(opt_cfg.error.get_error_msg());
+
+    /* cuts are sent as soon as they are reported, and the progress only every PROGRESS_INTERVAL */
+    std::chrono::steady_clock::time_point last_progress = std::chrono::steady_clock::now();
+    const ProgressCallback progress_callback = [client_fd, &last_progress](const FrameTimeCode& position,
+                                                                          const std::optional<FrameTimeCode>& cut) {
+        if (cut.has_value()) {
+            _send_line(client_fd, fmt::format("{{\"event\": \"cut\", \"frame\": {}, \"timecode\": \"{}\", \"latency\": {}}}",
+                                              cut.value().get_frame_num(), cut.value().to_string(),
+                                              position.get_frame_num() - cut.value().get_frame_num()));
+        }
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now - last_progress >= PROGRESS_INTERVAL) {
+            last_progress = now;
+            _send_line(client_fd, fmt::format("{{\"event\": \"progress\", \"frame\": {}, \"timecode\": \"{}\"}}",
+                                              position.get_frame_num(), position.to_string()));
+        }
+    };
+
+    /* a broken video must not stop the server */
+    try {
+        WithError<std::vector<FrameTimeCodePair>> opt_scene_list = run_job(opt_cfg.value(), progress_callback);
+        if (opt_scene_list.has_error())
+            return send_error(opt_scene_list.error.get_error_msg());
+
+        std::string scenes;
+        for (const FrameTimeCodePair& scene : opt_scene_list.value())
+            scenes += fmt::format("{}[{}, {}]", scenes.empty() ? "" : ", ",
+                                  std::get<0>(scene).get_frame_num(), std::get<1>(scene).get_frame_num());
+        _send_line(client_fd, "{\"event\": \"done\", \"scenes\": [" + scenes + "]}");
+    }
+    catch (const std::exception& err) {
+        send_error(err.what());
+    }
+}
+
+WithError<void> JobServer::submit(const std::filesystem::path& socket_path, const std::string& job,
+                                  const EventCallback& on_event) {
+    WithError<sockaddr_un> opt_address = _create_address(socket_path);
+    if (opt_address.has_error())
+        return WithError<void> { opt_address.error };
+    const sockaddr_un address = opt_address.value();
+
+    const int32_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || !_send_line(fd, job)) {
+        const std::string error_msg = "Failed to connect to " + socket_path.string() + ": " + std::strerror(errno);
+        if (fd >= 0)
+            close(fd);
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::string data;
+    std::string last_event;
+    char buffer[4096];
+    while (true) {
+        const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+        if (size <= 0)
+            break;
+        data.append(buffer, static_cast<size_t>(size));
+        for (size_t end = data.find('\n'); end != std::string::npos; end = data.find('\n')) {
+            last_event = data.substr(0, end);
+            data.erase(0, end + 1);
+            on_event(last_event);
+        }
+    }
+    close(fd);
+
+    if (last_event.starts_with("{\"event\": \"done\""))
+        return WithError<void> { Error(ErrorCode::Success, "") };
+    const std::string error_msg = last_event.empty() ? "The server closed the connection before the job finished." : last_event;
+    return WithError<void> { Error(ErrorCode::InvalidCommand, error_msg) };
+}
@@ -0,0 +1,51 @@
+#ifndef JOB_SERVER_H
+#define JOB_SERVER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/scene_manager.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+
+template <typename T> struct WithError;
+struct Config;
+
+/*
+   Detection service on a Unix domain socket (--serve), which saves the process startup per video.
+   A client sends one job per connection as an NDJSON line, in the format of a --batch manifest line,
+   and receives events as NDJSON lines until the connection is closed:
+     {"event": "progress", "frame": 1200, "timecode": "00:00:40.000"}               at most every PROGRESS_INTERVAL
+     {"event": "cut", "frame": 1234, "timecode": "00:00:41.133", "latency": 0}     as soon as the detector reports it
+     {"event": "done", "scenes": [[0, 1234], [1234, 3000]]}                        or {"event": "error", "message": "..."}
+   Jobs run on a fixed pool of workers, so that concurrent clients wait instead of oversubscribing the CPUs.
+*/
+class JobServer {
+    public:
+        using RunFunction = std::function<WithError<std::vector<FrameTimeCodePair>>(const Config& cfg,
+                                                                                    const ProgressCallback& progress_callback)>;
+        using EventCallback = std::function<void(const std::string& event)>;
+
+        explicit JobServer(const std::filesystem::path& socket_path, const std::vector<std::string>& shared_args,
+                           const size_t num_workers);
+        /* blocks until stop() is called */
+        WithError<void> serve(const RunFunction& run_job);
+        void stop();
+        /* client: sends the job and calls on_event for every event, returns an error if the job failed */
+        static WithError<void> submit(const std::filesystem::path& socket_path, const std::string& job,
+                                      const EventCallback& on_event);
+
+    private:
+        void _handle_client(const int32_t client_fd, const RunFunction& run_job) const;
+
+        const std::filesystem::path socket_path_;
+        const std::vector<std::string> shared_args_;
+        const size_t num_workers_;
+        std::atomic<int32_t> listen_fd_ = -1;
+        std::atomic<bool> is_stopped_ = false;
+};
+
+#endif
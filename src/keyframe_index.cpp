@@ -0,0 +1,81 @@
+#include "shutoh/error.hpp"
+#include "keyframe_index.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <algorithm>
+#include <cmath>
+
+KeyframeIndex::KeyframeIndex(const std::vector<int32_t>& keyframes) : keyframes_{keyframes} {}
+
+int32_t KeyframeIndex::estimate_interval() const {
+    /* median of the intervals, as keyframes inserted at cuts make the mean too short */
+    if (keyframes_.size() < 2)
+        return 0;
+
+    std::vector<int32_t> intervals;
+    for (size_t i = 1; i < keyframes_.size(); i++)
+        intervals.push_back(keyframes_[i] - keyframes_[i - 1]);
+    std::nth_element(intervals.begin(), intervals.begin() + intervals.size() / 2, intervals.end());
+    return intervals[intervals.size() / 2];
+}
+
+int32_t KeyframeIndex::previous_keyframe(const int32_t frame_num) const {
+    auto it = std::upper_bound(keyframes_.begin(), keyframes_.end(), frame_num);
+    if (it == keyframes_.begin())
+        return 0;
+    return *std::prev(it);
+}
+
+int32_t KeyframeIndex::next_keyframe(const int32_t frame_num) const {
+    auto it = std::lower_bound(keyframes_.begin(), keyframes_.end(), frame_num);
+    if (it == keyframes_.end())
+        return std::numeric_limits<int32_t>::max();
+    return *it;
+}
+
+WithError<KeyframeIndex> KeyframeIndex::build(const std::string& input_path, const float framerate, const size_t max_keyframes) {
+    AVFormatContext* format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, input_path.c_str(), nullptr, nullptr) < 0) {
+        const std::string error_msg = "Failed to open the video: " + input_path;
+        return WithError<KeyframeIndex> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_find_stream_info(format_ctx, nullptr) < 0) {
+        avformat_close_input(&format_ctx);
+        const std::string error_msg = "Failed to read stream information: " + input_path;
+        return WithError<KeyframeIndex> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const int32_t stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0) {
+        avformat_close_input(&format_ctx);
+        const std::string error_msg = "No video stream in " + input_path;
+        return WithError<KeyframeIndex> { std::nullopt, Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    const AVStream* stream = format_ctx->streams[stream_index];
+    const int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+    for (uint32_t i = 0; i < format_ctx->nb_streams; i++) {
+        if (static_cast<int32_t>(i) != stream_index)
+            format_ctx->streams[i]->discard = AVDISCARD_ALL;
+    }
+
+    std::vector<int32_t> keyframes;
+    AVPacket* packet = av_packet_alloc();
+    while (keyframes.size() < max_keyframes && av_read_frame(format_ctx, packet) >= 0) {
+        if (packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY) && packet->pts != AV_NOPTS_VALUE) {
+            const double seconds = (packet->pts - start_time) * av_q2d(stream->time_base);
+            keyframes.push_back(std::max(0, static_cast<int32_t>(std::lround(seconds * framerate))));
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&format_ctx);
+
+    std::sort(keyframes.begin(), keyframes.end());
+    return WithError<KeyframeIndex> { KeyframeIndex(keyframes), Error(ErrorCode::Success, "") };
+}
@@ -0,0 +1,26 @@
+#ifndef KEYFRAME_INDEX_H
+#define KEYFRAME_INDEX_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+template <typename T> struct WithError;
+
+/* Frame numbers of the keyframes of a video, read from packet flags with libavformat (no decoding). */
+class KeyframeIndex {
+    public:
+        explicit KeyframeIndex(const std::vector<int32_t>& keyframes);
+        const std::vector<int32_t>& get_keyframes() const { return keyframes_; }
+        int32_t estimate_interval() const;
+        int32_t previous_keyframe(const int32_t frame_num) const;
+        int32_t next_keyframe(const int32_t frame_num) const;
+        static WithError<KeyframeIndex> build(const std::string& input_path, const float framerate,
+                                              const size_t max_keyframes = std::numeric_limits<size_t>::max());
+
+    private:
+        std::vector<int32_t> keyframes_;
+};
+
+#endif
@@ -2,50 +2,253 @@
 #include "shutoh/frame_timecode.hpp"
 #include "shutoh/scene_manager.hpp"
 #include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/score_file.hpp"
+#include "shutoh/scene_cache.hpp"
+#include "shutoh/event_ring.hpp"
+#include "shutoh/error.hpp"
 
 #include "command_runner.hpp"
+#include "batch_runner.hpp"
+#include "job_server.hpp"
+#include "process_scheduler.hpp"
+#include "range_detector.hpp"
+#include "scene_query.hpp"
 #include "parameters.hpp"
 #include "config.hpp"
 
 #include <iostream>
+#include <charconv>
+#include <csignal>
 
-int main(int argc, char *argv[]) {
-    const WithError<Config> opt_cfg = parse_args(argc, argv);
-    if (opt_cfg.has_error()) {
-        opt_cfg.error.show_error_msg();
-        return 1;
+static JobServer* running_server = nullptr;
+
+void _stop_server(int) {
+    if (running_server)
+        running_server->stop();
+}
+
+WithError<void> _detect_scenes(SceneManager& scene_manager, VideoStream& video,
+                               const std::shared_ptr<BaseDetector>& detector, const Config& cfg) {
+    if (cfg.has_command("merge")) {
+        WithError<void> merge_err = merge_score_files(cfg.shards, cfg.load_scores.value());
+        if (merge_err.has_error())
+            return merge_err;
+        std::cout << "Merged " << cfg.shards.size() << " shards: " << cfg.load_scores.value().string() << std::endl;
     }
-    Config cfg = opt_cfg.value();
 
-    WithError<VideoStream> opt_video = VideoStream::initialize_video_stream(cfg.input_path);
-    if (opt_video.has_error()) {
-        opt_video.error.show_error_msg();
-        return 1;
+    if (cfg.load_scores.has_value()) {
+        WithError<std::shared_ptr<ScoreReader>> opt_score_reader = ScoreReader::initialize_score_reader(cfg.load_scores.value());
+        if (opt_score_reader.has_error())
+            return WithError<void> { opt_score_reader.error };
+        return scene_manager.replay_scores(*opt_score_reader.value(), video);
     }
-    VideoStream video = opt_video.value();    
-    WithError<void> settime_err = video.set_time(cfg.start, cfg.end, cfg.duration);
-    if (settime_err.has_error()) {
-        settime_err.error.show_error_msg();
-        return 1;
+
+    if (!cfg.save_scores.has_value()) {
+        scene_manager.detect_scenes(video);
+        return WithError<void> { Error(ErrorCode::Success, "") };
     }
 
+    WithError<std::shared_ptr<ScoreWriter>> opt_score_writer = ScoreWriter::initialize_score_writer(
+        cfg.save_scores.value(), detector->get_score_type(), video.get_framerate(),
+        video.get_start().get_frame_num(), video.get_end().get_frame_num());
+    if (opt_score_writer.has_error())
+        return WithError<void> { opt_score_writer.error };
+
+    std::shared_ptr<ScoreWriter> score_writer = opt_score_writer.value();
+    scene_manager.set_score_writer(score_writer);
+    scene_manager.detect_scenes(video);
+    return score_writer->close();
+}
+
+WithError<ProgressCallback> _create_live_callback(const BaseDetector& detector, const Config& cfg,
+                                                 const ProgressCallback& progress_callback) {
+    const std::optional<int32_t> latency = detector.get_latency();
+    if (!latency.has_value()) {
+        const std::string error_msg = "The detector decides cuts only after fades end. Set --max_latency with --live.";
+        return WithError<ProgressCallback> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    if (cfg.max_latency.has_value() && latency.value() > cfg.max_latency.value()) {
+        const std::string error_msg = "The detector decides cuts " + std::to_string(latency.value()) +
+                                      " frames after them, which is more than --max_latency.";
+        return WithError<ProgressCallback> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    std::cout << "Cuts are reported at most " << latency.value() << " frames after them." << std::endl;
+
+    const ProgressCallback live_callback = [progress_callback](const FrameTimeCode& position, const std::optional<FrameTimeCode>& cut) {
+        if (cut.has_value())
+            std::cout << "Cut at " << cut.value().to_string() << " (frame " << cut.value().get_frame_num() << "), decided at frame "
+                      << position.get_frame_num() << std::endl;
+        if (progress_callback)
+            progress_callback(position, cut);
+    };
+    return WithError<ProgressCallback> { live_callback, Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<FrameTimeCodePair>> _run(const Config& cfg, const ProgressCallback& progress_callback) {
+    WithError<VideoStream> opt_video = VideoStream::initialize_video_stream(cfg.input_path);
+    if (opt_video.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_video.error };
+    VideoStream video = opt_video.value();
+    WithError<void> settime_err = video.set_time(cfg.start, cfg.end, cfg.duration);
+    if (settime_err.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, settime_err.error };
+
     const DetectorParameters params = initialize_parameters(cfg);
     auto detector = _select_detector(params);
-    
-    SceneManager scene_manager = SceneManager(detector);
-    scene_manager.detect_scenes(video);
-    WithError<std::vector<FrameTimeCodePair>> opt_scene_list = scene_manager.get_scene_list();
-    if (opt_scene_list.has_error()) {
-        opt_scene_list.error.show_error_msg();
+
+    CommandRunner command_runner = CommandRunner(cfg);
+    std::vector<FrameTimeCodePair> scene_list;
+    if (!cfg.ranges.empty()) {
+        const RangeDetector range_detector = RangeDetector(params, cfg.cache_dir, cfg.readers);
+        WithError<std::vector<FrameTimeCodePair>> opt_scene_list = range_detector.detect_scenes(video, cfg.ranges);
+        if (opt_scene_list.has_error())
+            return opt_scene_list;
+        scene_list = opt_scene_list.value();
+    } else {
+        SceneManager scene_manager = SceneManager(detector);
+        /* a cached detection would not report the cuts as they are decided */
+        if (cfg.cache_dir.has_value() && !cfg.live)
+            scene_manager.set_scene_cache(std::make_shared<SceneCache>(cfg.cache_dir.value()));
+        if (cfg.checkpoint.has_value()) {
+            if (std::filesystem::exists(cfg.checkpoint.value())) {
+                WithError<void> checkpoint_err = scene_manager.load_checkpoint(cfg.checkpoint.value());
+                if (checkpoint_err.has_error())
+                    return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, checkpoint_err.error };
+            }
+            scene_manager.set_checkpoint(cfg.checkpoint.value(), cfg.checkpoint_interval);
+        }
+        if (cfg.follow)
+            scene_manager.set_follow(cfg.follow_timeout);
+        if (cfg.has_command("shard")) {
+            const std::optional<int32_t> warmup_frames = detector->get_warmup_frames();
+            if (!warmup_frames.has_value()) {
+                const std::string error_msg = "The detector's scores depend on the whole video, which shard does not decode.";
+                return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+            }
+            scene_manager.set_warmup_frames(warmup_frames.value());
+        }
+        if (cfg.live) {
+            WithError<ProgressCallback> opt_live_callback = _create_live_callback(*detector, cfg, progress_callback);
+            if (opt_live_callback.has_error())
+                return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_live_callback.error };
+            scene_manager.set_progress_callback(opt_live_callback.value());
+        } else if (progress_callback) {
+            scene_manager.set_progress_callback(progress_callback);
+        }
+        std::shared_ptr<EventRingWriter> event_ring = nullptr;
+        if (cfg.event_ring.has_value()) {
+            WithError<std::shared_ptr<EventRingWriter>> opt_event_ring = EventRingWriter::initialize_event_ring_writer(
+                cfg.event_ring.value(), cfg.event_ring_size, video.get_framerate());
+            if (opt_event_ring.has_error())
+                return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_event_ring.error };
+            event_ring = opt_event_ring.value();
+            scene_manager.set_event_ring(event_ring);
+        }
+        command_runner.prepare(scene_manager, video);
+        WithError<void> detect_err = _detect_scenes(scene_manager, video, detector, cfg);
+        /* consumers see the end of the events before the scenes are split */
+        if (event_ring)
+            event_ring->close();
+        if (detect_err.has_error())
+            return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, detect_err.error };
+        WithError<std::vector<FrameTimeCodePair>> opt_scene_list = scene_manager.get_scene_list();
+        if (opt_scene_list.has_error())
+            return opt_scene_list;
+        scene_list = opt_scene_list.value();
+    }
+
+    WithError<void> err = command_runner.execute(video, scene_list);
+    if (err.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, err.error };
+    return WithError<std::vector<FrameTimeCodePair>> { scene_list, Error(ErrorCode::Success, "") };
+}
+
+WithError<size_t> _extract_num_workers(std::vector<std::string>& args, const std::string& option) {
+    const std::string value = BatchRunner::extract_option(args, option).value_or("0");
+    int32_t num_workers = 0;
+    const auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), num_workers);
+    if (ec != std::errc() || ptr != value.data() + value.size() || num_workers < 0) {
+        const std::string error_msg = option + " should be a number of workers >= 0.";
+        return WithError<size_t> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    /* a job keeps a decoding and a detecting thread busy */
+    if (num_workers == 0)
+        return WithError<size_t> { std::max<size_t>(1, ProcessScheduler::get_available_cpus() / 2), Error(ErrorCode::Success, "") };
+    return WithError<size_t> { static_cast<size_t>(num_workers), Error(ErrorCode::Success, "") };
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> args(argv, argv + argc);
+
+    /* --connect sends the rest of the command line to a server */
+    const std::optional<std::string> connect_path = BatchRunner::extract_option(args, "--connect");
+    if (connect_path.has_value()) {
+        WithError<void> submit_err = JobServer::submit(connect_path.value(), BatchRunner::format_job(args),
+                                                       [](const std::string& event) { std::cout << event << std::endl; });
+        if (submit_err.has_error()) {
+            submit_err.error.show_error_msg();
+            return 1;
+        }
+        return 0;
+    }
+
+    /* --query reads a scene index written by index-scenes, without any video */
+    const std::optional<std::string> scene_index_path = BatchRunner::extract_option(args, "--query");
+    if (scene_index_path.has_value()) {
+        const WithError<QueryConfig> opt_query_cfg = parse_query_args(scene_index_path.value(), args);
+        if (opt_query_cfg.has_error()) {
+            opt_query_cfg.error.show_error_msg();
+            return 1;
+        }
+        WithError<void> query_err = SceneQuery(opt_query_cfg.value()).run(std::cout);
+        if (query_err.has_error()) {
+            query_err.error.show_error_msg();
+            return 1;
+        }
+        return 0;
+    }
+
+    /* --batch and --serve run many jobs sharing the other options, each parsed like a single run */
+    const std::optional<std::string> manifest_path = BatchRunner::extract_option(args, "--batch");
+    const std::optional<std::string> socket_path = BatchRunner::extract_option(args, "--serve");
+    if (manifest_path.has_value() || socket_path.has_value()) {
+        WithError<size_t> num_workers = _extract_num_workers(args, manifest_path.has_value() ? "--batch_workers" : "--serve_workers");
+        if (num_workers.has_error()) {
+            num_workers.error.show_error_msg();
+            return 1;
+        }
+
+        WithError<void> err = [&]() {
+            if (manifest_path.has_value()) {
+                const BatchRunner batch_runner = BatchRunner(args, num_workers.value());
+                return batch_runner.run(manifest_path.value(), [](const Config& cfg) { return _run(cfg, nullptr); });
+            }
+            JobServer job_server = JobServer(socket_path.value(), args, num_workers.value());
+            running_server = &job_server;
+            std::signal(SIGINT, _stop_server);
+            std::signal(SIGTERM, _stop_server);
+            WithError<void> serve_err = job_server.serve(_run);
+            running_server = nullptr;
+            return serve_err;
+        }();
+        if (err.has_error()) {
+            err.error.show_error_msg();
+            return 1;
+        }
+        return 0;
+    }
+
+    const WithError<Config> opt_cfg = parse_args(args);
+    if (opt_cfg.has_error()) {
+        opt_cfg.error.show_error_msg();
         return 1;
     }
-    std::vector<FrameTimeCodePair> scene_list = opt_scene_list.value();
-    
-    CommandRunner command_runner = CommandRunner(cfg, scene_list);
-    WithError<void> err = command_runner.execute(video);
-    if (err.has_error()) {
-        err.error.show_error_msg();
+
+    WithError<std::vector<FrameTimeCodePair>> opt_scene_list = _run(opt_cfg.value(), nullptr);
+    if (opt_scene_list.has_error()) {
+        opt_scene_list.error.show_error_msg();
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,174 @@
+#include "shutoh/error.hpp"
+#include "motion_vector_reader.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/motion_vector.h>
+}
+
+#include <algorithm>
+#include <cmath>
+
+constexpr int32_t COVERAGE_CELL_SIZE = 8; /* smallest H.264 partition is 4x4, yet 8x8 is enough to measure the ratio */
+
+MotionVectorReader::~MotionVectorReader() {
+    av_frame_free(&frame_);
+    av_packet_free(&packet_);
+    avcodec_free_context(&codec_ctx_);
+    avformat_close_input(&format_ctx_);
+}
+
+WithError<void> MotionVectorReader::open(const std::string& input_path, const float framerate) {
+    framerate_ = framerate;
+
+    if (avformat_open_input(&format_ctx_, input_path.c_str(), nullptr, nullptr) < 0) {
+        const std::string error_msg = "Failed to open the video: " + input_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_find_stream_info(format_ctx_, nullptr) < 0) {
+        const std::string error_msg = "Failed to read stream information: " + input_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const AVCodec* codec = nullptr;
+    stream_index_ = av_find_best_stream(format_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, &codec, 0);
+    if (stream_index_ < 0 || codec == nullptr) {
+        const std::string error_msg = "No decodable video stream in " + input_path;
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    codec_ctx_ = avcodec_alloc_context3(codec);
+    avcodec_parameters_to_context(codec_ctx_, format_ctx_->streams[stream_index_]->codecpar);
+    codec_ctx_->thread_count = 0; /* auto */
+    codec_ctx_->skip_loop_filter = AVDISCARD_ALL;
+
+    AVDictionary* options = nullptr;
+    av_dict_set(&options, "flags2", "+export_mvs", 0);
+    const int32_t ret = avcodec_open2(codec_ctx_, codec, &options);
+    av_dict_free(&options);
+    if (ret < 0) {
+        const std::string error_msg = "Failed to open the decoder for " + input_path;
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    packet_ = av_packet_alloc();
+    frame_ = av_frame_alloc();
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> MotionVectorReader::seek(const int32_t frame_num) {
+    if (frame_num < 0) {
+        std::string error_msg = "Frame num should be larger than 0, but got " + std::to_string(frame_num);
+        return WithError<void> { Error(ErrorCode::NegativeFrameNum, error_msg) };
+    }
+
+    if (frame_num == 0)
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    const AVStream* stream = format_ctx_->streams[stream_index_];
+    const int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+    const int64_t timestamp = start_time + static_cast<int64_t>(frame_num / framerate_ / av_q2d(stream->time_base));
+    if (av_seek_frame(format_ctx_, stream_index_, timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+        std::string error_msg = "Failed to set the frame position.";
+        return WithError<void> { Error(ErrorCode::FailedToSetFramePosition, error_msg) };
+    }
+    avcodec_flush_buffers(codec_ctx_);
+    flushing_ = false;
+
+    /* av_seek_frame() lands on the previous keyframe, so decode forward to the target. */
+    while (_receive_frame()) {
+        if (_get_frame_num() >= frame_num) {
+            has_pending_frame_ = true;
+            return WithError<void> { Error(ErrorCode::Success, "") };
+        }
+    }
+
+    std::string error_msg = "Target frame num is over the maximum frame count.";
+    return WithError<void> { Error(ErrorCode::OverMaximumFrameNum, error_msg) };
+}
+
+std::optional<VideoFrame> MotionVectorReader::read() {
+    /* seek() leaves the target frame decoded in frame_, which is returned first. */
+    if (!has_pending_frame_ && !_receive_frame())
+        return std::nullopt;
+
+    has_pending_frame_ = false;
+    const int32_t frame_num = _get_frame_num();
+    next_frame_num_ = frame_num + 1;
+    return VideoFrame { cv::Mat(), frame_num, false, _collect_motion_info() };
+}
+
+bool MotionVectorReader::_receive_frame() {
+    while (true) {
+        const int32_t ret = avcodec_receive_frame(codec_ctx_, frame_);
+        if (ret == 0)
+            return true;
+        if (ret == AVERROR_EOF || flushing_)
+            return false;
+
+        /* AVERROR(EAGAIN): the decoder needs more packets */
+        bool sent = false;
+        while (!sent) {
+            if (av_read_frame(format_ctx_, packet_) < 0) {
+                avcodec_send_packet(codec_ctx_, nullptr);
+                flushing_ = true;
+                break;
+            }
+            if (packet_->stream_index == stream_index_)
+                sent = avcodec_send_packet(codec_ctx_, packet_) >= 0;
+            av_packet_unref(packet_);
+        }
+    }
+}
+
+int32_t MotionVectorReader::_get_frame_num() const {
+    const AVStream* stream = format_ctx_->streams[stream_index_];
+    if (frame_->best_effort_timestamp == AV_NOPTS_VALUE)
+        return next_frame_num_;
+
+    const int64_t start_time = stream->start_time == AV_NOPTS_VALUE ? 0 : stream->start_time;
+    const double seconds = (frame_->best_effort_timestamp - start_time) * av_q2d(stream->time_base);
+    return std::max(0, static_cast<int32_t>(std::lround(seconds * framerate_)));
+}
+
+MotionInfo MotionVectorReader::_collect_motion_info() {
+    const char picture_type = av_get_picture_type_char(frame_->pict_type);
+    const AVFrameSideData* side_data = av_frame_get_side_data(frame_, AV_FRAME_DATA_MOTION_VECTORS);
+    if (side_data != nullptr)
+        has_motion_vectors_ = true;
+    if (picture_type == 'I')
+        return MotionInfo { picture_type, has_motion_vectors_, 1.0f, 0.0f };
+    /* libavcodec attaches no side data to a frame without any motion vector, i.e., whose blocks are all intra-coded */
+    if (side_data == nullptr)
+        return MotionInfo { picture_type, has_motion_vectors_, has_motion_vectors_ ? 1.0f : 0.0f, 0.0f };
+
+    /* Intra-coded blocks have no motion vector, so the uncovered area is the intra-coded area.
+       Bi-predicted blocks have two vectors, hence coverage is counted on a grid instead of summing areas. */
+    const int32_t grid_width = (frame_->width + COVERAGE_CELL_SIZE - 1) / COVERAGE_CELL_SIZE;
+    const int32_t grid_height = (frame_->height + COVERAGE_CELL_SIZE - 1) / COVERAGE_CELL_SIZE;
+    coverage_.assign(static_cast<size_t>(grid_width) * grid_height, 0);
+
+    const AVMotionVector* motion_vectors = reinterpret_cast<const AVMotionVector*>(side_data->data);
+    const size_t num_motion_vectors = side_data->size / sizeof(AVMotionVector);
+    double motion_sum = 0.0;
+
+    for (size_t i = 0; i < num_motion_vectors; i++) {
+        const AVMotionVector& mv = motion_vectors[i];
+        const int32_t x0 = std::clamp((mv.dst_x - mv.w / 2) / COVERAGE_CELL_SIZE, 0, grid_width - 1);
+        const int32_t y0 = std::clamp((mv.dst_y - mv.h / 2) / COVERAGE_CELL_SIZE, 0, grid_height - 1);
+        const int32_t x1 = std::clamp((mv.dst_x + mv.w / 2 - 1) / COVERAGE_CELL_SIZE, 0, grid_width - 1);
+        const int32_t y1 = std::clamp((mv.dst_y + mv.h / 2 - 1) / COVERAGE_CELL_SIZE, 0, grid_height - 1);
+        for (int32_t y = y0; y <= y1; y++)
+            std::fill(coverage_.begin() + y * grid_width + x0, coverage_.begin() + y * grid_width + x1 + 1, 1);
+
+        const double scale = mv.motion_scale > 0 ? mv.motion_scale : 1.0;
+        motion_sum += std::hypot(mv.motion_x / scale, mv.motion_y / scale);
+    }
+
+    const size_t covered = std::count(coverage_.begin(), coverage_.end(), 1);
+    const float intra_ratio = 1.0f - static_cast<float>(covered) / coverage_.size();
+    const float mean_motion = num_motion_vectors > 0 ? static_cast<float>(motion_sum / num_motion_vectors) : 0.0f;
+    return MotionInfo { picture_type, true, intra_ratio, mean_motion };
+}
@@ -0,0 +1,50 @@
+#ifndef MOTION_VECTOR_READER_H
+#define MOTION_VECTOR_READER_H
+
+#include "shutoh/video_frame.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <optional>
+
+template <typename T> struct WithError;
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVPacket;
+struct AVFrame;
+
+/*
+   Decodes a video with libavcodec only to collect the motion vectors of each frame.
+   Pixels are never converted nor resized, and the loop filter is skipped since nobody looks at them.
+*/
+class MotionVectorReader {
+    public:
+        MotionVectorReader() = default;
+        MotionVectorReader(const MotionVectorReader&) = delete;
+        MotionVectorReader& operator=(const MotionVectorReader&) = delete;
+        ~MotionVectorReader();
+
+        WithError<void> open(const std::string& input_path, const float framerate);
+        WithError<void> seek(const int32_t frame_num);
+        std::optional<VideoFrame> read();
+
+    private:
+        bool _receive_frame();
+        int32_t _get_frame_num() const;
+        MotionInfo _collect_motion_info();
+
+        float framerate_ = 0.0f;
+        int32_t stream_index_ = -1;
+        int32_t next_frame_num_ = 0;
+        AVFormatContext* format_ctx_ = nullptr;
+        AVCodecContext* codec_ctx_ = nullptr;
+        AVPacket* packet_ = nullptr;
+        AVFrame* frame_ = nullptr;
+        bool flushing_ = false;
+        bool has_pending_frame_ = false;
+        bool has_motion_vectors_ = false; /* whether any frame so far had motion vectors */
+        mutable std::vector<uint8_t> coverage_;
+};
+
+#endif
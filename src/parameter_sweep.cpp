@@ -0,0 +1,173 @@
+#include "shutoh/video_stream.hpp"
+#include "shutoh/scene_manager.hpp"
+#include "shutoh/score_file.hpp"
+#include "shutoh/error.hpp"
+
+#include "parameter_sweep.hpp"
+#include "parameters.hpp"
+#include "config.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <future>
+#include <thread>
+#include <fmt/core.h>
+
+ParameterSweep::ParameterSweep(const std::filesystem::path& output_dir, const std::string& output_filename,
+                               const std::optional<std::vector<int32_t>>& ground_truth, const int32_t tolerance)
+    : output_dir_{output_dir}, output_filename_{output_filename}, ground_truth_{ground_truth}, tolerance_{tolerance} {}
+
+WithError<void> ParameterSweep::sweep(const ScoreReader& score_reader, const VideoStream& video,
+                                      const std::vector<DetectorParameters>& params_list) const {
+    std::vector<std::vector<int32_t>> cuts_list(params_list.size());
+    const size_t num_workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), params_list.size());
+
+    /* each worker writes to its own elements of cuts_list */
+    std::vector<std::future<WithError<void>>> futures;
+    for (size_t worker_i = 0; worker_i < num_workers; worker_i++) {
+        futures.push_back(std::async(std::launch::async, [&, worker_i]() {
+            for (size_t i = worker_i; i < params_list.size(); i += num_workers) {
+                WithError<std::vector<int32_t>> opt_cuts = _replay(score_reader, video, params_list[i]);
+                if (opt_cuts.has_error())
+                    return WithError<void> { opt_cuts.error };
+                cuts_list[i] = opt_cuts.value();
+            }
+            return WithError<void> { Error(ErrorCode::Success, "") };
+        }));
+    }
+
+    std::optional<Error> first_error = std::nullopt;
+    for (std::future<WithError<void>>& future : futures) {
+        WithError<void> err = future.get();
+        if (err.has_error() && !first_error.has_value())
+            first_error.emplace(err.error);
+    }
+    if (first_error.has_value())
+        return WithError<void> { first_error.value() };
+
+    return _write_report(params_list, cuts_list);
+}
+
+WithError<std::vector<int32_t>> ParameterSweep::_replay(const ScoreReader& score_reader, const VideoStream& video,
+                                                        const DetectorParameters& params) const {
+    SceneManager scene_manager = SceneManager(_select_detector(params));
+    WithError<void> replay_err = scene_manager.replay_scores(score_reader, video);
+    if (replay_err.has_error())
+        return WithError<std::vector<int32_t>> { std::nullopt, replay_err.error };
+
+    WithError<std::vector<FrameTimeCodePair>> opt_scene_list = scene_manager.get_scene_list();
+    if (opt_scene_list.has_error())
+        return WithError<std::vector<int32_t>> { std::nullopt, opt_scene_list.error };
+
+    /* every scene but the first starts at a cut */
+    const std::vector<FrameTimeCodePair> scene_list = opt_scene_list.value();
+    std::vector<int32_t> cuts;
+    for (size_t i = 1; i < scene_list.size(); i++)
+        cuts.push_back(std::get<0>(scene_list[i]).get_frame_num());
+    return WithError<std::vector<int32_t>> { cuts, Error(ErrorCode::Success, "") };
+}
+
+CutMatch ParameterSweep::_match_cuts(const std::vector<int32_t>& cuts) const {
+    /* both lists are sorted, so each true cut is matched with at most one detected cut in a single pass */
+    const std::vector<int32_t>& ground_truth = ground_truth_.value();
+    int32_t true_positives = 0;
+    size_t cut_i = 0;
+    size_t truth_i = 0;
+    while (cut_i < cuts.size() && truth_i < ground_truth.size()) {
+        if (std::abs(cuts[cut_i] - ground_truth[truth_i]) <= tolerance_) {
+            true_positives++;
+            cut_i++;
+            truth_i++;
+        } else if (cuts[cut_i] < ground_truth[truth_i]) {
+            cut_i++;
+        } else {
+            truth_i++;
+        }
+    }
+
+    const float precision = cuts.empty() ? 0.0f : static_cast<float>(true_positives) / cuts.size();
+    const float recall = ground_truth.empty() ? 0.0f : static_cast<float>(true_positives) / ground_truth.size();
+    const float f1 = precision + recall > 0.0f ? 2.0f * precision * recall / (precision + recall) : 0.0f;
+    return CutMatch { true_positives, precision, recall, f1 };
+}
+
+WithError<void> ParameterSweep::_write_report(const std::vector<DetectorParameters>& params_list,
+                                              const std::vector<std::vector<int32_t>>& cuts_list) const {
+    const std::string output_csv_file = fmt::format("{}/{}.csv", output_dir_.string(), output_filename_);
+    std::ofstream csv_file(output_csv_file);
+    if (!csv_file.is_open()) {
+        const std::string error_msg = "Failed to open csv file for writing: " + output_csv_file;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    csv_file << "threshold,min_scene_len,window_width,min_content_val,num_cuts";
+    if (ground_truth_.has_value())
+        csv_file << ",true_positives,precision,recall,f1";
+    csv_file << "\n";
+
+    std::optional<size_t> best_i = std::nullopt;
+    float best_f1 = -1.0f;
+    for (size_t i = 0; i < params_list.size(); i++) {
+        const DetectorParameters& params = params_list[i];
+        csv_file << params.threshold << "," << params.min_scene_len << "," << params.adaptive_params.window_width
+                 << "," << params.adaptive_params.min_content_val << "," << cuts_list[i].size();
+
+        if (ground_truth_.has_value()) {
+            const CutMatch match = _match_cuts(cuts_list[i]);
+            csv_file << "," << match.true_positives << "," << match.precision << "," << match.recall << "," << match.f1;
+            if (match.f1 > best_f1) {
+                best_f1 = match.f1;
+                best_i = i;
+            }
+        }
+        csv_file << "\n";
+    }
+    csv_file.close();
+
+    std::cout << "Evaluated " << params_list.size() << " parameter combinations: " << output_csv_file << std::endl;
+    if (best_i.has_value()) {
+        const DetectorParameters& best = params_list[best_i.value()];
+        std::cout << "Best F1 " << best_f1 << " with --threshold " << best.threshold << " --min_scene_len " << best.min_scene_len;
+        if (best.detector_type == DetectorType::ADAPTIVE)
+            std::cout << " --window_width " << best.adaptive_params.window_width
+                      << " --min_content_val " << best.adaptive_params.min_content_val;
+        std::cout << std::endl;
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<int32_t>> ParameterSweep::load_ground_truth(const std::filesystem::path& input_path, const float framerate) {
+    std::ifstream file(input_path);
+    if (!file.is_open()) {
+        const std::string error_msg = "Failed to open the ground truth: " + input_path.string();
+        return WithError<std::vector<int32_t>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::vector<int32_t> ground_truth;
+    std::string line;
+    while (std::getline(file, line)) {
+        line.erase(std::remove_if(line.begin(), line.end(), [](const char c) { return std::isspace(static_cast<unsigned char>(c)); }), line.end());
+        if (line.empty())
+            continue;
+
+        if (line.find(':') != std::string::npos) {
+            WithError<FrameTimeCode> opt_timecode = FrameTimeCode::from_timecode_string(line, framerate);
+            if (opt_timecode.has_error())
+                return WithError<std::vector<int32_t>> { std::nullopt, opt_timecode.error };
+            ground_truth.push_back(opt_timecode.value().get_frame_num());
+            continue;
+        }
+
+        int32_t frame_num = 0;
+        const auto [ptr, ec] = std::from_chars(line.data(), line.data() + line.size(), frame_num);
+        if (ec != std::errc() || ptr != line.data() + line.size()) {
+            const std::string error_msg = "Invalid cut in the ground truth: " + line;
+            return WithError<std::vector<int32_t>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        ground_truth.push_back(frame_num);
+    }
+
+    std::sort(ground_truth.begin(), ground_truth.end());
+    return WithError<std::vector<int32_t>> { ground_truth, Error(ErrorCode::Success, "") };
+}
@@ -0,0 +1,50 @@
+#ifndef PARAMETER_SWEEP_H
+#define PARAMETER_SWEEP_H
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+
+class VideoStream;
+class ScoreReader;
+template <typename T> struct WithError;
+struct DetectorParameters;
+
+struct CutMatch {
+    const int32_t true_positives;
+    const float precision;
+    const float recall;
+    const float f1;
+};
+
+/*
+   Evaluates many detector parameters on the scores saved by one detection (sweep).
+   Each combination replays the scores through its own detector, which only runs the decision logic,
+   so all of them are evaluated in parallel in a fraction of the time of a single decode.
+   With a ground truth, cuts within tolerance frames of a true cut are counted as correct.
+*/
+class ParameterSweep {
+    public:
+        explicit ParameterSweep(const std::filesystem::path& output_dir, const std::string& output_filename,
+                                const std::optional<std::vector<int32_t>>& ground_truth, const int32_t tolerance);
+        WithError<void> sweep(const ScoreReader& score_reader, const VideoStream& video,
+                              const std::vector<DetectorParameters>& params_list) const;
+        /* one cut per line, as a frame number or a timecode (HH:MM:SS[.nnn]) */
+        static WithError<std::vector<int32_t>> load_ground_truth(const std::filesystem::path& input_path, const float framerate);
+
+    private:
+        WithError<std::vector<int32_t>> _replay(const ScoreReader& score_reader, const VideoStream& video,
+                                                const DetectorParameters& params) const;
+        CutMatch _match_cuts(const std::vector<int32_t>& cuts) const;
+        WithError<void> _write_report(const std::vector<DetectorParameters>& params_list,
+                                      const std::vector<std::vector<int32_t>>& cuts_list) const;
+
+        const std::filesystem::path output_dir_;
+        const std::string output_filename_;
+        const std::optional<std::vector<int32_t>> ground_truth_;
+        const int32_t tolerance_;
+};
+
+#endif
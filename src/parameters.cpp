@@ -2,30 +2,52 @@
 #include "config.hpp"
 
 DetectorParameters initialize_parameters(const Config& cfg) {
+    return _create_parameters(cfg, cfg.threshold, cfg.min_scene_len, cfg.window_width, cfg.min_content_val);
+}
+
+std::vector<DetectorParameters> initialize_sweep_parameters(const Config& cfg) {
+    /* window_width and min_content_val only change the adaptive detector */
+    const bool is_adaptive = cfg.detector_type == DetectorType::ADAPTIVE;
+    const std::vector<int32_t> window_widths = is_adaptive ? cfg.sweep_window_widths : std::vector<int32_t>{ cfg.window_width };
+    const std::vector<float> min_content_vals = is_adaptive ? cfg.sweep_min_content_vals : std::vector<float>{ cfg.min_content_val };
+
+    std::vector<DetectorParameters> params_list;
+    for (const float threshold : cfg.sweep_thresholds)
+        for (const int32_t min_scene_len : cfg.sweep_min_scene_lens)
+            for (const int32_t window_width : window_widths)
+                for (const float min_content_val : min_content_vals)
+                    params_list.push_back(_create_parameters(cfg, threshold, min_scene_len, window_width, min_content_val));
+    return params_list;
+}
+
+DetectorParameters _create_parameters(const Config& cfg, const float threshold, const int32_t min_scene_len,
+                                      const int32_t window_width, const float min_content_val) {
     const DetectorType detector_type = cfg.detector_type;
-    const float threshold = cfg.threshold;
-    const int32_t min_scene_len = cfg.min_scene_len;
 
     switch (detector_type) {
         case DetectorType::CONTENT:
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .max_latency = cfg.max_latency };
         case DetectorType::ADAPTIVE: {
-            const AdaptiveParameters adaptive_params { .window_width = cfg.window_width, .min_content_val = cfg.min_content_val };
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .adaptive_params = adaptive_params };
+            const AdaptiveParameters adaptive_params { .window_width = window_width, .min_content_val = min_content_val };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .adaptive_params = adaptive_params,
+                                        .max_latency = cfg.max_latency };
         }
         case DetectorType::HASH: {
             const HashParameters hash_params { .dct_size = cfg.dct_size, .lowpass = cfg.lowpass };
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .hash_params = hash_params };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .hash_params = hash_params,
+                                        .max_latency = cfg.max_latency };
         }
         case DetectorType::HISTOGRAM: {
             const HistogramParameters histo_params { .bins = cfg.bins };
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .histogram_params = histo_params };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .histogram_params = histo_params,
+                                        .max_latency = cfg.max_latency };
         }
         case DetectorType::THRESHOLD: {
             const ThresholdParameters threshold_params { .fade_bias = cfg.fade_bias };
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .threshold_params = threshold_params };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .threshold_params = threshold_params,
+                                        .max_latency = cfg.max_latency };
         }
         default:
-            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len };
+            return DetectorParameters { .detector_type = detector_type, .threshold = threshold, .min_scene_len = min_scene_len, .max_latency = cfg.max_latency };
     }
 }
@@ -29,8 +29,13 @@ struct DetectorParameters {
     const HashParameters hash_params;
     const HistogramParameters histogram_params;
     const ThresholdParameters threshold_params;
+    const std::optional<int32_t> max_latency = std::nullopt;
 };
 
 DetectorParameters initialize_parameters(const Config& cfg);
+/* every combination of the sweep ranges, which default to the single value of initialize_parameters() */
+std::vector<DetectorParameters> initialize_sweep_parameters(const Config& cfg);
+DetectorParameters _create_parameters(const Config& cfg, const float threshold, const int32_t min_scene_len,
+                                      const int32_t window_width, const float min_content_val);
 
 #endif
\ No newline at end of file
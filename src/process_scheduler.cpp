@@ -0,0 +1,158 @@
+#include "process_scheduler.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <map>
+#include <fstream>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cerrno>
+#include <cctype>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+extern char** environ;
+
+constexpr int32_t FOREIGN_CHILD_WAIT_MS = 10; /* an exited child of another owner is left for it to reap */
+
+static std::optional<pid_t> spawn_process(const std::vector<std::string>& args) {
+    std::vector<char*> argv;
+    for (const std::string& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, 0, "/dev/null", O_RDONLY, 0);
+
+    pid_t pid;
+    const int32_t ret = posix_spawnp(&pid, argv[0], &file_actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (ret != 0)
+        return std::nullopt;
+    return pid;
+}
+
+static std::optional<size_t> get_cgroup_cpu_limit() {
+    /* cgroup v2: "<quota> <period>" or "max <period>" */
+    std::ifstream cpu_max("/sys/fs/cgroup/cpu.max");
+    std::string quota_str;
+    double period = 0.0;
+    if (cpu_max >> quota_str >> period) {
+        if (quota_str == "max" || period <= 0.0)
+            return std::nullopt;
+        return static_cast<size_t>(std::ceil(std::stod(quota_str) / period));
+    }
+
+    /* cgroup v1 */
+    std::ifstream quota_file("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream period_file("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    double quota = 0.0;
+    if (quota_file >> quota && period_file >> period && quota > 0.0 && period > 0.0)
+        return static_cast<size_t>(std::ceil(quota / period));
+    return std::nullopt;
+}
+
+ProcessScheduler::ProcessScheduler(const size_t max_processes) : max_processes_{std::max<size_t>(1, max_processes)} {}
+
+size_t ProcessScheduler::run(const std::vector<ProcessJob>& jobs, const ExitCallback& on_exit) const {
+    std::vector<size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&jobs](const size_t a, const size_t b) { return jobs[a].cost > jobs[b].cost; });
+
+    std::deque<ProcessJob> pending;
+    for (const size_t job_i : order)
+        pending.push_back(jobs[job_i]);
+
+    std::map<pid_t, ProcessJob> running;
+    size_t num_failed = 0;
+    auto finish_job = [&pending, &num_failed, &on_exit](const ProcessJob& job, const bool success) {
+        if (!success)
+            num_failed++;
+        const std::optional<ProcessJob> next_job = on_exit(job, success);
+        if (next_job.has_value())
+            pending.push_front(next_job.value());
+    };
+
+    while (!pending.empty() || !running.empty()) {
+        while (running.size() < max_processes_ && !pending.empty()) {
+            const ProcessJob job = pending.front();
+            pending.pop_front();
+            const std::optional<pid_t> pid = spawn_process(job.args);
+            if (pid.has_value())
+                running.emplace(pid.value(), job);
+            else
+                finish_job(job, false);
+        }
+        if (running.empty())
+            continue;
+
+        /* Blocks until any child exits, without reaping it (WNOWAIT): waitpid(-1) would also reap those of
+           other schedulers or of std::system. Then only our own exited children are reaped, each freeing its slot. */
+        siginfo_t info {};
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOWAIT) < 0 && errno == EINTR)
+            continue;
+        bool has_exited = false;
+        for (auto it = running.begin(); it != running.end();) {
+            int status = 0;
+            const pid_t pid = waitpid(it->first, &status, WNOHANG);
+            if (pid == 0 || (pid < 0 && errno == EINTR)) {
+                ++it;
+                continue;
+            }
+            /* a child reaped elsewhere (ECHILD) has an unknown exit status and counts as failed */
+            const bool success = pid > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            const ProcessJob job = it->second;
+            it = running.erase(it);
+            finish_job(job, success);
+            has_exited = true;
+        }
+        if (!has_exited)
+            std::this_thread::sleep_for(std::chrono::milliseconds(FOREIGN_CHILD_WAIT_MS));
+    }
+    return num_failed;
+}
+
+size_t ProcessScheduler::get_available_cpus() {
+    size_t num_cpus = std::max(1u, std::thread::hardware_concurrency());
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+        num_cpus = std::max(1, CPU_COUNT(&cpu_set));
+#endif
+    const std::optional<size_t> cgroup_limit = get_cgroup_cpu_limit();
+    if (cgroup_limit.has_value())
+        num_cpus = std::min(num_cpus, std::max<size_t>(1, cgroup_limit.value()));
+    return num_cpus;
+}
+
+std::vector<std::string> split_args(const std::string& args) {
+    /* whitespace separated, double quotes group words */
+    std::vector<std::string> tokens;
+    std::string token;
+    bool in_quotes = false;
+    bool has_token = false;
+    for (const char c : args) {
+        if (c == '"') {
+            in_quotes = !in_quotes;
+            has_token = true;
+        } else if (std::isspace(static_cast<unsigned char>(c)) && !in_quotes) {
+            if (has_token)
+                tokens.push_back(token);
+            token.clear();
+            has_token = false;
+        } else {
+            token += c;
+            has_token = true;
+        }
+    }
+    if (has_token)
+        tokens.push_back(token);
+    return tokens;
+}
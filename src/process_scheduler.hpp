@@ -0,0 +1,37 @@
+#ifndef PROCESS_SCHEDULER_H
+#define PROCESS_SCHEDULER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <optional>
+#include <cstdint>
+
+struct ProcessJob {
+    const std::vector<std::string> args; /* argv, args[0] is looked up in PATH */
+    const double cost; /* jobs with a larger cost are started first */
+    const int32_t id; /* passed back to the exit callback */
+};
+
+/*
+   Runs external processes without a shell, up to max_processes at a time. A slot is refilled as soon as
+   any of its children exits, and the exit callback may return a follow-up job which is started next.
+   Only its own children are waited for, so other children of the process are left to their owners.
+*/
+class ProcessScheduler {
+    public:
+        using ExitCallback = std::function<std::optional<ProcessJob>(const ProcessJob& job, const bool success)>;
+
+        explicit ProcessScheduler(const size_t max_processes);
+        size_t run(const std::vector<ProcessJob>& jobs, const ExitCallback& on_exit) const; /* returns the number of failed jobs */
+
+        /* CPUs this process may use: the affinity mask, limited by a cgroup CPU quota if any */
+        static size_t get_available_cpus();
+
+    private:
+        const size_t max_processes_;
+};
+
+std::vector<std::string> split_args(const std::string& args);
+
+#endif
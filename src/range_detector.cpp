@@ -0,0 +1,136 @@
+#include "shutoh/video_stream.hpp"
+#include "shutoh/scene_manager.hpp"
+#include "shutoh/scene_cache.hpp"
+#include "shutoh/error.hpp"
+
+#include "range_detector.hpp"
+#include "parameters.hpp"
+#include "config.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <future>
+#include <thread>
+
+RangeDetector::RangeDetector(const DetectorParameters& params, const std::optional<std::filesystem::path>& cache_dir,
+                             const int32_t num_readers)
+    : params_{params}, cache_dir_{cache_dir}, num_readers_{num_readers} {}
+
+WithError<std::vector<FrameTimeCodePair>> RangeDetector::detect_scenes(VideoStream& video, const std::vector<TimeRange>& ranges) const {
+    /* ranges are validated and ordered by their start frames before any decoding */
+    std::vector<FrameTimeCodePair> bounds;
+    for (const TimeRange& range : ranges) {
+        WithError<FrameTimeCode> opt_start = FrameTimeCode::from_timecode_string(range.start, video.get_framerate());
+        WithError<FrameTimeCode> opt_end = FrameTimeCode::from_timecode_string(range.end, video.get_framerate());
+        if (opt_start.has_error())
+            return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_start.error };
+        if (opt_end.has_error())
+            return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_end.error };
+        bounds.push_back(FrameTimeCodePair { opt_start.value(), opt_end.value() });
+    }
+
+    std::vector<size_t> order(ranges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&bounds](const size_t a, const size_t b) {
+        return std::get<0>(bounds[a]) < std::get<0>(bounds[b]);
+    });
+    for (size_t i = 1; i < order.size(); i++) {
+        if (std::get<0>(bounds[order[i]]) < std::get<1>(bounds[order[i - 1]])) {
+            const std::string error_msg = "--range " + ranges[order[i]].start + "-" + ranges[order[i]].end + " overlaps another range.";
+            return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+    }
+
+    /* each reader writes to its own elements of scene_lists */
+    std::vector<std::vector<FrameTimeCodePair>> scene_lists(ranges.size());
+    const size_t num_readers = _get_num_readers(ranges.size());
+    std::vector<std::future<WithError<void>>> futures;
+    for (size_t reader_i = 0; reader_i < num_readers; reader_i++) {
+        futures.push_back(std::async(std::launch::async, [&, reader_i]() {
+            std::optional<VideoStream> reader = std::nullopt;
+            if (reader_i > 0) {
+                WithError<VideoStream> opt_reader = VideoStream::initialize_video_stream(video.get_input_path());
+                if (opt_reader.has_error())
+                    return WithError<void> { opt_reader.error };
+                reader.emplace(opt_reader.value());
+            }
+
+            for (size_t i = reader_i * order.size() / num_readers; i < (reader_i + 1) * order.size() / num_readers; i++) {
+                WithError<std::vector<FrameTimeCodePair>> opt_scene_list = _detect_range(reader ? reader.value() : video, ranges[order[i]]);
+                if (opt_scene_list.has_error())
+                    return WithError<void> { opt_scene_list.error };
+                scene_lists[i] = opt_scene_list.value();
+            }
+            return WithError<void> { Error(ErrorCode::Success, "") };
+        }));
+    }
+
+    std::optional<Error> first_error = std::nullopt;
+    for (std::future<WithError<void>>& future : futures) {
+        WithError<void> err = future.get();
+        if (err.has_error() && !first_error.has_value())
+            first_error.emplace(err.error);
+    }
+    if (first_error.has_value())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, first_error.value() };
+
+    std::vector<FrameTimeCodePair> scene_list;
+    for (const std::vector<FrameTimeCodePair>& range_scene_list : scene_lists)
+        scene_list.insert(scene_list.end(), range_scene_list.begin(), range_scene_list.end());
+    return WithError<std::vector<FrameTimeCodePair>> { scene_list, Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<FrameTimeCodePair>> RangeDetector::_detect_range(VideoStream& video, const TimeRange& range) const {
+    /* the reader is reused across its ranges, and detect_scenes() seeks to the start of each */
+    WithError<void> settime_err = video.set_time(range.start, range.end, std::nullopt);
+    if (settime_err.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, settime_err.error };
+
+    SceneManager scene_manager = SceneManager(_select_detector(params_));
+    if (cache_dir_.has_value())
+        scene_manager.set_scene_cache(std::make_shared<SceneCache>(cache_dir_.value()));
+    scene_manager.detect_scenes(video);
+    return scene_manager.get_scene_list();
+}
+
+size_t RangeDetector::_get_num_readers(const size_t num_ranges) const {
+    const size_t max_readers = num_readers_ > 0 ? num_readers_ : std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(max_readers, num_ranges));
+}
+
+WithError<std::vector<TimeRange>> RangeDetector::load_ranges(const std::filesystem::path& input_path) {
+    std::ifstream file(input_path);
+    if (!file.is_open()) {
+        const std::string error_msg = "Failed to open the ranges: " + input_path.string();
+        return WithError<std::vector<TimeRange>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::vector<TimeRange> ranges;
+    std::string line;
+    while (std::getline(file, line)) {
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        const size_t begin = line.find_first_not_of(" \t");
+        if (begin == std::string::npos || line[begin] == '#')
+            continue;
+
+        WithError<TimeRange> opt_range = parse_range(line.substr(begin));
+        if (opt_range.has_error())
+            return WithError<std::vector<TimeRange>> { std::nullopt, opt_range.error };
+        ranges.push_back(opt_range.value());
+    }
+    return WithError<std::vector<TimeRange>> { ranges, Error(ErrorCode::Success, "") };
+}
+
+WithError<TimeRange> RangeDetector::parse_range(const std::string& range) {
+    const size_t separator = range.find_first_of("- \t");
+    const size_t end_begin = separator == std::string::npos ? std::string::npos : range.find_first_not_of("- \t", separator);
+    if (separator == 0 || end_begin == std::string::npos) {
+        const std::string error_msg = "A range should be START-END, e.g., 00:01:00-00:02:30, but got " + range;
+        return WithError<TimeRange> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    const size_t end_length = range.find_last_not_of(" \t") + 1 - end_begin;
+    return WithError<TimeRange> { TimeRange { range.substr(0, separator), range.substr(end_begin, end_length) },
+                                  Error(ErrorCode::Success, "") };
+}
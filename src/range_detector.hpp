@@ -0,0 +1,46 @@
+#ifndef RANGE_DETECTOR_H
+#define RANGE_DETECTOR_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <optional>
+#include <cstdint>
+
+class VideoStream;
+template <typename T> struct WithError;
+struct DetectorParameters;
+
+/* HH:MM:SS[.nnn] as in --start and --end */
+struct TimeRange {
+    const std::string start;
+    const std::string end;
+};
+
+/*
+   Detects scenes in several disjoint ranges of one video (--range). Ranges are sorted and split into
+   contiguous groups, one reader (VideoStream) per group, so each reader only seeks forward and the file
+   is probed once per reader instead of once per range. Every range gets a new detector, as if it were
+   detected by its own run with --start and --end.
+*/
+class RangeDetector {
+    public:
+        explicit RangeDetector(const DetectorParameters& params, const std::optional<std::filesystem::path>& cache_dir,
+                               const int32_t num_readers);
+        WithError<std::vector<FrameTimeCodePair>> detect_scenes(VideoStream& video, const std::vector<TimeRange>& ranges) const;
+        /* START-END (or START END) per line, where blank lines and lines starting with # are skipped */
+        static WithError<std::vector<TimeRange>> load_ranges(const std::filesystem::path& input_path);
+        static WithError<TimeRange> parse_range(const std::string& range);
+
+    private:
+        WithError<std::vector<FrameTimeCodePair>> _detect_range(VideoStream& video, const TimeRange& range) const;
+        size_t _get_num_readers(const size_t num_ranges) const;
+
+        const DetectorParameters& params_;
+        const std::optional<std::filesystem::path> cache_dir_;
+        const int32_t num_readers_;
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "shutoh/scene_aggregator.hpp"
+
+#include <fmt/core.h>
+#include <algorithm>
+
+constexpr int32_t PHASH_IMAGE_SIZE = 32;
+constexpr int32_t PHASH_SIZE = 8;
+constexpr int32_t MOTION_IMAGE_WIDTH = 160;
+
+ColorAggregator::ColorAggregator(const float black_level, const float flash_delta)
+    : black_level_{black_level}, flash_delta_{flash_delta} {}
+
+std::vector<std::string> ColorAggregator::get_columns() const {
+    return { "mean_red", "mean_green", "mean_blue", "brightness", "black", "flash" };
+}
+
+std::optional<ColorSample> ColorAggregator::_measure(const VideoFrame& frame) {
+    if (frame.frame.empty() || frame.frame.channels() != 3)
+        return std::nullopt;
+
+    const cv::Scalar mean_bgr = cv::mean(frame.frame);
+    const float brightness = static_cast<float>(0.114 * mean_bgr[0] + 0.587 * mean_bgr[1] + 0.299 * mean_bgr[2]);
+    const bool is_flash = last_brightness_.has_value() && brightness - last_brightness_.value() >= flash_delta_;
+    last_brightness_ = brightness;
+    return ColorSample { mean_bgr, brightness, is_flash };
+}
+
+void ColorAggregator::_fold(const int32_t frame_num, const ColorSample& sample) {
+    /* the first frame of a scene is brighter than the previous one because of the cut itself */
+    if (num_frames_ > 0)
+        has_flash_ = has_flash_ || sample.is_flash;
+    sum_bgr_ += sample.mean_bgr;
+    sum_brightness_ += sample.brightness;
+    num_frames_++;
+}
+
+std::vector<std::string> ColorAggregator::_finish_scene() {
+    const double num_frames = std::max(1, num_frames_);
+    const double brightness = sum_brightness_ / num_frames;
+    std::vector<std::string> values {
+        fmt::format("{:.2f}", sum_bgr_[2] / num_frames),
+        fmt::format("{:.2f}", sum_bgr_[1] / num_frames),
+        fmt::format("{:.2f}", sum_bgr_[0] / num_frames),
+        fmt::format("{:.2f}", brightness),
+        num_frames_ > 0 && brightness < black_level_ ? "1" : "0",
+        has_flash_ ? "1" : "0",
+    };
+
+    sum_bgr_ = cv::Scalar::all(0.0);
+    sum_brightness_ = 0.0;
+    num_frames_ = 0;
+    has_flash_ = false;
+    return values;
+}
+
+std::vector<std::string> MotionAggregator::get_columns() const {
+    return { "motion_energy", "keyframe", "keyframe_phash" };
+}
+
+uint64_t MotionAggregator::compute_phash(const cv::Mat& gray_frame) {
+    cv::Mat resized;
+    cv::resize(gray_frame, resized, cv::Size(PHASH_IMAGE_SIZE, PHASH_IMAGE_SIZE), 0, 0, cv::INTER_AREA);
+    resized.convertTo(resized, CV_32F);
+    cv::Mat dct;
+    cv::dct(resized, dct);
+
+    /* bit i is set if the i-th lowest frequency is above their median, excluding the DC term from the median */
+    const cv::Mat low_freq = dct(cv::Range(0, PHASH_SIZE), cv::Range(0, PHASH_SIZE)).clone();
+    std::vector<float> coefficients(low_freq.begin<float>(), low_freq.end<float>());
+    std::vector<float> sorted(coefficients.begin() + 1, coefficients.end());
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    const float median = sorted[sorted.size() / 2];
+
+    uint64_t hash = 0;
+    for (size_t i = 0; i < coefficients.size(); i++) {
+        if (coefficients[i] > median)
+            hash |= uint64_t(1) << i;
+    }
+    return hash;
+}
+
+std::optional<MotionSample> MotionAggregator::_measure(const VideoFrame& frame) {
+    if (frame.frame.empty())
+        return std::nullopt;
+
+    /* downscaled before the conversion, so that no full-resolution copy is made */
+    const double scale = std::min(1.0, static_cast<double>(MOTION_IMAGE_WIDTH) / frame.frame.cols);
+    cv::Mat thumbnail;
+    cv::resize(frame.frame, thumbnail, cv::Size(), scale, scale, cv::INTER_AREA);
+    if (thumbnail.channels() == 3)
+        cv::cvtColor(thumbnail, thumbnail, cv::COLOR_BGR2GRAY);
+
+    const float motion = last_gray_.empty() || last_gray_.size() != thumbnail.size() ? 0.0f
+                         : static_cast<float>(cv::norm(thumbnail, last_gray_, cv::NORM_L1) / thumbnail.total());
+    last_gray_ = thumbnail;
+    return MotionSample { motion, thumbnail };
+}
+
+void MotionAggregator::_fold(const int32_t frame_num, const MotionSample& sample) {
+    /* the first frame of a scene differs from the previous one because of the cut itself */
+    if (num_frames_ > 0) {
+        sum_motion_ += sample.motion;
+        if (num_frames_ == 1 || sample.motion < keyframe_.value().second.motion)
+            keyframe_ = std::make_pair(frame_num, sample);
+    } else {
+        keyframe_ = std::make_pair(frame_num, sample);
+    }
+    num_frames_++;
+}
+
+std::vector<std::string> MotionAggregator::_finish_scene() {
+    const std::optional<uint64_t> hash = keyframe_.has_value() ? std::optional<uint64_t>(compute_phash(keyframe_.value().second.thumbnail))
+                                                               : std::nullopt;
+    std::vector<std::string> values {
+        fmt::format("{:.3f}", num_frames_ > 1 ? sum_motion_ / (num_frames_ - 1) : 0.0),
+        keyframe_.has_value() ? std::to_string(keyframe_.value().first) : "",
+        hash.has_value() ? fmt::format("{:016x}", hash.value()) : "",
+    };
+    if (keyframe_.has_value())
+        keyframes_.push_back(std::make_pair(keyframe_.value().first, hash.value()));
+    else
+        keyframes_.push_back(std::nullopt);
+
+    sum_motion_ = 0.0;
+    num_frames_ = 0;
+    keyframe_ = std::nullopt;
+    return values;
+}
@@ -0,0 +1,119 @@
+#include "shutoh/scene_cache.hpp"
+#include "shutoh/video_stream.hpp"
+#include "shutoh/detector/base_detector.hpp"
+#include "shutoh/error.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <unistd.h>
+
+constexpr int32_t NUM_SAMPLED_BLOCKS = 16;
+constexpr size_t SAMPLED_BLOCK_SIZE = 64 * 1024;
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+/* FNV-1a, stable across platforms and runs unlike std::hash */
+static uint64_t _hash_bytes(const char* data, const size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static std::string _to_hex(const uint64_t value) {
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << value;
+    return stream.str();
+}
+
+SceneCache::SceneCache(const std::filesystem::path& cache_dir) : cache_dir_{cache_dir} {}
+
+std::optional<std::vector<int32_t>> SceneCache::load(const std::string& key) const {
+    std::ifstream file(_get_entry_path(key));
+    if (!file.is_open())
+        return std::nullopt;
+
+    /* the key is stored in the entry, so that a hash collision is a miss */
+    std::string stored_key;
+    if (!std::getline(file, stored_key) || stored_key != key)
+        return std::nullopt;
+
+    std::vector<int32_t> cutting_list;
+    int32_t cut = 0;
+    while (file >> cut)
+        cutting_list.push_back(cut);
+    if (!file.eof())
+        return std::nullopt;
+    return cutting_list;
+}
+
+WithError<void> SceneCache::store(const std::string& key, const std::vector<int32_t>& cutting_list) const {
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir_, ec);
+    if (ec) {
+        const std::string error_msg = "Failed to create the cache directory: " + cache_dir_.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const std::filesystem::path entry_path = _get_entry_path(key);
+    std::ostringstream suffix;
+    suffix << ".tmp." << getpid() << "." << std::this_thread::get_id();
+    const std::filesystem::path temp_path = entry_path.string() + suffix.str();
+
+    std::ofstream file(temp_path);
+    file << key << "\n";
+    for (const int32_t cut : cutting_list)
+        file << cut << "\n";
+    file.close();
+    if (file.fail()) {
+        std::filesystem::remove(temp_path, ec);
+        const std::string error_msg = "Failed to write the cache entry: " + temp_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::filesystem::rename(temp_path, entry_path, ec);
+    if (ec) {
+        std::filesystem::remove(temp_path, ec);
+        const std::string error_msg = "Failed to write the cache entry: " + entry_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::string> SceneCache::create_key(const VideoStream& video, const BaseDetector& detector) {
+    const std::filesystem::path input_path = video.get_input_path();
+    std::error_code ec;
+    const uintmax_t file_size = std::filesystem::file_size(input_path, ec);
+    std::ifstream file(input_path, std::ios::binary);
+    if (ec || !file.is_open()) {
+        const std::string error_msg = "Failed to read the video for its fingerprint: " + input_path.string();
+        return WithError<std::string> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    /* Blocks evenly spaced from the head to the tail of the file. Reading ~1 MiB is enough to tell
+       videos apart, as a modified or re-encoded video changes its container header and bitstream. */
+    uint64_t content_hash = FNV_OFFSET_BASIS;
+    std::vector<char> block(SAMPLED_BLOCK_SIZE);
+    const uintmax_t last_offset = file_size > SAMPLED_BLOCK_SIZE ? file_size - SAMPLED_BLOCK_SIZE : 0;
+    for (int32_t i = 0; i < NUM_SAMPLED_BLOCKS; i++) {
+        const uintmax_t offset = last_offset * i / (NUM_SAMPLED_BLOCKS - 1);
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(block.data(), block.size());
+        content_hash = _hash_bytes(block.data(), static_cast<size_t>(file.gcount()), content_hash);
+        file.clear();
+    }
+
+    std::ostringstream key;
+    key << "v1|size=" << file_size << "|hash=" << _to_hex(content_hash)
+        << "|width=" << video.width() << "|height=" << video.height() << "|fps=" << video.get_framerate()
+        << "|range=" << video.get_start().get_frame_num() << "-" << video.get_end().get_frame_num()
+        << "|" << detector.serialize_parameters();
+    return WithError<std::string> { key.str(), Error(ErrorCode::Success, "") };
+}
+
+std::filesystem::path SceneCache::_get_entry_path(const std::string& key) const {
+    return cache_dir_ / (_to_hex(_hash_bytes(key.data(), key.size())) + ".scenes");
+}
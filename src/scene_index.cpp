@@ -0,0 +1,326 @@
+#include "shutoh/scene_index.hpp"
+#include "shutoh/error.hpp"
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <map>
+
+static double _get_cut_rate(const size_t num_cuts, const double duration) {
+    return duration > 0.0 ? num_cuts * 60.0 / duration : 0.0;
+}
+
+/* the offsets of the records from begin to the end of the mapping, std::nullopt if one of them is cut off */
+static std::optional<std::vector<uint64_t>> _find_record_offsets(const void* data, const uint64_t begin, const uint64_t end) {
+    std::vector<uint64_t> offsets;
+    uint64_t offset = begin;
+    while (offset < end) {
+        if (end - offset < sizeof(SceneListHeader))
+            return std::nullopt;
+        const SceneListHeader& header = *reinterpret_cast<const SceneListHeader*>(static_cast<const char*>(data) + offset);
+        const uint64_t payload_size = sizeof(SceneListHeader) + uint64_t(header.num_cuts) * sizeof(int32_t) +
+                                      header.name_size + header.key_size;
+        if (header.record_size % 8 != 0 || header.record_size < payload_size || header.record_size > end - offset)
+            return std::nullopt;
+        offsets.push_back(offset);
+        offset += header.record_size;
+    }
+    return offsets;
+}
+
+static WithError<std::shared_ptr<SceneIndex>> _open_scene_index(const std::filesystem::path& index_path) {
+    /* The directory is opened first: it lists a prefix of the records, and the records only grow after it.
+       A directory being replaced is still readable through its descriptor. */
+    const std::filesystem::path directory_path = index_path.string() + ".dir";
+    void* directory = nullptr;
+    size_t directory_size = 0;
+    uint64_t sorted_size = 0;
+    const int32_t directory_fd = ::open(directory_path.c_str(), O_RDONLY);
+    if (directory_fd >= 0) {
+        SceneDirectoryHeader directory_header;
+        struct stat directory_stat;
+        const bool is_directory = ::pread(directory_fd, &directory_header, sizeof(SceneDirectoryHeader), 0) == sizeof(SceneDirectoryHeader) &&
+                                  std::memcmp(directory_header.magic, SCENE_DIRECTORY_MAGIC, sizeof(directory_header.magic)) == 0 &&
+                                  directory_header.version == SCENE_INDEX_VERSION && fstat(directory_fd, &directory_stat) == 0 &&
+                                  static_cast<uint64_t>(directory_stat.st_size) ==
+                                  sizeof(SceneDirectoryHeader) + directory_header.num_entries * sizeof(SceneDirectoryEntry);
+        directory_size = is_directory ? directory_stat.st_size : 0;
+        directory = is_directory ? mmap(nullptr, directory_size, PROT_READ, MAP_PRIVATE, directory_fd, 0) : MAP_FAILED;
+        ::close(directory_fd); /* the mapping stays valid */
+        if (directory == MAP_FAILED) {
+            const std::string error_msg = directory_path.string() + " is not a scene directory of this version.";
+            return WithError<std::shared_ptr<SceneIndex>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+        sorted_size = directory_header.data_size;
+    }
+
+    const int32_t fd = ::open(index_path.c_str(), O_RDONLY);
+    SceneIndexHeader header;
+    struct stat file_stat;
+    const bool is_index = fd >= 0 && ::pread(fd, &header, sizeof(SceneIndexHeader), 0) == sizeof(SceneIndexHeader) &&
+                          std::memcmp(header.magic, SCENE_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+                          header.version == SCENE_INDEX_VERSION && fstat(fd, &file_stat) == 0 &&
+                          static_cast<uint64_t>(file_stat.st_size) >= sizeof(SceneIndexHeader) + header.data_size &&
+                          sorted_size <= header.data_size;
+    /* bytes after data_size are an append in progress */
+    const size_t size = is_index ? sizeof(SceneIndexHeader) + header.data_size : 0;
+    void* data = is_index ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (fd >= 0)
+        ::close(fd);
+    const std::optional<std::vector<uint64_t>> unsorted_offsets =
+        data != MAP_FAILED ? _find_record_offsets(data, sizeof(SceneIndexHeader) + sorted_size, size) : std::nullopt;
+    if (!unsorted_offsets.has_value()) {
+        if (data != MAP_FAILED)
+            munmap(data, size);
+        if (directory)
+            munmap(directory, directory_size);
+        const std::string error_msg = fd < 0 ? "Failed to open " + index_path.string()
+                                             : index_path.string() + " is not a scene index of this version.";
+        return WithError<std::shared_ptr<SceneIndex>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::vector<uint64_t> offsets = unsorted_offsets.value();
+    std::shared_ptr<SceneIndex> scene_index = std::make_shared<SceneIndex>(data, size, directory, directory_size, std::move(offsets));
+    return WithError<std::shared_ptr<SceneIndex>> { scene_index, Error(ErrorCode::Success, "") };
+}
+
+double SceneListRecord::get_cuts_per_minute() const {
+    return _get_cut_rate(cuts.size(), get_duration());
+}
+
+std::span<const int32_t> SceneListRecord::get_cuts(const int32_t first, const int32_t last) const {
+    const auto begin = std::lower_bound(cuts.begin(), cuts.end(), first);
+    const auto end = std::upper_bound(begin, cuts.end(), last);
+    return std::span<const int32_t>(begin, end);
+}
+
+SceneIndex::SceneIndex(const void* data, const size_t size, const void* directory, const size_t directory_size,
+                       std::vector<uint64_t>&& unsorted_offsets)
+    : data_{data}, size_{size}, directory_{directory}, directory_size_{directory_size}, unsorted_offsets_{std::move(unsorted_offsets)} {}
+
+SceneIndex::~SceneIndex() {
+    munmap(const_cast<void*>(data_), size_);
+    if (directory_)
+        munmap(const_cast<void*>(directory_), directory_size_);
+}
+
+size_t SceneIndex::get_num_records() const {
+    return _get_directory().size() + unsorted_offsets_.size();
+}
+
+SceneListRecord SceneIndex::_get_record(const uint64_t offset) const {
+    const char* record = static_cast<const char*>(data_) + offset;
+    const SceneListHeader& header = *reinterpret_cast<const SceneListHeader*>(record);
+    const int32_t* cuts = reinterpret_cast<const int32_t*>(record + sizeof(SceneListHeader));
+    const char* name = reinterpret_cast<const char*>(cuts + header.num_cuts);
+    return SceneListRecord { std::string_view(name, header.name_size), std::string_view(name + header.name_size, header.key_size),
+                             header.framerate, header.start_frame, header.end_frame, std::span<const int32_t>(cuts, header.num_cuts) };
+}
+
+std::span<const SceneDirectoryEntry> SceneIndex::_get_directory() const {
+    if (!directory_)
+        return std::span<const SceneDirectoryEntry>();
+    const SceneDirectoryHeader& header = *static_cast<const SceneDirectoryHeader*>(directory_);
+    const SceneDirectoryEntry* entries = reinterpret_cast<const SceneDirectoryEntry*>(static_cast<const char*>(directory_) + sizeof(SceneDirectoryHeader));
+    return std::span<const SceneDirectoryEntry>(entries, header.num_entries);
+}
+
+std::optional<SceneListRecord> SceneIndex::find(const std::string_view video_name) const {
+    for (auto it = unsorted_offsets_.rbegin(); it != unsorted_offsets_.rend(); it++) {
+        const SceneListRecord record = _get_record(*it);
+        if (record.video_name == video_name)
+            return record;
+    }
+
+    /* the latest record of the video is the one before the first record of a later name */
+    const std::span<const SceneDirectoryEntry> directory = _get_directory();
+    const auto it = std::upper_bound(directory.begin(), directory.end(), video_name,
+                                     [this](const std::string_view name, const SceneDirectoryEntry& entry) {
+                                         return name < _get_record(entry.record_offset).video_name;
+                                     });
+    if (it == directory.begin())
+        return std::nullopt;
+    const SceneListRecord record = _get_record(std::prev(it)->record_offset);
+    if (record.video_name != video_name)
+        return std::nullopt;
+    return record;
+}
+
+std::vector<SceneListRecord> SceneIndex::find_by_cut_rate(const double min_cuts_per_minute) const {
+    /* records appended after the directory supersede those listed in it */
+    std::map<std::string_view, uint64_t> unsorted_latest;
+    for (const uint64_t offset : unsorted_offsets_)
+        unsorted_latest.insert_or_assign(_get_record(offset).video_name, offset);
+
+    /* only the records of the matching videos are read */
+    std::vector<SceneListRecord> records;
+    for (const SceneDirectoryEntry& entry : _get_directory()) {
+        if (!entry.is_latest || _get_cut_rate(entry.num_cuts, entry.duration) < min_cuts_per_minute)
+            continue;
+        const SceneListRecord record = _get_record(entry.record_offset);
+        if (!unsorted_latest.contains(record.video_name))
+            records.push_back(record);
+    }
+
+    const size_t num_sorted = records.size();
+    for (const auto& [video_name, offset] : unsorted_latest) {
+        const SceneListRecord record = _get_record(offset);
+        if (record.get_cuts_per_minute() >= min_cuts_per_minute)
+            records.push_back(record);
+    }
+    std::inplace_merge(records.begin(), records.begin() + num_sorted, records.end(),
+                       [](const SceneListRecord& a, const SceneListRecord& b) { return a.video_name < b.video_name; });
+    return records;
+}
+
+WithError<void> SceneIndex::write_directory(const std::filesystem::path& directory_path) const {
+    const auto by_name = [this](const SceneDirectoryEntry& a, const SceneDirectoryEntry& b) {
+        const std::string_view name_a = _get_record(a.record_offset).video_name;
+        const std::string_view name_b = _get_record(b.record_offset).video_name;
+        return name_a < name_b || (name_a == name_b && a.record_offset < b.record_offset);
+    };
+
+    /* the current directory is already sorted, so only the unsorted records are sorted before merging */
+    std::vector<SceneDirectoryEntry> unsorted;
+    for (const uint64_t offset : unsorted_offsets_) {
+        const SceneListRecord record = _get_record(offset);
+        unsorted.push_back(SceneDirectoryEntry { offset, record.get_duration(), static_cast<uint32_t>(record.cuts.size()), 1 });
+    }
+    std::sort(unsorted.begin(), unsorted.end(), by_name);
+
+    const std::span<const SceneDirectoryEntry> directory = _get_directory();
+    std::vector<SceneDirectoryEntry> entries(directory.size() + unsorted.size());
+    std::merge(directory.begin(), directory.end(), unsorted.begin(), unsorted.end(), entries.begin(), by_name);
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i].is_latest = i + 1 == entries.size() ||
+                               _get_record(entries[i].record_offset).video_name != _get_record(entries[i + 1].record_offset).video_name;
+    }
+
+    SceneDirectoryHeader header {};
+    std::memcpy(header.magic, SCENE_DIRECTORY_MAGIC, sizeof(header.magic));
+    header.version = SCENE_INDEX_VERSION;
+    header.data_size = size_ - sizeof(SceneIndexHeader);
+    header.num_entries = entries.size();
+
+    /* readers of the previous directory keep their mapping of the replaced file */
+    const std::filesystem::path temp_path = directory_path.string() + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(SceneDirectoryHeader));
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(SceneDirectoryEntry));
+    file.close();
+    if (file.fail()) {
+        std::filesystem::remove(temp_path);
+        const std::string error_msg = "Failed to write " + temp_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::error_code rename_error;
+    std::filesystem::rename(temp_path, directory_path, rename_error);
+    if (rename_error) {
+        const std::string error_msg = "Failed to replace " + directory_path.string() + ": " + rename_error.message();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::shared_ptr<SceneIndex>> SceneIndex::initialize_scene_index(const std::filesystem::path& index_path) {
+    /* waits for an append in progress; an index never appended to has no lock file */
+    const std::filesystem::path lock_path = index_path.string() + ".lock";
+    const int32_t lock_fd = ::open(lock_path.c_str(), O_RDONLY);
+    if (lock_fd >= 0)
+        flock(lock_fd, LOCK_SH);
+    WithError<std::shared_ptr<SceneIndex>> opt_scene_index = _open_scene_index(index_path);
+    if (lock_fd >= 0)
+        ::close(lock_fd);
+    return opt_scene_index;
+}
+
+static WithError<bool> _append_to_scene_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                              const std::string& key, const double framerate, const int32_t start_frame,
+                                              const int32_t end_frame, const std::vector<int32_t>& cuts) {
+    const int32_t fd = ::open(index_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        const std::string error_msg = "Failed to open " + index_path.string();
+        return WithError<bool> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    SceneIndexHeader header {};
+    const ssize_t header_size = ::pread(fd, &header, sizeof(SceneIndexHeader), 0);
+    if (header_size == 0) {
+        std::memcpy(header.magic, SCENE_INDEX_MAGIC, sizeof(header.magic));
+        header.version = SCENE_INDEX_VERSION;
+    } else {
+        /* nothing is appended if the video was indexed with the same fingerprint and parameters */
+        WithError<std::shared_ptr<SceneIndex>> opt_scene_index = _open_scene_index(index_path);
+        if (opt_scene_index.has_error() || header_size != sizeof(SceneIndexHeader)) {
+            ::close(fd);
+            const std::string error_msg = index_path.string() + " is not a scene index of this version.";
+            return WithError<bool> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+        const std::optional<SceneListRecord> record = opt_scene_index.value()->find(video_name);
+        if (record.has_value() && record.value().key == key) {
+            ::close(fd);
+            return WithError<bool> { false, Error(ErrorCode::Success, "") };
+        }
+    }
+
+    const size_t payload_size = sizeof(SceneListHeader) + cuts.size() * sizeof(int32_t) + video_name.size() + key.size();
+    const size_t record_size = (payload_size + 7) / 8 * 8;
+    const SceneListHeader record_header { record_size, framerate, start_frame, end_frame, static_cast<uint32_t>(cuts.size()),
+                                          static_cast<uint32_t>(video_name.size()), static_cast<uint32_t>(key.size()), 0 };
+    std::vector<char> record(record_size, 0);
+    char* position = record.data();
+    std::memcpy(position, &record_header, sizeof(SceneListHeader));
+    position += sizeof(SceneListHeader);
+    std::memcpy(position, cuts.data(), cuts.size() * sizeof(int32_t));
+    position += cuts.size() * sizeof(int32_t);
+    std::memcpy(position, video_name.data(), video_name.size());
+    std::memcpy(position + video_name.size(), key.data(), key.size());
+
+    /* The record becomes visible when the header is updated after it. Bytes of an append interrupted
+       before that are overwritten. */
+    const off_t offset = sizeof(SceneIndexHeader) + header.data_size;
+    header.data_size += record_size;
+    header.num_records++;
+    const bool is_written = ::ftruncate(fd, offset) == 0 &&
+                            ::pwrite(fd, record.data(), record_size, offset) == static_cast<ssize_t>(record_size) &&
+                            ::pwrite(fd, &header, sizeof(SceneIndexHeader), 0) == sizeof(SceneIndexHeader);
+    ::close(fd);
+    if (!is_written) {
+        const std::string error_msg = "Failed to append to " + index_path.string();
+        return WithError<bool> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    WithError<std::shared_ptr<SceneIndex>> opt_scene_index = _open_scene_index(index_path);
+    if (opt_scene_index.has_error())
+        return WithError<bool> { std::nullopt, opt_scene_index.error };
+    if (opt_scene_index.value()->get_num_unsorted() > SCENE_INDEX_MAX_UNSORTED) {
+        WithError<void> directory_err = opt_scene_index.value()->write_directory(index_path.string() + ".dir");
+        if (directory_err.has_error())
+            return WithError<bool> { std::nullopt, directory_err.error };
+    }
+    return WithError<bool> { true, Error(ErrorCode::Success, "") };
+}
+
+WithError<bool> append_to_scene_index(const std::filesystem::path& index_path, const std::string& video_name,
+                                      const std::string& key, const double framerate, const int32_t start_frame,
+                                      const int32_t end_frame, const std::vector<int32_t>& cuts) {
+    /* concurrent runs (--batch) append one after the other; the lock is released when closed */
+    const std::filesystem::path lock_path = index_path.string() + ".lock";
+    const int32_t lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) != 0) {
+        if (lock_fd >= 0)
+            ::close(lock_fd);
+        const std::string error_msg = "Failed to lock " + lock_path.string();
+        return WithError<bool> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    WithError<bool> append_err = _append_to_scene_index(index_path, video_name, key, framerate, start_frame, end_frame, cuts);
+    ::close(lock_fd);
+    return append_err;
+}
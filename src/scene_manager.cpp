@@ -2,13 +2,52 @@
 #include "shutoh/video_frame.hpp"
 #include "shutoh/video_stream.hpp"
 #include "shutoh/error.hpp"
+#include "shutoh/score_file.hpp"
+#include "shutoh/scene_cache.hpp"
+#include "shutoh/event_ring.hpp"
+#include "shutoh/detector/detector_state.hpp"
 #include "blocking_queue.hpp"
+#include "motion_vector_reader.hpp"
 
 #include <thread>
 #include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <utility>
 
 constexpr int32_t DEFAULT_MIN_WIDTH = 256;
 constexpr int32_t MAX_FRAME_QUEUE_LENGTH = 100;
+constexpr int32_t MAX_FULL_FRAME_QUEUE_LENGTH = 8; /* frames also carry the full resolution image */
+constexpr std::chrono::milliseconds FOLLOW_POLL_INTERVAL(1000);
+const std::string CHECKPOINT_MAGIC = "SHUTOHCP";
+constexpr uint32_t CHECKPOINT_VERSION = 2;
+constexpr int32_t MAX_SCENE_QUEUE_LENGTH = 16;
+
+/* passes the scenes of generate_scenes() from the detection thread to the coroutine */
+class SceneQueueObserver : public SceneObserver {
+    public:
+        SceneQueueObserver(BlockingQueue<std::optional<FrameTimeCodePair>>& scene_queue, std::shared_ptr<SceneObserver> next_observer)
+            : scene_queue_{scene_queue}, next_observer_{next_observer} {}
+
+        void on_scene(const FrameTimeCodePair& scene) override {
+            if (next_observer_)
+                next_observer_->on_scene(scene);
+            scene_queue_.push(scene);
+        }
+
+    private:
+        BlockingQueue<std::optional<FrameTimeCodePair>>& scene_queue_;
+        const std::shared_ptr<SceneObserver> next_observer_;
+};
+
+/* runs the function when the scope is left, also when a suspended coroutine is destroyed */
+template <typename F>
+struct ScopeExit {
+    F function;
+    ~ScopeExit() { function(); }
+};
 
 SceneManager::SceneManager(std::shared_ptr<BaseDetector> detector) : detector_{detector} {}
 
@@ -16,23 +55,296 @@ void SceneManager::detect_scenes(VideoStream& video) {
     start_ = video.get_start();
     end_ = video.get_end();
     framerate_ = video.get_framerate();
+    if (!next_frame_num_.has_value())
+        next_frame_num_ = std::max(0, start_.value().get_frame_num() - warmup_frames_);
 
-    const int32_t start_frame_num = start_.value().get_frame_num();
-    video.seek(start_frame_num);
+    const std::optional<std::string> cache_key = _get_cache_key(video);
+    if (cache_key.has_value()) {
+        std::optional<std::vector<int32_t>> cached_cutting_list = scene_cache_->load(cache_key.value());
+        if (cached_cutting_list.has_value()) {
+            cutting_list_ = cached_cutting_list.value();
+            if (scene_observer_) {
+                for (const FrameTimeCodePair& scene : get_scene_list().value())
+                    scene_observer_->on_scene(scene);
+            }
+            return;
+        }
+    }
+
+    WithError<void> detect_err = _detect_scenes(video);
+    if (detect_err.has_error()) {
+        detect_err.error.show_error_msg();
+        return;
+    }
+
+    if (follow_timeout_.has_value()) {
+        WithError<void> follow_err = _follow(video.get_input_path());
+        if (follow_err.has_error())
+            follow_err.error.show_error_msg();
+    }
+
+    if (checkpoint_path_.has_value()) {
+        WithError<void> checkpoint_err = _save_checkpoint();
+        if (checkpoint_err.has_error())
+            checkpoint_err.error.show_error_msg();
+    }
+
+    /* a stopped detection leaves a partial cutting_list_ */
+    if (stop_requested_)
+        return;
+
+    /* cutting_list_ is complete only if the detection succeeded */
+    if (cache_key.has_value()) {
+        WithError<void> store_err = scene_cache_->store(cache_key.value(), cutting_list_);
+        if (store_err.has_error())
+            store_err.error.show_error_msg();
+    }
+    _close_scene(std::nullopt);
+    for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_)
+        aggregator->close_scene(std::nullopt);
+}
+
+Generator<FrameTimeCodePair> SceneManager::generate_scenes(VideoStream& video) {
+    BlockingQueue<std::optional<FrameTimeCodePair>> scene_queue(MAX_SCENE_QUEUE_LENGTH);
+    const std::shared_ptr<SceneObserver> observer = scene_observer_;
+    scene_observer_ = std::make_shared<SceneQueueObserver>(scene_queue, observer);
+    stop_requested_ = false;
+
+    std::thread thread([this, &video, &scene_queue]() {
+        detect_scenes(video);
+        scene_queue.push(std::nullopt);
+    });
+
+    /* If the caller stops iterating, the coroutine is destroyed at co_yield. The detection is then stopped,
+       and the queue drained so that the thread is not blocked on it, before joining the thread. */
+    bool is_finished = false;
+    const ScopeExit join_thread { [&]() {
+        if (!is_finished) {
+            stop_requested_ = true;
+            while (scene_queue.get().has_value()) {}
+        }
+        thread.join();
+        scene_observer_ = observer;
+    } };
+
+    while (true) {
+        std::optional<FrameTimeCodePair> scene = scene_queue.get();
+        if (!scene.has_value())
+            break;
+        co_yield scene.value();
+    }
+    is_finished = true;
+}
+
+std::optional<std::string> SceneManager::_get_cache_key(const VideoStream& video) const {
+    /* frame callbacks, score writers, event rings and aggregators need the decoded frames,
+       and resumed or followed videos are partial */
+    if (!scene_cache_ || frame_callback_ || score_writer_ || event_ring_ || !scene_aggregators_.empty() || checkpoint_path_.has_value() || follow_timeout_.has_value())
+        return std::nullopt;
+
+    WithError<std::string> opt_cache_key = SceneCache::create_key(video, *detector_);
+    if (opt_cache_key.has_error()) {
+        opt_cache_key.error.show_error_msg();
+        return std::nullopt;
+    }
+    return opt_cache_key.value();
+}
+
+void SceneManager::set_checkpoint(const std::filesystem::path& checkpoint_path, const int32_t interval) {
+    checkpoint_path_ = checkpoint_path;
+    checkpoint_interval_ = interval;
+}
+
+void SceneManager::add_scene_aggregator(std::shared_ptr<SceneAggregator> aggregator) {
+    aggregator->set_latency(detector_->get_latency());
+    scene_aggregators_.push_back(aggregator);
+}
+
+WithError<void> SceneManager::load_checkpoint(const std::filesystem::path& checkpoint_path) {
+    std::ifstream file(checkpoint_path, std::ios::binary);
+    if (!file.is_open()) {
+        const std::string error_msg = "Failed to open the checkpoint: " + checkpoint_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    const std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    StateReader reader(data);
+    std::string magic;
+    uint32_t version = 0;
+    reader.read(magic);
+    reader.read(version);
+    if (reader.has_failed() || magic != CHECKPOINT_MAGIC || version != CHECKPOINT_VERSION) {
+        const std::string error_msg = checkpoint_path.string() + " is not a checkpoint of this version.";
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::string parameters;
+    reader.read(parameters);
+    if (parameters != detector_->serialize_parameters()) {
+        const std::string error_msg = checkpoint_path.string() + " was saved with other detector parameters (" + parameters + ").";
+        return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    int32_t next_frame_num = 0;
+    std::vector<int32_t> cutting_list;
+    reader.read(next_frame_num);
+    reader.read(cutting_list);
+    detector_->load_state(reader);
+    if (reader.has_failed()) {
+        const std::string error_msg = checkpoint_path.string() + " is truncated.";
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    next_frame_num_ = next_frame_num;
+    cutting_list_ = cutting_list;
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> SceneManager::_save_checkpoint() const {
+    StateWriter writer;
+    writer.write(CHECKPOINT_MAGIC);
+    writer.write(CHECKPOINT_VERSION);
+    writer.write(detector_->serialize_parameters());
+    writer.write(next_frame_num_.value());
+    writer.write(cutting_list_);
+    detector_->save_state(writer);
+
+    /* replaced at once, so that a run killed while saving leaves the previous checkpoint */
+    const std::filesystem::path& checkpoint_path = checkpoint_path_.value();
+    const std::filesystem::path temp_path = checkpoint_path.string() + ".tmp";
+    std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+    file.write(writer.get_data().data(), writer.get_data().size());
+    file.close();
+
+    std::error_code ec;
+    if (!file.fail())
+        std::filesystem::rename(temp_path, checkpoint_path, ec);
+    if (file.fail() || ec) {
+        const std::string error_msg = "Failed to save the checkpoint: " + checkpoint_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> SceneManager::_follow(const std::string& input_path) {
+    const std::chrono::duration<float> timeout(follow_timeout_.value());
+    std::chrono::steady_clock::time_point last_growth = std::chrono::steady_clock::now();
+
+    while (std::chrono::steady_clock::now() - last_growth < timeout && !stop_requested_) {
+        std::this_thread::sleep_for(FOLLOW_POLL_INTERVAL);
 
-    BlockingQueue<VideoFrame> frame_queue(MAX_FRAME_QUEUE_LENGTH);
+        /* the container may not be readable while the recorder is writing it, so errors are retried */
+        WithError<VideoStream> opt_video = VideoStream::initialize_video_stream(input_path);
+        if (opt_video.has_error())
+            continue;
+
+        VideoStream video = opt_video.value();
+        const int32_t processed_frame_num = next_frame_num_.value();
+        if (video.get_end().get_frame_num() <= processed_frame_num)
+            continue;
+
+        end_ = video.get_end();
+        WithError<void> detect_err = _detect_scenes(video);
+        if (detect_err.has_error())
+            return detect_err;
+
+        if (next_frame_num_.value() > processed_frame_num)
+            last_growth = std::chrono::steady_clock::now();
+    }
+
+    /* the frame count of a growing file is an estimate, so the scene list ends at the last decoded frame */
+    end_ = FrameTimeCode::from_frame_nums(next_frame_num_.value(), framerate_).value();
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> SceneManager::_detect_scenes(VideoStream& video) {
+    /* a resumed detection may have processed the whole video already */
+    const int32_t start_frame_num = next_frame_num_.value();
+    if (start_frame_num >= video.get_end().get_frame_num())
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    BlockingQueue<VideoFrame> frame_queue(frame_callback_ ? MAX_FULL_FRAME_QUEUE_LENGTH : MAX_FRAME_QUEUE_LENGTH);
+
+    if (detector_->get_frame_source() == FrameSource::MOTION_VECTORS) {
+        MotionVectorReader reader;
+        WithError<void> open_err = reader.open(video.get_input_path(), framerate_);
+        if (open_err.has_error())
+            return open_err;
+        WithError<void> seek_err = reader.seek(start_frame_num);
+        if (seek_err.has_error())
+            return seek_err;
+        std::thread thread(&SceneManager::_motion_vector_thread, this, std::ref(reader), std::ref(frame_queue));
+        _consume_frames(frame_queue);
+        thread.join();
+        return WithError<void> { Error(ErrorCode::Success, "") };
+    }
+
+    video.seek(start_frame_num);
     const float downscale_factor = compute_downscale_factor(video.width());
     std::thread thread(&SceneManager::_decode_thread, this, std::ref(video),
                        downscale_factor, std::ref(frame_queue));
+    _consume_frames(frame_queue);
+    thread.join();
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> SceneManager::replay_scores(const ScoreReader& score_reader, const VideoStream& video) {
+    start_ = video.get_start();
+    end_ = video.get_end();
+    framerate_ = video.get_framerate();
+
+    const ScoreFileHeader& header = score_reader.get_header();
+    const std::string score_type = detector_->get_score_type();
+    if (score_reader.get_score_type() != score_type) {
+        const std::string error_msg = "The scores were saved by a " + score_reader.get_score_type() +
+                                      " detector and cannot be replayed by a " + score_type + " detector.";
+        return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    if (std::abs(header.framerate - framerate_) > 0.001f) {
+        const std::string error_msg = "The scores were saved from a video at a different framerate.";
+        return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+
+    const int32_t start_frame_num = start_.value().get_frame_num();
+    const int32_t end_frame_num = end_.value().get_frame_num();
+    if (header.start_frame_num > start_frame_num || header.end_frame_num < end_frame_num) {
+        const std::string error_msg = "The scores cover frames " + std::to_string(header.start_frame_num) + "-" +
+                                      std::to_string(header.end_frame_num) + " only. Save them again with a wider range.";
+        return WithError<void> { Error(ErrorCode::TimeOutOfRange, error_msg) };
+    }
 
+    for (const FrameScore& frame_score : score_reader.get_scores()) {
+        if (frame_score.frame_num < start_frame_num || frame_score.frame_num > end_frame_num)
+            continue;
+
+        const std::optional<float> score = std::isnan(frame_score.score) ? std::nullopt : std::optional<float>(frame_score.score);
+        std::optional<int32_t> cut = detector_->process_score(frame_score.frame_num, score);
+        if (cut.has_value()) {
+            cutting_list_.push_back(cut.value());
+            _close_scene(cut);
+        }
+        if (event_ring_) {
+            event_ring_->publish_score(frame_score.frame_num, score);
+            if (cut.has_value())
+                event_ring_->publish_cut(cut.value(), frame_score.frame_num);
+        }
+    }
+    _close_scene(std::nullopt);
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void SceneManager::_consume_frames(BlockingQueue<VideoFrame>& frame_queue) {
     while (true) {
         VideoFrame next_frame = frame_queue.get();
-        _process_frame(next_frame);
+        const bool is_end_marker = next_frame.frame.empty() && !next_frame.motion_info.has_value();
+        /* a stopped detection only drains the frames decoded before the decoder saw the request */
+        if (!is_end_marker && !stop_requested_)
+            _process_frame(next_frame);
 
         if (next_frame.is_end_frame)
             break;
     }
-    thread.join();
 }
 
 WithError<std::vector<FrameTimeCodePair>> SceneManager::get_scene_list() const {
@@ -74,9 +386,54 @@ std::vector<FrameTimeCode> SceneManager::_get_cutting_list() const {
 }
 
 void SceneManager::_process_frame(VideoFrame& next_frame) {
+    /* the detector may convert the frame in place, and warm-up frames are before the first scene */
+    if (next_frame.frame_num >= start_.value().get_frame_num()) {
+        for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_)
+            aggregator->add_frame(next_frame);
+    }
+
     std::optional<int32_t> cuts = detector_->process_frame(next_frame);
-    if (cuts.has_value())
+    if (cuts.has_value()) {
         cutting_list_.push_back(cuts.value());
+        _close_scene(cuts);
+        for (const std::shared_ptr<SceneAggregator>& aggregator : scene_aggregators_)
+            aggregator->close_scene(cuts);
+    }
+    if (score_writer_)
+        score_writer_->write(next_frame.frame_num, detector_->get_frame_score());
+    if (event_ring_) {
+        event_ring_->publish_score(next_frame.frame_num, detector_->get_frame_score());
+        if (cuts.has_value())
+            event_ring_->publish_cut(cuts.value(), next_frame.frame_num);
+    }
+
+    next_frame_num_ = next_frame.frame_num + 1;
+    if (checkpoint_path_.has_value() && ++frames_since_checkpoint_ >= checkpoint_interval_) {
+        frames_since_checkpoint_ = 0;
+        WithError<void> checkpoint_err = _save_checkpoint();
+        if (checkpoint_err.has_error())
+            checkpoint_err.error.show_error_msg();
+    }
+    if (frame_callback_ && !next_frame.original_frame.empty())
+        frame_callback_(next_frame.original_frame, next_frame.frame_num, cuts);
+    if (progress_callback_) {
+        const FrameTimeCode position = FrameTimeCode::from_frame_nums(next_frame.frame_num, framerate_).value();
+        std::optional<FrameTimeCode> cut = std::nullopt;
+        if (cuts.has_value())
+            cut = FrameTimeCode::from_frame_nums(cuts.value(), framerate_).value();
+        progress_callback_(position, cut);
+    }
+}
+
+void SceneManager::_close_scene(const std::optional<int32_t> cut) const {
+    if (!scene_observer_)
+        return;
+
+    const size_t num_previous_cuts = cut.has_value() ? cutting_list_.size() - 1 : cutting_list_.size();
+    const FrameTimeCode scene_start = num_previous_cuts == 0 ? start_.value()
+                                      : FrameTimeCode::from_frame_nums(cutting_list_[num_previous_cuts - 1], framerate_).value();
+    const FrameTimeCode scene_end = cut.has_value() ? FrameTimeCode::from_frame_nums(cut.value(), framerate_).value() : end_.value();
+    scene_observer_->on_scene(FrameTimeCodePair { scene_start, scene_end });
 }
 
 void SceneManager::_decode_thread(VideoStream& video,
@@ -93,13 +450,21 @@ void SceneManager::_decode_thread(VideoStream& video,
     while (true) {
         cv::Mat frame;
 
-        if(!video.get_cap().read(frame))
+        /* the file may end before its frame count, e.g., while it is being written */
+        if(stop_requested_ || !video.get_cap().read(frame)) {
+            frame_queue.push(VideoFrame { cv::Mat(), -1, true });
             break;
+        }
+
+        /* detectors may convert the frame in place, so the full resolution image must not share its buffer */
+        cv::Mat original_frame;
+        if (frame_callback_)
+            original_frame = downscale_factor > 1 ? frame : frame.clone();
 
         if (downscale_factor > 1)
             cv::resize(frame, frame, new_size, 0, 0, cv::INTER_LINEAR);
 
-        VideoFrame video_frame {frame, video.position().get_frame_num(), video.is_end_frame()};
+        VideoFrame video_frame {frame, video.position().get_frame_num(), video.is_end_frame(), std::nullopt, original_frame};
         frame_queue.push(video_frame);
 
         if (video.is_end_frame())
@@ -107,6 +472,33 @@ void SceneManager::_decode_thread(VideoStream& video,
     }
 }
 
+void SceneManager::_motion_vector_thread(MotionVectorReader& reader,
+                                         BlockingQueue<VideoFrame>& frame_queue) {
+    const int32_t end_frame_num = end_.value().get_frame_num();
+    std::optional<VideoFrame> video_frame = reader.read();
+    if (!video_frame.has_value()) {
+        /* no motion info: the end marker, not an empty frame to detect */
+        frame_queue.push(VideoFrame { cv::Mat(), start_.value().get_frame_num(), true, std::nullopt });
+        return;
+    }
+
+    /* Frames are pushed one behind the reader so that the last one can be flagged as the end frame
+       even when the stream ends before end_. */
+    while (true) {
+        const bool reached_end = video_frame.value().frame_num >= end_frame_num - 1 || stop_requested_;
+        std::optional<VideoFrame> next_frame = reached_end ? std::nullopt : reader.read();
+
+        const bool is_end_frame = !next_frame.has_value();
+        frame_queue.push(VideoFrame { video_frame.value().frame, video_frame.value().frame_num,
+                                      is_end_frame, video_frame.value().motion_info });
+        if (is_end_frame)
+            break;
+
+        video_frame.reset();
+        video_frame.emplace(next_frame.value());
+    }
+}
+
 float compute_downscale_factor(const int32_t frame_width) {
     if (frame_width < DEFAULT_MIN_WIDTH)
         return 1.0f;
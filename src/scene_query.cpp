@@ -0,0 +1,83 @@
+#include "shutoh/scene_index.hpp"
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/error.hpp"
+
+#include "scene_query.hpp"
+
+#include <fmt/core.h>
+#include <filesystem>
+#include <charconv>
+#include <limits>
+
+/* a frame number, or a timecode (HH:MM:SS[.nnn]) of the video */
+static WithError<int32_t> _parse_position(const std::string& position, const float framerate) {
+    if (position.find(':') != std::string::npos) {
+        WithError<FrameTimeCode> opt_timecode = FrameTimeCode::from_timecode_string(position, framerate);
+        if (opt_timecode.has_error())
+            return WithError<int32_t> { std::nullopt, opt_timecode.error };
+        return WithError<int32_t> { opt_timecode.value().get_frame_num(), Error(ErrorCode::Success, "") };
+    }
+
+    int32_t frame_num = 0;
+    const auto [ptr, ec] = std::from_chars(position.data(), position.data() + position.size(), frame_num);
+    if (ec != std::errc() || ptr != position.data() + position.size()) {
+        const std::string error_msg = "Invalid time: " + position;
+        return WithError<int32_t> { std::nullopt, Error(ErrorCode::InvalidTimestamp, error_msg) };
+    }
+    return WithError<int32_t> { frame_num, Error(ErrorCode::Success, "") };
+}
+
+SceneQuery::SceneQuery(const QueryConfig& cfg) : cfg_{cfg} {}
+
+WithError<void> SceneQuery::run(std::ostream& stream) const {
+    WithError<std::shared_ptr<SceneIndex>> opt_scene_index = SceneIndex::initialize_scene_index(cfg_.scene_index);
+    if (opt_scene_index.has_error())
+        return WithError<void> { opt_scene_index.error };
+
+    if (cfg_.video.has_value())
+        return _list_cuts(*opt_scene_index.value(), stream);
+    _list_videos(*opt_scene_index.value(), stream);
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> SceneQuery::_list_cuts(const SceneIndex& scene_index, std::ostream& stream) const {
+    /* videos are indexed by absolute path, see CommandRunner::_index_scenes() */
+    const std::string video_name = std::filesystem::absolute(cfg_.video.value()).lexically_normal().string();
+    const std::optional<SceneListRecord> opt_record = scene_index.find(video_name);
+    if (!opt_record.has_value()) {
+        const std::string error_msg = video_name + " is not in " + cfg_.scene_index.string();
+        return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    const SceneListRecord& record = opt_record.value();
+    const float framerate = static_cast<float>(record.framerate);
+
+    int32_t first = std::numeric_limits<int32_t>::min();
+    int32_t last = std::numeric_limits<int32_t>::max();
+    if (cfg_.start.has_value()) {
+        WithError<int32_t> opt_first = _parse_position(cfg_.start.value(), framerate);
+        if (opt_first.has_error())
+            return WithError<void> { opt_first.error };
+        first = opt_first.value();
+    }
+    if (cfg_.end.has_value()) {
+        WithError<int32_t> opt_last = _parse_position(cfg_.end.value(), framerate);
+        if (opt_last.has_error())
+            return WithError<void> { opt_last.error };
+        last = opt_last.value();
+    }
+
+    stream << "frame_number,timecode\n";
+    for (const int32_t cut : record.get_cuts(first, last))
+        stream << cut << ',' << FrameTimeCode(cut, framerate).to_string() << '\n';
+    stream.flush();
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void SceneQuery::_list_videos(const SceneIndex& scene_index, std::ostream& stream) const {
+    stream << "video,num_cuts,duration,cuts_per_minute\n";
+    for (const SceneListRecord& record : scene_index.find_by_cut_rate(cfg_.min_cuts_per_minute)) {
+        stream << '"' << record.video_name << "\"," << record.cuts.size() << ','
+               << fmt::format("{:.3f},{:.3f}", record.get_duration(), record.get_cuts_per_minute()) << '\n';
+    }
+    stream.flush();
+}
@@ -0,0 +1,30 @@
+#ifndef SCENE_QUERY_H
+#define SCENE_QUERY_H
+
+#include "config.hpp"
+
+#include <string>
+#include <ostream>
+#include <cstdint>
+
+class SceneIndex;
+template <typename T> struct WithError;
+
+/*
+   Answers --query from a scene index (index-scenes) as CSV: the cuts of one video within a time range,
+   or the indexed videos with at least a number of cuts per minute. Only the records of the matching
+   videos are read from the mapped index.
+*/
+class SceneQuery {
+    public:
+        explicit SceneQuery(const QueryConfig& cfg);
+        WithError<void> run(std::ostream& stream) const;
+
+    private:
+        WithError<void> _list_cuts(const SceneIndex& scene_index, std::ostream& stream) const;
+        void _list_videos(const SceneIndex& scene_index, std::ostream& stream) const;
+
+        const QueryConfig cfg_;
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/error.hpp"
+
+#include "scene_writer.hpp"
+
+#include <iostream>
+#include <charconv>
+#include <cstring>
+
+constexpr size_t FLUSH_SIZE = 64 * 1024;
+constexpr std::chrono::milliseconds FLUSH_INTERVAL(200);
+constexpr size_t TIMECODE_BUFFER_SIZE = 32;
+const std::string CSV_HEADER = "scene_number,start_frame,start_time,end_frame,end_time\n";
+
+static bool _is_regular_file(const std::filesystem::path& path) {
+    std::error_code error;
+    return std::filesystem::is_regular_file(path, error);
+}
+
+SceneWriter::SceneWriter(const std::optional<std::filesystem::path>& output_path, const SceneFormat format)
+    : output_path_{output_path}, format_{format},
+      file_{output_path.has_value() ? std::ofstream(output_path.value(), std::ios::binary | std::ios::trunc) : std::ofstream()},
+      stream_{output_path.has_value() ? static_cast<std::ostream&>(file_) : std::cout},
+      is_stream_{!output_path.has_value() || !_is_regular_file(output_path.value())},
+      last_flush_{std::chrono::steady_clock::now()} {
+    buffer_.reserve(FLUSH_SIZE + TIMECODE_BUFFER_SIZE * 4);
+}
+
+void SceneWriter::on_scene(const FrameTimeCodePair& scene) {
+    const FrameTimeCode& start = std::get<0>(scene);
+    const FrameTimeCode& end = std::get<1>(scene);
+    /* the first frame of a scene but the first one is the frame after the cut */
+    const int32_t start_index = num_scenes_ == 0 ? start.get_frame_num() : start.get_frame_num() + 1;
+
+    switch (format_) {
+        case SceneFormat::CSV:
+            _append_csv(start, end, start_index);
+            break;
+        case SceneFormat::NDJSON:
+            _append_ndjson(start, end, start_index);
+            break;
+        case SceneFormat::BINARY: {
+            if (num_scenes_ == 0)
+                _append_header(start.get_framerate());
+            const SceneRecord record { start.get_frame_num(), end.get_frame_num() };
+            buffer_.append(reinterpret_cast<const char*>(&record), sizeof(SceneRecord));
+            break;
+        }
+    }
+    num_scenes_++;
+
+    /* a consumer of a pipe waits for each scene, whereas the next one may be minutes away */
+    if (is_stream_ || buffer_.size() >= FLUSH_SIZE || std::chrono::steady_clock::now() - last_flush_ >= FLUSH_INTERVAL)
+        _flush();
+}
+
+WithError<void> SceneWriter::close() {
+    /* an empty list still has its header */
+    if (num_scenes_ == 0 && format_ == SceneFormat::CSV)
+        buffer_ += CSV_HEADER;
+    if (num_scenes_ == 0 && format_ == SceneFormat::BINARY)
+        _append_header(0.0f);
+    _flush();
+
+    if (!output_path_.has_value())
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    if (format_ == SceneFormat::BINARY) {
+        buffer_.clear();
+        _append_header(framerate_);
+        file_.seekp(0);
+        _flush();
+    }
+    file_.close();
+    if (file_.fail()) {
+        const std::string error_msg = "Failed to write the scene list: " + output_path_.value().string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void SceneWriter::_append_csv(const FrameTimeCode& start, const FrameTimeCode& end, const int32_t start_index) {
+    if (num_scenes_ == 0)
+        buffer_ += CSV_HEADER;
+    _append_number(num_scenes_);
+    buffer_ += ',';
+    _append_number(start_index);
+    buffer_ += ',';
+    _append_timecode(start);
+    buffer_ += ',';
+    _append_number(end.get_frame_num());
+    buffer_ += ',';
+    _append_timecode(end);
+    buffer_ += '\n';
+}
+
+void SceneWriter::_append_ndjson(const FrameTimeCode& start, const FrameTimeCode& end, const int32_t start_index) {
+    buffer_ += "{\"scene\": ";
+    _append_number(num_scenes_);
+    buffer_ += ", \"start_frame\": ";
+    _append_number(start_index);
+    buffer_ += ", \"start_time\": \"";
+    _append_timecode(start);
+    buffer_ += "\", \"end_frame\": ";
+    _append_number(end.get_frame_num());
+    buffer_ += ", \"end_time\": \"";
+    _append_timecode(end);
+    buffer_ += "\"}\n";
+}
+
+void SceneWriter::_append_header(const float framerate) {
+    framerate_ = framerate;
+    SceneFileHeader header {};
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_FILE_VERSION;
+    header.num_scenes = static_cast<uint32_t>(num_scenes_);
+    header.framerate = framerate;
+    buffer_.append(reinterpret_cast<const char*>(&header), sizeof(SceneFileHeader));
+}
+
+void SceneWriter::_append_number(const int64_t value) {
+    char digits[24];
+    const std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer_.append(digits, result.ptr);
+}
+
+void SceneWriter::_append_timecode(const FrameTimeCode& timecode) {
+    char text[TIMECODE_BUFFER_SIZE];
+    const std::to_chars_result result = timecode.to_chars(text, text + sizeof(text));
+    buffer_.append(text, result.ptr);
+}
+
+void SceneWriter::_flush() {
+    stream_.write(buffer_.data(), buffer_.size());
+    stream_.flush();
+    buffer_.clear();
+    last_flush_ = std::chrono::steady_clock::now();
+}
+
+WithError<std::shared_ptr<SceneWriter>> SceneWriter::initialize_scene_writer(const std::optional<std::filesystem::path>& output_path,
+                                                                             const SceneFormat format) {
+    std::shared_ptr<SceneWriter> writer = std::make_shared<SceneWriter>(output_path, format);
+    if (output_path.has_value() && !writer->file_.is_open()) {
+        const std::string error_msg = "Failed to open the scene list for writing: " + output_path.value().string();
+        return WithError<std::shared_ptr<SceneWriter>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<std::shared_ptr<SceneWriter>> { writer, Error(ErrorCode::Success, "") };
+}
+
+std::string SceneWriter::get_extension(const SceneFormat format) {
+    switch (format) {
+        case SceneFormat::NDJSON:
+            return "ndjson";
+        case SceneFormat::BINARY:
+            return "bin";
+        default:
+            return "csv";
+    }
+}
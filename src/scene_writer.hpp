@@ -0,0 +1,82 @@
+#ifndef SCENE_WRITER_H
+#define SCENE_WRITER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/scene_observer.hpp"
+
+#include <string>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+
+class FrameTimeCode;
+template <typename T> struct WithError;
+
+enum class SceneFormat {
+    CSV,
+    NDJSON,
+    BINARY,
+};
+
+/* binary scene list: a fixed header followed by one SceneRecord per scene, in native byte order */
+constexpr char SCENE_FILE_MAGIC[8] = { 'S', 'H', 'U', 'T', 'O', 'H', 'S', 'L' };
+constexpr uint32_t SCENE_FILE_VERSION = 1;
+
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_scenes; /* written when the file is closed, 0 if the run did not finish or on stdout */
+    float framerate;
+    int32_t reserved;
+};
+static_assert(sizeof(SceneFileHeader) == 24);
+
+struct SceneRecord {
+    int32_t start_frame_num;
+    int32_t end_frame_num;
+};
+static_assert(sizeof(SceneRecord) == 8);
+
+/*
+   Writes the scene list (list-scenes) as the scenes are closed, so that a consumer of the file or stdout
+   gets the first scenes while the rest of the video is detected. Scenes are formatted into a reused buffer.
+   On stdout or a pipe, it is written after each scene; to a regular file, when it is full or when a scene
+   is closed FLUSH_INTERVAL after the last write.
+     CSV     scene_number,start_frame,start_time,end_frame,end_time
+     NDJSON  {"scene": 0, "start_frame": 0, "start_time": "00:00:00.000", "end_frame": 64, "end_time": "00:00:02.135"}
+     BINARY  SceneFileHeader and one SceneRecord per scene, e.g., numpy.fromfile(path, "<i4", offset=24).reshape(-1, 2)
+*/
+class SceneWriter : public SceneObserver {
+    public:
+        explicit SceneWriter(const std::optional<std::filesystem::path>& output_path, const SceneFormat format);
+        void on_scene(const FrameTimeCodePair& scene) override;
+        size_t get_num_scenes() const { return num_scenes_; }
+        WithError<void> close();
+        /* writes to stdout if output_path is std::nullopt */
+        static WithError<std::shared_ptr<SceneWriter>> initialize_scene_writer(const std::optional<std::filesystem::path>& output_path,
+                                                                               const SceneFormat format);
+        static std::string get_extension(const SceneFormat format);
+
+    private:
+        void _append_csv(const FrameTimeCode& start, const FrameTimeCode& end, const int32_t start_index);
+        void _append_ndjson(const FrameTimeCode& start, const FrameTimeCode& end, const int32_t start_index);
+        void _append_header(const float framerate);
+        void _append_number(const int64_t value);
+        void _append_timecode(const FrameTimeCode& timecode);
+        void _flush();
+
+        const std::optional<std::filesystem::path> output_path_;
+        const SceneFormat format_;
+        std::ofstream file_;
+        std::ostream& stream_;
+        const bool is_stream_; /* stdout or a pipe rather than a regular file */
+        std::string buffer_;
+        size_t num_scenes_ = 0;
+        float framerate_ = 0.0f;
+        std::chrono::steady_clock::time_point last_flush_;
+};
+
+#endif
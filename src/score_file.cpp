@@ -0,0 +1,165 @@
+#include "shutoh/score_file.hpp"
+#include "shutoh/error.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+ScoreWriter::ScoreWriter(const std::filesystem::path& output_path, const ScoreFileHeader& header)
+    : output_path_{output_path}, header_(header), file_(output_path, std::ios::binary | std::ios::trunc) {
+    /* num_scores stays 0 until close(), so that an interrupted run is not replayed */
+    file_.write(reinterpret_cast<const char*>(&header_), sizeof(ScoreFileHeader));
+}
+
+void ScoreWriter::write(const int32_t frame_num, const std::optional<float> score) {
+    if (frame_num < header_.start_frame_num)
+        return;
+
+    const FrameScore frame_score { frame_num, score.value_or(std::numeric_limits<float>::quiet_NaN()) };
+    file_.write(reinterpret_cast<const char*>(&frame_score), sizeof(FrameScore));
+    header_.num_scores++;
+}
+
+WithError<void> ScoreWriter::close() {
+    file_.seekp(0);
+    file_.write(reinterpret_cast<const char*>(&header_), sizeof(ScoreFileHeader));
+    file_.close();
+    if (file_.fail()) {
+        const std::string error_msg = "Failed to write the scores to " + output_path_.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::shared_ptr<ScoreWriter>> ScoreWriter::initialize_score_writer(const std::filesystem::path& output_path,
+                                                                             const std::string& score_type,
+                                                                             const float framerate,
+                                                                             const int32_t start_frame_num,
+                                                                             const int32_t end_frame_num) {
+    ScoreFileHeader header {};
+    std::memcpy(header.magic, SCORE_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCORE_FILE_VERSION;
+    header.num_scores = 0;
+    header.framerate = framerate;
+    header.start_frame_num = start_frame_num;
+    header.end_frame_num = end_frame_num;
+    if (score_type.size() >= sizeof(header.score_type)) {
+        const std::string error_msg = "Score type is too long to be saved: " + score_type;
+        return WithError<std::shared_ptr<ScoreWriter>> { std::nullopt, Error(ErrorCode::InvalidArgument, error_msg) };
+    }
+    std::copy(score_type.begin(), score_type.end(), header.score_type);
+
+    std::shared_ptr<ScoreWriter> score_writer = std::make_shared<ScoreWriter>(output_path, header);
+    if (!score_writer->file_.is_open()) {
+        const std::string error_msg = "Failed to create " + output_path.string();
+        return WithError<std::shared_ptr<ScoreWriter>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<std::shared_ptr<ScoreWriter>> { score_writer, Error(ErrorCode::Success, "") };
+}
+
+ScoreReader::ScoreReader(const void* data, const size_t size) : data_{data}, size_{size} {}
+
+ScoreReader::~ScoreReader() {
+    munmap(const_cast<void*>(data_), size_);
+}
+
+std::string ScoreReader::get_score_type() const {
+    const char* score_type = get_header().score_type;
+    return std::string(score_type, strnlen(score_type, sizeof(ScoreFileHeader::score_type)));
+}
+
+std::span<const FrameScore> ScoreReader::get_scores() const {
+    const FrameScore* scores = reinterpret_cast<const FrameScore*>(static_cast<const char*>(data_) + sizeof(ScoreFileHeader));
+    return std::span<const FrameScore>(scores, get_header().num_scores);
+}
+
+WithError<std::shared_ptr<ScoreReader>> ScoreReader::initialize_score_reader(const std::filesystem::path& input_path) {
+    const int32_t fd = ::open(input_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        const std::string error_msg = "Failed to open " + input_path.string();
+        return WithError<std::shared_ptr<ScoreReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    struct stat file_stat;
+    const bool has_header = fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= sizeof(ScoreFileHeader);
+    void* data = has_header ? mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd); /* the mapping stays valid */
+    if (data == MAP_FAILED) {
+        const std::string error_msg = input_path.string() + " is not a score file.";
+        return WithError<std::shared_ptr<ScoreReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    std::shared_ptr<ScoreReader> score_reader = std::make_shared<ScoreReader>(data, file_stat.st_size);
+    const ScoreFileHeader& header = score_reader->get_header();
+    if (std::memcmp(header.magic, SCORE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != SCORE_FILE_VERSION) {
+        const std::string error_msg = input_path.string() + " is not a score file of this version.";
+        return WithError<std::shared_ptr<ScoreReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const size_t expected_size = sizeof(ScoreFileHeader) + static_cast<size_t>(header.num_scores) * sizeof(FrameScore);
+    if (header.num_scores == 0 || expected_size != score_reader->size_) {
+        const std::string error_msg = input_path.string() + " is incomplete. The run which saved it may have been interrupted.";
+        return WithError<std::shared_ptr<ScoreReader>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<std::shared_ptr<ScoreReader>> { score_reader, Error(ErrorCode::Success, "") };
+}
+
+WithError<void> merge_score_files(const std::vector<std::filesystem::path>& input_paths, const std::filesystem::path& output_path) {
+    std::vector<std::shared_ptr<ScoreReader>> readers;
+    for (const std::filesystem::path& input_path : input_paths) {
+        WithError<std::shared_ptr<ScoreReader>> opt_reader = ScoreReader::initialize_score_reader(input_path);
+        if (opt_reader.has_error())
+            return WithError<void> { opt_reader.error };
+        readers.push_back(opt_reader.value());
+    }
+
+    /* shards may be given in any order */
+    std::vector<size_t> order(readers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&readers](const size_t a, const size_t b) {
+        return readers[a]->get_header().start_frame_num < readers[b]->get_header().start_frame_num;
+    });
+
+    const ScoreReader& first = *readers[order.front()];
+    int32_t end_frame_num = first.get_header().end_frame_num;
+    for (size_t i = 1; i < order.size(); i++) {
+        const ScoreReader& reader = *readers[order[i]];
+        const std::string& shard_name = input_paths[order[i]].string();
+        if (reader.get_score_type() != first.get_score_type() ||
+            std::abs(reader.get_header().framerate - first.get_header().framerate) > 0.001f) {
+            const std::string error_msg = shard_name + " was saved by another detector or from another video.";
+            return WithError<void> { Error(ErrorCode::InvalidArgument, error_msg) };
+        }
+        if (reader.get_header().start_frame_num > end_frame_num) {
+            const std::string error_msg = "No shard covers frames " + std::to_string(end_frame_num) + "-" +
+                                          std::to_string(reader.get_header().start_frame_num - 1) + ".";
+            return WithError<void> { Error(ErrorCode::TimeOutOfRange, error_msg) };
+        }
+        end_frame_num = std::max(end_frame_num, reader.get_header().end_frame_num);
+    }
+
+    WithError<std::shared_ptr<ScoreWriter>> opt_writer = ScoreWriter::initialize_score_writer(
+        output_path, first.get_score_type(), first.get_header().framerate, first.get_header().start_frame_num, end_frame_num);
+    if (opt_writer.has_error())
+        return WithError<void> { opt_writer.error };
+
+    std::shared_ptr<ScoreWriter> writer = opt_writer.value();
+    int32_t next_frame_num = std::numeric_limits<int32_t>::min();
+    for (const size_t i : order) {
+        for (const FrameScore& frame_score : readers[i]->get_scores()) {
+            if (frame_score.frame_num < next_frame_num)
+                continue;
+            const std::optional<float> score = std::isnan(frame_score.score) ? std::nullopt : std::optional<float>(frame_score.score);
+            writer->write(frame_score.frame_num, score);
+            next_frame_num = frame_score.frame_num + 1;
+        }
+    }
+    return writer->close();
+}
@@ -0,0 +1,242 @@
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/error.hpp"
+#include "smart_splitter.hpp"
+#include "keyframe_index.hpp"
+#include "process_scheduler.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <fstream>
+#include <algorithm>
+#include <iostream>
+#include <fmt/core.h>
+
+/* -ss lands between two frames so that rounding of the frame time never selects the neighbour */
+constexpr float SEEK_MARGIN_FRAMES = 0.5f;
+
+static std::optional<std::string> get_h264_profile(const int32_t profile) {
+    switch (profile) {
+        case 66: return "baseline";
+        case 578: return "baseline"; /* constrained baseline */
+        case 77: return "main";
+        case 100: return "high";
+        case 110: return "high10";
+        case 122: return "high422";
+        case 244: return "high444";
+        default: return std::nullopt;
+    }
+}
+
+static std::optional<std::string> get_hevc_profile(const int32_t profile) {
+    switch (profile) {
+        case 1: return "main";
+        case 2: return "main10";
+        default: return std::nullopt;
+    }
+}
+
+static std::optional<SourceEncoder> probe_source_encoder(const std::filesystem::path& input_path) {
+    AVFormatContext* format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, input_path.c_str(), nullptr, nullptr) < 0)
+        return std::nullopt;
+    if (avformat_find_stream_info(format_ctx, nullptr) < 0) {
+        avformat_close_input(&format_ctx);
+        return std::nullopt;
+    }
+
+    const int32_t stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (stream_index < 0) {
+        avformat_close_input(&format_ctx);
+        return std::nullopt;
+    }
+
+    const AVCodecParameters* codecpar = format_ctx->streams[stream_index]->codecpar;
+    const char* pix_fmt_name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(codecpar->format));
+    const std::string pix_fmt = pix_fmt_name ? pix_fmt_name : "yuv420p";
+    const int32_t level = codecpar->level;
+    std::optional<SourceEncoder> source_encoder = std::nullopt;
+
+    if (codecpar->codec_id == AV_CODEC_ID_H264) {
+        const std::optional<std::string> level_str = level > 0 ? std::optional<std::string>(fmt::format("{}.{}", level / 10, level % 10))
+                                                               : std::nullopt;
+        source_encoder.emplace(SourceEncoder { "libx264", "-x264-params", get_h264_profile(codecpar->profile), level_str, pix_fmt });
+    } else if (codecpar->codec_id == AV_CODEC_ID_HEVC) {
+        /* HEVC level_idc is 30 times the level */
+        const std::optional<std::string> level_str = level > 0 ? std::optional<std::string>(fmt::format("{}", level / 30.0f))
+                                                               : std::nullopt;
+        source_encoder.emplace(SourceEncoder { "libx265", "-x265-params", get_hevc_profile(codecpar->profile), level_str, pix_fmt });
+    }
+
+    avformat_close_input(&format_ctx);
+    return source_encoder;
+}
+
+static std::string escape_concat_path(const std::string& path) {
+    /* the concat demuxer reads '...' quoted paths, with ' written as '\'' */
+    std::string escaped;
+    for (const char c : path)
+        escaped += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return escaped;
+}
+
+SmartSplitter::SmartSplitter(const std::filesystem::path& output_dir, const std::string& output_filename,
+                             const int32_t crf, const std::string& preset)
+    : output_dir_{output_dir}, output_filename_{output_filename}, crf_{crf}, preset_{preset} {}
+
+WithError<void> SmartSplitter::split_video(const std::filesystem::path& input_path,
+                                           const std::vector<FrameTimeCodePair>& scene_list) const {
+    if (scene_list.empty())
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    const float framerate = std::get<0>(scene_list[0]).get_framerate();
+    WithError<KeyframeIndex> opt_keyframe_index = KeyframeIndex::build(input_path.string(), framerate);
+    if (opt_keyframe_index.has_error())
+        return WithError<void> { opt_keyframe_index.error };
+    const KeyframeIndex keyframe_index = opt_keyframe_index.value();
+
+    const std::optional<SourceEncoder> source_encoder = probe_source_encoder(input_path);
+    if (!source_encoder.has_value())
+        std::cout << "Warning: the video codec cannot be matched by libx264/libx265, every scene is re-encoded." << std::endl;
+
+    /* ids of part jobs index part_scenes, ids of concat jobs are -1 - scene_number */
+    std::vector<int32_t> part_scenes;
+    std::vector<std::vector<std::string>> concat_args(scene_list.size());
+    std::vector<int32_t> remaining_parts(scene_list.size(), 0);
+    std::vector<bool> is_scene_failed(scene_list.size(), false);
+    std::vector<ProcessJob> process_jobs;
+
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        const FrameTimeCodePair& scene = scene_list[scene_number];
+        WithError<std::vector<std::vector<std::string>>> opt_parts = _get_scene_commands(input_path, scene, scene_number, keyframe_index,
+                                                                                         source_encoder, concat_args[scene_number]);
+        if (opt_parts.has_error()) {
+            std::cerr << "Error: " << opt_parts.error.get_error_msg() << std::endl;
+            is_scene_failed[scene_number] = true;
+            continue;
+        }
+        const double cost = std::get<1>(scene).get_frame_num() - std::get<0>(scene).get_frame_num();
+        for (const std::vector<std::string>& args : opt_parts.value()) {
+            process_jobs.push_back(ProcessJob { args, cost, static_cast<int32_t>(part_scenes.size()) });
+            part_scenes.push_back(scene_number);
+            remaining_parts[scene_number]++;
+        }
+    }
+
+    auto on_exit = [&part_scenes, &concat_args, &remaining_parts, &is_scene_failed](const ProcessJob& process_job, const bool success) {
+        std::optional<ProcessJob> next_job = std::nullopt;
+        const int32_t scene_number = process_job.id < 0 ? -1 - process_job.id : part_scenes[process_job.id];
+        if (!success) {
+            is_scene_failed[scene_number] = true;
+            return next_job;
+        }
+        /* the parts of a scene are joined once all of them are encoded */
+        if (process_job.id >= 0 && --remaining_parts[scene_number] == 0 && !concat_args[scene_number].empty())
+            next_job.emplace(ProcessJob { concat_args[scene_number], 0.0, -1 - scene_number });
+        return next_job;
+    };
+
+    const ProcessScheduler scheduler = ProcessScheduler(ProcessScheduler::get_available_cpus());
+    scheduler.run(process_jobs, on_exit);
+    const size_t num_failed = std::count(is_scene_failed.begin(), is_scene_failed.end(), true);
+
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        for (const std::string suffix : { "_head.ts", "_middle.ts", "_tail.ts", "_concat.txt" })
+            std::filesystem::remove(_get_output_path(scene_number, suffix));
+    }
+
+    if (num_failed > 0) {
+        const std::string error_msg = fmt::format("Failed to split {} scene(s) with ffmpeg.", num_failed);
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<std::vector<std::vector<std::string>>> SmartSplitter::_get_scene_commands(const std::filesystem::path& input_path,
+                                                                                   const FrameTimeCodePair& scene, const int32_t scene_number,
+                                                                                   const KeyframeIndex& keyframe_index,
+                                                                                   const std::optional<SourceEncoder>& source_encoder,
+                                                                                   std::vector<std::string>& concat_args) const {
+    const float framerate = std::get<0>(scene).get_framerate();
+    const int32_t start = std::get<0>(scene).get_frame_num();
+    const int32_t end = std::get<1>(scene).get_frame_num();
+    const std::string output_path = _get_output_path(scene_number, ".mp4");
+
+    /* [start, first_keyframe) and [last_keyframe, end) are re-encoded, the GOPs in between are copied */
+    const int32_t first_keyframe = keyframe_index.next_keyframe(start);
+    const int32_t last_keyframe = keyframe_index.previous_keyframe(end);
+    if (!source_encoder.has_value() || first_keyframe >= last_keyframe) {
+        const SourceEncoder fallback_encoder { "libx264", "-x264-params", std::nullopt, std::nullopt, "yuv420p" };
+        const std::vector<std::string> encode_args = _get_encode_args(input_path, start, end - start, framerate,
+                                                                      source_encoder.value_or(fallback_encoder), output_path, false);
+        return WithError<std::vector<std::vector<std::string>>> { std::vector<std::vector<std::string>> { encode_args },
+                                                                  Error(ErrorCode::Success, "") };
+    }
+
+    std::vector<std::vector<std::string>> part_args;
+    std::vector<std::string> parts;
+    if (start < first_keyframe) {
+        parts.push_back(_get_output_path(scene_number, "_head.ts"));
+        part_args.push_back(_get_encode_args(input_path, start, first_keyframe - start, framerate,
+                                             source_encoder.value(), parts.back(), true));
+    }
+
+    parts.push_back(_get_output_path(scene_number, "_middle.ts"));
+    part_args.push_back({ "ffmpeg", "-nostdin", "-y", "-v", "quiet", "-ss", fmt::format("{:.6f}", (first_keyframe + SEEK_MARGIN_FRAMES) / framerate),
+                          "-i", input_path.string(), "-map", "0:v:0", "-frames:v", std::to_string(last_keyframe - first_keyframe),
+                          "-c:v", "copy", parts.back() });
+
+    if (last_keyframe < end) {
+        parts.push_back(_get_output_path(scene_number, "_tail.ts"));
+        part_args.push_back(_get_encode_args(input_path, last_keyframe, end - last_keyframe, framerate,
+                                             source_encoder.value(), parts.back(), true));
+    }
+
+    /* the concat list is written up front; ffmpeg reads it only after the parts exist */
+    const std::string concat_path = _get_output_path(scene_number, "_concat.txt");
+    std::ofstream concat_file(concat_path);
+    for (const std::string& part : parts)
+        concat_file << "file '" << escape_concat_path(part) << "'\n";
+    concat_file.close();
+    if (!concat_file) {
+        const std::string error_msg = fmt::format("Failed to write {}.", concat_path);
+        return WithError<std::vector<std::vector<std::string>>> { std::nullopt, Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    concat_args = { "ffmpeg", "-nostdin", "-y", "-v", "quiet", "-f", "concat", "-safe", "0", "-i", concat_path,
+                    "-ss", fmt::format("{:.6f}", start / framerate), "-t", fmt::format("{:.6f}", (end - start) / framerate),
+                    "-i", input_path.string(), "-map", "0:v:0", "-map", "1:a?", "-c", "copy", output_path };
+    return WithError<std::vector<std::vector<std::string>>> { part_args, Error(ErrorCode::Success, "") };
+}
+
+std::vector<std::string> SmartSplitter::_get_encode_args(const std::filesystem::path& input_path, const int32_t start, const int32_t num_frames,
+                                                         const float framerate, const SourceEncoder& source_encoder,
+                                                         const std::string& output_path, const bool is_part) const {
+    /* A part has exactly num_frames video frames and no audio; audio is copied when the parts are joined.
+       Headers are repeated in-band, since only the first part's parameter sets reach the mp4 header. */
+    const float seek_seconds = std::max(0.0f, (start - SEEK_MARGIN_FRAMES) / framerate);
+    std::vector<std::string> args = { "ffmpeg", "-nostdin", "-y", "-v", "quiet", "-ss", fmt::format("{:.6f}", seek_seconds),
+                                      "-i", input_path.string() };
+    if (is_part)
+        args.insert(args.end(), { "-map", "0:v:0", "-frames:v", std::to_string(num_frames) });
+    else
+        args.insert(args.end(), { "-t", fmt::format("{:.6f}", num_frames / framerate) });
+    args.insert(args.end(), { "-c:v", source_encoder.encoder, "-preset", preset_, "-crf", std::to_string(crf_),
+                              "-pix_fmt", source_encoder.pix_fmt });
+    if (source_encoder.profile.has_value())
+        args.insert(args.end(), { "-profile:v", source_encoder.profile.value() });
+    if (source_encoder.level.has_value())
+        args.insert(args.end(), { "-level", source_encoder.level.value() });
+    args.insert(args.end(), { source_encoder.params_option, "repeat-headers=1", output_path });
+    return args;
+}
+
+std::string SmartSplitter::_get_output_path(const int32_t scene_number, const std::string& suffix) const {
+    std::string filename = output_filename_;
+    const std::string pattern = "@SCENE_NUMBER";
+    for (size_t pos = filename.find(pattern); pos != std::string::npos; pos = filename.find(pattern, pos))
+        filename.replace(pos, pattern.size(), std::to_string(scene_number));
+    return output_dir_.string() + "/" + filename + suffix;
+}
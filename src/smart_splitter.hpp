@@ -0,0 +1,53 @@
+#ifndef SMART_SPLITTER_H
+#define SMART_SPLITTER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <optional>
+
+template <typename T> struct WithError;
+class KeyframeIndex;
+
+/* Encoder settings which reproduce the source video stream closely enough to be concatenated with it. */
+struct SourceEncoder {
+    const std::string encoder; /* libx264 or libx265 */
+    const std::string params_option; /* -x264-params or -x265-params */
+    const std::optional<std::string> profile;
+    const std::optional<std::string> level;
+    const std::string pix_fmt;
+};
+
+/*
+   Frame-accurate split which re-encodes only the partial GOPs at the head and tail of each scene.
+   The keyframe-aligned middle is stream-copied, and the parts are joined with the concat demuxer.
+   The parts of all scenes are run without a shell by a ProcessScheduler, and each scene's join follows its parts.
+*/
+class SmartSplitter {
+    public:
+        explicit SmartSplitter(const std::filesystem::path& output_dir, const std::string& output_filename,
+                               const int32_t crf, const std::string& preset);
+        WithError<void> split_video(const std::filesystem::path& input_path,
+                                    const std::vector<FrameTimeCodePair>& scene_list) const;
+
+    private:
+        /* the ffmpeg runs of the scene's parts, which concat_args joins afterwards unless it is left empty */
+        WithError<std::vector<std::vector<std::string>>> _get_scene_commands(const std::filesystem::path& input_path,
+                                                                             const FrameTimeCodePair& scene, const int32_t scene_number,
+                                                                             const KeyframeIndex& keyframe_index,
+                                                                             const std::optional<SourceEncoder>& source_encoder,
+                                                                             std::vector<std::string>& concat_args) const;
+        std::vector<std::string> _get_encode_args(const std::filesystem::path& input_path, const int32_t start, const int32_t num_frames,
+                                                  const float framerate, const SourceEncoder& source_encoder,
+                                                  const std::string& output_path, const bool is_part) const;
+        std::string _get_output_path(const int32_t scene_number, const std::string& suffix) const;
+
+        const std::filesystem::path output_dir_;
+        const std::string output_filename_;
+        const int32_t crf_;
+        const std::string preset_;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/error.hpp"
+#include "stream_copy_splitter.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <cmath>
+#include <algorithm>
+#include <optional>
+
+constexpr AVRational MICROSECONDS = { 1, AV_TIME_BASE };
+
+StreamCopySplitter::StreamCopySplitter(const std::filesystem::path& output_dir, const std::string& output_filename)
+    : output_dir_{output_dir}, output_filename_{output_filename} {}
+
+StreamCopySplitter::~StreamCopySplitter() {
+    for (AVPacket* packet : pending_packets_)
+        av_packet_free(&packet);
+    if (output_ctx_) {
+        if (!(output_ctx_->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&output_ctx_->pb);
+        avformat_free_context(output_ctx_);
+    }
+    avformat_close_input(&input_ctx_);
+}
+
+WithError<std::vector<FrameTimeCodePair>> StreamCopySplitter::split_video(const std::filesystem::path& input_path,
+                                                                          const std::vector<FrameTimeCodePair>& scene_list) {
+    std::vector<FrameTimeCodePair> split_list;
+    if (scene_list.empty())
+        return WithError<std::vector<FrameTimeCodePair>> { split_list, Error(ErrorCode::Success, "") };
+
+    WithError<void> open_err = _open_input(input_path);
+    if (open_err.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, open_err.error };
+
+    const float framerate = std::get<0>(scene_list[0]).get_framerate();
+    const int32_t end_frame = std::get<1>(scene_list.back()).get_frame_num();
+    const AVStream* video_stream = input_ctx_->streams[video_index_];
+
+    const int32_t first_frame = std::get<0>(scene_list[0]).get_frame_num();
+    if (first_frame > 0) {
+        const int64_t seek_pts = av_rescale_q(static_cast<int64_t>(std::llround((video_start_seconds_ + first_frame / framerate) * AV_TIME_BASE)),
+                                              MICROSECONDS, video_stream->time_base);
+        av_seek_frame(input_ctx_, video_index_, seek_pts, AVSEEK_FLAG_BACKWARD);
+    }
+
+    /* scene whose output is open, and the frame at which it actually starts */
+    int32_t scene_ind = -1;
+    int32_t cut_frame = 0;
+    const double end_seconds = video_start_seconds_ + end_frame / framerate;
+    std::optional<Error> error = std::nullopt;
+
+    AVPacket* packet = av_packet_alloc();
+    while (!error.has_value() && av_read_frame(input_ctx_, packet) >= 0) {
+        if (stream_mapping_[packet->stream_index] < 0) {
+            av_packet_unref(packet);
+            continue;
+        }
+
+        const double seconds = _get_seconds(packet);
+        if (packet->stream_index != video_index_) {
+            /* held back until the next cut decides which file the packet belongs to */
+            const size_t next_scene = static_cast<size_t>(scene_ind + 1);
+            const bool waits_for_cut = next_scene < scene_list.size()
+                                       && seconds >= video_start_seconds_ + std::get<0>(scene_list[next_scene]).get_frame_num() / framerate;
+            if (seconds < end_seconds && waits_for_cut)
+                pending_packets_.push_back(av_packet_clone(packet));
+            else if (seconds < end_seconds && scene_ind >= 0) {
+                WithError<void> err = _write_packet(packet);
+                if (err.has_error())
+                    error.emplace(err.error);
+            }
+            av_packet_unref(packet);
+            continue;
+        }
+
+        const int32_t frame_num = static_cast<int32_t>(std::lround((seconds - video_start_seconds_) * framerate));
+        const bool is_keyframe = packet->flags & AV_PKT_FLAG_KEY;
+        if (is_keyframe && frame_num >= end_frame) {
+            av_packet_unref(packet);
+            break;
+        }
+
+        /* the last scene starting at or before this keyframe */
+        int32_t next_scene_ind = scene_ind;
+        while (is_keyframe && static_cast<size_t>(next_scene_ind + 1) < scene_list.size()
+               && std::get<0>(scene_list[next_scene_ind + 1]).get_frame_num() <= frame_num)
+            next_scene_ind++;
+
+        if (next_scene_ind != scene_ind) {
+            if (scene_ind >= 0)
+                split_list.push_back(FrameTimeCodePair { FrameTimeCode(cut_frame, framerate), FrameTimeCode(frame_num, framerate) });
+
+            const size_t following_scene = static_cast<size_t>(next_scene_ind + 1);
+            const double next_cut_seconds = following_scene < scene_list.size()
+                                            ? video_start_seconds_ + std::get<0>(scene_list[following_scene]).get_frame_num() / framerate
+                                            : end_seconds;
+            WithError<void> err = _switch_output(next_scene_ind, seconds, next_cut_seconds,
+                                                 packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts);
+            if (err.has_error()) {
+                error.emplace(err.error);
+                av_packet_unref(packet);
+                break;
+            }
+            scene_ind = next_scene_ind;
+            cut_frame = frame_num;
+        }
+
+        if (scene_ind >= 0 && frame_num < end_frame) {
+            WithError<void> err = _write_packet(packet);
+            if (err.has_error())
+                error.emplace(err.error);
+        }
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+
+    if (!error.has_value() && scene_ind >= 0) {
+        split_list.push_back(FrameTimeCodePair { FrameTimeCode(cut_frame, framerate), FrameTimeCode(end_frame, framerate) });
+        WithError<void> flush_err = _flush_pending(end_seconds);
+        WithError<void> close_err = _close_output();
+        if (flush_err.has_error())
+            error.emplace(flush_err.error);
+        else if (close_err.has_error())
+            error.emplace(close_err.error);
+    }
+
+    if (error.has_value())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, error.value() };
+    return WithError<std::vector<FrameTimeCodePair>> { split_list, Error(ErrorCode::Success, "") };
+}
+
+WithError<void> StreamCopySplitter::_open_input(const std::filesystem::path& input_path) {
+    if (avformat_open_input(&input_ctx_, input_path.c_str(), nullptr, nullptr) < 0) {
+        const std::string error_msg = "Failed to open the video: " + input_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_find_stream_info(input_ctx_, nullptr) < 0) {
+        const std::string error_msg = "Failed to read stream information: " + input_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    video_index_ = av_find_best_stream(input_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (video_index_ < 0) {
+        const std::string error_msg = "No video stream in " + input_path.string();
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    const AVStream* video_stream = input_ctx_->streams[video_index_];
+    const int64_t video_start_time = video_stream->start_time == AV_NOPTS_VALUE ? 0 : video_stream->start_time;
+    video_start_seconds_ = video_start_time * av_q2d(video_stream->time_base);
+
+    /* same selection as "-map 0:v:0 -map 0:a? -map 0:s?", minus codecs the output container cannot hold */
+    const AVOutputFormat* output_format = av_guess_format(nullptr, _get_output_path(0).c_str(), nullptr);
+    int32_t output_index = 0;
+    for (uint32_t i = 0; i < input_ctx_->nb_streams; i++) {
+        AVStream* stream = input_ctx_->streams[i];
+        const AVMediaType type = stream->codecpar->codec_type;
+        const bool is_selected = static_cast<int32_t>(i) == video_index_ || type == AVMEDIA_TYPE_AUDIO || type == AVMEDIA_TYPE_SUBTITLE;
+        if (is_selected && avformat_query_codec(output_format, stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 1) {
+            stream_mapping_.push_back(output_index++);
+        } else {
+            stream_mapping_.push_back(-1);
+            stream->discard = AVDISCARD_ALL;
+        }
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> StreamCopySplitter::_switch_output(const int32_t scene_number, const double cut_seconds,
+                                                   const double next_cut_seconds, const int64_t cut_pts) {
+    WithError<void> flush_err = _flush_pending(cut_seconds);
+    if (flush_err.has_error())
+        return flush_err;
+
+    WithError<void> close_err = _close_output();
+    if (close_err.has_error())
+        return close_err;
+
+    WithError<void> open_err = _open_output(scene_number, cut_pts);
+    if (open_err.has_error())
+        return open_err;
+
+    return _flush_pending(next_cut_seconds);
+}
+
+WithError<void> StreamCopySplitter::_open_output(const int32_t scene_number, const int64_t cut_pts) {
+    const std::string output_path = _get_output_path(scene_number);
+    if (avformat_alloc_output_context2(&output_ctx_, nullptr, nullptr, output_path.c_str()) < 0) {
+        const std::string error_msg = "Failed to create the output: " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    /* B-frames before the keyframe's pts would get negative timestamps; shift all streams alike */
+    output_ctx_->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+
+    for (uint32_t i = 0; i < input_ctx_->nb_streams; i++) {
+        if (stream_mapping_[i] < 0)
+            continue;
+        const AVStream* input_stream = input_ctx_->streams[i];
+        AVStream* output_stream = avformat_new_stream(output_ctx_, nullptr);
+        if (!output_stream || avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar) < 0) {
+            const std::string error_msg = "Failed to copy the stream parameters to " + output_path;
+            return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+        output_stream->codecpar->codec_tag = 0;
+        output_stream->time_base = input_stream->time_base;
+    }
+
+    if (!(output_ctx_->oformat->flags & AVFMT_NOFILE) && avio_open(&output_ctx_->pb, output_path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        const std::string error_msg = "Failed to open the output file: " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_write_header(output_ctx_, nullptr) < 0) {
+        const std::string error_msg = "Failed to write the header of " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    cut_time_us_ = av_rescale_q(cut_pts, input_ctx_->streams[video_index_]->time_base, MICROSECONDS);
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> StreamCopySplitter::_close_output() {
+    if (!output_ctx_)
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    const int32_t ret = av_write_trailer(output_ctx_);
+    if (!(output_ctx_->oformat->flags & AVFMT_NOFILE))
+        avio_closep(&output_ctx_->pb);
+    avformat_free_context(output_ctx_);
+    output_ctx_ = nullptr;
+
+    if (ret < 0)
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, "Failed to finalize a split video.") };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> StreamCopySplitter::_write_packet(AVPacket* packet) {
+    const AVRational input_time_base = input_ctx_->streams[packet->stream_index]->time_base;
+    const int64_t offset = av_rescale_q(cut_time_us_, MICROSECONDS, input_time_base);
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->pts -= offset;
+    if (packet->dts != AV_NOPTS_VALUE)
+        packet->dts -= offset;
+
+    packet->stream_index = stream_mapping_[packet->stream_index];
+    av_packet_rescale_ts(packet, input_time_base, output_ctx_->streams[packet->stream_index]->time_base);
+    packet->pos = -1;
+
+    if (av_interleaved_write_frame(output_ctx_, packet) < 0)
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, "Failed to write a packet to a split video.") };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> StreamCopySplitter::_flush_pending(const double cut_seconds) {
+    /* packets before the cut go to the current output; the rest are kept for the next one */
+    std::vector<AVPacket*> remaining;
+    std::optional<Error> error = std::nullopt;
+    for (AVPacket* packet : pending_packets_) {
+        if (_get_seconds(packet) >= cut_seconds) {
+            remaining.push_back(packet);
+            continue;
+        }
+        if (output_ctx_ && !error.has_value()) {
+            WithError<void> err = _write_packet(packet);
+            if (err.has_error())
+                error.emplace(err.error);
+        }
+        av_packet_free(&packet);
+    }
+    pending_packets_ = remaining;
+
+    if (error.has_value())
+        return WithError<void> { error.value() };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+double StreamCopySplitter::_get_seconds(const AVPacket* packet) const {
+    const int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+    if (timestamp == AV_NOPTS_VALUE)
+        return video_start_seconds_;
+    return timestamp * av_q2d(input_ctx_->streams[packet->stream_index]->time_base);
+}
+
+std::string StreamCopySplitter::_get_output_path(const int32_t scene_number) const {
+    std::string filename = output_filename_;
+    const std::string pattern = "@SCENE_NUMBER";
+    for (size_t pos = filename.find(pattern); pos != std::string::npos; pos = filename.find(pattern, pos))
+        filename.replace(pos, pattern.size(), std::to_string(scene_number));
+    return output_dir_.string() + "/" + filename + ".mp4";
+}
@@ -0,0 +1,54 @@
+#ifndef STREAM_COPY_SPLITTER_H
+#define STREAM_COPY_SPLITTER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+
+template <typename T> struct WithError;
+struct AVFormatContext;
+struct AVPacket;
+
+/*
+   Splits a video without re-encoding (--copy). The input is demuxed once and packets are routed into
+   one muxer per scene. A stream can only start at a keyframe, so each cut is moved to the first keyframe
+   at or after the detected one; scenes without a keyframe of their own stay in the previous file.
+*/
+class StreamCopySplitter {
+    public:
+        explicit StreamCopySplitter(const std::filesystem::path& output_dir, const std::string& output_filename);
+        StreamCopySplitter(const StreamCopySplitter&) = delete;
+        StreamCopySplitter& operator=(const StreamCopySplitter&) = delete;
+        ~StreamCopySplitter();
+
+        /* returns the scenes actually written, with their keyframe-aligned boundaries */
+        WithError<std::vector<FrameTimeCodePair>> split_video(const std::filesystem::path& input_path,
+                                                              const std::vector<FrameTimeCodePair>& scene_list);
+
+    private:
+        WithError<void> _open_input(const std::filesystem::path& input_path);
+        WithError<void> _switch_output(const int32_t scene_number, const double cut_seconds,
+                                       const double next_cut_seconds, const int64_t cut_pts);
+        WithError<void> _open_output(const int32_t scene_number, const int64_t cut_pts);
+        WithError<void> _close_output();
+        WithError<void> _write_packet(AVPacket* packet);
+        WithError<void> _flush_pending(const double cut_seconds);
+        double _get_seconds(const AVPacket* packet) const;
+        std::string _get_output_path(const int32_t scene_number) const;
+
+        const std::filesystem::path output_dir_;
+        const std::string output_filename_;
+
+        AVFormatContext* input_ctx_ = nullptr;
+        AVFormatContext* output_ctx_ = nullptr;
+        int32_t video_index_ = -1;
+        double video_start_seconds_ = 0.0;
+        int64_t cut_time_us_ = 0; /* start of the current output, in microseconds on the input clock */
+        std::vector<int32_t> stream_mapping_; /* input stream index -> output stream index, -1 if dropped */
+        std::vector<AVPacket*> pending_packets_; /* non-video packets waiting for the next cut */
+};
+
+#endif
@@ -0,0 +1,447 @@
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/error.hpp"
+#include "transcode_splitter.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <iostream>
+
+constexpr size_t MAX_QUEUED_FRAMES_PER_ENCODER = 16; /* bounds the decoded frames in flight */
+constexpr size_t MAX_RUNNING_ENCODERS = 2; /* the previous scene flushes while the next one starts */
+constexpr size_t MAX_PENDING_AUDIO_PACKETS = 4096; /* audio waiting for the first frame of its scene */
+constexpr AVRational MICROSECONDS = { 1, AV_TIME_BASE };
+
+SceneEncoder::~SceneEncoder() {
+    if (thread_.joinable()) {
+        frame_queue_.push(nullptr);
+        thread_.join();
+    }
+    avcodec_free_context(&encoder_ctx_);
+    sws_freeContext(sws_ctx_);
+    if (output_ctx_) {
+        if (!(output_ctx_->oformat->flags & AVFMT_NOFILE))
+            avio_closep(&output_ctx_->pb);
+        avformat_free_context(output_ctx_);
+    }
+}
+
+WithError<void> SceneEncoder::open(const std::string& output_path, const AVFormatContext* input_ctx, const AVCodecContext* decoder_ctx,
+                                   const std::vector<int32_t>& stream_mapping, const int64_t start_time_us,
+                                   const int32_t crf, const std::string& preset, const int32_t num_threads) {
+    start_time_us_ = start_time_us;
+    stream_mapping_ = stream_mapping;
+
+    if (avformat_alloc_output_context2(&output_ctx_, nullptr, nullptr, output_path.c_str()) < 0) {
+        const std::string error_msg = "Failed to create the output: " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    output_ctx_->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_NON_NEGATIVE;
+
+    const AVCodec* encoder = avcodec_find_encoder_by_name("libx264");
+    if (!encoder) {
+        const std::string error_msg = "libx264 is not available in libavcodec.";
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    for (uint32_t i = 0; i < input_ctx->nb_streams; i++) {
+        if (stream_mapping_[i] < 0)
+            continue;
+
+        const AVStream* input_stream = input_ctx->streams[i];
+        AVStream* output_stream = avformat_new_stream(output_ctx_, nullptr);
+        if (!output_stream) {
+            const std::string error_msg = "Failed to add a stream to " + output_path;
+            return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+        }
+
+        if (input_stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+            avcodec_parameters_copy(output_stream->codecpar, input_stream->codecpar);
+            output_stream->codecpar->codec_tag = 0;
+            output_stream->time_base = input_stream->time_base;
+            continue;
+        }
+
+        video_index_ = output_stream->index;
+        encoder_ctx_ = avcodec_alloc_context3(encoder);
+        encoder_ctx_->width = decoder_ctx->width;
+        encoder_ctx_->height = decoder_ctx->height;
+        encoder_ctx_->pix_fmt = encoder->pix_fmts ? avcodec_find_best_pix_fmt_of_list(encoder->pix_fmts, decoder_ctx->pix_fmt, 0, nullptr)
+                                                  : decoder_ctx->pix_fmt;
+        if (encoder_ctx_->pix_fmt != decoder_ctx->pix_fmt) {
+            /* e.g., 10-bit video with an 8-bit build of libx264 */
+            sws_ctx_ = sws_getContext(decoder_ctx->width, decoder_ctx->height, decoder_ctx->pix_fmt,
+                                      decoder_ctx->width, decoder_ctx->height, encoder_ctx_->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr);
+            if (!sws_ctx_) {
+                const std::string error_msg = std::string("Failed to convert ") + av_get_pix_fmt_name(decoder_ctx->pix_fmt)
+                                              + " frames for libx264: " + output_path;
+                return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+            }
+        }
+        encoder_ctx_->sample_aspect_ratio = decoder_ctx->sample_aspect_ratio;
+        encoder_ctx_->time_base = input_stream->time_base;
+        encoder_ctx_->framerate = input_stream->avg_frame_rate;
+        encoder_ctx_->thread_count = num_threads;
+        av_opt_set(encoder_ctx_->priv_data, "preset", preset.c_str(), 0);
+        av_opt_set(encoder_ctx_->priv_data, "crf", std::to_string(crf).c_str(), 0);
+        if (output_ctx_->oformat->flags & AVFMT_GLOBALHEADER)
+            encoder_ctx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+        if (avcodec_open2(encoder_ctx_, encoder, nullptr) < 0) {
+            const std::string error_msg = "Failed to open libx264 for " + output_path;
+            return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+        }
+        avcodec_parameters_from_context(output_stream->codecpar, encoder_ctx_);
+        output_stream->time_base = encoder_ctx_->time_base;
+    }
+
+    if (!(output_ctx_->oformat->flags & AVFMT_NOFILE) && avio_open(&output_ctx_->pb, output_path.c_str(), AVIO_FLAG_WRITE) < 0) {
+        const std::string error_msg = "Failed to open the output file: " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_write_header(output_ctx_, nullptr) < 0) {
+        const std::string error_msg = "Failed to write the header of " + output_path;
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    thread_ = std::thread(&SceneEncoder::_encode_thread, this);
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void SceneEncoder::push_frame(AVFrame* frame) {
+    /* timestamps restart at the scene start, and keyframes are left to the encoder */
+    const int64_t offset = av_rescale_q(start_time_us_, MICROSECONDS, encoder_ctx_->time_base);
+    frame->pts = frame->best_effort_timestamp == AV_NOPTS_VALUE ? AV_NOPTS_VALUE : frame->best_effort_timestamp - offset;
+    frame->pict_type = AV_PICTURE_TYPE_NONE;
+    frame_queue_.push(frame);
+}
+
+void SceneEncoder::write_packet(AVPacket* packet, const AVRational& input_time_base) {
+    const int64_t offset = av_rescale_q(start_time_us_, MICROSECONDS, input_time_base);
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->pts -= offset;
+    if (packet->dts != AV_NOPTS_VALUE)
+        packet->dts -= offset;
+
+    packet->stream_index = stream_mapping_[packet->stream_index];
+    av_packet_rescale_ts(packet, input_time_base, output_ctx_->streams[packet->stream_index]->time_base);
+    packet->pos = -1;
+
+    std::lock_guard<std::mutex> lock(mux_mutex_);
+    if (av_interleaved_write_frame(output_ctx_, packet) < 0 && !error_msg_.has_value())
+        error_msg_ = "Failed to write an audio packet to a split video.";
+}
+
+WithError<void> SceneEncoder::finish() {
+    if (!thread_.joinable()) /* open() failed and has already reported why */
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, "A split video was not opened.") };
+
+    frame_queue_.push(nullptr);
+    thread_.join();
+
+    std::lock_guard<std::mutex> lock(mux_mutex_);
+    if (av_write_trailer(output_ctx_) < 0 && !error_msg_.has_value())
+        error_msg_ = "Failed to finalize a split video.";
+
+    if (error_msg_.has_value())
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg_.value()) };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+void SceneEncoder::_encode_thread() {
+    AVPacket* packet = av_packet_alloc();
+    while (true) {
+        AVFrame* frame = frame_queue_.get();
+        const bool is_flush = frame == nullptr;
+        if (!is_flush && sws_ctx_ && !_convert_frame(frame)) {
+            av_frame_free(&frame);
+            continue;
+        }
+        if (avcodec_send_frame(encoder_ctx_, frame) < 0)
+            _set_error("Failed to encode a frame with libx264.");
+        av_frame_free(&frame);
+        _write_encoded_packets(packet);
+        if (is_flush)
+            break;
+    }
+    av_packet_free(&packet);
+}
+
+bool SceneEncoder::_convert_frame(AVFrame*& frame) {
+    AVFrame* converted = av_frame_alloc();
+    converted->format = encoder_ctx_->pix_fmt;
+    converted->width = encoder_ctx_->width;
+    converted->height = encoder_ctx_->height;
+    if (sws_scale_frame(sws_ctx_, converted, frame) < 0) {
+        av_frame_free(&converted);
+        _set_error("Failed to convert a frame for libx264.");
+        return false;
+    }
+    av_frame_copy_props(converted, frame);
+    av_frame_free(&frame);
+    frame = converted;
+    return true;
+}
+
+void SceneEncoder::_write_encoded_packets(AVPacket* packet) {
+    while (avcodec_receive_packet(encoder_ctx_, packet) == 0) {
+        packet->stream_index = video_index_;
+        av_packet_rescale_ts(packet, encoder_ctx_->time_base, output_ctx_->streams[video_index_]->time_base);
+
+        std::lock_guard<std::mutex> lock(mux_mutex_);
+        if (av_interleaved_write_frame(output_ctx_, packet) < 0 && !error_msg_.has_value())
+            error_msg_ = "Failed to write a video packet to a split video.";
+    }
+}
+
+void SceneEncoder::_set_error(const std::string& error_msg) {
+    std::lock_guard<std::mutex> lock(mux_mutex_);
+    if (!error_msg_.has_value())
+        error_msg_ = error_msg;
+}
+
+TranscodeSplitter::TranscodeSplitter(const std::filesystem::path& output_dir, const std::string& output_filename,
+                                     const int32_t crf, const std::string& preset)
+    : output_dir_{output_dir}, output_filename_{output_filename}, crf_{crf}, preset_{preset} {}
+
+TranscodeSplitter::~TranscodeSplitter() {
+    encoders_.clear();
+    for (auto& [scene_ind, packet] : pending_audio_)
+        av_packet_free(&packet);
+    av_frame_free(&frame_);
+    avcodec_free_context(&decoder_ctx_);
+    avformat_close_input(&input_ctx_);
+}
+
+WithError<void> TranscodeSplitter::split_video(const std::filesystem::path& input_path,
+                                               const std::vector<FrameTimeCodePair>& scene_list) {
+    if (scene_list.empty())
+        return WithError<void> { Error(ErrorCode::Success, "") };
+
+    framerate_ = std::get<0>(scene_list[0]).get_framerate();
+    WithError<void> open_err = _open_input(input_path);
+    if (open_err.has_error())
+        return open_err;
+
+    const int32_t start_frame = std::get<0>(scene_list[0]).get_frame_num();
+    const int32_t end_frame = std::get<1>(scene_list.back()).get_frame_num();
+    const AVStream* video_stream = input_ctx_->streams[video_index_];
+    if (start_frame > 0) {
+        const int64_t seek_us = static_cast<int64_t>(std::llround((video_start_seconds_ + start_frame / framerate_) * AV_TIME_BASE));
+        av_seek_frame(input_ctx_, video_index_, av_rescale_q(seek_us, MICROSECONDS, video_stream->time_base), AVSEEK_FLAG_BACKWARD);
+    }
+
+    std::optional<Error> error = std::nullopt;
+    bool is_end = false;
+    AVPacket* packet = av_packet_alloc();
+    while (!is_end && !error.has_value() && av_read_frame(input_ctx_, packet) >= 0) {
+        const int32_t stream_index = packet->stream_index;
+        if (stream_index == video_index_) {
+            const bool sent = avcodec_send_packet(decoder_ctx_, packet) >= 0;
+            av_packet_unref(packet);
+            WithError<void> err = _dispatch_frames(scene_list, is_end);
+            if (!sent && !err.has_error())
+                std::cout << "Warning: a video packet could not be decoded and is skipped." << std::endl;
+            if (err.has_error())
+                error.emplace(err.error);
+        } else if (stream_mapping_[stream_index] >= 0) {
+            /* audio goes to the scene it is played in; packets of already finished scenes are dropped */
+            const int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            const int32_t frame_num = _get_frame_num(timestamp, stream_index);
+            if (frame_num >= start_frame && frame_num < end_frame)
+                _dispatch_audio(packet, _get_scene_ind(frame_num, scene_list));
+            av_packet_unref(packet);
+        } else {
+            av_packet_unref(packet);
+        }
+    }
+    av_packet_free(&packet);
+
+    if (!is_end && !error.has_value()) {
+        avcodec_send_packet(decoder_ctx_, nullptr);
+        WithError<void> err = _dispatch_frames(scene_list, is_end);
+        if (err.has_error())
+            error.emplace(err.error);
+    }
+
+    while (!encoders_.empty()) {
+        WithError<void> err = _finish_oldest_encoder();
+        if (err.has_error() && !error.has_value())
+            error.emplace(err.error);
+    }
+
+    if (error.has_value())
+        return WithError<void> { error.value() };
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> TranscodeSplitter::_open_input(const std::filesystem::path& input_path) {
+    if (avformat_open_input(&input_ctx_, input_path.c_str(), nullptr, nullptr) < 0) {
+        const std::string error_msg = "Failed to open the video: " + input_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    if (avformat_find_stream_info(input_ctx_, nullptr) < 0) {
+        const std::string error_msg = "Failed to read stream information: " + input_path.string();
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+
+    const AVCodec* decoder = nullptr;
+    video_index_ = av_find_best_stream(input_ctx_, AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (video_index_ < 0 || decoder == nullptr) {
+        const std::string error_msg = "No decodable video stream in " + input_path.string();
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+
+    const AVStream* video_stream = input_ctx_->streams[video_index_];
+    decoder_ctx_ = avcodec_alloc_context3(decoder);
+    avcodec_parameters_to_context(decoder_ctx_, video_stream->codecpar);
+    decoder_ctx_->thread_count = 0; /* auto */
+    if (avcodec_open2(decoder_ctx_, decoder, nullptr) < 0) {
+        const std::string error_msg = "Failed to open the decoder for " + input_path.string();
+        return WithError<void> { Error(ErrorCode::NotSupportedCodec, error_msg) };
+    }
+    frame_ = av_frame_alloc();
+
+    const int64_t video_start_time = video_stream->start_time == AV_NOPTS_VALUE ? 0 : video_stream->start_time;
+    video_start_seconds_ = video_start_time * av_q2d(video_stream->time_base);
+
+    /* the video is re-encoded; audio streams the container supports are copied */
+    const AVOutputFormat* output_format = av_guess_format(nullptr, _get_output_path(0).c_str(), nullptr);
+    int32_t output_index = 0;
+    for (uint32_t i = 0; i < input_ctx_->nb_streams; i++) {
+        AVStream* stream = input_ctx_->streams[i];
+        const bool is_video = static_cast<int32_t>(i) == video_index_;
+        const bool is_audio = stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO
+                              && avformat_query_codec(output_format, stream->codecpar->codec_id, FF_COMPLIANCE_NORMAL) == 1;
+        if (is_video || is_audio) {
+            stream_mapping_.push_back(output_index++);
+        } else {
+            stream_mapping_.push_back(-1);
+            stream->discard = AVDISCARD_ALL;
+        }
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<void> TranscodeSplitter::_dispatch_frames(const std::vector<FrameTimeCodePair>& scene_list, bool& is_end) {
+    const int32_t start_frame = std::get<0>(scene_list[0]).get_frame_num();
+    const int32_t end_frame = std::get<1>(scene_list.back()).get_frame_num();
+
+    while (avcodec_receive_frame(decoder_ctx_, frame_) == 0) {
+        const int32_t frame_num = _get_frame_num(frame_->best_effort_timestamp, video_index_);
+        if (frame_num >= end_frame)
+            is_end = true;
+        if (frame_num < start_frame || frame_num >= end_frame) {
+            av_frame_unref(frame_);
+            continue;
+        }
+
+        WithError<SceneEncoder*> encoder = _get_encoder(_get_scene_ind(frame_num, scene_list), scene_list);
+        if (encoder.has_error()) {
+            av_frame_unref(frame_);
+            return WithError<void> { encoder.error };
+        }
+        if (encoder.value() != nullptr)
+            encoder.value()->push_frame(av_frame_clone(frame_)); /* shares the decoded buffers, no copy */
+        av_frame_unref(frame_);
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
+}
+
+WithError<SceneEncoder*> TranscodeSplitter::_get_encoder(const int32_t scene_ind, const std::vector<FrameTimeCodePair>& scene_list) {
+    if (scene_ind < first_running_scene_)
+        return WithError<SceneEncoder*> { nullptr, Error(ErrorCode::Success, "") };
+
+    /* Frames are decoded in scene order, so only the newest encoder is fed and each one gets every core
+       as x264 threads. The oldest is finished first when too many are running. */
+    while (first_running_scene_ + static_cast<int32_t>(encoders_.size()) <= scene_ind) {
+        if (encoders_.size() >= MAX_RUNNING_ENCODERS) {
+            WithError<void> err = _finish_oldest_encoder();
+            if (err.has_error())
+                return WithError<SceneEncoder*> { std::nullopt, err.error };
+        }
+
+        const int32_t scene_number = first_running_scene_ + static_cast<int32_t>(encoders_.size());
+        const int32_t scene_start = std::get<0>(scene_list[scene_number]).get_frame_num();
+        const int64_t start_time_us = static_cast<int64_t>(std::llround((video_start_seconds_ + scene_start / framerate_) * AV_TIME_BASE));
+        const int32_t num_threads = std::max(1, static_cast<int32_t>(std::thread::hardware_concurrency()));
+
+        encoders_.push_back(std::make_unique<SceneEncoder>(MAX_QUEUED_FRAMES_PER_ENCODER));
+        WithError<void> err = encoders_.back()->open(_get_output_path(scene_number), input_ctx_, decoder_ctx_, stream_mapping_,
+                                                     start_time_us, crf_, preset_, num_threads);
+        if (err.has_error())
+            return WithError<SceneEncoder*> { std::nullopt, err.error };
+        _write_pending_audio(scene_number, encoders_.back().get());
+    }
+    return WithError<SceneEncoder*> { encoders_[scene_ind - first_running_scene_].get(), Error(ErrorCode::Success, "") };
+}
+
+void TranscodeSplitter::_dispatch_audio(AVPacket* packet, const int32_t scene_ind) {
+    /* Encoders are started and finished by video frames only. Audio is demuxed slightly ahead of the video
+       it plays with, so packets of a scene whose encoder has not started yet wait for it. */
+    const int32_t num_running = static_cast<int32_t>(encoders_.size());
+    if (scene_ind < first_running_scene_)
+        return;
+    if (scene_ind < first_running_scene_ + num_running) {
+        encoders_[scene_ind - first_running_scene_]->write_packet(packet, input_ctx_->streams[packet->stream_index]->time_base);
+        return;
+    }
+    if (pending_audio_.size() >= MAX_PENDING_AUDIO_PACKETS) {
+        if (!is_audio_dropped_)
+            std::cout << "Warning: audio is too far ahead of the video, some of it is dropped from the split videos." << std::endl;
+        is_audio_dropped_ = true;
+        return;
+    }
+    pending_audio_.emplace_back(scene_ind, av_packet_clone(packet));
+}
+
+void TranscodeSplitter::_write_pending_audio(const int32_t scene_ind, SceneEncoder* encoder) {
+    for (auto it = pending_audio_.begin(); it != pending_audio_.end();) {
+        if (it->first != scene_ind) {
+            ++it;
+            continue;
+        }
+        encoder->write_packet(it->second, input_ctx_->streams[it->second->stream_index]->time_base);
+        av_packet_free(&it->second);
+        it = pending_audio_.erase(it);
+    }
+}
+
+WithError<void> TranscodeSplitter::_finish_oldest_encoder() {
+    std::unique_ptr<SceneEncoder> encoder = std::move(encoders_.front());
+    encoders_.erase(encoders_.begin());
+    first_running_scene_++;
+    return encoder->finish();
+}
+
+int32_t TranscodeSplitter::_get_frame_num(const int64_t timestamp, const int32_t stream_index) const {
+    if (timestamp == AV_NOPTS_VALUE)
+        return 0;
+    const double seconds = timestamp * av_q2d(input_ctx_->streams[stream_index]->time_base) - video_start_seconds_;
+    return static_cast<int32_t>(std::lround(seconds * framerate_));
+}
+
+int32_t TranscodeSplitter::_get_scene_ind(const int32_t frame_num, const std::vector<FrameTimeCodePair>& scene_list) const {
+    auto it = std::upper_bound(scene_list.begin(), scene_list.end(), frame_num, [](const int32_t frame, const FrameTimeCodePair& scene) {
+        return frame < std::get<0>(scene).get_frame_num();
+    });
+    return std::max(0, static_cast<int32_t>(std::distance(scene_list.begin(), it)) - 1);
+}
+
+std::string TranscodeSplitter::_get_output_path(const int32_t scene_number) const {
+    std::string filename = output_filename_;
+    const std::string pattern = "@SCENE_NUMBER";
+    for (size_t pos = filename.find(pattern); pos != std::string::npos; pos = filename.find(pattern, pos))
+        filename.replace(pos, pattern.size(), std::to_string(scene_number));
+    return output_dir_.string() + "/" + filename + ".mp4";
+}
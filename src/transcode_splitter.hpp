@@ -0,0 +1,107 @@
+#ifndef TRANSCODE_SPLITTER_H
+#define TRANSCODE_SPLITTER_H
+
+#include "shutoh/frame_timecode_pair.hpp"
+#include "blocking_queue.hpp"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <optional>
+#include <cstdint>
+
+template <typename T> struct WithError;
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+struct AVRational;
+struct SwsContext;
+
+/*
+   One output file. Decoded frames are encoded with libx264 on its own thread, converted first if libx264 does not
+   support their pixel format, and copied audio is muxed alongside.
+*/
+class SceneEncoder {
+    public:
+        explicit SceneEncoder(const size_t max_queued_frames) : frame_queue_{max_queued_frames} {}
+        SceneEncoder(const SceneEncoder&) = delete;
+        SceneEncoder& operator=(const SceneEncoder&) = delete;
+        ~SceneEncoder();
+
+        WithError<void> open(const std::string& output_path, const AVFormatContext* input_ctx, const AVCodecContext* decoder_ctx,
+                             const std::vector<int32_t>& stream_mapping, const int64_t start_time_us,
+                             const int32_t crf, const std::string& preset, const int32_t num_threads);
+        void push_frame(AVFrame* frame); /* takes the ownership, blocks while the queue is full */
+        void write_packet(AVPacket* packet, const AVRational& input_time_base);
+        WithError<void> finish();
+
+    private:
+        void _encode_thread();
+        bool _convert_frame(AVFrame*& frame); /* replaces the frame, false on failure */
+        void _write_encoded_packets(AVPacket* packet);
+        void _set_error(const std::string& error_msg);
+
+        AVFormatContext* output_ctx_ = nullptr;
+        AVCodecContext* encoder_ctx_ = nullptr;
+        SwsContext* sws_ctx_ = nullptr; /* nullptr if the decoded format is encoded as is */
+        int64_t start_time_us_ = 0;
+        int32_t video_index_ = -1;
+        std::vector<int32_t> stream_mapping_;
+        BlockingQueue<AVFrame*> frame_queue_; /* nullptr flushes the encoder */
+        std::thread thread_;
+        std::mutex mux_mutex_; /* the encoder thread writes video, the demuxer writes audio */
+        std::optional<std::string> error_msg_ = std::nullopt;
+};
+
+/*
+   Re-encoding split which decodes the video once. Frames are dispatched to the encoder of their scene, which
+   uses every core since the scenes are reached one after another; the previous scene is flushed while the next
+   one starts. Audio packets never start or finish an encoder; those of a scene not started yet are held until
+   its first frame is decoded.
+*/
+class TranscodeSplitter {
+    public:
+        explicit TranscodeSplitter(const std::filesystem::path& output_dir, const std::string& output_filename,
+                                   const int32_t crf, const std::string& preset);
+        TranscodeSplitter(const TranscodeSplitter&) = delete;
+        TranscodeSplitter& operator=(const TranscodeSplitter&) = delete;
+        ~TranscodeSplitter();
+
+        WithError<void> split_video(const std::filesystem::path& input_path, const std::vector<FrameTimeCodePair>& scene_list);
+
+    private:
+        WithError<void> _open_input(const std::filesystem::path& input_path);
+        WithError<SceneEncoder*> _get_encoder(const int32_t scene_ind, const std::vector<FrameTimeCodePair>& scene_list);
+        WithError<void> _finish_oldest_encoder();
+        void _dispatch_audio(AVPacket* packet, const int32_t scene_ind);
+        void _write_pending_audio(const int32_t scene_ind, SceneEncoder* encoder);
+        WithError<void> _dispatch_frames(const std::vector<FrameTimeCodePair>& scene_list, bool& is_end);
+        int32_t _get_frame_num(const int64_t timestamp, const int32_t stream_index) const;
+        int32_t _get_scene_ind(const int32_t frame_num, const std::vector<FrameTimeCodePair>& scene_list) const;
+        std::string _get_output_path(const int32_t scene_number) const;
+
+        const std::filesystem::path output_dir_;
+        const std::string output_filename_;
+        const int32_t crf_;
+        const std::string preset_;
+
+        AVFormatContext* input_ctx_ = nullptr;
+        AVCodecContext* decoder_ctx_ = nullptr;
+        AVFrame* frame_ = nullptr;
+        int32_t video_index_ = -1;
+        float framerate_ = 0.0f;
+        double video_start_seconds_ = 0.0;
+        std::vector<int32_t> stream_mapping_; /* input stream index -> output stream index, -1 if dropped */
+        std::vector<std::unique_ptr<SceneEncoder>> encoders_; /* running encoders, oldest first */
+        int32_t first_running_scene_ = 0;
+        std::deque<std::pair<int32_t, AVPacket*>> pending_audio_; /* scene index and packet, in demuxing order */
+        bool is_audio_dropped_ = false;
+};
+
+#endif
@@ -1,68 +1,257 @@
 #include "shutoh/frame_timecode.hpp"
 #include "shutoh/error.hpp"
 #include "video_splitter.hpp"
+#include "keyframe_index.hpp"
+#include "process_scheduler.hpp"
 
-#include <future>
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
 #include <iostream>
 #include <fmt/core.h>
 #include <regex>
 
+constexpr float MIN_CHUNK_SECONDS = 30.0f; /* shorter chunks spend more on encoder warm-up and joining than they save */
+constexpr float SEEK_MARGIN_FRAMES = 0.5f; /* -ss between two frames, so that rounding never selects the neighbour */
+constexpr float OUTPUT_DURATION_TOLERANCE_SECONDS = 0.5f;
+
+static std::optional<int64_t> get_frame_pixels(const std::string& input_path) {
+    AVFormatContext* format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, input_path.c_str(), nullptr, nullptr) < 0)
+        return std::nullopt;
+
+    std::optional<int64_t> frame_pixels = std::nullopt;
+    if (avformat_find_stream_info(format_ctx, nullptr) >= 0) {
+        const int32_t stream_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+        if (stream_index >= 0) {
+            const AVCodecParameters* codecpar = format_ctx->streams[stream_index]->codecpar;
+            frame_pixels = static_cast<int64_t>(codecpar->width) * codecpar->height;
+        }
+    }
+    avformat_close_input(&format_ctx);
+    return frame_pixels;
+}
+
+static std::string escape_concat_path(const std::string& path) {
+    /* the concat demuxer reads '...' quoted paths, with ' written as '\'' */
+    std::string escaped;
+    for (const char c : path)
+        escaped += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    return escaped;
+}
+
 VideoSplitter::VideoSplitter(const std::filesystem::path& output_dir, const std::string& output_filename,
                              const int32_t crf, const std::string& preset, const std::string& ffmpeg_args) 
     : output_dir_{output_dir}, output_filename_{output_filename}, crf_{crf}, preset_{preset}, ffmpeg_args_{ffmpeg_args} {};
 
-void VideoSplitter::split_video(const std::filesystem::path& input_path,
-                                const std::vector<FrameTimeCodePair>& scene_list) const {
-    const std::vector<std::string> commands = _get_ffmpeg_split_commands(input_path, scene_list);
-    _run_ffmpeg_parallel(commands);
+WithError<void> VideoSplitter::split_video(const std::filesystem::path& input_path,
+                                           const std::vector<FrameTimeCodePair>& scene_list) const {
+    std::vector<std::vector<std::string>> concat_args(scene_list.size());
+    std::vector<bool> is_scene_failed(scene_list.size(), false);
+    const std::vector<SplitJob> jobs = _get_split_jobs(input_path, scene_list, concat_args, is_scene_failed);
+    const int64_t frame_pixels = get_frame_pixels(input_path.string()).value_or(1);
+    _run_ffmpeg_parallel(jobs, concat_args, scene_list, frame_pixels, is_scene_failed);
+
+    std::string failed_scenes;
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        if (is_scene_failed[scene_number])
+            failed_scenes += (failed_scenes.empty() ? "" : ", ") + std::to_string(scene_number);
+    }
+    if (!failed_scenes.empty()) {
+        const std::string error_msg = "Failed to split scene(s) " + failed_scenes + " with ffmpeg.";
+        return WithError<void> { Error(ErrorCode::FailedToOpenFile, error_msg) };
+    }
+    return WithError<void> { Error(ErrorCode::Success, "") };
 }
 
-std::vector<std::string> VideoSplitter::_get_ffmpeg_split_commands(const std::filesystem::path& input_path,
-                                                                   const std::vector<FrameTimeCodePair>& scene_list) const {
-    const std::string output_dir_str = output_dir_.string();
+std::vector<SplitJob> VideoSplitter::_get_split_jobs(const std::filesystem::path& input_path,
+                                                     const std::vector<FrameTimeCodePair>& scene_list,
+                                                     std::vector<std::vector<std::string>>& concat_args,
+                                                     std::vector<bool>& is_scene_failed) const {
     const std::string input_path_str = input_path.string();
-    const std::regex pattern("@SCENE_NUMBER");
+    std::vector<SplitJob> jobs;
+    if (scene_list.empty())
+        return jobs;
+
+    /* Scenes much longer than an even share of the work are encoded as chunks in parallel, unless the user's
+       ffmpeg arguments are given: they may filter or re-encode in ways the chunks could not be joined after. */
+    const float framerate = std::get<0>(scene_list[0]).get_framerate();
+    int32_t total_frames = 0;
+    for (const FrameTimeCodePair& scene : scene_list)
+        total_frames += std::get<1>(scene).get_frame_num() - std::get<0>(scene).get_frame_num();
+    const int32_t max_concurrent_tasks = static_cast<int32_t>(ProcessScheduler::get_available_cpus());
+    const int32_t chunk_frames = std::max(total_frames / max_concurrent_tasks, static_cast<int32_t>(MIN_CHUNK_SECONDS * framerate));
 
-    std::vector<std::string> commands;    
-    
+    std::optional<KeyframeIndex> keyframe_index = std::nullopt;
     for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
-        
-        const std::string output_filename = std::regex_replace(output_filename_, pattern, std::to_string(scene_number));
-        
         const FrameTimeCode& start_time = std::get<0>(scene_list[scene_number]);
         const FrameTimeCode& end_time = std::get<1>(scene_list[scene_number]);
+        const int32_t start = start_time.get_frame_num();
+        const int32_t end = end_time.get_frame_num();
+        const std::string output_path = _get_output_path(scene_number, ".mp4");
+
+        if (end - start <= 2 * chunk_frames || !ffmpeg_args_.empty()) {
+            const std::string& start_time_str = start_time.to_string_second();
+            const std::string& duration_str = (end_time - start_time).to_string_second();
+            std::vector<std::string> args = { "ffmpeg", "-nostdin", "-y", "-ss", start_time_str, "-i", input_path_str, "-t", duration_str,
+                                              "-v", "quiet", "-c:v", "libx264", "-preset", preset_, "-crf", std::to_string(crf_) };
+            for (const std::string& arg : split_args(ffmpeg_args_))
+                args.push_back(arg);
+            args.push_back(output_path);
+            jobs.push_back(SplitJob { args, output_path, end - start, static_cast<int32_t>(scene_number), false });
+            continue;
+        }
+
+        if (!keyframe_index.has_value()) {
+            WithError<KeyframeIndex> opt_keyframe_index = KeyframeIndex::build(input_path_str, framerate);
+            if (!opt_keyframe_index.has_error())
+                keyframe_index.emplace(opt_keyframe_index.value());
+        }
+
+        /* Every chunk starts with its own IDR frame, so the chunks join without re-encoding.
+           Headers are repeated in-band because only the first chunk's reach the mp4 header. */
+        const std::vector<int32_t> chunk_starts = _get_chunk_starts(start, end, chunk_frames, keyframe_index);
+        const std::string concat_path = _get_output_path(scene_number, "_chunks.txt");
+        std::ofstream concat_file(concat_path);
+        if (!concat_file) {
+            std::cerr << "Error: Failed to write " << concat_path << "." << std::endl;
+            is_scene_failed[scene_number] = true;
+            continue;
+        }
+        for (size_t chunk_i = 0; chunk_i < chunk_starts.size(); chunk_i++) {
+            const int32_t chunk_start = chunk_starts[chunk_i];
+            const int32_t chunk_end = chunk_i + 1 < chunk_starts.size() ? chunk_starts[chunk_i + 1] : end;
+            const std::string chunk_path = _get_output_path(scene_number, fmt::format("_chunk{}.ts", chunk_i));
+            concat_file << "file '" << escape_concat_path(chunk_path) << "'\n";
 
-        const std::string& start_time_str = start_time.to_string_second();
-        const std::string& duration_str = (end_time - start_time).to_string_second();
+            const float seek_seconds = std::max(0.0f, (chunk_start - SEEK_MARGIN_FRAMES) / framerate);
+            const std::vector<std::string> args = { "ffmpeg", "-nostdin", "-y", "-ss", fmt::format("{:.6f}", seek_seconds), "-i", input_path_str,
+                                                    "-map", "0:v:0", "-frames:v", std::to_string(chunk_end - chunk_start), "-v", "quiet",
+                                                    "-c:v", "libx264", "-preset", preset_, "-crf", std::to_string(crf_),
+                                                    "-x264-params", "repeat-headers=1", chunk_path };
+            jobs.push_back(SplitJob { args, chunk_path, chunk_end - chunk_start, static_cast<int32_t>(scene_number), true });
+        }
 
-        const std::string command = fmt::format("ffmpeg -nostdin -y -ss {} -i {} -t {} -v quiet -c:v libx264 -preset {} -crf {} {} {}/{}.mp4",
-                                                start_time_str, input_path_str, duration_str, preset_, crf_,
-                                                ffmpeg_args_, output_dir_str, output_filename);
-        commands.push_back(command);
+        concat_args[scene_number] = { "ffmpeg", "-nostdin", "-y", "-f", "concat", "-safe", "0", "-i", concat_path,
+                                      "-ss", start_time.to_string_second(), "-t", (end_time - start_time).to_string_second(),
+                                      "-i", input_path_str, "-v", "quiet", "-map", "0:v:0", "-map", "1:a?", "-c:v", "copy", "-c:a", "aac",
+                                      output_path };
     }
 
-    return commands;
+    return jobs;
 }
 
-void VideoSplitter::_run_ffmpeg_parallel(const std::vector<std::string>& commands) const {
-    std::vector<std::future<void>> futures;
-    const size_t max_concurrent_tasks = std::thread::hardware_concurrency();
+std::vector<int32_t> VideoSplitter::_get_chunk_starts(const int32_t start, const int32_t end, const int32_t chunk_frames,
+                                                      const std::optional<KeyframeIndex>& keyframe_index) const {
+    /* boundaries are moved to a close keyframe if there is one, so the chunk's seek does not decode a whole GOP */
+    const int32_t num_chunks = std::max(1, (end - start + chunk_frames / 2) / chunk_frames);
+    std::vector<int32_t> chunk_starts = { start };
+    for (int32_t chunk_i = 1; chunk_i < num_chunks; chunk_i++) {
+        const int32_t target = start + static_cast<int32_t>(static_cast<int64_t>(end - start) * chunk_i / num_chunks);
+        int32_t chunk_start = target;
+        if (keyframe_index.has_value()) {
+            const int32_t keyframe = keyframe_index.value().next_keyframe(target);
+            if (keyframe - target < chunk_frames / 4 && keyframe < end)
+                chunk_start = keyframe;
+        }
+        if (chunk_start > chunk_starts.back())
+            chunk_starts.push_back(chunk_start);
+    }
+    return chunk_starts;
+}
 
-    for (size_t i = 0; i < commands.size(); i++) {
-        futures.emplace_back(std::async(std::launch::async, cut_video_with_ffmpeg, commands[i]));
-        if (futures.size() >= max_concurrent_tasks) {
-            futures.front().get();
-            futures.erase(futures.begin());
+void VideoSplitter::_run_ffmpeg_parallel(const std::vector<SplitJob>& jobs, const std::vector<std::vector<std::string>>& concat_args,
+                                         const std::vector<FrameTimeCodePair>& scene_list, const int64_t frame_pixels,
+                                         std::vector<bool>& is_scene_failed) const {
+    /* Outputs left by an interrupted run are kept when they are complete, so only the rest is encoded again. */
+    const float framerate = scene_list.empty() ? 1.0f : std::get<0>(scene_list[0]).get_framerate();
+    std::vector<bool> is_scene_done(scene_list.size());
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        const int32_t num_frames = std::get<1>(scene_list[scene_number]).get_frame_num() - std::get<0>(scene_list[scene_number]).get_frame_num();
+        is_scene_done[scene_number] = _is_valid_output(_get_output_path(scene_number, ".mp4"), num_frames / framerate);
+    }
+
+    auto remove_chunks = [this, &jobs](const int32_t scene_number) {
+        for (const SplitJob& job : jobs) {
+            if (job.is_chunk && job.scene_number == scene_number)
+                std::filesystem::remove(job.output_path);
         }
+        std::filesystem::remove(_get_output_path(scene_number, "_chunks.txt"));
+    };
+
+    /* ids of split jobs are their index in jobs, ids of concat jobs are -1 - scene_number */
+    std::vector<ProcessJob> process_jobs;
+    std::vector<int32_t> remaining_chunks(scene_list.size(), 0);
+    std::vector<bool> is_chunked(scene_list.size(), false);
+    for (size_t job_i = 0; job_i < jobs.size(); job_i++) {
+        const SplitJob& job = jobs[job_i];
+        if (is_scene_done[job.scene_number])
+            continue;
+        if (job.is_chunk) {
+            is_chunked[job.scene_number] = true;
+            if (_is_valid_output(job.output_path, job.num_frames / framerate))
+                continue;
+            remaining_chunks[job.scene_number]++;
+        }
+        const double cost = static_cast<double>(job.num_frames) * frame_pixels;
+        process_jobs.push_back(ProcessJob { job.args, cost, static_cast<int32_t>(job_i) });
     }
-    for (auto& future : futures) {
-        future.get();
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        if (is_scene_done[scene_number] && !concat_args[scene_number].empty())
+            remove_chunks(scene_number);
+        else if (is_chunked[scene_number] && remaining_chunks[scene_number] == 0)
+            process_jobs.push_back(ProcessJob { concat_args[scene_number], 0.0, -1 - static_cast<int32_t>(scene_number) });
     }
+
+    auto on_exit = [&jobs, &concat_args, &remaining_chunks, &remove_chunks, &is_scene_failed](const ProcessJob& process_job,
+                                                                                              const bool success) {
+        std::optional<ProcessJob> next_job = std::nullopt;
+        const int32_t scene_number = process_job.id < 0 ? -1 - process_job.id : jobs[process_job.id].scene_number;
+        if (!success)
+            is_scene_failed[scene_number] = true;
+
+        if (process_job.id < 0) {
+            if (success)
+                remove_chunks(scene_number);
+            return next_job;
+        }
+
+        const SplitJob& job = jobs[process_job.id];
+        if (job.is_chunk && success && --remaining_chunks[scene_number] == 0)
+            next_job.emplace(ProcessJob { concat_args[scene_number], 0.0, -1 - scene_number });
+        return next_job;
+    };
+
+    const ProcessScheduler scheduler = ProcessScheduler(ProcessScheduler::get_available_cpus());
+    scheduler.run(process_jobs, on_exit);
 }
 
-void cut_video_with_ffmpeg(const std::string& command) {
-    const int8_t ret = std::system(command.c_str());
-    if (ret != 0) {
-        std::cerr << "Error: Failed to process a video cut with ffmpeg." << std::endl;
+bool VideoSplitter::_is_valid_output(const std::string& output_path, const float expected_seconds) const {
+    /* a file cut short lacks its index or its tail, which shows up as a missing stream or a short duration */
+    if (!std::filesystem::exists(output_path))
+        return false;
+
+    AVFormatContext* format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, output_path.c_str(), nullptr, nullptr) < 0)
+        return false;
+
+    bool is_valid = false;
+    if (avformat_find_stream_info(format_ctx, nullptr) >= 0 && format_ctx->duration != AV_NOPTS_VALUE
+        && av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0) >= 0) {
+        const double seconds = format_ctx->duration / static_cast<double>(AV_TIME_BASE);
+        is_valid = std::abs(seconds - expected_seconds) <= OUTPUT_DURATION_TOLERANCE_SECONDS;
     }
+    avformat_close_input(&format_ctx);
+    return is_valid;
+}
+
+std::string VideoSplitter::_get_output_path(const int32_t scene_number, const std::string& suffix) const {
+    const std::regex pattern("@SCENE_NUMBER");
+    const std::string output_filename = std::regex_replace(output_filename_, pattern, std::to_string(scene_number));
+    return output_dir_.string() + "/" + output_filename + suffix;
 }
\ No newline at end of file
@@ -6,20 +6,39 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <optional>
 
 template <typename T> struct WithError;
+class KeyframeIndex;
+
+/* An ffmpeg run; chunks of a long scene are joined by the scene's concat job once all are done. */
+struct SplitJob {
+    const std::vector<std::string> args;
+    const std::string output_path;
+    const int32_t num_frames;
+    const int32_t scene_number;
+    const bool is_chunk;
+};
 
 class VideoSplitter {
     public:
         explicit VideoSplitter(const std::filesystem::path& output_dir, const std::string& output_filename, 
                                const int32_t crf, const std::string& preset, const std::string& ffmpeg_args);
-        void split_video(const std::filesystem::path& input_path,
-                         const std::vector<FrameTimeCodePair>& scene_list) const;
+        WithError<void> split_video(const std::filesystem::path& input_path,
+                                    const std::vector<FrameTimeCodePair>& scene_list) const;
 
     private:
-        std::vector<std::string> _get_ffmpeg_split_commands(const std::filesystem::path& input_path,
-                                                            const std::vector<FrameTimeCodePair>& scene_list) const;
-        void _run_ffmpeg_parallel(const std::vector<std::string>& commands) const;
+        std::vector<SplitJob> _get_split_jobs(const std::filesystem::path& input_path,
+                                              const std::vector<FrameTimeCodePair>& scene_list,
+                                              std::vector<std::vector<std::string>>& concat_args,
+                                              std::vector<bool>& is_scene_failed) const;
+        std::vector<int32_t> _get_chunk_starts(const int32_t start, const int32_t end, const int32_t chunk_frames,
+                                               const std::optional<KeyframeIndex>& keyframe_index) const;
+        void _run_ffmpeg_parallel(const std::vector<SplitJob>& jobs, const std::vector<std::vector<std::string>>& concat_args,
+                                  const std::vector<FrameTimeCodePair>& scene_list, const int64_t frame_pixels,
+                                  std::vector<bool>& is_scene_failed) const;
+        bool _is_valid_output(const std::string& output_path, const float expected_seconds) const;
+        std::string _get_output_path(const int32_t scene_number, const std::string& suffix) const;
 
         const std::filesystem::path output_dir_;
         const std::string output_filename_;
@@ -28,6 +47,4 @@ class VideoSplitter {
         const std::string ffmpeg_args_;
 };
 
-void cut_video_with_ffmpeg(const std::string& command);
-
 #endif
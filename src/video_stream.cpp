@@ -42,7 +42,8 @@ WithError<void> VideoStream::set_time(const std::optional<std::string>& start, c
         start_ = start_err.value();
     }
 
-    const int32_t frame_num = static_cast<int32_t>(cap_.get(cv::CAP_PROP_POS_FRAMES));
+    /* the frame count, as the position is anywhere once the stream has been read */
+    const int32_t frame_num = static_cast<int32_t>(cap_.get(cv::CAP_PROP_FRAME_COUNT));
     const FrameTimeCode video_end = FrameTimeCode::from_frame_nums(frame_num, framerate_).value();
 
     if (end.has_value()) {
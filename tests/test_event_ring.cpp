@@ -0,0 +1,116 @@
+#include "shutoh/video_stream.hpp"
+#include "shutoh/scene_manager.hpp"
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/event_ring.hpp"
+#include "shutoh/error.hpp"
+#include "shutoh/detector/content_detector.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+const std::string TEST_EVENT_RING = "/shutoh-test-event-ring";
+
+TEST_CASE("EventRing - lapped consumer", "[EventRing]") {
+    std::shared_ptr<EventRingWriter> writer = EventRingWriter::initialize_event_ring_writer(TEST_EVENT_RING, 8, 29.97f).value();
+    std::shared_ptr<EventRingReader> reader = EventRingReader::initialize_event_ring_reader(TEST_EVENT_RING).value();
+    REQUIRE(reader->get_header().capacity == 8);
+    REQUIRE(!reader->read().has_value());
+
+    for (int32_t frame_num = 0; frame_num < 20; frame_num++)
+        writer->publish_score(frame_num, frame_num == 0 ? std::nullopt : std::optional<float>(frame_num * 0.5f));
+    writer->publish_cut(17, 19);
+
+    /* the oldest events were overwritten before they were read */
+    const RingEvent first = reader->read().value();
+    REQUIRE(reader->get_num_lost() == 13);
+    REQUIRE(first.type == EventType::SCORE);
+    REQUIRE(first.frame_num == 13);
+    REQUIRE(first.score == 6.5f);
+    for (int32_t i = 0; i < 6; i++)
+        reader->read();
+    const RingEvent cut = reader->read().value();
+    REQUIRE(cut.type == EventType::CUT);
+    REQUIRE(cut.frame_num == 17);
+    REQUIRE(cut.decided_frame_num == 19);
+    REQUIRE(!reader->read().has_value());
+
+    writer->close();
+    REQUIRE(reader->read().value().type == EventType::END);
+    REQUIRE(EventRingReader::initialize_event_ring_reader(TEST_EVENT_RING).has_error());
+}
+
+TEST_CASE("EventRing - producer and consumer processes", "[EventRing]") {
+    const std::string input_path = "../../video/input.mp4";
+    int32_t ready_pipe[2];
+    int32_t start_pipe[2];
+    REQUIRE(pipe(ready_pipe) == 0);
+    REQUIRE(pipe(start_pipe) == 0);
+
+    const pid_t pid = fork();
+    REQUIRE(pid >= 0);
+    if (pid == 0) {
+        /* producer: detects while the parent process reads the events */
+        VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+        WithError<std::shared_ptr<EventRingWriter>> opt_writer =
+            EventRingWriter::initialize_event_ring_writer(TEST_EVENT_RING, 1 << 16, video.get_framerate());
+        char signal = opt_writer.has_error() ? 0 : 1;
+        if (write(ready_pipe[1], &signal, 1) != 1 || signal == 0 || read(start_pipe[0], &signal, 1) != 1)
+            _exit(1);
+
+        SceneManager scene_manager = SceneManager(std::make_unique<ContentDetector>());
+        scene_manager.set_event_ring(opt_writer.value());
+        scene_manager.detect_scenes(video);
+        opt_writer.value()->close();
+        _exit(0);
+    }
+
+    char signal = 0;
+    REQUIRE(read(ready_pipe[0], &signal, 1) == 1);
+    REQUIRE(signal == 1);
+    std::shared_ptr<EventRingReader> reader = EventRingReader::initialize_event_ring_reader(TEST_EVENT_RING).value();
+    REQUIRE(write(start_pipe[1], &signal, 1) == 1);
+
+    std::vector<int32_t> cuts;
+    int32_t num_scores = 0;
+    int32_t last_frame_num = -1;
+    bool is_ended = false;
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+    while (!is_ended && std::chrono::steady_clock::now() < deadline) {
+        const std::optional<RingEvent> event = reader->read();
+        if (!event.has_value()) {
+            usleep(100);
+            continue;
+        }
+        if (event.value().type == EventType::SCORE) {
+            REQUIRE((last_frame_num < 0 || event.value().frame_num == last_frame_num + 1));
+            last_frame_num = event.value().frame_num;
+            num_scores++;
+        } else if (event.value().type == EventType::CUT) {
+            REQUIRE(event.value().decided_frame_num >= event.value().frame_num);
+            cuts.push_back(event.value().frame_num);
+        }
+        is_ended = event.value().type == EventType::END;
+    }
+
+    int32_t status = 0;
+    REQUIRE(waitpid(pid, &status, 0) == pid);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(is_ended);
+    REQUIRE(reader->get_num_lost() == 0);
+
+    /* the consumer got the cuts of the same detection in this process */
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_unique<ContentDetector>());
+    scene_manager.detect_scenes(video);
+    const std::vector<FrameTimeCodePair> scene_list = scene_manager.get_scene_list().value();
+    REQUIRE(cuts.size() + 1 == scene_list.size());
+    for (size_t i = 0; i < cuts.size(); i++)
+        REQUIRE(cuts[i] == std::get<1>(scene_list[i]).get_frame_num());
+    REQUIRE(num_scores > 0);
+    REQUIRE(last_frame_num <= std::get<1>(scene_list.back()).get_frame_num());
+}
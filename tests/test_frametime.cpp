@@ -1,6 +1,9 @@
 #include <catch2/catch_test_macros.hpp>
 #include "shutoh/frame_timecode.hpp"
 
+#include <vector>
+#include <string>
+
 // Initialization
 TEST_CASE("FrameTime initialization - FrameTimeCode", "[Frametime init]") {
     FrameTimeCode frametime = FrameTimeCode(0, 0.5);
@@ -69,4 +72,19 @@ TEST_CASE("FrameTime comparison - Add and substract", "[FrameTime comparison]")
             REQUIRE(b - a == FrameTimeCode(0, 1.0));
         }
     }
-}
\ No newline at end of file
+}
+TEST_CASE("FrameTime conversion - to_chars", "[FrameTime conversion]") {
+    const std::vector<float> framerates { 23.976f, 25.0f, 29.97f, 30.0f, 59.94f, 0.5f };
+    for (const float framerate : framerates) {
+        for (int32_t frame_num = 0; frame_num < 400000; frame_num += 7) {
+            const FrameTimeCode timecode = FrameTimeCode(frame_num, framerate);
+            char text[32];
+            const std::to_chars_result result = timecode.to_chars(text, text + sizeof(text));
+            REQUIRE(result.ec == std::errc());
+            REQUIRE(std::string(text, result.ptr) == timecode.to_string());
+        }
+    }
+
+    char short_text[8];
+    REQUIRE(FrameTimeCode(100, 30.0f).to_chars(short_text, short_text + sizeof(short_text)).ec == std::errc::value_too_large);
+}
@@ -0,0 +1,78 @@
+#include "shutoh/hash_index.hpp"
+#include "shutoh/scene_aggregator.hpp"
+#include "shutoh/error.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <random>
+#include <bit>
+
+TEST_CASE("HashIndex - near-duplicate search", "[HashIndex]") {
+    const std::filesystem::path index_path = std::filesystem::temp_directory_path() / "shutoh-test-hashes.idx";
+    for (const std::string suffix : { "", ".log", ".lock" })
+        std::filesystem::remove(index_path.string() + suffix);
+
+    /* more hashes than HASH_INDEX_MAX_APPENDED, so that some are found in the tables and others in the log */
+    std::mt19937_64 random(0);
+    std::vector<std::vector<SceneHash>> videos(200);
+    for (size_t video = 0; video < videos.size(); video++) {
+        for (int32_t scene = 0; scene < 500; scene++)
+            videos[video].push_back(SceneHash { scene, scene * 30, random() });
+        REQUIRE(!add_to_hash_index(index_path, "video" + std::to_string(video), videos[video]).has_error());
+    }
+    REQUIRE(std::filesystem::exists(index_path.string() + ".log"));
+
+    /* a video added again supersedes its scenes in the tables */
+    const uint64_t replaced_hash = videos[3][7].hash;
+    videos[3][7].hash = random();
+    REQUIRE(!add_to_hash_index(index_path, "video3", videos[3]).has_error());
+
+    std::shared_ptr<HashIndex> hash_index = HashIndex::initialize_hash_index(index_path).value();
+    REQUIRE(hash_index->get_num_videos() == 200);
+    size_t num_latest = 0;
+    for (uint32_t entry_id = 0; entry_id < hash_index->get_num_entries(); entry_id++)
+        num_latest += hash_index->is_latest(entry_id);
+    REQUIRE(num_latest == 200 * 500);
+    REQUIRE(hash_index->query(replaced_hash, 0).empty());
+    const std::vector<HashMatch> replacing = hash_index->query(videos[3][7].hash, 0);
+    REQUIRE(replacing.size() == 1);
+    REQUIRE(hash_index->get_video_name(hash_index->get_entry(replacing.front().entry_id).video_id) == "video3");
+
+    /* the same matches as comparing every hash */
+    for (int32_t max_distance : { 0, 3, 8, 13 }) {
+        for (size_t video = 0; video < videos.size(); video += 10) {
+            uint64_t query = videos[video][video * 11 % 500].hash;
+            for (int32_t flip = 0; flip < max_distance; flip++)
+                query ^= uint64_t(1) << (random() % 64);
+
+            size_t num_expected = 0;
+            for (uint32_t entry_id = 0; entry_id < hash_index->get_num_entries(); entry_id++)
+                num_expected += hash_index->is_latest(entry_id) && std::popcount(hash_index->get_entry(entry_id).hash ^ query) <= max_distance;
+
+            const std::vector<HashMatch> matches = hash_index->query(query, max_distance);
+            REQUIRE(matches.size() == num_expected);
+            REQUIRE(matches.size() >= 1);
+            const HashIndexEntry& closest = hash_index->get_entry(matches.front().entry_id);
+            REQUIRE(hash_index->get_video_name(closest.video_id) == "video" + std::to_string(video));
+            REQUIRE(closest.scene_number == static_cast<int32_t>(video * 11 % 500));
+            REQUIRE(closest.keyframe == static_cast<int32_t>(video * 11 % 500 * 30));
+        }
+    }
+    for (const std::string suffix : { "", ".log", ".lock" })
+        std::filesystem::remove(index_path.string() + suffix);
+}
+
+TEST_CASE("HashIndex - perceptual hash of resized frames", "[HashIndex]") {
+    cv::Mat frame(180, 320, CV_8UC1);
+    cv::randu(frame, 0, 255);
+    cv::GaussianBlur(frame, frame, cv::Size(31, 31), 0);
+    cv::Mat resized;
+    cv::resize(frame, resized, cv::Size(160, 90), 0, 0, cv::INTER_AREA);
+    cv::Mat other(180, 320, CV_8UC1);
+    cv::randu(other, 0, 255);
+    cv::GaussianBlur(other, other, cv::Size(31, 31), 0);
+
+    const uint64_t hash = MotionAggregator::compute_phash(frame);
+    REQUIRE(std::popcount(hash ^ MotionAggregator::compute_phash(resized)) <= 8);
+    REQUIRE(std::popcount(hash ^ MotionAggregator::compute_phash(other)) > 8);
+}
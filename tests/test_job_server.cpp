@@ -0,0 +1,51 @@
+#include "shutoh/video_stream.hpp"
+#include "shutoh/scene_manager.hpp"
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/error.hpp"
+#include "shutoh/detector/content_detector.hpp"
+
+#include "../src/job_server.hpp"
+#include "../src/config.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+
+WithError<std::vector<FrameTimeCodePair>> _run_job(const Config& cfg, const ProgressCallback& progress_callback) {
+    WithError<VideoStream> opt_video = VideoStream::initialize_video_stream(cfg.input_path);
+    if (opt_video.has_error())
+        return WithError<std::vector<FrameTimeCodePair>> { std::nullopt, opt_video.error };
+    VideoStream video = opt_video.value();
+    SceneManager scene_manager = SceneManager(std::make_unique<ContentDetector>());
+    scene_manager.set_progress_callback(progress_callback);
+    scene_manager.detect_scenes(video);
+    return scene_manager.get_scene_list();
+}
+
+TEST_CASE("JobServer - stream events of a job", "[JobServer serve]") {
+    const std::filesystem::path socket_path = std::filesystem::temp_directory_path() / "shutoh-test-job-server.sock";
+    JobServer job_server = JobServer(socket_path, std::vector<std::string> { "shutoh" }, 1);
+    std::thread server_thread([&]() { job_server.serve(_run_job); });
+
+    const std::string job = "{\"input\": \"../../video/input.mp4\", \"command\": \"list-scenes\", \"no_output_file\": true}";
+    std::vector<std::string> events;
+    bool is_done = false;
+    /* the server may not be listening yet */
+    for (int32_t attempt = 0; attempt < 50 && !is_done; attempt++) {
+        events.clear();
+        is_done = !JobServer::submit(socket_path, job, [&](const std::string& event) { events.push_back(event); }).has_error();
+        if (!is_done)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    job_server.stop();
+    server_thread.join();
+
+    REQUIRE(is_done);
+    bool has_cut = false;
+    for (const std::string& event : events)
+        has_cut |= event.starts_with("{\"event\": \"cut\"");
+    REQUIRE(has_cut);
+    REQUIRE(events.back().starts_with("{\"event\": \"done\""));
+    REQUIRE(!std::filesystem::exists(socket_path));
+}
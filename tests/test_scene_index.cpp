@@ -0,0 +1,72 @@
+#include "shutoh/scene_index.hpp"
+#include "shutoh/error.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <random>
+#include <map>
+
+TEST_CASE("SceneIndex - append and query", "[SceneIndex]") {
+    const std::filesystem::path index_path = std::filesystem::temp_directory_path() / "shutoh-test-scenes.idx";
+    for (const std::string suffix : { "", ".dir", ".lock" })
+        std::filesystem::remove(index_path.string() + suffix);
+
+    /* more records than SCENE_INDEX_MAX_UNSORTED, so that some are found in the directory and others after it */
+    std::mt19937 random(0);
+    std::map<std::string, std::pair<std::vector<int32_t>, int32_t>> videos;
+    for (int32_t i = 0; i < 3000; i++) {
+        const std::string video_name = "video" + std::to_string(random() % 2000);
+        std::vector<int32_t> cuts;
+        int32_t frame_num = 0;
+        for (uint32_t cut = random() % 40; cut > 0; cut--) {
+            frame_num += 1 + random() % 300;
+            cuts.push_back(frame_num);
+        }
+        const int32_t end_frame = frame_num + 1 + random() % 300;
+        WithError<bool> opt_appended = append_to_scene_index(index_path, video_name, "key" + std::to_string(i), 25.0, 0, end_frame, cuts);
+        REQUIRE(!opt_appended.has_error());
+        REQUIRE(opt_appended.value());
+        videos[video_name] = std::make_pair(cuts, end_frame);
+    }
+    /* the same detection of a video is not appended again */
+    REQUIRE(append_to_scene_index(index_path, "video0", "key", 25.0, 0, 100, { 50 }).value());
+    REQUIRE(!append_to_scene_index(index_path, "video0", "key", 25.0, 0, 100, { 50 }).value());
+    videos["video0"] = std::make_pair(std::vector<int32_t> { 50 }, 100);
+
+    std::shared_ptr<SceneIndex> scene_index = SceneIndex::initialize_scene_index(index_path).value();
+    REQUIRE(scene_index->get_num_records() == 3001);
+    REQUIRE(scene_index->get_num_unsorted() <= SCENE_INDEX_MAX_UNSORTED);
+    REQUIRE(std::filesystem::exists(index_path.string() + ".dir"));
+
+    /* the latest record of each video */
+    for (const auto& [video_name, scenes] : videos) {
+        const std::optional<SceneListRecord> record = scene_index->find(video_name);
+        REQUIRE(record.has_value());
+        REQUIRE(std::vector<int32_t>(record.value().cuts.begin(), record.value().cuts.end()) == scenes.first);
+        REQUIRE(record.value().end_frame == scenes.second);
+    }
+    REQUIRE(!scene_index->find("video").has_value());
+    REQUIRE(!scene_index->find("video99999").has_value());
+
+    const SceneListRecord record = scene_index->find("video0").value();
+    REQUIRE(record.get_cuts(0, 49).empty());
+    REQUIRE(record.get_cuts(50, 50).size() == 1);
+    REQUIRE(record.get_cuts_per_minute() == 15.0);
+
+    for (const double min_cuts_per_minute : { 0.0, 10.0, 30.0 }) {
+        size_t num_expected = 0;
+        for (const auto& [video_name, scenes] : videos)
+            num_expected += scenes.first.size() * 60.0 / (scenes.second / 25.0) >= min_cuts_per_minute;
+
+        const std::vector<SceneListRecord> records = scene_index->find_by_cut_rate(min_cuts_per_minute);
+        REQUIRE(records.size() == num_expected);
+        for (size_t i = 0; i < records.size(); i++) {
+            REQUIRE(records[i].get_cuts_per_minute() >= min_cuts_per_minute);
+            if (i > 0)
+                REQUIRE(records[i - 1].video_name < records[i].video_name);
+        }
+    }
+
+    for (const std::string suffix : { "", ".dir", ".lock" })
+        std::filesystem::remove(index_path.string() + suffix);
+}
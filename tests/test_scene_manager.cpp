@@ -1,14 +1,23 @@
 #include "shutoh/video_stream.hpp"
 #include "shutoh/scene_manager.hpp"
 #include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/score_file.hpp"
+#include "shutoh/scene_cache.hpp"
+#include "shutoh/scene_aggregator.hpp"
+#include "shutoh/error.hpp"
 #include "shutoh/detector/base_detector.hpp"
 #include "shutoh/detector/content_detector.hpp"
 #include "shutoh/detector/hash_detector.hpp"
 #include "shutoh/detector/histogram_detector.hpp"
 #include "shutoh/detector/threshold_detector.hpp"
 #include "shutoh/detector/adaptive_detector.hpp"
+#include "shutoh/detector/motion_vector_detector.hpp"
 
 #include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
 
 enum class DetectorType {
     CONTENT,
@@ -16,6 +25,7 @@ enum class DetectorType {
     HISTOGRAM,
     ADAPTIVE,
     THRESHOLD,
+    MOTION,
     OTHER,
 };
 
@@ -31,6 +41,8 @@ std::unique_ptr<BaseDetector> _select_default_detector(const DetectorType detect
             return std::make_unique<ThresholdDetector>();
         case DetectorType::ADAPTIVE:
             return std::make_unique<AdaptiveDetector>();
+        case DetectorType::MOTION:
+            return std::make_unique<MotionVectorDetector>();
         default: 
             return std::make_unique<ContentDetector>();
     }
@@ -111,3 +123,339 @@ TEST_CASE("SceneManager - adaptive detector", "[SceneManager scene_detect]") {
         2913, 2992, 3072, 3151, 3212, 3271, 3352, 3453, 3618, 4122, 4257, 4316, 4397 };
     test_frame_index(scene_list, expected_inds);
 }
+
+TEST_CASE("SceneManager - motion vector detector", "[SceneManager scene_detect]") {
+    const DetectorType detector_type = DetectorType::MOTION;
+    std::vector<FrameTimeCodePair> scene_list = _get_scenes(detector_type);
+    /* the hard cuts of the content detector, which the encoder marks with a keyframe or intra-coded blocks
+       on the first frame of the new shot, give or take the frame the encoder chose */
+    std::vector<int32_t> expected_inds {
+        0, 64, 143, 194, 254, 314, 419, 628, 712, 809, 880, 965, 1125,
+        1211, 1250, 1330, 1391, 1449, 1529, 1611, 1704, 1804, 2000, 2207,
+        2541, 2872, 2913, 2992, 3072, 3151, 3212, 3271, 3352, 3453, 3618,
+        4122, 4257 };
+    REQUIRE(std::get<0>(scene_list.front()).get_frame_num() == 0);
+    for (const FrameTimeCodePair& scene : scene_list) {
+        const int32_t frame_num = std::get<0>(scene).get_frame_num();
+        const auto nearest = std::lower_bound(expected_inds.begin(), expected_inds.end(), frame_num - 1);
+        REQUIRE(nearest != expected_inds.end());
+        REQUIRE(std::abs(*nearest - frame_num) <= 1);
+    }
+    /* every cut is one of them, and at most a few of them are missed */
+    REQUIRE(scene_list.size() >= expected_inds.size() * 9 / 10);
+}
+
+TEST_CASE("SceneManager - replay saved scores", "[SceneManager replay_scores]") {
+    const std::string input_path = "../../video/input.mp4";
+    const std::filesystem::path score_path = std::filesystem::temp_directory_path() / "shutoh-test-scores.bin";
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+
+    std::shared_ptr<BaseDetector> detector = std::make_shared<ContentDetector>();
+    std::shared_ptr<ScoreWriter> score_writer = ScoreWriter::initialize_score_writer(
+        score_path, detector->get_score_type(), video.get_framerate(),
+        video.get_start().get_frame_num(), video.get_end().get_frame_num()).value();
+    SceneManager scene_manager = SceneManager(detector);
+    scene_manager.set_score_writer(score_writer);
+    scene_manager.detect_scenes(video);
+    REQUIRE(!score_writer->close().has_error());
+    std::vector<FrameTimeCodePair> detected_list = scene_manager.get_scene_list().value();
+
+    std::shared_ptr<ScoreReader> score_reader = ScoreReader::initialize_score_reader(score_path).value();
+    SceneManager replay_manager = SceneManager(std::make_shared<ContentDetector>());
+    REQUIRE(!replay_manager.replay_scores(*score_reader, video).has_error());
+    std::vector<FrameTimeCodePair> replayed_list = replay_manager.get_scene_list().value();
+    REQUIRE(replayed_list.size() == detected_list.size());
+    for (size_t i = 0; i < replayed_list.size(); i++)
+        REQUIRE(std::get<0>(replayed_list[i]) == std::get<0>(detected_list[i]));
+
+    /* the hash detector does not score frames the same way */
+    SceneManager hash_manager = SceneManager(std::make_shared<HashDetector>());
+    REQUIRE(hash_manager.replay_scores(*score_reader, video).has_error());
+    std::filesystem::remove(score_path);
+}
+
+TEST_CASE("SceneManager - cached scenes", "[SceneManager scene_cache]") {
+    const std::string input_path = "../../video/input.mp4";
+    const std::filesystem::path cache_dir = std::filesystem::temp_directory_path() / "shutoh-test-cache";
+    std::filesystem::remove_all(cache_dir);
+    std::shared_ptr<SceneCache> scene_cache = std::make_shared<SceneCache>(cache_dir);
+
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_shared<ContentDetector>());
+    scene_manager.set_scene_cache(scene_cache);
+    scene_manager.detect_scenes(video);
+    std::vector<FrameTimeCodePair> detected_list = scene_manager.get_scene_list().value();
+
+    const std::string cache_key = SceneCache::create_key(video, ContentDetector()).value();
+    REQUIRE(scene_cache->load(cache_key).has_value());
+    REQUIRE(!scene_cache->load(SceneCache::create_key(video, ContentDetector(30.0f)).value()).has_value());
+
+    SceneManager cached_manager = SceneManager(std::make_shared<ContentDetector>());
+    cached_manager.set_scene_cache(scene_cache);
+    cached_manager.detect_scenes(video);
+    std::vector<FrameTimeCodePair> cached_list = cached_manager.get_scene_list().value();
+    REQUIRE(cached_list.size() == detected_list.size());
+    for (size_t i = 0; i < cached_list.size(); i++)
+        REQUIRE(std::get<0>(cached_list[i]) == std::get<0>(detected_list[i]));
+    std::filesystem::remove_all(cache_dir);
+}
+
+TEST_CASE("SceneManager - resume from checkpoint", "[SceneManager checkpoint]") {
+    const std::string input_path = "../../video/input.mp4";
+    const std::filesystem::path checkpoint_path = std::filesystem::temp_directory_path() / "shutoh-test.checkpoint";
+    std::filesystem::remove(checkpoint_path);
+
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_shared<ContentDetector>());
+    scene_manager.detect_scenes(video);
+    std::vector<FrameTimeCodePair> detected_list = scene_manager.get_scene_list().value();
+
+    /* the first run stops in the middle of the video as if it were killed */
+    VideoStream first_video = VideoStream::initialize_video_stream(input_path).value();
+    REQUIRE(!first_video.set_time(std::nullopt, std::nullopt, "00:00:03").has_error());
+    SceneManager first_manager = SceneManager(std::make_shared<ContentDetector>());
+    first_manager.set_checkpoint(checkpoint_path, 10);
+    first_manager.detect_scenes(first_video);
+    REQUIRE(std::filesystem::exists(checkpoint_path));
+
+    SceneManager other_manager = SceneManager(std::make_shared<ContentDetector>(30.0f));
+    REQUIRE(other_manager.load_checkpoint(checkpoint_path).has_error());
+
+    VideoStream resumed_video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager resumed_manager = SceneManager(std::make_shared<ContentDetector>());
+    REQUIRE(!resumed_manager.load_checkpoint(checkpoint_path).has_error());
+    resumed_manager.detect_scenes(resumed_video);
+    std::vector<FrameTimeCodePair> resumed_list = resumed_manager.get_scene_list().value();
+    REQUIRE(resumed_list.size() == detected_list.size());
+    for (size_t i = 0; i < resumed_list.size(); i++)
+        REQUIRE(std::get<0>(resumed_list[i]) == std::get<0>(detected_list[i]));
+    std::filesystem::remove(checkpoint_path);
+}
+
+TEST_CASE("SceneManager - merge shards", "[SceneManager merge_score_files]") {
+    const std::string input_path = "../../video/input.mp4";
+    const std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+    const std::vector<std::filesystem::path> shard_paths = { temp_dir / "shutoh-test-shard-1.bin", temp_dir / "shutoh-test-shard-0.bin" };
+    const std::filesystem::path merged_path = temp_dir / "shutoh-test-merged.bin";
+
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_shared<ContentDetector>());
+    scene_manager.detect_scenes(video);
+    std::vector<FrameTimeCodePair> detected_list = scene_manager.get_scene_list().value();
+
+    /* the second shard is given first */
+    const std::vector<std::optional<std::string>> shard_starts = { "00:00:03", std::nullopt };
+    const std::vector<std::optional<std::string>> shard_ends = { std::nullopt, "00:00:03" };
+    for (size_t i = 0; i < shard_paths.size(); i++) {
+        VideoStream shard_video = VideoStream::initialize_video_stream(input_path).value();
+        REQUIRE(!shard_video.set_time(shard_starts[i], shard_ends[i], std::nullopt).has_error());
+        std::shared_ptr<BaseDetector> detector = std::make_shared<ContentDetector>();
+        std::shared_ptr<ScoreWriter> score_writer = ScoreWriter::initialize_score_writer(
+            shard_paths[i], detector->get_score_type(), shard_video.get_framerate(),
+            shard_video.get_start().get_frame_num(), shard_video.get_end().get_frame_num()).value();
+        SceneManager shard_manager = SceneManager(detector);
+        shard_manager.set_score_writer(score_writer);
+        shard_manager.set_warmup_frames(detector->get_warmup_frames().value());
+        shard_manager.detect_scenes(shard_video);
+        REQUIRE(!score_writer->close().has_error());
+    }
+
+    REQUIRE(!merge_score_files(shard_paths, merged_path).has_error());
+    std::shared_ptr<ScoreReader> score_reader = ScoreReader::initialize_score_reader(merged_path).value();
+    SceneManager merged_manager = SceneManager(std::make_shared<ContentDetector>());
+    REQUIRE(!merged_manager.replay_scores(*score_reader, video).has_error());
+    std::vector<FrameTimeCodePair> merged_list = merged_manager.get_scene_list().value();
+    REQUIRE(merged_list.size() == detected_list.size());
+    for (size_t i = 0; i < merged_list.size(); i++)
+        REQUIRE(std::get<0>(merged_list[i]) == std::get<0>(detected_list[i]));
+
+    /* a missing shard leaves a gap */
+    const std::vector<std::filesystem::path> second_shard = { shard_paths[0] };
+    const std::filesystem::path partial_path = temp_dir / "shutoh-test-partial.bin";
+    REQUIRE(!merge_score_files(second_shard, partial_path).has_error());
+    std::shared_ptr<ScoreReader> partial_reader = ScoreReader::initialize_score_reader(partial_path).value();
+    SceneManager partial_manager = SceneManager(std::make_shared<ContentDetector>());
+    REQUIRE(partial_manager.replay_scores(*partial_reader, video).has_error());
+
+    for (const std::filesystem::path& shard_path : shard_paths)
+        std::filesystem::remove(shard_path);
+    std::filesystem::remove(merged_path);
+    std::filesystem::remove(partial_path);
+}
+
+TEST_CASE("SceneManager - merge shards of other detectors", "[SceneManager merge_score_files]") {
+    const std::string input_path = "../../video/input.mp4";
+    const std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+    const std::vector<std::filesystem::path> shard_paths = { temp_dir / "shutoh-test-shard-0.bin", temp_dir / "shutoh-test-shard-1.bin" };
+    const std::filesystem::path merged_path = temp_dir / "shutoh-test-merged.bin";
+    REQUIRE(ThresholdDetector().get_warmup_frames() == 0);
+    REQUIRE(!MotionVectorDetector().get_warmup_frames().has_value());
+
+    /* the adaptive detector decides a cut from the window_width frames around it, across the shard boundary */
+    for (const DetectorType detector_type : { DetectorType::ADAPTIVE, DetectorType::HASH, DetectorType::THRESHOLD }) {
+        VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+        std::vector<FrameTimeCodePair> detected_list = _get_scenes(detector_type);
+
+        const std::vector<std::optional<std::string>> shard_starts = { std::nullopt, "00:00:03" };
+        const std::vector<std::optional<std::string>> shard_ends = { "00:00:03", std::nullopt };
+        for (size_t i = 0; i < shard_paths.size(); i++) {
+            VideoStream shard_video = VideoStream::initialize_video_stream(input_path).value();
+            REQUIRE(!shard_video.set_time(shard_starts[i], shard_ends[i], std::nullopt).has_error());
+            std::shared_ptr<BaseDetector> detector = _select_default_detector(detector_type);
+            std::shared_ptr<ScoreWriter> score_writer = ScoreWriter::initialize_score_writer(
+                shard_paths[i], detector->get_score_type(), shard_video.get_framerate(),
+                shard_video.get_start().get_frame_num(), shard_video.get_end().get_frame_num()).value();
+            SceneManager shard_manager = SceneManager(detector);
+            shard_manager.set_score_writer(score_writer);
+            shard_manager.set_warmup_frames(detector->get_warmup_frames().value());
+            shard_manager.detect_scenes(shard_video);
+            REQUIRE(!score_writer->close().has_error());
+        }
+
+        REQUIRE(!merge_score_files(shard_paths, merged_path).has_error());
+        std::shared_ptr<ScoreReader> score_reader = ScoreReader::initialize_score_reader(merged_path).value();
+        SceneManager merged_manager = SceneManager(_select_default_detector(detector_type));
+        REQUIRE(!merged_manager.replay_scores(*score_reader, video).has_error());
+        std::vector<FrameTimeCodePair> merged_list = merged_manager.get_scene_list().value();
+        REQUIRE(merged_list.size() == detected_list.size());
+        for (size_t i = 0; i < merged_list.size(); i++)
+            REQUIRE(std::get<0>(merged_list[i]) == std::get<0>(detected_list[i]));
+    }
+
+    for (const std::filesystem::path& shard_path : shard_paths)
+        std::filesystem::remove(shard_path);
+    std::filesystem::remove(merged_path);
+}
+
+TEST_CASE("SceneManager - bounded decision delay", "[SceneManager live]") {
+    REQUIRE(ContentDetector().get_latency() == 15);
+    REQUIRE(!ThresholdDetector().get_latency().has_value());
+    REQUIRE(AdaptiveDetector().get_latency() == 2);
+    REQUIRE(HashDetector().get_latency() == 0);
+
+    /* flashes longer than the latency are decided while they last */
+    const int32_t max_latency = 5;
+    ContentDetector flash_detector = ContentDetector(27.0f, 3);
+    flash_detector.set_max_latency(max_latency);
+    REQUIRE(flash_detector.get_latency() == max_latency);
+    std::vector<std::tuple<int32_t, int32_t>> flash_cuts;
+    for (int32_t frame_num = 0; frame_num < 40; frame_num++) {
+        const float score = (frame_num == 10 || frame_num >= 20) && frame_num % 2 == 0 ? 50.0f : 0.0f;
+        const std::optional<int32_t> cut = flash_detector.process_score(frame_num, score);
+        if (cut.has_value())
+            flash_cuts.push_back({ cut.value(), frame_num });
+    }
+    REQUIRE(flash_cuts.size() >= 2);
+    for (const auto& [cut, frame_num] : flash_cuts)
+        REQUIRE(frame_num - cut <= max_latency);
+
+    const std::string input_path = "../../video/input.mp4";
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    std::shared_ptr<ContentDetector> detector = std::make_shared<ContentDetector>();
+    detector->set_max_latency(max_latency);
+    SceneManager scene_manager = SceneManager(detector);
+    std::vector<int32_t> live_cuts;
+    scene_manager.set_progress_callback([&](const FrameTimeCode& position, const std::optional<FrameTimeCode>& cut) {
+        if (!cut.has_value())
+            return;
+        REQUIRE(position.get_frame_num() - cut.value().get_frame_num() <= max_latency);
+        live_cuts.push_back(cut.value().get_frame_num());
+    });
+    scene_manager.detect_scenes(video);
+
+    /* every cut is reported while detecting */
+    std::vector<FrameTimeCodePair> scene_list = scene_manager.get_scene_list().value();
+    REQUIRE(live_cuts.size() + 1 == scene_list.size());
+    for (size_t i = 0; i < live_cuts.size(); i++)
+        REQUIRE(std::get<0>(scene_list[i + 1]).get_frame_num() == live_cuts[i]);
+}
+
+class SceneCollector : public SceneObserver {
+    public:
+        void on_scene(const FrameTimeCodePair& scene) override { scenes.push_back(scene); }
+        std::vector<FrameTimeCodePair> scenes;
+};
+
+TEST_CASE("SceneManager - scenes yielded while detecting", "[SceneManager generate_scenes]") {
+    const std::string input_path = "../../video/input.mp4";
+    std::vector<FrameTimeCodePair> detected_list = _get_scenes(DetectorType::CONTENT);
+
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_shared<ContentDetector>());
+    std::shared_ptr<SceneCollector> collector = std::make_shared<SceneCollector>();
+    scene_manager.set_scene_observer(collector);
+    std::vector<FrameTimeCodePair> yielded_list;
+    for (const FrameTimeCodePair& scene : scene_manager.generate_scenes(video))
+        yielded_list.push_back(scene);
+
+    REQUIRE(yielded_list.size() == detected_list.size());
+    REQUIRE(collector->scenes.size() == detected_list.size());
+    for (size_t i = 0; i < detected_list.size(); i++) {
+        REQUIRE(std::get<0>(yielded_list[i]) == std::get<0>(detected_list[i]));
+        REQUIRE(std::get<1>(yielded_list[i]) == std::get<1>(detected_list[i]));
+        REQUIRE(std::get<0>(collector->scenes[i]) == std::get<0>(detected_list[i]));
+    }
+
+    /* stopping early stops the detection */
+    VideoStream stopped_video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager stopped_manager = SceneManager(std::make_shared<ContentDetector>());
+    size_t num_yielded = 0;
+    for (const FrameTimeCodePair& scene : stopped_manager.generate_scenes(stopped_video)) {
+        REQUIRE(std::get<0>(scene) == std::get<0>(detected_list[num_yielded]));
+        if (++num_yielded == 3)
+            break;
+    }
+    REQUIRE(stopped_manager.get_scene_list().value().size() < detected_list.size());
+}
+
+class FrameCounter : public FrameSampleAggregator<int32_t> {
+    public:
+        std::vector<std::string> get_columns() const override { return { "num_frames" }; }
+
+    protected:
+        std::optional<int32_t> _measure(const VideoFrame& frame) override { return frame.frame_num; }
+        void _fold(const int32_t frame_num, const int32_t& sample) override { num_frames_++; }
+        std::vector<std::string> _finish_scene() override { return { std::to_string(std::exchange(num_frames_, 0)) }; }
+
+    private:
+        int32_t num_frames_ = 0;
+};
+
+TEST_CASE("SceneManager - scene statistics", "[SceneManager scene_aggregator]") {
+    /* frames added after a cut but before it is reported belong to the next scene */
+    FrameCounter counter;
+    counter.set_latency(3);
+    for (int32_t frame_num = 0; frame_num < 10; frame_num++) {
+        counter.add_frame(VideoFrame { cv::Mat(), frame_num });
+        if (frame_num == 6)
+            counter.close_scene(4);
+    }
+    counter.close_scene(std::nullopt);
+    REQUIRE(counter.get_scene_values() == std::vector<std::vector<std::string>> { { "5" }, { "5" } });
+
+    const std::string input_path = "../../video/input.mp4";
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_shared<ContentDetector>());
+    std::shared_ptr<ColorAggregator> color_aggregator = std::make_shared<ColorAggregator>();
+    std::shared_ptr<MotionAggregator> motion_aggregator = std::make_shared<MotionAggregator>();
+    scene_manager.add_scene_aggregator(color_aggregator);
+    scene_manager.add_scene_aggregator(motion_aggregator);
+    scene_manager.detect_scenes(video);
+
+    const std::vector<FrameTimeCodePair> scene_list = scene_manager.get_scene_list().value();
+    const std::vector<std::vector<std::string>>& colors = color_aggregator->get_scene_values();
+    const std::vector<std::vector<std::string>>& motions = motion_aggregator->get_scene_values();
+    REQUIRE(colors.size() == scene_list.size());
+    REQUIRE(motions.size() == scene_list.size());
+    for (size_t i = 0; i < scene_list.size(); i++) {
+        REQUIRE(colors[i].size() == color_aggregator->get_columns().size());
+        const float brightness = std::stof(colors[i][3]);
+        REQUIRE((brightness >= 0.0f && brightness <= 255.0f));
+
+        /* the keyframe is in its scene */
+        const int32_t keyframe = std::stoi(motions[i][1]);
+        REQUIRE(keyframe >= std::get<0>(scene_list[i]).get_frame_num());
+        REQUIRE(keyframe <= std::get<1>(scene_list[i]).get_frame_num());
+        REQUIRE(motions[i][2].size() == 16);
+    }
+}
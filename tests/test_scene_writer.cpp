@@ -0,0 +1,91 @@
+#include "shutoh/frame_timecode.hpp"
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/error.hpp"
+
+#include "../src/scene_writer.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::vector<FrameTimeCodePair> _create_scenes() {
+    const float framerate = 29.97f;
+    const std::vector<int32_t> cuts { 0, 64, 143, 4257 };
+    std::vector<FrameTimeCodePair> scenes;
+    for (size_t i = 1; i < cuts.size(); i++)
+        scenes.push_back(FrameTimeCodePair { FrameTimeCode(cuts[i - 1], framerate), FrameTimeCode(cuts[i], framerate) });
+    return scenes;
+}
+
+std::string _write_scenes(const std::filesystem::path& output_path, const SceneFormat format) {
+    std::shared_ptr<SceneWriter> writer = SceneWriter::initialize_scene_writer(output_path, format).value();
+    for (const FrameTimeCodePair& scene : _create_scenes())
+        writer->on_scene(scene);
+    REQUIRE(writer->get_num_scenes() == 3);
+    REQUIRE(!writer->close().has_error());
+
+    std::ifstream file(output_path, std::ios::binary);
+    std::ostringstream content;
+    content << file.rdbuf();
+    std::filesystem::remove(output_path);
+    return content.str();
+}
+
+TEST_CASE("SceneWriter - csv and ndjson", "[SceneWriter list_scenes]") {
+    const std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+    const std::vector<FrameTimeCodePair> scenes = _create_scenes();
+    const std::string end_time = std::get<1>(scenes.back()).to_string();
+
+    const std::string csv = _write_scenes(temp_dir / "shutoh-test-scenes.csv", SceneFormat::CSV);
+    REQUIRE(csv == "scene_number,start_frame,start_time,end_frame,end_time\n"
+                   "0,0,00:00:00.000,64," + std::get<1>(scenes[0]).to_string() + "\n"
+                   "1,65," + std::get<0>(scenes[1]).to_string() + ",143," + std::get<1>(scenes[1]).to_string() + "\n"
+                   "2,144," + std::get<0>(scenes[2]).to_string() + ",4257," + end_time + "\n");
+
+    const std::string ndjson = _write_scenes(temp_dir / "shutoh-test-scenes.ndjson", SceneFormat::NDJSON);
+    REQUIRE(ndjson.find("{\"scene\": 0, \"start_frame\": 0, \"start_time\": \"00:00:00.000\", \"end_frame\": 64, ") == 0);
+    REQUIRE(ndjson.ends_with("\"end_frame\": 4257, \"end_time\": \"" + end_time + "\"}\n"));
+}
+
+TEST_CASE("SceneWriter - binary", "[SceneWriter list_scenes]") {
+    const std::filesystem::path output_path = std::filesystem::temp_directory_path() / "shutoh-test-scenes.bin";
+    const std::string data = _write_scenes(output_path, SceneFormat::BINARY);
+    REQUIRE(data.size() == sizeof(SceneFileHeader) + 3 * sizeof(SceneRecord));
+
+    SceneFileHeader header;
+    std::memcpy(&header, data.data(), sizeof(SceneFileHeader));
+    REQUIRE(std::memcmp(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic)) == 0);
+    REQUIRE(header.num_scenes == 3);
+    REQUIRE(header.framerate == 29.97f);
+
+    SceneRecord last_record;
+    std::memcpy(&last_record, data.data() + sizeof(SceneFileHeader) + 2 * sizeof(SceneRecord), sizeof(SceneRecord));
+    REQUIRE(last_record.start_frame_num == 143);
+    REQUIRE(last_record.end_frame_num == 4257);
+}
+
+TEST_CASE("SceneWriter - each scene reaches a pipe", "[SceneWriter list_scenes]") {
+    const std::filesystem::path fifo_path = std::filesystem::temp_directory_path() / "shutoh-test-scenes.fifo";
+    std::filesystem::remove(fifo_path);
+    REQUIRE(mkfifo(fifo_path.c_str(), 0600) == 0);
+    /* the reader is opened first, so that opening the writer does not block */
+    const int32_t fifo_fd = open(fifo_path.c_str(), O_RDONLY | O_NONBLOCK);
+    REQUIRE(fifo_fd >= 0);
+
+    std::shared_ptr<SceneWriter> writer = SceneWriter::initialize_scene_writer(fifo_path, SceneFormat::CSV).value();
+    writer->on_scene(_create_scenes()[0]);
+    char buffer[256];
+    const ssize_t size = read(fifo_fd, buffer, sizeof(buffer));
+    REQUIRE(size > 0);
+    REQUIRE(std::string(buffer, size).ends_with(",64," + std::get<1>(_create_scenes()[0]).to_string() + "\n"));
+
+    REQUIRE(!writer->close().has_error());
+    close(fifo_fd);
+    std::filesystem::remove(fifo_path);
+}
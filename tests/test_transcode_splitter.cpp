@@ -0,0 +1,56 @@
+#include "shutoh/video_stream.hpp"
+#include "shutoh/scene_manager.hpp"
+#include "shutoh/frame_timecode_pair.hpp"
+#include "shutoh/error.hpp"
+#include "shutoh/detector/content_detector.hpp"
+
+#include "../src/transcode_splitter.hpp"
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include <catch2/catch_test_macros.hpp>
+#include <filesystem>
+
+int32_t _count_video_frames(const std::string& path) {
+    AVFormatContext* format_ctx = nullptr;
+    if (avformat_open_input(&format_ctx, path.c_str(), nullptr, nullptr) < 0)
+        return -1;
+    avformat_find_stream_info(format_ctx, nullptr);
+    const int32_t video_index = av_find_best_stream(format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+
+    int32_t num_frames = 0;
+    AVPacket* packet = av_packet_alloc();
+    while (av_read_frame(format_ctx, packet) >= 0) {
+        num_frames += packet->stream_index == video_index;
+        av_packet_unref(packet);
+    }
+    av_packet_free(&packet);
+    avformat_close_input(&format_ctx);
+    return num_frames;
+}
+
+TEST_CASE("TranscodeSplitter - every frame reaches its scene", "[TranscodeSplitter split]") {
+    const std::string input_path = "../../video/input.mp4";
+    VideoStream video = VideoStream::initialize_video_stream(input_path).value();
+    SceneManager scene_manager = SceneManager(std::make_unique<ContentDetector>());
+    scene_manager.detect_scenes(video);
+    std::vector<FrameTimeCodePair> scene_list = scene_manager.get_scene_list().value();
+    if (scene_list.size() > 8)
+        scene_list.erase(scene_list.begin() + 8, scene_list.end());
+
+    /* audio of the next scene is demuxed before the last frames of the current one, and must not end it early */
+    const std::filesystem::path output_dir = std::filesystem::temp_directory_path() / "shutoh-test-transcode";
+    std::filesystem::create_directories(output_dir);
+    TranscodeSplitter transcode_splitter = TranscodeSplitter(output_dir, "scene-@SCENE_NUMBER", 28, "ultrafast");
+    REQUIRE(!transcode_splitter.split_video(input_path, scene_list).has_error());
+
+    for (size_t scene_number = 0; scene_number < scene_list.size(); scene_number++) {
+        const int32_t expected_frames = std::get<1>(scene_list[scene_number]).get_frame_num()
+                                        - std::get<0>(scene_list[scene_number]).get_frame_num();
+        const std::string output_path = (output_dir / ("scene-" + std::to_string(scene_number) + ".mp4")).string();
+        REQUIRE(_count_video_frames(output_path) == expected_frames);
+    }
+    std::filesystem::remove_all(output_dir);
+}